@@ -21,8 +21,12 @@
 #include <stdio.h>                      // for printf, fprintf, NULL, etc
 #include <stdlib.h>                     // for qsort
 #include <string.h>                     // for memset, memcpy, memcmp, etc
+#include <atomic>
+#include <functional>                   // for cref
 #include <memory>
 #include <string>                       // for string, operator==, etc
+#include <thread>
+#include <vector>
 
 #include "compact_enc_det_hint_code.h"
 #include "../util/string_util.h"
@@ -244,6 +248,9 @@ static const int kWeightshiftForTagTitleText = 4;   // Give text in tags, etc.
 static const int kStrongPairs = 6;          // Let reliable enc with this many
                                             // pairs overcome missing hint
 
+static const int kMaxDetectDepth = 3;       // InternalDetectEncoding nesting:
+                                            // tags recursion, then Rescan
+
 enum CEDInternalFlags {
   kCEDNone = 0,           // The empty flag
   kCEDRescanning = 1,     // Do not further recurse
@@ -253,7 +260,9 @@ enum CEDInternalFlags {
 
 // Forward declaration
 Encoding InternalDetectEncoding(
-    CEDInternalFlags flags, const char* text, int text_length,
+    CEDInternalFlags flags, DetectEncodingScratch* scratch,
+    const CompactEncDet::DetectEncodingOptions& options,
+    const char* text, int text_length,
     const char* url_hint, const char* http_charset_hint,
     const char* meta_charset_hint, const int encoding_hint,
     const Language language_hint,  // User interface lang
@@ -319,15 +328,6 @@ static const uint32 kHighAccentCode = 0x00000800;   // accents in 8x-Fx
 static const uint32 kEUCJPActive    = 0x00001000;   // Have to mess with phase
 
 
-// Debug only. not thread safe
-static int encdet_used = 0;
-static int rescore_used = 0;
-static int rescan_used = 0;
-static int robust_used = 0;
-static int looking_used = 0;
-static int doing_used = 0;
-
-
 // For debugging only -- about 256B/entry times about 500 = 128KB
 // TODO: only allocate this if being used
 typedef struct {
@@ -338,10 +338,41 @@ typedef struct {
   int detail_enc_prob[NUM_RANKEDENCODING];
 } DetailEntry;
 
-static int watch1_rankedenc = -1;     // Debug. not threadsafe
-static int watch2_rankedenc = -1;     // Debug. not threadsafe
-////static int next_detail_entry = 0;     // Debug. not threadsafe
-////static DetailEntry details[kMaxPairs * 10];  // Allow 10 details per bigram
+// Debug settings and bookkeeping for one top-level DetectEncoding call.
+// The debug flags are read once when the call starts, so detection touches
+// no mutable globals and calls on separate states may run concurrently.
+struct DetectEncodingTrace {
+  DetectEncodingTrace();
+  void Init();                    // Read the flags, reset the bookkeeping
+
+  bool summary;                   // FLAGS_enc_detect_summary
+  bool counts;                    // FLAGS_counts
+  bool detail;                    // FLAGS_enc_detect_detail
+  bool detail2;                   // FLAGS_enc_detect_detail2
+  bool source;                    // FLAGS_enc_detect_source
+  bool force127;                  // FLAGS_force127
+  bool demo_nodefault;            // FLAGS_demo_nodefault
+  bool dirtsimple;                // FLAGS_dirtsimple
+  bool echo_input;                // FLAGS_ced_echo_input
+
+  // Major-section usage, for counts
+  int encdet_used;
+  int rescore_used;
+  int rescan_used;
+  int robust_used;
+  int looking_used;
+  int doing_used;
+
+  int watch1_rankedenc;
+  int watch2_rankedenc;
+
+  // PostScript source dump, for source
+  int pssourcenext;               // Dump only >= this
+  int pssourcewidth;
+  std::unique_ptr<char[]> pssource_mark_buffer;
+  int next_do_src_line;
+  int do_src_offset[16];
+};
 // End For debugging only
 
 // Must match kTestPrintableAsciiTildePlus exit codes, minus one
@@ -367,6 +398,10 @@ typedef struct {
                                   // FLAGS_enc_detect_detail PostScript data
   int next_detail_entry;          // Debug
 
+  const CompactEncDet::DetectEncodingOptions* options;  // Caller's settings
+  DetectEncodingScratch* scratch;                       // For recursive calls
+  DetectEncodingTrace* trace;                           // Debug settings
+
   bool done;
   bool reliable;
   bool hints_derated;
@@ -1265,57 +1300,54 @@ static inline const char* MyRankedEncName(int r_enc) {
 }
 
 
-// Only for debugging. not thread safe
+// Only for debugging
 static const int kPsSourceWidth = 32;
-static int pssourcenext = 0;    // debug only. not threadsafe. dump only >= this
-static int pssourcewidth = 0;   // debug only.
-static char* pssource_mark_buffer = NULL;
-int next_do_src_line;
-int do_src_offset[16];
 
 
-void PsSourceInit(int len) {
-   pssourcenext = 0;
-   pssourcewidth = len;
-   delete[] pssource_mark_buffer;
+void PsSourceInit(DetectEncodingTrace* trace, int len) {
+   trace->pssourcenext = 0;
+   trace->pssourcewidth = len;
    // Allocate 2 Ascii characters per input byte
-   pssource_mark_buffer = new char[(pssourcewidth * 2) + 8];  // 8 = overscan
-   memset(pssource_mark_buffer, ' ', pssourcewidth * 2);
-   memset(pssource_mark_buffer + (pssourcewidth * 2), '\0', 8);
-
-   next_do_src_line = 0;
-   memset(do_src_offset, 0, sizeof(do_src_offset));
+   trace->pssource_mark_buffer.reset(
+       new char[(trace->pssourcewidth * 2) + 8]);  // 8 = overscan
+   char* mark_buffer = trace->pssource_mark_buffer.get();
+   memset(mark_buffer, ' ', trace->pssourcewidth * 2);
+   memset(mark_buffer + (trace->pssourcewidth * 2), '\0', 8);
+
+   trace->next_do_src_line = 0;
+   memset(trace->do_src_offset, 0, sizeof(trace->do_src_offset));
 }
 
-void PsSourceFinish() {
+void PsSourceFinish(DetectEncodingTrace* trace) {
   // Print preceding mark buffer
-  int j = (pssourcewidth * 2) - 1;
-  while ((0 <= j) && (pssource_mark_buffer[j] == ' ')) {--j;}   // trim
-  pssource_mark_buffer[j + 1] = '\0';
-  fprintf(stderr, "(      %s) do-src\n", pssource_mark_buffer);
-  memset(pssource_mark_buffer, ' ', pssourcewidth * 2);
-  memset(pssource_mark_buffer + (pssourcewidth * 2), '\0', 8);
-
-  delete[] pssource_mark_buffer;
-  pssource_mark_buffer = NULL;
+  char* mark_buffer = trace->pssource_mark_buffer.get();
+  int j = (trace->pssourcewidth * 2) - 1;
+  while ((0 <= j) && (mark_buffer[j] == ' ')) {--j;}   // trim
+  mark_buffer[j + 1] = '\0';
+  fprintf(stderr, "(      %s) do-src\n", mark_buffer);
+
+  trace->pssource_mark_buffer.reset();
 }
 
 // Dump aligned len bytes src... if not already dumped
-void PsSource(const uint8* src, const uint8* isrc, const uint8* srclimit) {
+void PsSource(DetectEncodingTrace* trace,
+              const uint8* src, const uint8* isrc, const uint8* srclimit) {
+  int pssourcewidth = trace->pssourcewidth;
   int offset = src - isrc;
   offset -= (offset % pssourcewidth);     // round down to multiple of len bytes
-  if (offset < pssourcenext) {
+  if (offset < trace->pssourcenext) {
     return;
   }
-  pssourcenext = offset + pssourcewidth;  // Min offset for next dump
+  trace->pssourcenext = offset + pssourcewidth;  // Min offset for next dump
 
   // Print preceding mark buffer
+  char* mark_buffer = trace->pssource_mark_buffer.get();
   int j = (pssourcewidth * 2) - 1;
-  while ((0 <= j) && (pssource_mark_buffer[j] == ' ')) {--j;}   // trim
-  pssource_mark_buffer[j + 1] = '\0';
-  fprintf(stderr, "(      %s) do-src\n", pssource_mark_buffer);
-  memset(pssource_mark_buffer, ' ', pssourcewidth * 2);
-  memset(pssource_mark_buffer + (pssourcewidth * 2), '\0', 8);
+  while ((0 <= j) && (mark_buffer[j] == ' ')) {--j;}   // trim
+  mark_buffer[j + 1] = '\0';
+  fprintf(stderr, "(      %s) do-src\n", mark_buffer);
+  memset(mark_buffer, ' ', pssourcewidth * 2);
+  memset(mark_buffer + (pssourcewidth * 2), '\0', 8);
 
   // Print source bytes
   const uint8* src_aligned = isrc + offset;
@@ -1342,21 +1374,23 @@ void PsSource(const uint8* src, const uint8* isrc, const uint8* srclimit) {
   }
   fprintf(stderr, ") do-src\n");
   // Remember which source offsets are where, mod 16
-  do_src_offset[next_do_src_line & 0x0f] = offset;
-  ++next_do_src_line;
+  trace->do_src_offset[trace->next_do_src_line & 0x0f] = offset;
+  ++trace->next_do_src_line;
 }
 
 // Mark bytes in just-previous source bytes
-void PsMark(const uint8* src, int len, const uint8* isrc, int weightshift) {
+void PsMark(DetectEncodingTrace* trace,
+            const uint8* src, int len, const uint8* isrc, int weightshift) {
   int offset = src - isrc;
-  offset = (offset % pssourcewidth);     // mod len bytes
+  offset = (offset % trace->pssourcewidth);     // mod len bytes
   char mark = (weightshift == 0) ? '-' : 'x';
 
-  pssource_mark_buffer[(offset * 2)] = '=';
-  pssource_mark_buffer[(offset * 2) + 1] = '=';
+  char* mark_buffer = trace->pssource_mark_buffer.get();
+  mark_buffer[(offset * 2)] = '=';
+  mark_buffer[(offset * 2) + 1] = '=';
   for (int i = 1; i < len; ++i) {
-    pssource_mark_buffer[(offset + i) * 2] = mark;
-    pssource_mark_buffer[((offset + i) * 2) + 1] = mark;
+    mark_buffer[(offset + i) * 2] = mark;
+    mark_buffer[((offset + i) * 2) + 1] = mark;
   }
 }
 
@@ -1364,13 +1398,14 @@ void PsMark(const uint8* src, int len, const uint8* isrc, int weightshift) {
 // Highlight trigram bytes in just-previous source bytes
 // Unfortunately, we have to skip back N lines since source was printed for
 // up to 8 bigrams before we get here. Match on src+1 to handle 0/31 better
-void PsHighlight(const uint8* src, const uint8* isrc, int trigram_val, int n) {
+void PsHighlight(const DetectEncodingTrace* trace,
+                 const uint8* src, const uint8* isrc, int trigram_val, int n) {
   int offset = (src + 1) - isrc;
-  int offset32 = (offset % pssourcewidth);    // mod len bytes
+  int offset32 = (offset % trace->pssourcewidth);    // mod len bytes
   offset -= offset32;                     // round down to multiple of len bytes
 
   for (int i = 1; i <= 16; ++i) {
-    if (do_src_offset[(next_do_src_line - i) & 0x0f] == offset) {
+    if (trace->do_src_offset[(trace->next_do_src_line - i) & 0x0f] == offset) {
       fprintf(stderr, "%d %d %d do-highlight%d\n",
               i, offset32 - 1, trigram_val, n);
       break;
@@ -1388,6 +1423,10 @@ void InitDetectEncodingState(DetectEncodingState* destatep) {
   destatep->debug_data = NULL;
   destatep->next_detail_entry = 0;
 
+  destatep->options = NULL;           // Filled in by caller
+  destatep->scratch = NULL;
+  destatep->trace = NULL;
+
   destatep->done = false;
   destatep->reliable = false;
   destatep->hints_derated = false;
@@ -1460,6 +1499,71 @@ void InitDetectEncodingState(DetectEncodingState* destatep) {
   // interesting_pairs/offsets/weightshifts not initialized; no need
 }
 
+DetectEncodingTrace::DetectEncodingTrace() {
+  Init();
+}
+
+void DetectEncodingTrace::Init() {
+  summary = FLAGS_enc_detect_summary;
+  counts = FLAGS_counts;
+  detail = FLAGS_enc_detect_detail;
+  detail2 = FLAGS_enc_detect_detail2;
+  source = FLAGS_enc_detect_source;
+  force127 = FLAGS_force127;
+  demo_nodefault = FLAGS_demo_nodefault;
+  dirtsimple = FLAGS_dirtsimple;
+  echo_input = FLAGS_ced_echo_input;
+
+  encdet_used = 0;
+  rescore_used = 0;
+  rescan_used = 0;
+  robust_used = 0;
+  looking_used = 0;
+  doing_used = 0;
+
+  watch1_rankedenc = -1;
+  watch2_rankedenc = -1;
+
+  pssourcenext = 0;
+  pssourcewidth = kPsSourceWidth;
+  pssource_mark_buffer.reset();
+  next_do_src_line = 0;
+  memset(do_src_offset, 0, sizeof(do_src_offset));
+}
+
+// Storage behind CompactEncDet::DetectEncodingContext. The initial state is
+// built once and copied for each InternalDetectEncoding call, one per
+// nesting level.
+struct DetectEncodingScratch {
+  DetectEncodingScratch() : depth(0) {
+    InitDetectEncodingState(&initial);
+  }
+
+  DetectEncodingState initial;
+  DetectEncodingState levels[kMaxDetectDepth];
+  int depth;                      // Levels in use
+  string sample;                  // Head/middle/tail stripes of long text
+  DetectEncodingTrace trace;      // Debug settings of the current call
+};
+
+CompactEncDet::DetectEncodingContext::DetectEncodingContext()
+    : scratch_(new DetectEncodingScratch) {
+}
+
+CompactEncDet::DetectEncodingContext::~DetectEncodingContext() {
+  delete scratch_;
+}
+
+CompactEncDet::DetectEncodingOptions::DetectEncodingOptions()
+    : slow_max_kb(FLAGS_enc_detect_slow_max_kb),
+      fast_max_kb(FLAGS_enc_detect_fast_max_kb),
+      sample_max_kb(0),
+      sample_strategy(SAMPLE_HEAD),
+      reliable_difference(FLAGS_ced_reliable_difference),
+      early_exit_difference(0),
+      allow_utf8utf8(FLAGS_ced_allow_utf8utf8) {
+}
+
 // Probability strings are uint8, with zeros removed via simple run-length:
 //  (<skip-take byte> <data bytes>)*
 // skip-take:
@@ -1902,7 +2006,7 @@ int ApplyDefaultHint(const CompactEncDet::TextCorpusType corpus_type,
     break;
   }
 
-  if (FLAGS_demo_nodefault) {
+  if (destatep->trace->demo_nodefault) {
     // Demo, make initial probs all zero
     for (int i = 0; i < NUM_RANKEDENCODING; i++) {
       destatep->enc_prob[i] = 0;
@@ -2139,15 +2243,16 @@ void ApplyHints(const char* url_hint,
   if (destatep->debug_data != NULL) {
     // Show state at end of hints
     SetDetailsEncProb(destatep, 0, -1, "Endhints");
-    if(FLAGS_enc_detect_detail2) {
+    const DetectEncodingTrace* trace = destatep->trace;
+    if(trace->detail2) {
       // Add a line showing the watched encoding(s)
-      if (watch1_rankedenc >= 0) {
+      if (trace->watch1_rankedenc >= 0) {
         SetDetailsEncProb(destatep, 0,
-                          watch1_rankedenc, FLAGS_enc_detect_watch1);
+                          trace->watch1_rankedenc, FLAGS_enc_detect_watch1);
       }
-      if (watch2_rankedenc >= 0) {
+      if (trace->watch2_rankedenc >= 0) {
         SetDetailsEncProb(destatep, 0,
-                          watch2_rankedenc, FLAGS_enc_detect_watch2);
+                          trace->watch2_rankedenc, FLAGS_enc_detect_watch2);
       }
     }     // End detail2
   }
@@ -2157,16 +2262,18 @@ void ApplyHints(const char* url_hint,
     destatep->declared_enc_2 = F_ASCII_7_bit;
   }
 
-  if (FLAGS_force127) {
+  if (destatep->trace->force127) {
     destatep->do_latin_trigrams = true;
-    if (FLAGS_enc_detect_source) {
-      PsHighlight(0, destatep->initial_src, 0, 2);
+    if (destatep->trace->source) {
+      PsHighlight(destatep->trace, 0, destatep->initial_src, 0, 2);
     }
   }
 
 
-  if (FLAGS_counts && destatep->looking_for_latin_trigrams) {++looking_used;}
-  if (FLAGS_counts && destatep->do_latin_trigrams) {++doing_used;}
+  if (destatep->trace->counts) {
+    if (destatep->looking_for_latin_trigrams) {++destatep->trace->looking_used;}
+    if (destatep->do_latin_trigrams) {++destatep->trace->doing_used;}
+  }
 
   //
   // At this point, destatep->enc_prob[] is an initial probability vector based
@@ -2398,7 +2505,7 @@ void InitialBytesBoost(const uint8* src,
   }
 
   // Usually kill mixed encodings
-  if (!FLAGS_ced_allow_utf8utf8) {
+  if (!destatep->options->allow_utf8utf8) {
     Whack(destatep, F_UTF8UTF8, kBadPairWhack * 8);
   }
   // 2011.11.07 never use UTF8CP1252 -- answer will be UTF8 instead
@@ -3275,7 +3382,7 @@ void CalcReliable(DetectEncodingState* destatep) {
     return;
   }
   if ((destatep->top_prob - destatep->second_top_prob) >=
-      FLAGS_ced_reliable_difference) {
+      destatep->options->reliable_difference) {
     destatep->reliable = true;
     return;
   }
@@ -3677,9 +3784,8 @@ static const uint64 kLatin127Trigrams[1024] = {
 
 
 
-// Just for debugging. not thread-safe
-static char tri_string[4];
-char* Latin127Str(int trisub) {
+// Just for debugging. Writes the trigram to tri_string[4]
+char* Latin127Str(int trisub, char* tri_string) {
   tri_string[0] = "_abcdefghijklmnopqrstuvwxyzAEIOC"[(trisub >> 10) & 0x1f];
   tri_string[1] = "_abcdefghijklmnopqrstuvwxyzAEIOC"[(trisub >> 5) & 0x1f];
   tri_string[2] = "_abcdefghijklmnopqrstuvwxyzAEIOC"[(trisub >> 0) & 0x1f];
@@ -3695,7 +3801,9 @@ int TrigramValue(const uint8* trisrc) {
   int byte2_p = kMapToFiveBits[trisrc[2]];
   int subscr = ((byte0_p) << 5) | byte1_p;
   int temp = static_cast<int>((kLatin127Trigrams[subscr] >> (byte2_p * 2)));
-  //printf("%s=%d ", Latin127Str((subscr << 5) | byte2_p), temp & 3);
+  //char tri_string[4];
+  //printf("%s=%d ", Latin127Str((subscr << 5) | byte2_p, tri_string),
+  //       temp & 3);
   return temp & 3;
 }
 
@@ -3714,8 +3822,9 @@ bool BoostLatin127Trigrams(int tri_block_offset,
     // Selectively boost Latin1, Latin2, or Latin7 and friends
     int trigram_val = TrigramValue(trisrc);
     if (trigram_val != 0) {
-      if (FLAGS_enc_detect_source) {
-        PsHighlight(trisrc, destatep->initial_src, trigram_val, 1);
+      if (destatep->trace->source) {
+        PsHighlight(destatep->trace,
+                    trisrc, destatep->initial_src, trigram_val, 1);
       }
       if (trigram_val == kTriLatin1Likely) {
         Boost(destatep, F_Latin1, kTrigramBoost);
@@ -3852,7 +3961,7 @@ void BoostPrune(const uint8* src, DetectEncodingState* destatep,
       pair_used = true;
       // Boost both charset= declared encodings, so
       // Nearly-same probability nearby encoding doesn't drift to the top
-      if (!FLAGS_demo_nodefault) {
+      if (!destatep->trace->demo_nodefault) {
         destatep->enc_prob[destatep->declared_enc_1] += kDeclaredEncBoost >> weightshift;
         destatep->enc_prob[destatep->declared_enc_2] += kDeclaredEncBoost >> weightshift;
       }
@@ -3896,9 +4005,9 @@ void BoostPrune(const uint8* src, DetectEncodingState* destatep,
           incr >>= weightshift;
           destatep->enc_prob[rankedencoding] += incr;   // The actual increment
 
-          if (FLAGS_enc_detect_detail2) {
-            if (watch1_rankedenc == rankedencoding) {watch1_incr = incr;}
-            if (watch2_rankedenc == rankedencoding) {watch2_incr = incr;}
+          if (destatep->trace->detail2) {
+            if (destatep->trace->watch1_rankedenc == rankedencoding) {watch1_incr = incr;}
+            if (destatep->trace->watch2_rankedenc == rankedencoding) {watch2_incr = incr;}
           }
         }
 
@@ -3943,13 +4052,14 @@ void BoostPrune(const uint8* src, DetectEncodingState* destatep,
           int tri_block_offset = offset_byte12 & ~0x1f;
           if (destatep->trigram_highwater_mark <= tri_block_offset) {
             bool turnon = BoostLatin127Trigrams(tri_block_offset, destatep);
-            if (FLAGS_counts && !destatep->do_latin_trigrams && turnon) {
-              ++doing_used;    // First time
+            if (destatep->trace->counts && !destatep->do_latin_trigrams && turnon) {
+              ++destatep->trace->doing_used;    // First time
             }
-            if (FLAGS_enc_detect_source) {
+            if (destatep->trace->source) {
               if (!destatep->do_latin_trigrams && turnon) {
                 // First time
-                PsHighlight(trisrc, destatep->initial_src, 0, 2);
+                PsHighlight(destatep->trace,
+                            trisrc, destatep->initial_src, 0, 2);
               }
             }
             destatep->do_latin_trigrams |= turnon;
@@ -3982,7 +4092,7 @@ void BoostPrune(const uint8* src, DetectEncodingState* destatep,
                         kMostLikelyEncoding[(byte1 << 8) + byte2],
                         buff);
     }
-    if (FLAGS_enc_detect_detail2) {
+    if (destatep->trace->detail2) {
       if ((watch1_incr != 0) || (watch2_incr != 0)) {
         // Show increment detail for this encoding
         char buff[32];
@@ -4296,7 +4406,7 @@ void BoostPrune(const uint8* src, DetectEncodingState* destatep,
     destatep->reliable = true;
   }
   if ((destatep->top_prob - destatep->second_top_prob) >=
-      FLAGS_ced_reliable_difference) {
+      destatep->options->reliable_difference) {
     destatep->reliable = true;
   }
   if (destatep->next_interesting_pair[OtherPair] == 1) {
@@ -4314,6 +4424,15 @@ void BoostPrune(const uint8* src, DetectEncodingState* destatep,
     destatep->done = true;
   }
 
+  // If the caller is happy with a clear enough winner, we are done
+  if ((destatep->options->early_exit_difference > 0) &&
+      (destatep->next_interesting_pair[OtherPair] >= kStrongPairs) &&
+      ((destatep->top_prob - destatep->second_top_prob) >=
+       destatep->options->early_exit_difference)) {
+    destatep->reliable = true;
+    destatep->done = true;
+  }
+
   // If we pruned to two or three encodings in the same *superset/subset
   // rankedencoding*  and enough pairs, we are done. Else keep going
   if (destatep->rankedencoding_list_len == 2) {
@@ -4652,7 +4771,7 @@ Encoding SupersetEnc(Encoding enc, Encoding enc2) {
 // If unreliable, try rescoring to separate some encodings
 Encoding Rescore(Encoding enc, const uint8* isrc,
                  const uint8* srctextlimit, DetectEncodingState* destatep) {
-  if (FLAGS_counts) {++rescore_used;}
+  if (destatep->trace->counts) {++destatep->trace->rescore_used;}
   Encoding new_enc = enc;
 
   bool rescore_change = false;
@@ -4765,8 +4884,9 @@ int RobustScan(const char* text,
                 int text_length,
                 int robust_renc_list_len,
                 int* robust_renc_list,
-                int* robust_renc_probs) {
-  if (FLAGS_counts) {++robust_used;}
+                int* robust_renc_probs,
+                DetectEncodingTrace* trace) {
+  if (trace->counts) {++trace->robust_used;}
   // Zero all the result probabilities
   for (int i = 0; i < robust_renc_list_len; ++i) {
     robust_renc_probs[i] = 0;
@@ -4782,8 +4902,8 @@ int RobustScan(const char* text,
 
   int bigram_count = 0;
 
-  if (FLAGS_enc_detect_source) {
-    PsSourceInit(kPsSourceWidth);
+  if (trace->source) {
+    PsSourceInit(trace, kPsSourceWidth);
     fprintf(stderr, "(RobustScan) do-src\n");
   }
 
@@ -4808,8 +4928,8 @@ int RobustScan(const char* text,
       // Next 5 lines commented out so we don't show all the source.
       //const uint8* srctextlimit = isrc + text_length;
       //if (FLAGS_enc_detect_source) {
-      //  PsSource(src, isrc, srctextlimit);
-      //  PsMark(src, 2, isrc, 0);
+      //  PsSource(trace, src, isrc, srctextlimit);
+      //  PsMark(trace, src, 2, isrc, 0);
       //}
 
       uint8 byte1 = src[0];
@@ -4848,7 +4968,7 @@ int RobustScan(const char* text,
     }
   }
 
-  if (FLAGS_enc_detect_source) {
+  if (trace->source) {
     fprintf(stderr, "(  bigram_count = %d) do-src\n", bigram_count);
     if (bigram_count == 0) {bigram_count = 1;}    // zdiv
     for (int i = 0; i < robust_renc_list_len; ++i) {
@@ -4856,12 +4976,34 @@ int RobustScan(const char* text,
               MyRankedEncName(robust_renc_list[i]), robust_renc_probs[i],
               robust_renc_probs[i] / bigram_count);
     }
-    PsSourceFinish();
+    PsSourceFinish(trace);
   }
 
   return bigram_count;
 }
 
+// Look back a bit from offset for a low byte to synchronize on, so that text
+// starting at the result does not start in the middle of a multi-byte
+// character. Does not look back beyond lowlimit. Returns an even offset to
+// keep UTF-16 in sync, or offset unchanged if there is no low byte.
+int SyncToLowByte(const uint8* isrc, int offset, const uint8* lowlimit) {
+  const uint8* srcbacklimit = isrc + offset - kMaxScanBack;
+  if (srcbacklimit < lowlimit) {
+    srcbacklimit = lowlimit;
+  }
+  const uint8* ss = isrc + offset - 1;
+  while (srcbacklimit <= ss) {
+    if ((*ss & 0x80) == 0) {break;}
+    --ss;
+  }
+  // Leave offset unchanged unless we found a low byte
+  if (srcbacklimit <= ss) {
+    // Align to low byte or high byte just after it, whichever is even
+    offset = (ss - isrc + 1) & ~1;     // Even to keep UTF-16 in sync
+  }
+  return offset;
+}
+
 // If unreliable, rescan middle of document to see if we can get a better
 // answer. Rescan is only worthwhile if there are ~200 bytes or more left,
 // since the detector takes as much as 96 bytes of bigrams to decide.
@@ -4882,7 +5024,7 @@ Encoding Rescan(Encoding enc,
   Encoding second_best_enc =
     kMapToEncoding[destatep->second_top_rankedencoding];
 
-  if (FLAGS_counts) {++rescan_used;}
+  if (destatep->trace->counts) {++destatep->trace->rescan_used;}
 
   int scanned_bytes = src - isrc;
   int unscanned_bytes = srctextlimit - src;
@@ -4908,20 +5050,7 @@ Encoding Rescan(Encoding enc,
     CHECK(middle_offset <= text_length);
 
     // Look back a bit for a low byte to synchronize, else hope for the best.
-    const uint8* srcbacklimit = isrc + middle_offset - kMaxScanBack;
-    if (srcbacklimit < src) {
-      srcbacklimit = src;
-    }
-    const uint8* ss = isrc + middle_offset - 1;
-    while (srcbacklimit <= ss) {
-      if ((*ss & 0x80) == 0) {break;}
-      --ss;
-    }
-    // Leave middle offset unchanged unless we found a low byte
-    if (srcbacklimit <= ss) {
-      // Align to low byte or high byte just after it, whichever is even
-      middle_offset = (ss - isrc + 1) & ~1;     // Even to keep UTF-16 in sync
-    }
+    middle_offset = SyncToLowByte(isrc, middle_offset, src);
     CHECK(middle_offset <= text_length);
 
     if (destatep->debug_data != NULL) {
@@ -4943,6 +5072,8 @@ Encoding Rescan(Encoding enc,
     // Recursive call for rescan of half of remaining
     Encoding mid_enc = InternalDetectEncoding(
                              newflags,
+                             destatep->scratch,
+                             *destatep->options,
                              text + middle_offset,
                              text_length - middle_offset,
                              url_hint,
@@ -5025,7 +5156,8 @@ Encoding Rescan(Encoding enc,
       }
 
       int bigram_count = RobustScan(text, text_length,
-                 robust_renc_list_len, robust_renc_list, robust_renc_probs);
+                 robust_renc_list_len, robust_renc_list, robust_renc_probs,
+                 destatep->trace);
 
       // Default to new_enc and update if something better was found
       int best_prob = -1;
@@ -5084,7 +5216,9 @@ bool NoHintsCloseEnoughCompatible(Encoding top_enc) {
 // Setting ignore_7bit_mail_encodings effectively turns off detection of
 //  UTF-7, HZ, and ISO-2022-xx
 Encoding InternalDetectEncoding(
-    CEDInternalFlags flags, const char* text, int text_length,
+    CEDInternalFlags flags, DetectEncodingScratch* scratch,
+    const CompactEncDet::DetectEncodingOptions& options,
+    const char* text, int text_length,
     const char* url_hint, const char* http_charset_hint,
     const char* meta_charset_hint, const int encoding_hint,
     const Language language_hint,  // User interface lang
@@ -5111,12 +5245,24 @@ Encoding InternalDetectEncoding(
     return ASCII_7BIT;
   }
 
-  // Go for the full boat detection
-  DetectEncodingState destate;
-  InitDetectEncodingState(&destate);
+  // Go for the full boat detection, in the scratch state for this nesting
+  // level. Copying the initial state is all the setup needed.
+  CHECK(scratch->depth < kMaxDetectDepth);
+  DetectEncodingState& destate = scratch->levels[scratch->depth];
+  destate = scratch->initial;
+  destate.options = &options;
+  destate.scratch = scratch;
+  destate.trace = &scratch->trace;
+  DetectEncodingTrace* trace = destate.trace;
+  ++scratch->depth;
+  struct ReleaseLevel {
+    explicit ReleaseLevel(DetectEncodingScratch* s) : scratch(s) {}
+    ~ReleaseLevel() { --scratch->depth; }
+    DetectEncodingScratch* scratch;
+  } release_level(scratch);
 
   std::unique_ptr<DetailEntry[]> scoped_debug_data;
-  if (FLAGS_enc_detect_detail) {
+  if (trace->detail) {
     // Allocate max 10 details per bigram
     scoped_debug_data.reset(new DetailEntry[kMaxPairs * 10]);
     destate.debug_data = scoped_debug_data.get();
@@ -5129,8 +5275,8 @@ Encoding InternalDetectEncoding(
   // scan the rest (up to 256KB) a bit faster by no longer looking for
   // interesting bytes below 0x80. This allows us to skip over runs of
   // 7-bit-ASCII much more quickly.
-  int slow_len = minint(text_length, (FLAGS_enc_detect_slow_max_kb << 10));
-  int fast_len = minint(text_length, (FLAGS_enc_detect_fast_max_kb << 10));
+  int slow_len = minint(text_length, (options.slow_max_kb << 10));
+  int fast_len = minint(text_length, (options.fast_max_kb << 10));
 
   // Initialize pointers.
   // In general, we do not look at last 3 bytes of input in the fast scan
@@ -5164,22 +5310,22 @@ Encoding InternalDetectEncoding(
     BeginDetail(&destate);
     // Take any incoming watch encoding name and backmap to the corresponding
     // ranked enum value
-    watch1_rankedenc = LookupWatchEnc(FLAGS_enc_detect_watch1);
-    if (watch1_rankedenc >= 0) {
-      fprintf(stderr, "/track-me %d def\n", watch1_rankedenc);
+    trace->watch1_rankedenc = LookupWatchEnc(FLAGS_enc_detect_watch1);
+    if (trace->watch1_rankedenc >= 0) {
+      fprintf(stderr, "/track-me %d def\n", trace->watch1_rankedenc);
     }
 
-    watch2_rankedenc = LookupWatchEnc(FLAGS_enc_detect_watch2);
-    if (watch2_rankedenc >= 0) {
-      fprintf(stderr, "/track-me2 %d def\n", watch2_rankedenc);
+    trace->watch2_rankedenc = LookupWatchEnc(FLAGS_enc_detect_watch2);
+    if (trace->watch2_rankedenc >= 0) {
+      fprintf(stderr, "/track-me2 %d def\n", trace->watch2_rankedenc);
     }
 
     fprintf(stderr, "%% kDerateHintsBelow = %d\n", kDerateHintsBelow);
   }
-  if (FLAGS_enc_detect_source) {
-    PsSourceInit(kPsSourceWidth);
-    PsSource(src, isrc, srctextlimit);
-    PsMark(src, 4, isrc, 0);
+  if (trace->source) {
+    PsSourceInit(trace, kPsSourceWidth);
+    PsSource(trace, src, isrc, srctextlimit);
+    PsMark(trace, src, 4, isrc, 0);
   }
 
   // Apply hints, if any, to probabilities
@@ -5214,8 +5360,8 @@ Encoding InternalDetectEncoding(
     }
 
     if (src < srclimitslow2) {
-      if (FLAGS_enc_detect_source) {
-        PsSource(src, isrc, srctextlimit);    // don't mark yet
+      if (trace->source) {
+        PsSource(trace, src, isrc, srctextlimit);    // don't mark yet
       }
 
       int weightshift = 0;
@@ -5237,8 +5383,8 @@ Encoding InternalDetectEncoding(
           }
         }
       }
-      if (FLAGS_enc_detect_source) {
-        PsMark(src, 2, isrc, weightshift);
+      if (trace->source) {
+        PsMark(trace, src, 2, isrc, weightshift);
       }
       // Saves byte pair and offset
       bool pruned = IncrementAndBoostPrune(src, srctextlimit - src,
@@ -5278,9 +5424,9 @@ Encoding InternalDetectEncoding(
     }
   }
 
-  if (FLAGS_enc_detect_source) {
-    PsSource(src, isrc, srctextlimit);
-    PsMark(src, 2, isrc, 0);
+  if (trace->source) {
+    PsSource(trace, src, isrc, srctextlimit);
+    PsMark(trace, src, 2, isrc, 0);
   }
   // Force a pruning based on whatever we have
   // Delete the seven-bit encodings if there is no evidence of them so far
@@ -5290,7 +5436,7 @@ Encoding InternalDetectEncoding(
     // If not clear yet on 7-bit-encodings and more bytes, do more slow
     if (SevenBitActive(&destate) && (src < srclimitfast2)) {
       // Increment limit by another xxxK
-      slow_len += (FLAGS_enc_detect_slow_max_kb << 10);
+      slow_len += (options.slow_max_kb << 10);
       srclimitslow2 = isrc + slow_len - 1;
       if (srclimitslow2 > srclimitfast2) {
         srclimitslow2 = srclimitfast2;
@@ -5319,9 +5465,9 @@ Encoding InternalDetectEncoding(
       }
 
       if (src < srclimitfast2) {
-        if (FLAGS_enc_detect_source) {
-          PsSource(src, isrc, srctextlimit);
-          PsMark(src, 2, isrc, 0);
+        if (trace->source) {
+          PsSource(trace, src, isrc, srctextlimit);
+          PsMark(trace, src, 2, isrc, 0);
         }
         // saves byte pair and offset
         bool pruned = IncrementAndBoostPrune(src, srctextlimit - src,
@@ -5351,19 +5497,19 @@ Encoding InternalDetectEncoding(
 
   }     // End if !done
 
-  if (FLAGS_enc_detect_source) {
-    PsSource(src, isrc, srctextlimit);
-    PsMark(src, 2, isrc, 0);
+  if (trace->source) {
+    PsSource(trace, src, isrc, srctextlimit);
+    PsMark(trace, src, 2, isrc, 0);
   }
   // Force a pruning based on whatever we have
   BoostPrune(src, &destate, PRUNE_FINAL);
 
-  if (FLAGS_enc_detect_summary) {
+  if (trace->summary) {
     DumpSummary(&destate, AsciiPair, 32);
     DumpSummary(&destate, OtherPair, 32);
   }
-  if (FLAGS_enc_detect_source) {
-    PsSourceFinish();
+  if (trace->source) {
+    PsSourceFinish(trace);
   }
   if (destate.debug_data != NULL) {
     //// DumpDetail(&destate);
@@ -5388,6 +5534,8 @@ Encoding InternalDetectEncoding(
     // Recursive call for high bytes in tags [no longer used, 1/16 tag score]
     Encoding enc2 = InternalDetectEncoding(
                              kCEDForceTags,  // force
+                             scratch,
+                             options,
                              text,
                              text_length,
                              url_hint,
@@ -5534,28 +5682,61 @@ Encoding InternalDetectEncoding(
   return top_enc;
 }
 
-Encoding CompactEncDet::DetectEncoding(
+// Copy head, middle and tail stripes of text that is longer than budget into
+// scratch->sample and point text at the copy. No stripe starts or ends in the
+// middle of a multi-byte character.
+void SampleStripes(int budget, DetectEncodingScratch* scratch,
+                   const char** text, int* text_length) {
+  const uint8* isrc = reinterpret_cast<const uint8*>(*text);
+  int stripe = (budget / 3) & ~1;
+  int stripe_offsets[3] = {
+    0,
+    ((*text_length - stripe) / 2) & ~1,
+    (*text_length - stripe) & ~1,
+  };
+  scratch->sample.clear();
+  int prior_end = 0;
+  for (int i = 0; i < 3; ++i) {
+    int start = SyncToLowByte(isrc, stripe_offsets[i], isrc + prior_end);
+    if (start < prior_end) {start = prior_end;}
+    int end = *text_length;
+    if (i < 2) {
+      end = SyncToLowByte(isrc, start + stripe, isrc + start + 1);
+    }
+    scratch->sample.append(*text + start, end - start);
+    prior_end = end;
+  }
+  *text = scratch->sample.data();
+  *text_length = static_cast<int>(scratch->sample.size());
+}
+
+// DetectEncoding on text that is already cut down to the sample budget
+Encoding DetectSampledEncoding(
+    DetectEncodingScratch* scratch,
+    const CompactEncDet::DetectEncodingOptions& options,
     const char* text, int text_length, const char* url_hint,
     const char* http_charset_hint, const char* meta_charset_hint,
     const int encoding_hint,
     const Language language_hint,  // User interface lang
-    const TextCorpusType corpus_type, bool ignore_7bit_mail_encodings,
+    const CompactEncDet::TextCorpusType corpus_type,
+    bool ignore_7bit_mail_encodings,
     int* bytes_consumed, bool* is_reliable) {
-  if (FLAGS_ced_echo_input) {
+  DetectEncodingTrace* trace = &scratch->trace;
+  if (trace->echo_input) {
     string temp(text, text_length);
     fprintf(stderr, "CompactEncDet::DetectEncoding()\n%s\n\n", temp.c_str());
   }
 
-  if (FLAGS_counts) {
-    encdet_used = 0;
-    rescore_used = 0;
-    rescan_used = 0;
-    robust_used = 0;
-    looking_used = 0;
-    doing_used = 0;
-    ++encdet_used;
+  if (trace->counts) {
+    trace->encdet_used = 0;
+    trace->rescore_used = 0;
+    trace->rescan_used = 0;
+    trace->robust_used = 0;
+    trace->looking_used = 0;
+    trace->doing_used = 0;
+    ++trace->encdet_used;
   }
-  if (FLAGS_dirtsimple) {
+  if (trace->dirtsimple) {
     // Just count first 64KB bigram encoding probabilities for each encoding
     int robust_renc_list_len;         // Number of active encodings
     int robust_renc_list[NUM_RANKEDENCODING];   // List of ranked encodings
@@ -5567,7 +5748,8 @@ Encoding CompactEncDet::DetectEncoding(
     robust_renc_list_len = NUM_RANKEDENCODING;
 
     RobustScan(text, text_length,
-                 robust_renc_list_len, robust_renc_list, robust_renc_probs);
+                 robust_renc_list_len, robust_renc_list, robust_renc_probs,
+                 trace);
 
     // Pick off best encoding
     int best_prob = -1;
@@ -5581,14 +5763,14 @@ Encoding CompactEncDet::DetectEncoding(
 
     *bytes_consumed = minint(text_length, (kMaxKBToRobustScan << 10));
     *is_reliable = true;
-    if (FLAGS_counts) {
+    if (trace->counts) {
       printf("CEDcounts ");
-      while (encdet_used--) {printf("encdet ");}
-      while (rescore_used--) {printf("rescore ");}
-      while (rescan_used--) {printf("rescan ");}
-      while (robust_used--) {printf("robust ");}
-      while (looking_used--) {printf("looking ");}
-      while (doing_used--) {printf("doing ");}
+      while (trace->encdet_used--) {printf("encdet ");}
+      while (trace->rescore_used--) {printf("rescore ");}
+      while (trace->rescan_used--) {printf("rescan ");}
+      while (trace->robust_used--) {printf("robust ");}
+      while (trace->looking_used--) {printf("looking ");}
+      while (trace->doing_used--) {printf("doing ");}
       printf("\n");
     }
 
@@ -5597,6 +5779,8 @@ Encoding CompactEncDet::DetectEncoding(
 
   Encoding second_best_enc;
   Encoding enc = InternalDetectEncoding(kCEDNone,
+                           scratch,
+                           options,
                            text,
                            text_length,
                            url_hint,
@@ -5609,14 +5793,14 @@ Encoding CompactEncDet::DetectEncoding(
                            bytes_consumed,
                            is_reliable,
                            &second_best_enc);
-  if (FLAGS_counts) {
+  if (trace->counts) {
     printf("CEDcounts ");
-    while (encdet_used--) {printf("encdet ");}
-    while (rescore_used--) {printf("rescore ");}
-    while (rescan_used--) {printf("rescan ");}
-    while (robust_used--) {printf("robust ");}
-    while (looking_used--) {printf("looking ");}
-    while (doing_used--) {printf("doing ");}
+    while (trace->encdet_used--) {printf("encdet ");}
+    while (trace->rescore_used--) {printf("rescore ");}
+    while (trace->rescan_used--) {printf("rescan ");}
+    while (trace->robust_used--) {printf("robust ");}
+    while (trace->looking_used--) {printf("looking ");}
+    while (trace->doing_used--) {printf("doing ");}
     printf("\n");
   }
 
@@ -5671,6 +5855,123 @@ Encoding CompactEncDet::DetectEncoding(
   return enc;
 }
 
+Encoding CompactEncDet::DetectEncoding(
+    const char* text, int text_length, const char* url_hint,
+    const char* http_charset_hint, const char* meta_charset_hint,
+    const int encoding_hint,
+    const Language language_hint,  // User interface lang
+    const TextCorpusType corpus_type, bool ignore_7bit_mail_encodings,
+    int* bytes_consumed, bool* is_reliable) {
+  return DetectEncoding(text, text_length, url_hint, http_charset_hint,
+                        meta_charset_hint, encoding_hint, language_hint,
+                        corpus_type, ignore_7bit_mail_encodings,
+                        DetectEncodingOptions(), NULL,
+                        bytes_consumed, is_reliable);
+}
+
+Encoding CompactEncDet::DetectEncoding(
+    const char* text, int text_length, const char* url_hint,
+    const char* http_charset_hint, const char* meta_charset_hint,
+    const int encoding_hint,
+    const Language language_hint,  // User interface lang
+    const TextCorpusType corpus_type, bool ignore_7bit_mail_encodings,
+    const DetectEncodingOptions& options, DetectEncodingContext* state,
+    int* bytes_consumed, bool* is_reliable) {
+  std::unique_ptr<DetectEncodingContext> scoped_state;
+  if (state == NULL) {
+    scoped_state.reset(new DetectEncodingContext);
+    state = scoped_state.get();
+  }
+  int unused_bytes_consumed;
+  if (bytes_consumed == NULL) {
+    bytes_consumed = &unused_bytes_consumed;
+  }
+  DetectEncodingScratch* scratch = state->scratch();
+  scratch->trace.Init();
+
+  int budget = options.sample_max_kb << 10;
+  if ((budget > 0) && (text_length > budget)) {
+    const uint8* isrc = reinterpret_cast<const uint8*>(text);
+    if (options.sample_strategy == SAMPLE_STRIPES) {
+      // Most text gives its encoding away in the head stripe. Only copy the
+      // stripes together if it does not.
+      int head_length = SyncToLowByte(isrc, (budget / 3) & ~1, isrc);
+      Encoding enc = DetectSampledEncoding(
+          scratch, options, text, head_length, url_hint, http_charset_hint,
+          meta_charset_hint, encoding_hint, language_hint, corpus_type,
+          ignore_7bit_mail_encodings, bytes_consumed, is_reliable);
+      if (*is_reliable && (enc != ASCII_7BIT)) {return enc;}
+      SampleStripes(budget, scratch, &text, &text_length);
+    } else {
+      text_length = SyncToLowByte(isrc, budget, isrc);
+    }
+  }
+
+  return DetectSampledEncoding(
+      scratch, options, text, text_length, url_hint, http_charset_hint,
+      meta_charset_hint, encoding_hint, language_hint, corpus_type,
+      ignore_7bit_mail_encodings, bytes_consumed, is_reliable);
+}
+
+CompactEncDet::DetectEncodingInput::DetectEncodingInput()
+    : text(NULL), text_length(0), url_hint(NULL), http_charset_hint(NULL),
+      meta_charset_hint(NULL), encoding_hint(UNKNOWN_ENCODING),
+      language_hint(UNKNOWN_LANGUAGE), corpus_type(QUERY_CORPUS),
+      ignore_7bit_mail_encodings(false) {
+}
+
+CompactEncDet::DetectEncodingInput::DetectEncodingInput(const char* text,
+                                                        int text_length)
+    : text(text), text_length(text_length), url_hint(NULL),
+      http_charset_hint(NULL), meta_charset_hint(NULL),
+      encoding_hint(UNKNOWN_ENCODING), language_hint(UNKNOWN_LANGUAGE),
+      corpus_type(QUERY_CORPUS), ignore_7bit_mail_encodings(false) {
+}
+
+// Detect inputs until none are left, taking the next index from *next.
+// Each worker has its own state, so nothing is shared but the read-only
+// inputs and options.
+static void DetectEncodingWorker(
+    const CompactEncDet::DetectEncodingInput* inputs, int count,
+    const CompactEncDet::DetectEncodingOptions& options,
+    std::atomic<int>* next, CompactEncDet::DetectEncodingResult* results) {
+  CompactEncDet::DetectEncodingContext state;
+  for (int i = (*next)++; i < count; i = (*next)++) {
+    const CompactEncDet::DetectEncodingInput& in = inputs[i];
+    CompactEncDet::DetectEncodingResult& out = results[i];
+    out.encoding = CompactEncDet::DetectEncoding(
+        in.text, in.text_length, in.url_hint, in.http_charset_hint,
+        in.meta_charset_hint, in.encoding_hint, in.language_hint,
+        in.corpus_type, in.ignore_7bit_mail_encodings, options, &state,
+        &out.bytes_consumed, &out.is_reliable);
+  }
+}
+
+void CompactEncDet::DetectEncodingBatch(const DetectEncodingInput* inputs,
+                                        int count,
+                                        const DetectEncodingOptions& options,
+                                        int num_threads,
+                                        DetectEncodingResult* results) {
+  if (count <= 0) {return;}
+  if (num_threads <= 0) {
+    num_threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  num_threads = maxint(1, minint(num_threads, count));
+
+  // The calling thread is one of the workers
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  workers.reserve(num_threads - 1);
+  for (int i = 1; i < num_threads; ++i) {
+    workers.push_back(std::thread(DetectEncodingWorker, inputs, count,
+                                  std::cref(options), &next, results));
+  }
+  DetectEncodingWorker(inputs, count, options, &next, results);
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+}
+
 
 // Return top encoding hint for given string
 Encoding CompactEncDet::TopEncodingOfLangHint(const char* name) {
@@ -22,6 +22,9 @@
 
 #include <string.h>
 
+// Working storage of the detector, defined in compact_enc_det.cc
+struct DetectEncodingScratch;
+
 namespace CompactEncDet {
   // We may want different statistics, depending on whether the text being
   // identfied is from the web, from email, etc.  This is currently ignored,
@@ -72,6 +75,103 @@ namespace CompactEncDet {
       const TextCorpusType corpus_type, bool ignore_7bit_mail_encodings,
       int* bytes_consumed, bool* is_reliable);
 
+  // How much of a long text DetectEncoding looks at, see
+  // DetectEncodingOptions::sample_max_kb
+  enum SampleStrategy {
+    SAMPLE_HEAD,        // The start of the text
+    SAMPLE_STRIPES,     // The start of the text, and if that is not
+                        // conclusive, equal stripes from the start, middle
+                        // and end
+  };
+
+  // Per-call settings for DetectEncoding. The defaults give the same results
+  // as the DetectEncoding overload without options.
+  struct DetectEncodingOptions {
+    DetectEncodingOptions();
+
+    // Kbytes to examine for 7-bit-only (2022, Hz, UTF7) encodings. The limit
+    // grows in steps of this size while those encodings are still possible.
+    int slow_max_kb;
+    // Kbytes to examine for all other encodings
+    int fast_max_kb;
+    // Kbytes of the text the detector may look at all, including rescans of
+    // the middle of the text. 0 for no limit. Longer text is sampled as set
+    // by sample_strategy; bytes_consumed then counts bytes of the sample.
+    int sample_max_kb;
+    SampleStrategy sample_strategy;
+    // 30 * bits of probability difference between the top two encodings for
+    // the result to be considered reliable
+    int reliable_difference;
+    // Stop scanning as soon as the top two encodings are this far apart
+    // (30 * bits) and enough non-ASCII bigrams have been seen. 0 scans up to
+    // the limits above.
+    int early_exit_difference;
+    // Allow the UTF8UTF8 encoding, for mixtures of CP1252 converted to UTF-8
+    // zero, one, or two times
+    bool allow_utf8utf8;
+  };
+
+  // Scratch state for DetectEncoding. It is set up once when constructed, so
+  // a caller that detects many texts can keep one and pass it to every call
+  // instead of paying for the setup each time. All mutable state of a call
+  // lives here, so calls with separate states may run concurrently; one
+  // state must not be shared between threads.
+  class DetectEncodingContext {
+   public:
+    DetectEncodingContext();
+    ~DetectEncodingContext();
+
+    DetectEncodingScratch* scratch() const { return scratch_; }
+
+   private:
+    DetectEncodingContext(const DetectEncodingContext&);
+    void operator=(const DetectEncodingContext&);
+
+    DetectEncodingScratch* scratch_;
+  };
+
+  // Same as above, with per-call options. state may be NULL, in which case a
+  // temporary state is set up for this call. bytes_consumed may be NULL.
+  Encoding DetectEncoding(
+      const char* text, int text_length, const char* url_hint,
+      const char* http_charset_hint, const char* meta_charset_hint,
+      const int encoding_hint,
+      const Language language_hint,  // User interface lang
+      const TextCorpusType corpus_type, bool ignore_7bit_mail_encodings,
+      const DetectEncodingOptions& options, DetectEncodingContext* state,
+      int* bytes_consumed, bool* is_reliable);
+
+  // One text for DetectEncodingBatch, with the hints DetectEncoding takes.
+  // The defaults are no hints, QUERY_CORPUS and 7-bit mail encodings on.
+  struct DetectEncodingInput {
+    DetectEncodingInput();
+    DetectEncodingInput(const char* text, int text_length);
+
+    const char* text;
+    int text_length;
+    const char* url_hint;
+    const char* http_charset_hint;
+    const char* meta_charset_hint;
+    int encoding_hint;
+    Language language_hint;
+    TextCorpusType corpus_type;
+    bool ignore_7bit_mail_encodings;
+  };
+
+  struct DetectEncodingResult {
+    Encoding encoding;
+    int bytes_consumed;
+    bool is_reliable;
+  };
+
+  // Detects the encodings of count texts on up to num_threads threads, the
+  // calling thread included, each with its own DetectEncodingContext.
+  // num_threads 0 uses one thread per hardware thread. results[i] is what
+  // DetectEncoding with options returns for inputs[i].
+  void DetectEncodingBatch(const DetectEncodingInput* inputs, int count,
+                           const DetectEncodingOptions& options,
+                           int num_threads, DetectEncodingResult* results);
+
   // Support functions for unit test program
   int BackmapEncodingToRankedEncoding(Encoding enc);
   Encoding TopEncodingOfLangHint(const char* name);
@@ -19,6 +19,8 @@
 #include <stdio.h>                      // for fprintf, stderr, FILE, etc
 #include <string.h>                     // for strlen, NULL
 #include <string>                       // for string
+#include <thread>
+#include <vector>
 
 
 #include "gtest/gtest.h"
@@ -5126,6 +5128,185 @@ TEST_F(CompactEncDetTest, ShiftJISNoHintTest) {
   EXPECT_EQ(is_reliable, true);
 }
 
+// Repeat str until the result is at least len bytes long
+string RepeatToLength(const char* str, size_t len) {
+  string res;
+  while (res.size() < len) {res.append(str);}
+  return res;
+}
+
+Encoding DetectWithOptions(const string& text,
+                           const CompactEncDet::DetectEncodingOptions& options,
+                           CompactEncDet::DetectEncodingContext* state,
+                           int* bytes_consumed, bool* is_reliable) {
+  return CompactEncDet::DetectEncoding(
+      text.data(), text.size(),
+      NULL, NULL, NULL,                   // url, http, meta hints
+      UNKNOWN_ENCODING,                   // enc hint
+      UNKNOWN_LANGUAGE,                   // lang hint
+      CompactEncDet::QUERY_CORPUS,
+      true,                               // Ignore 7-bit encodings
+      options, state, bytes_consumed, is_reliable);
+}
+
+TEST_F(CompactEncDetTest, DefaultOptionsMatchPlainCall) {
+  const char* const texts[] = {kTeststr00, kTeststr03, kTeststr06, kTeststr11,
+                               kTeststr13, kTeststr14, kTeststr22, kTeststr26,
+                               kTeststr33, kTeststr46};
+  CompactEncDet::DetectEncodingOptions options;
+  CompactEncDet::DetectEncodingContext state;
+  for (size_t i = 0; i < arraysize(texts); ++i) {
+    // Long enough for the rescan of the middle to kick in
+    string text = RepeatToLength(texts[i], 64 << 10);
+    int bytes_consumed;
+    bool is_reliable;
+    Encoding enc = CompactEncDet::DetectEncoding(
+        text.data(), text.size(), NULL, NULL, NULL, UNKNOWN_ENCODING,
+        UNKNOWN_LANGUAGE, CompactEncDet::QUERY_CORPUS, true,
+        &bytes_consumed, &is_reliable);
+    // Reusing one state must not change anything either
+    for (int pass = 0; pass < 2; ++pass) {
+      int state_bytes_consumed;
+      bool state_is_reliable;
+      EXPECT_EQ(enc, DetectWithOptions(text, options, &state,
+                                       &state_bytes_consumed,
+                                       &state_is_reliable));
+      EXPECT_EQ(bytes_consumed, state_bytes_consumed);
+      EXPECT_EQ(is_reliable, state_is_reliable);
+    }
+  }
+}
+
+TEST_F(CompactEncDetTest, SampleBudget) {
+  // Plain ASCII text with Shift-JIS text only at the very end
+  string text = RepeatToLength("Plain ASCII line of text.\n", 512 << 10);
+  text.append(RepeatToLength(kTeststr11, 8 << 10));
+
+  CompactEncDet::DetectEncodingOptions options;
+  options.sample_max_kb = 48;
+  int bytes_consumed;
+  bool is_reliable;
+
+  // The head alone never sees the Japanese text
+  options.sample_strategy = CompactEncDet::SAMPLE_HEAD;
+  EXPECT_EQ(ASCII_7BIT, DetectWithOptions(text, options, NULL,
+                                          &bytes_consumed, &is_reliable));
+  EXPECT_LE(bytes_consumed, 48 << 10);
+
+  options.sample_strategy = CompactEncDet::SAMPLE_STRIPES;
+  EXPECT_EQ(JAPANESE_SHIFT_JIS, DetectWithOptions(text, options, NULL,
+                                                  &bytes_consumed,
+                                                  &is_reliable));
+  EXPECT_LE(bytes_consumed, 48 << 10);
+
+  // Stripes of text that is shorter than the budget are the whole text
+  string short_text(kTeststr11);
+  EXPECT_EQ(JAPANESE_SHIFT_JIS, DetectWithOptions(short_text, options, NULL,
+                                                  &bytes_consumed,
+                                                  &is_reliable));
+}
+
+TEST_F(CompactEncDetTest, EarlyExit) {
+  const char* const texts[] = {kTeststr11, kTeststr14, kTeststr22};
+  CompactEncDet::DetectEncodingContext state;
+  for (size_t i = 0; i < arraysize(texts); ++i) {
+    string text = RepeatToLength(texts[i], 128 << 10);
+    CompactEncDet::DetectEncodingOptions options;
+    int full_bytes_consumed;
+    bool full_is_reliable;
+    Encoding enc = DetectWithOptions(text, options, &state,
+                                     &full_bytes_consumed, &full_is_reliable);
+
+    options.early_exit_difference = options.reliable_difference;
+    int bytes_consumed;
+    bool is_reliable;
+    EXPECT_EQ(enc, DetectWithOptions(text, options, &state,
+                                     &bytes_consumed, &is_reliable));
+    EXPECT_TRUE(is_reliable);
+    EXPECT_LE(bytes_consumed, full_bytes_consumed);
+
+    // Callers that do not need bytes_consumed may pass NULL
+    EXPECT_EQ(enc, DetectWithOptions(text, options, &state, NULL,
+                                     &is_reliable));
+  }
+}
+
+// Detect texts one at a time on this thread
+void DetectSequentially(const CompactEncDet::DetectEncodingOptions& options,
+                        const std::vector<string>& texts,
+                        std::vector<CompactEncDet::DetectEncodingResult>* res) {
+  CompactEncDet::DetectEncodingContext state;
+  res->resize(texts.size());
+  for (size_t i = 0; i < texts.size(); ++i) {
+    (*res)[i].encoding = DetectWithOptions(texts[i], options, &state,
+                                           &(*res)[i].bytes_consumed,
+                                           &(*res)[i].is_reliable);
+  }
+}
+
+// Detect texts with DetectEncodingBatch, many times over
+void DetectInBatches(const CompactEncDet::DetectEncodingOptions& options,
+                     const std::vector<string>& texts, int rounds,
+                     const std::vector<CompactEncDet::DetectEncodingResult>&
+                         expected) {
+  std::vector<CompactEncDet::DetectEncodingInput> inputs;
+  for (size_t i = 0; i < texts.size(); ++i) {
+    inputs.push_back(CompactEncDet::DetectEncodingInput(texts[i].data(),
+                                                        texts[i].size()));
+    inputs.back().ignore_7bit_mail_encodings = true;
+  }
+  std::vector<CompactEncDet::DetectEncodingResult> res(inputs.size());
+  for (int round = 0; round < rounds; ++round) {
+    CompactEncDet::DetectEncodingBatch(inputs.data(), inputs.size(), options,
+                                       8, res.data());
+    for (size_t i = 0; i < res.size(); ++i) {
+      EXPECT_EQ(expected[i].encoding, res[i].encoding) << "text " << i;
+      EXPECT_EQ(expected[i].bytes_consumed, res[i].bytes_consumed);
+      EXPECT_EQ(expected[i].is_reliable, res[i].is_reliable);
+    }
+  }
+}
+
+TEST_F(CompactEncDetTest, ConcurrentBatches) {
+  const char* const strs[] = {kTeststr00, kTeststr03, kTeststr06, kTeststr11,
+                              kTeststr13, kTeststr14, kTeststr22, kTeststr26,
+                              kTeststr33, kTeststr46, kTeststr63};
+  // Short texts and texts long enough for the rescans, so every nesting
+  // level of the detector runs on several threads at once
+  std::vector<string> texts;
+  const size_t lengths[] = {0, 4 << 10, 64 << 10};
+  for (size_t l = 0; l < arraysize(lengths); ++l) {
+    for (size_t i = 0; i < arraysize(strs); ++i) {
+      texts.push_back(RepeatToLength(strs[i], lengths[l]));
+      if (lengths[l] == 0) {texts.back() = strs[i];}
+    }
+  }
+
+  // Two option sets that give different answers for kTeststr63
+  CompactEncDet::DetectEncodingOptions plain;
+  plain.allow_utf8utf8 = false;
+  CompactEncDet::DetectEncodingOptions mixed;
+  mixed.allow_utf8utf8 = true;
+  mixed.sample_max_kb = 32;
+  mixed.sample_strategy = CompactEncDet::SAMPLE_STRIPES;
+  mixed.early_exit_difference = mixed.reliable_difference;
+
+  std::vector<CompactEncDet::DetectEncodingResult> plain_expected;
+  std::vector<CompactEncDet::DetectEncodingResult> mixed_expected;
+  DetectSequentially(plain, texts, &plain_expected);
+  DetectSequentially(mixed, texts, &mixed_expected);
+#if !defined(HTML5_MODE)
+  EXPECT_EQ(UTF8, plain_expected[arraysize(strs) - 1].encoding);
+  EXPECT_EQ(UTF8UTF8, mixed_expected[arraysize(strs) - 1].encoding);
+#endif
+
+  // Both batches run at the same time, on eight threads each
+  std::thread other(DetectInBatches, std::cref(mixed), std::cref(texts), 8,
+                    std::cref(mixed_expected));
+  DetectInBatches(plain, texts, 8, plain_expected);
+  other.join();
+}
+
 #if 0
 CP1252 => UTF8 => UTF8UTF8
 80 => E282AC => C3A2E2809AC2AC
@@ -14,22 +14,32 @@ namespace Lexilla {
 
 class CatalogueModules {
 	std::vector<LexerModule *> lexerCatalogue;
+	// Indices into lexerCatalogue so lookups by name or identifier are not linear.
+	// Only the first module added for a name or identifier is indexed to match a linear search.
+	std::unordered_map<std::string_view, unsigned int> nameIndex;
+	std::unordered_map<int, unsigned int> languageIndex;
+
+	void Index(unsigned int index) {
+		const LexerModule *lm = lexerCatalogue[index];
+		if (lm->languageName) {
+			nameIndex.emplace(lm->languageName, index);
+		}
+		languageIndex.emplace(lm->GetLanguage(), index);
+	}
 public:
 	const LexerModule *Find(int language) const {
-		for (const LexerModule *lm : lexerCatalogue) {
-			if (lm->GetLanguage() == language) {
-				return lm;
-			}
+		const auto it = languageIndex.find(language);
+		if (it != languageIndex.end()) {
+			return lexerCatalogue[it->second];
 		}
 		return nullptr;
 	}
 
 	const LexerModule *Find(const char *languageName) const noexcept {
 		if (languageName) {
-			for (const LexerModule *lm : lexerCatalogue) {
-				if (lm->languageName && (0 == strcmp(lm->languageName, languageName))) {
-					return lm;
-				}
+			const auto it = nameIndex.find(languageName);
+			if (it != nameIndex.end()) {
+				return lexerCatalogue[it->second];
 			}
 		}
 		return nullptr;
@@ -37,10 +47,15 @@ public:
 
 	void AddLexerModule(LexerModule *plm) {
 		lexerCatalogue.push_back(plm);
+		Index(Count() - 1);
 	}
 
 	void AddLexerModules(std::initializer_list<LexerModule *> modules) {
+		const unsigned int start = Count();
 		lexerCatalogue.insert(lexerCatalogue.end(), modules);
+		for (unsigned int index = start; index < Count(); index++) {
+			Index(index);
+		}
 	}
 
 	unsigned int Count() const noexcept {
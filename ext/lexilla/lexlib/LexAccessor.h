@@ -21,14 +21,17 @@ private:
 	 * @a slopSize positions the buffer before the desired position
 	 * in case there is some backtracking. */
 	enum {bufferSize=4000, slopSize=bufferSize/8};
+	/** Styles are accumulated for the whole range being lexed and sent to the
+	 * document in one call so it can compare and notify once.
+	 * @a styleBufferLimit bounds the memory used when styling huge ranges. */
+	enum {styleBufferLimit=0x400000};
 	char buf[bufferSize+1];
 	Sci_Position startPos;
 	Sci_Position endPos;
 	int codePage;
 	enum EncodingType encodingType;
 	Sci_Position lenDoc;
-	char styleBuf[bufferSize];
-	Sci_Position validLen;
+	std::string styleBuf;
 	Sci_PositionU startSeg;
 	Sci_Position startPosStyling;
 	int documentVersion;
@@ -53,12 +56,10 @@ public:
 		codePage(pAccess->CodePage()),
 		encodingType(EncodingType::eightBit),
 		lenDoc(pAccess->Length()),
-		validLen(0),
 		startSeg(0), startPosStyling(0),
 		documentVersion(pAccess->Version()) {
-		// Prevent warnings by static analyzers about uninitialized buf and styleBuf.
+		// Prevent warnings by static analyzers about uninitialized buf.
 		buf[0] = 0;
-		styleBuf[0] = 0;
 		switch (codePage) {
 		case 65001:
 			encodingType = EncodingType::unicode;
@@ -131,7 +132,7 @@ public:
 	// This is faster and can avoid calls to Flush() as that may be expensive.
 	int BufferStyleAt(Sci_Position position) const {
 		const Sci_Position index = position - startPosStyling;
-		if (index >= 0 && index < validLen) {
+		if (index >= 0 && index < static_cast<Sci_Position>(styleBuf.length())) {
 			return static_cast<unsigned char>(styleBuf[index]);
 		}
 		return static_cast<unsigned char>(pAccess->StyleAt(position));
@@ -152,10 +153,10 @@ public:
 		return lenDoc;
 	}
 	void Flush() {
-		if (validLen > 0) {
-			pAccess->SetStyles(validLen, styleBuf);
-			startPosStyling += validLen;
-			validLen = 0;
+		if (!styleBuf.empty()) {
+			pAccess->SetStyles(styleBuf.length(), styleBuf.data());
+			startPosStyling += styleBuf.length();
+			styleBuf.clear();
 		}
 	}
 	int GetLineState(Sci_Position line) const {
@@ -183,17 +184,17 @@ public:
 				return;
 			}
 
-			if (validLen + (pos - startSeg + 1) >= bufferSize)
+			const Sci_PositionU lengthRun = pos - startSeg + 1;
+			if (styleBuf.length() + lengthRun >= styleBufferLimit)
 				Flush();
 			const char attr = static_cast<char>(chAttr);
-			if (validLen + (pos - startSeg + 1) >= bufferSize) {
+			if (lengthRun >= styleBufferLimit) {
 				// Too big for buffer so send directly
-				pAccess->SetStyleFor(pos - startSeg + 1, attr);
+				pAccess->SetStyleFor(lengthRun, attr);
+				startPosStyling += lengthRun;
 			} else {
-				for (Sci_PositionU i = startSeg; i <= pos; i++) {
-					assert((startPosStyling + validLen) < Length());
-					styleBuf[validLen++] = attr;
-				}
+				assert((startPosStyling + styleBuf.length() + lengthRun) <= static_cast<Sci_PositionU>(Length()));
+				styleBuf.append(lengthRun, attr);
 			}
 		}
 		startSeg = pos+1;
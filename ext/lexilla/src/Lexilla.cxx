@@ -8,7 +8,9 @@
 
 #include <cstring>
 
+#include <string_view>
 #include <vector>
+#include <unordered_map>
 #include <initializer_list>
 
 #if _WIN32
@@ -339,11 +341,9 @@ EXPORT_FUNCTION LexerFactoryFunction CALLING_CONVENTION GetLexerFactory(unsigned
 
 EXPORT_FUNCTION Scintilla::ILexer5 * CALLING_CONVENTION CreateLexer(const char *name) {
 	AddEachLexer();
-	for (unsigned int i = 0; i < catalogueLexilla.Count(); i++) {
-		const char *lexerName = catalogueLexilla.Name(i);
-		if (0 == strcmp(lexerName, name)) {
-			return catalogueLexilla.Create(i);
-		}
+	const LexerModule *pModule = catalogueLexilla.Find(name);
+	if (pModule) {
+		return pModule->Create();
 	}
 	return nullptr;
 }
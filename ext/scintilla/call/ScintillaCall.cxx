@@ -1219,6 +1219,14 @@ bool ScintillaCall::Modify() {
 	return Call(Message::GetModify);
 }
 
+Position ScintillaCall::UnsavedStart() {
+	return Call(Message::GetUnsavedStart);
+}
+
+Position ScintillaCall::UnsavedEnd() {
+	return Call(Message::GetUnsavedEnd);
+}
+
 void ScintillaCall::SetSel(Position anchor, Position caret) {
 	Call(Message::SetSel, anchor, caret);
 }
@@ -1427,6 +1435,22 @@ Position ScintillaCall::ReplaceTargetMinimal(Position length, const char *text)
 	return CallString(Message::ReplaceTargetMinimal, length, text);
 }
 
+Position ScintillaCall::ReplaceAllInTarget(void *tr) {
+	return CallPointer(Message::ReplaceAllInTarget, 0, tr);
+}
+
+Line ScintillaCall::TrimTrailingWhitespaceInTarget() {
+	return Call(Message::TrimTrailingWhitespaceInTarget);
+}
+
+Line ScintillaCall::TabsToSpacesInTarget(bool skipQuoted) {
+	return Call(Message::TabsToSpacesInTarget, skipQuoted);
+}
+
+Line ScintillaCall::SpacesToTabsInTarget(bool skipQuoted) {
+	return Call(Message::SpacesToTabsInTarget, skipQuoted);
+}
+
 Position ScintillaCall::SearchInTarget(Position length, const char *text) {
 	return CallString(Message::SearchInTarget, length, text);
 }
@@ -1975,6 +1999,10 @@ void ScintillaCall::UpperCase() {
 	Call(Message::UpperCase);
 }
 
+void ScintillaCall::TitleCase() {
+	Call(Message::TitleCase);
+}
+
 void ScintillaCall::LineScrollDown() {
 	Call(Message::LineScrollDown);
 }
@@ -3103,6 +3131,10 @@ void *ScintillaCall::CreateLoader(Position bytes, Scintilla::DocumentOption docu
 	return reinterpret_cast<void *>(Call(Message::CreateLoader, bytes, static_cast<intptr_t>(documentOptions)));
 }
 
+void *ScintillaCall::TakeTextSnapshot() {
+	return reinterpret_cast<void *>(Call(Message::TakeTextSnapshot));
+}
+
 void ScintillaCall::FindIndicatorShow(Position start, Position end) {
 	Call(Message::FindIndicatorShow, start, end);
 }
@@ -142,6 +142,7 @@ CellBuffer.o: \
 	../src/SparseVector.h \
 	../src/ChangeHistory.h \
 	../src/CellBuffer.h \
+	../src/PieceTable.h \
 	../src/UniConversion.h
 ChangeHistory.o: \
 	../src/ChangeHistory.cxx \
@@ -480,6 +481,9 @@ Style.o: \
 UniConversion.o: \
 	../src/UniConversion.cxx \
 	../src/UniConversion.h
+UniTranscode.o: \
+	../src/UniTranscode.cxx \
+	../src/UniTranscode.h
 UniqueString.o: \
 	../src/UniqueString.cxx \
 	../src/UniqueString.h
@@ -1,6 +1,6 @@
 // Scintilla source code edit control
 /** @file ILoader.h
- ** Interface for loading into a Scintilla document from a background thread.
+ ** Interfaces for loading into a Scintilla document and reading from it on background threads.
  **/
 // Copyright 1998-2017 by Neil Hodgson <neilh@scintilla.org>
 // The License.txt file describes the conditions under which this software may be distributed.
@@ -20,6 +20,14 @@ public:
 	virtual void * SCI_METHOD ConvertToDocument() = 0;
 };
 
+class ITextSnapshot {
+public:
+	virtual int SCI_METHOD Release() = 0;
+	virtual Sci_Position SCI_METHOD Length() const = 0;
+	// Returns false if the range is outside the snapshot or its text could not be kept
+	virtual bool SCI_METHOD GetCharRange(char *buffer, Sci_Position position, Sci_Position lengthRetrieve) const = 0;
+};
+
 }
 
 #endif
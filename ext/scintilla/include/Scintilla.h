@@ -509,6 +509,8 @@ typedef sptr_t (*SciFnDirectStatus)(sptr_t ptr, unsigned int iMessage, uptr_t wP
 #define SCI_SETMARGINRIGHT 2157
 #define SCI_GETMARGINRIGHT 2158
 #define SCI_GETMODIFY 2159
+#define SCI_GETUNSAVEDSTART 2782
+#define SCI_GETUNSAVEDEND 2783
 #define SCI_SETSEL 2160
 #define SCI_GETSELTEXT 2161
 #define SCI_GETTEXTRANGE 2162
@@ -558,6 +560,10 @@ typedef sptr_t (*SciFnDirectStatus)(sptr_t ptr, unsigned int iMessage, uptr_t wP
 #define SCI_REPLACETARGET 2194
 #define SCI_REPLACETARGETRE 2195
 #define SCI_REPLACETARGETMINIMAL 2779
+#define SCI_REPLACEALLINTARGET 2784
+#define SCI_TRIMTRAILINGWHITESPACEINTARGET 2785
+#define SCI_TABSTOSPACESINTARGET 2786
+#define SCI_SPACESTOTABSINTARGET 2787
 #define SCI_SEARCHINTARGET 2197
 #define SCI_SETSEARCHFLAGS 2198
 #define SCI_GETSEARCHFLAGS 2199
@@ -752,6 +758,7 @@ typedef sptr_t (*SciFnDirectStatus)(sptr_t ptr, unsigned int iMessage, uptr_t wP
 #define SCI_LINEDUPLICATE 2404
 #define SCI_LOWERCASE 2340
 #define SCI_UPPERCASE 2341
+#define SCI_TITLECASE 2788
 #define SCI_LINESCROLLDOWN 2342
 #define SCI_LINESCROLLUP 2343
 #define SCI_DELETEBACKNOTLINE 2344
@@ -805,7 +812,9 @@ typedef sptr_t (*SciFnDirectStatus)(sptr_t ptr, unsigned int iMessage, uptr_t wP
 #define SCI_GETZOOM 2374
 #define SC_DOCUMENTOPTION_DEFAULT 0
 #define SC_DOCUMENTOPTION_STYLES_NONE 0x1
+#define SC_DOCUMENTOPTION_STYLES_WINDOWED 0x2
 #define SC_DOCUMENTOPTION_TEXT_LARGE 0x100
+#define SC_DOCUMENTOPTION_TEXT_PIECES 0x200
 #define SCI_CREATEDOCUMENT 2375
 #define SCI_ADDREFDOCUMENT 2376
 #define SCI_RELEASEDOCUMENT 2377
@@ -1084,6 +1093,7 @@ typedef sptr_t (*SciFnDirectStatus)(sptr_t ptr, unsigned int iMessage, uptr_t wP
 #define SCI_SETTECHNOLOGY 2630
 #define SCI_GETTECHNOLOGY 2631
 #define SCI_CREATELOADER 2632
+#define SCI_TAKETEXTSNAPSHOT 2789
 #define SCI_FINDINDICATORSHOW 2640
 #define SCI_FINDINDICATORFLASH 2641
 #define SCI_FINDINDICATORHIDE 2642
@@ -1324,6 +1334,13 @@ struct Sci_TextToFindFull {
 	struct Sci_CharacterRangeFull chrgText;
 };
 
+struct Sci_TextToReplace {
+	const char *lpstrSearch;
+	Sci_Position searchLength;
+	const char *lpstrReplacement;
+	Sci_Position replacementLength;
+};
+
 typedef void *Sci_SurfaceID;
 
 struct Sci_Rectangle {
@@ -343,6 +343,8 @@ public:
 	void SetMarginRight(int pixelWidth);
 	int MarginRight();
 	bool Modify();
+	Position UnsavedStart();
+	Position UnsavedEnd();
 	void SetSel(Position anchor, Position caret);
 	Position GetSelText(char *text);
 	std::string GetSelText();
@@ -395,6 +397,10 @@ public:
 	Position ReplaceTarget(Position length, const char *text);
 	Position ReplaceTargetRE(Position length, const char *text);
 	Position ReplaceTargetMinimal(Position length, const char *text);
+	Position ReplaceAllInTarget(void *tr);
+	Line TrimTrailingWhitespaceInTarget();
+	Line TabsToSpacesInTarget(bool skipQuoted);
+	Line SpacesToTabsInTarget(bool skipQuoted);
 	Position SearchInTarget(Position length, const char *text);
 	void SetSearchFlags(Scintilla::FindOption searchFlags);
 	Scintilla::FindOption SearchFlags();
@@ -532,6 +538,7 @@ public:
 	void LineDuplicate();
 	void LowerCase();
 	void UpperCase();
+	void TitleCase();
 	void LineScrollDown();
 	void LineScrollUp();
 	void DeleteBackNotLine();
@@ -814,6 +821,7 @@ public:
 	void SetTechnology(Scintilla::Technology technology);
 	Scintilla::Technology Technology();
 	void *CreateLoader(Position bytes, Scintilla::DocumentOption documentOptions);
+	void *TakeTextSnapshot();
 	void FindIndicatorShow(Position start, Position end);
 	void FindIndicatorFlash(Position start, Position end);
 	void FindIndicatorHide();
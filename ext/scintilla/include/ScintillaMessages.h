@@ -275,6 +275,8 @@ enum class Message {
 	SetMarginRight = 2157,
 	GetMarginRight = 2158,
 	GetModify = 2159,
+	GetUnsavedStart = 2782,
+	GetUnsavedEnd = 2783,
 	SetSel = 2160,
 	GetSelText = 2161,
 	GetTextRange = 2162,
@@ -324,6 +326,10 @@ enum class Message {
 	ReplaceTarget = 2194,
 	ReplaceTargetRE = 2195,
 	ReplaceTargetMinimal = 2779,
+	ReplaceAllInTarget = 2784,
+	TrimTrailingWhitespaceInTarget = 2785,
+	TabsToSpacesInTarget = 2786,
+	SpacesToTabsInTarget = 2787,
 	SearchInTarget = 2197,
 	SetSearchFlags = 2198,
 	GetSearchFlags = 2199,
@@ -459,6 +465,7 @@ enum class Message {
 	LineDuplicate = 2404,
 	LowerCase = 2340,
 	UpperCase = 2341,
+	TitleCase = 2788,
 	LineScrollDown = 2342,
 	LineScrollUp = 2343,
 	DeleteBackNotLine = 2344,
@@ -732,6 +739,7 @@ enum class Message {
 	SetTechnology = 2630,
 	GetTechnology = 2631,
 	CreateLoader = 2632,
+	TakeTextSnapshot = 2789,
 	FindIndicatorShow = 2640,
 	FindIndicatorFlash = 2641,
 	FindIndicatorHide = 2642,
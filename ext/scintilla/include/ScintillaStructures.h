@@ -46,6 +46,13 @@ struct TextToFindFull {
 	CharacterRangeFull chrgText;
 };
 
+struct TextToReplace {
+	const char *lpstrSearch;
+	Position searchLength;
+	const char *lpstrReplacement;
+	Position replacementLength;
+};
+
 using SurfaceID = void *;
 
 struct Rectangle {
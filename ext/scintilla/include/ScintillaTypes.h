@@ -403,7 +403,9 @@ enum class PopUp {
 enum class DocumentOption {
 	Default = 0,
 	StylesNone = 0x1,
+	StylesWindowed = 0x2,
 	TextLarge = 0x100,
+	TextPieces = 0x200,
 };
 
 enum class Status {
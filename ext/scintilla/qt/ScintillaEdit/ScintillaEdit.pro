@@ -24,6 +24,7 @@ SOURCES += \
     ../../src/XPM.cxx \
     ../../src/ViewStyle.cxx \
     ../../src/UniqueString.cxx \
+    ../../src/UniTranscode.cxx \
     ../../src/UniConversion.cxx \
     ../../src/Style.cxx \
     ../../src/Selection.cxx \
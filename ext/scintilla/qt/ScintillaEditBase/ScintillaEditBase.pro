@@ -21,6 +21,7 @@ SOURCES += \
     ../../src/XPM.cxx \
     ../../src/ViewStyle.cxx \
     ../../src/UniqueString.cxx \
+    ../../src/UniTranscode.cxx \
     ../../src/UniConversion.cxx \
     ../../src/Style.cxx \
     ../../src/Selection.cxx \
@@ -57,6 +58,7 @@ HEADERS  += \
     ScintillaEditBase.h \
     ../../src/XPM.h \
     ../../src/ViewStyle.h \
+    ../../src/UniTranscode.h \
     ../../src/UniConversion.h \
     ../../src/Style.h \
     ../../src/SplitVector.h \
@@ -66,6 +68,7 @@ HEADERS  += \
     ../../src/RESearch.h \
     ../../src/PositionCache.h \
     ../../src/Platform.h \
+    ../../src/PieceTable.h \
     ../../src/PerLine.h \
     ../../src/Partitioning.h \
     ../../src/LineMarker.h \
@@ -65,6 +65,8 @@ def convertIFaceTypeToC(t):
 		return "Sci_TextRangeFull *"
 	elif t == "findtextfull":
 		return "Sci_TextToFindFull *"
+	elif t == "texttoreplace":
+		return "Sci_TextToReplace *"
 	elif t == "formatrangefull":
 		return "Sci_RangeToFormatFull *"
 	elif Face.IsEnumeration(t):
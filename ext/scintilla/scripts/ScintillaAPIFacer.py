@@ -31,6 +31,7 @@ typeAliases = {
 	"stringresult": "char *",
 	"textrange": "void *",
 	"textrangefull": "void *",
+	"texttoreplace": "void *",
 }
 
 basicTypes = [
@@ -17,8 +17,10 @@
 #include <string_view>
 #include <vector>
 #include <optional>
+#include <functional>
 #include <algorithm>
 #include <memory>
+#include <mutex>
 
 #include "ScintillaTypes.h"
 
@@ -31,6 +33,7 @@
 #include "SparseVector.h"
 #include "ChangeHistory.h"
 #include "CellBuffer.h"
+#include "PieceTable.h"
 #include "UniConversion.h"
 
 namespace Scintilla::Internal {
@@ -87,6 +90,20 @@ public:
 	virtual ~ILineVector() {}
 };
 
+struct SnapshotText {
+	std::mutex mutex;
+	/// The buffer while it is unchanged, then nullptr with the text in pieces or a copy
+	const CellBuffer *live;
+	/// Start of each piece followed by the length of the text, the text of each piece and
+	/// the allocations of the piece table that hold the pieces
+	std::vector<Sci::Position> starts;
+	std::vector<const char *> texts;
+	std::vector<std::shared_ptr<const char[]>> holders;
+	bool lost = false;
+	explicit SnapshotText(const CellBuffer *live_) noexcept : live(live_) {
+	}
+};
+
 }
 
 using namespace Scintilla;
@@ -333,9 +350,10 @@ Action::Action() noexcept {
 	position = 0;
 	lenData = 0;
 	mayCoalesce = false;
+	keepsLines = false;
 }
 
-void Action::Create(ActionType at_, Sci::Position position_, const char *data_, Sci::Position lenData_, bool mayCoalesce_) {
+void Action::Create(ActionType at_, Sci::Position position_, const char *data_, Sci::Position lenData_, bool mayCoalesce_, bool keepsLines_) {
 	data = nullptr;
 	position = position_;
 	at = at_;
@@ -345,6 +363,7 @@ void Action::Create(ActionType at_, Sci::Position position_, const char *data_,
 	}
 	lenData = lenData_;
 	mayCoalesce = mayCoalesce_;
+	keepsLines = keepsLines_;
 }
 
 void Action::Clear() noexcept {
@@ -392,7 +411,7 @@ void UndoHistory::EnsureUndoRoom() {
 }
 
 const char *UndoHistory::AppendAction(ActionType at, Sci::Position position, const char *data, Sci::Position lengthData,
-	bool &startSequence, bool mayCoalesce) {
+	bool &startSequence, bool mayCoalesce, bool keepsLines) {
 	EnsureUndoRoom();
 	//Platform::DebugPrintf("%% %d action %d %d %d\n", at, position, lengthData, currentAction);
 	//Platform::DebugPrintf("^ %d action %d %d\n", actions[currentAction - 1].at,
@@ -461,7 +480,7 @@ const char *UndoHistory::AppendAction(ActionType at, Sci::Position position, con
 	}
 	startSequence = oldCurrentAction != currentAction;
 	const int actionWithData = currentAction;
-	actions[currentAction].Create(at, position, data, lengthData, mayCoalesce);
+	actions[currentAction].Create(at, position, data, lengthData, mayCoalesce, keepsLines);
 	currentAction++;
 	actions[currentAction].Create(ActionType::start);
 	maxAction = currentAction;
@@ -608,26 +627,67 @@ void UndoHistory::CompletedRedoStep() {
 	currentAction++;
 }
 
-CellBuffer::CellBuffer(bool hasStyles_, bool largeDocument_) :
-	hasStyles(hasStyles_), largeDocument(largeDocument_) {
+TextSnapshot::TextSnapshot(std::shared_ptr<SnapshotText> text_, Sci::Position length_) noexcept :
+	text(std::move(text_)), length(length_) {
+}
+
+Sci::Position TextSnapshot::Length() const noexcept {
+	return length;
+}
+
+bool TextSnapshot::GetCharRange(char *buffer, Sci::Position position, Sci::Position lengthRetrieve) const {
+	if (!text || (position < 0) || (lengthRetrieve < 0) || ((position + lengthRetrieve) > length))
+		return false;
+	std::lock_guard<std::mutex> guard(text->mutex);
+	if (text->live) {
+		text->live->GetCharRange(buffer, position, lengthRetrieve);
+		return true;
+	}
+	if (text->lost)
+		return false;
+	if (lengthRetrieve == 0)
+		return true;
+	const std::vector<Sci::Position> &starts = text->starts;
+	size_t piece = static_cast<size_t>(std::upper_bound(starts.begin(), starts.end(), position) - starts.begin() - 1);
+	while (lengthRetrieve > 0) {
+		const Sci::Position offset = position - starts[piece];
+		const Sci::Position lengthCopy = std::min(starts[piece + 1] - position, lengthRetrieve);
+		const char *pieceText = text->texts[piece] + offset;
+		std::copy(pieceText, pieceText + lengthCopy, buffer);
+		buffer += lengthCopy;
+		position += lengthCopy;
+		lengthRetrieve -= lengthCopy;
+		piece++;
+	}
+	return true;
+}
+
+CellBuffer::CellBuffer(bool hasStyles_, bool largeDocument_, bool windowedStyles_, bool pieceTable_) :
+	hasStyles(hasStyles_), largeDocument(largeDocument_), windowedStyles(hasStyles_ && windowedStyles_), styleStart(0),
+	unsavedStart(0), unsavedSuffix(0) {
 	readOnly = false;
 	utf8Substance = false;
 	utf8LineEnds = LineEndType::Default;
 	collectingUndo = true;
+	perLine = nullptr;
 	if (largeDocument)
 		plv = std::make_unique<LineVector<Sci::Position>>();
 	else
 		plv = std::make_unique<LineVector<int>>();
+	if (pieceTable_)
+		pieces = std::make_unique<PieceTable>();
 }
 
-CellBuffer::~CellBuffer() noexcept = default;
+CellBuffer::~CellBuffer() noexcept {
+	DetachSnapshot();
+}
 
 char CellBuffer::CharAt(Sci::Position position) const noexcept {
-	return substance.ValueAt(position);
+	return pieces ? pieces->ValueAt(position) : substance.ValueAt(position);
 }
 
 unsigned char CellBuffer::UCharAt(Sci::Position position) const noexcept {
-	return substance.ValueAt(position);
+	return CharAt(position);
 }
 
 void CellBuffer::GetCharRange(char *buffer, Sci::Position position, Sci::Position lengthRetrieve) const {
@@ -635,18 +695,21 @@ void CellBuffer::GetCharRange(char *buffer, Sci::Position position, Sci::Positio
 		return;
 	if (position < 0)
 		return;
-	if ((position + lengthRetrieve) > substance.Length()) {
+	if ((position + lengthRetrieve) > Length()) {
 		Platform::DebugPrintf("Bad GetCharRange %.0f for %.0f of %.0f\n",
 				      static_cast<double>(position),
 				      static_cast<double>(lengthRetrieve),
-				      static_cast<double>(substance.Length()));
+				      static_cast<double>(Length()));
 		return;
 	}
-	substance.GetRange(buffer, position, lengthRetrieve);
+	if (pieces)
+		pieces->GetRange(buffer, position, lengthRetrieve);
+	else
+		substance.GetRange(buffer, position, lengthRetrieve);
 }
 
 char CellBuffer::StyleAt(Sci::Position position) const noexcept {
-	return hasStyles ? style.ValueAt(position) : 0;
+	return hasStyles ? style.ValueAt(position - styleStart) : 0;
 }
 
 void CellBuffer::GetStyleRange(unsigned char *buffer, Sci::Position position, Sci::Position lengthRetrieve) const {
@@ -658,29 +721,103 @@ void CellBuffer::GetStyleRange(unsigned char *buffer, Sci::Position position, Sc
 		std::fill(buffer, buffer + lengthRetrieve, static_cast<unsigned char>(0));
 		return;
 	}
-	if ((position + lengthRetrieve) > style.Length()) {
+	if ((position + lengthRetrieve) > Length()) {
 		Platform::DebugPrintf("Bad GetStyleRange %.0f for %.0f of %.0f\n",
 				      static_cast<double>(position),
 				      static_cast<double>(lengthRetrieve),
-				      static_cast<double>(style.Length()));
+				      static_cast<double>(Length()));
+		return;
+	}
+	if (windowedStyles) {
+		// Positions outside the window are style 0
+		const Sci::Position end = position + lengthRetrieve;
+		const Sci::Position overlapStart = std::clamp(styleStart, position, end);
+		const Sci::Position overlapEnd = std::clamp(StyleWindowEnd(), overlapStart, end);
+		std::fill(buffer, buffer + (overlapStart - position), static_cast<unsigned char>(0));
+		style.GetRange(reinterpret_cast<char *>(buffer + (overlapStart - position)),
+			overlapStart - styleStart, overlapEnd - overlapStart);
+		std::fill(buffer + (overlapEnd - position), buffer + lengthRetrieve, static_cast<unsigned char>(0));
 		return;
 	}
 	style.GetRange(reinterpret_cast<char *>(buffer), position, lengthRetrieve);
 }
 
 const char *CellBuffer::BufferPointer() {
-	return substance.BufferPointer();
+	DetachSnapshot();
+	return pieces ? pieces->BufferPointer() : substance.BufferPointer();
 }
 
-const char *CellBuffer::RangePointer(Sci::Position position, Sci::Position rangeLength) noexcept {
+const char *CellBuffer::RangePointer(Sci::Position position, Sci::Position rangeLength) {
+	if (pieces) {
+		if (!pieces->IsContiguous(position, rangeLength)) {
+			// The pieces will be copied together
+			DetachSnapshot();
+		}
+		return pieces->RangePointer(position, rangeLength);
+	}
+	if ((position < substance.GapPosition()) && ((position + rangeLength) > substance.GapPosition())) {
+		// The gap will move
+		DetachSnapshot();
+	}
 	return substance.RangePointer(position, rangeLength);
 }
 
 Sci::Position CellBuffer::GapPosition() const noexcept {
-	return substance.GapPosition();
+	return pieces ? pieces->GapPosition() : substance.GapPosition();
 }
 
-SplitView CellBuffer::AllView() const noexcept {
+TextSnapshot CellBuffer::TakeSnapshot() {
+	if (!snapshot) {
+		snapshot = std::make_shared<SnapshotText>(this);
+	}
+	return TextSnapshot(snapshot, Length());
+}
+
+void CellBuffer::DetachSnapshot() noexcept {
+	if (!snapshot)
+		return;
+	// Only this thread creates snapshots so a count of 1 can not grow again
+	std::shared_ptr<std::vector<char>> copy;
+	if (!pieces && (snapshot.use_count() > 1)) {
+		// A gap buffer stays a gap buffer and its text is copied for the snapshots.
+		// The readers only read the buffer too so the copy does not block them.
+		try {
+			copy = std::make_shared<std::vector<char>>(substance.Length());
+			substance.GetRange(copy->data(), 0, substance.Length());
+		} catch (...) {
+			copy.reset();
+		}
+	}
+	{
+		// Taking the lock also waits for readers still in GetCharRange
+		std::lock_guard<std::mutex> guard(snapshot->mutex);
+		if (snapshot.use_count() > 1) {
+			try {
+				if (pieces) {
+					pieces->Share(snapshot->starts, snapshot->texts, snapshot->holders);
+				} else if (copy) {
+					snapshot->starts = { 0, static_cast<Sci::Position>(copy->size()) };
+					snapshot->texts = { copy->data() };
+					snapshot->holders = { std::shared_ptr<const char[]>(copy, copy->data()) };
+				} else {
+					snapshot->lost = true;
+				}
+			} catch (...) {
+				snapshot->lost = true;
+			}
+		}
+		snapshot->live = nullptr;
+	}
+	snapshot.reset();
+}
+
+SplitView CellBuffer::AllView() {
+	if (pieces) {
+		if (pieces->Pieces() > 2) {
+			DetachSnapshot();
+		}
+		return pieces->AllView();
+	}
 	const size_t length = substance.Length();
 	size_t length1 = substance.GapPosition();
 	if (length1 == 0) {
@@ -696,17 +833,20 @@ SplitView CellBuffer::AllView() const noexcept {
 }
 
 // The char* returned is to an allocation owned by the undo history
-const char *CellBuffer::InsertString(Sci::Position position, const char *s, Sci::Position insertLength, bool &startSequence) {
+const char *CellBuffer::InsertString(Sci::Position position, const char *s, Sci::Position insertLength, bool &startSequence, bool keepLines) {
 	// InsertString and DeleteChars are the bottleneck though which all changes occur
 	const char *data = s;
 	if (!readOnly) {
 		if (collectingUndo) {
 			// Save into the undo/redo stack, but only the characters - not the formatting
 			// This takes up about half load time
-			data = uh.AppendAction(ActionType::insert, position, s, insertLength, startSequence);
+			data = uh.AppendAction(ActionType::insert, position, s, insertLength, startSequence, true, keepLines);
 		}
 
 		BasicInsertString(position, s, insertLength);
+		if (keepLines) {
+			plv->SetPerLine(perLine);
+		}
 		if (changeHistory) {
 			changeHistory->Insert(position, insertLength, collectingUndo, uh.BeforeReachableSavePoint());
 		}
@@ -718,9 +858,13 @@ bool CellBuffer::SetStyleAt(Sci::Position position, char styleValue) noexcept {
 	if (!hasStyles) {
 		return false;
 	}
-	const char curVal = style.ValueAt(position);
+	const Sci::Position index = position - styleStart;
+	if ((index < 0) || (index >= style.Length())) {
+		return false;
+	}
+	const char curVal = style.ValueAt(index);
 	if (curVal != styleValue) {
-		style.SetValueAt(position, styleValue);
+		style.SetValueAt(index, styleValue);
 		return true;
 	} else {
 		return false;
@@ -731,22 +875,98 @@ bool CellBuffer::SetStyleFor(Sci::Position position, Sci::Position lengthStyle,
 	if (!hasStyles) {
 		return false;
 	}
+	if (windowedStyles) {
+		ClipToStyleWindow(position, lengthStyle);
+	}
 	bool changed = false;
+	position -= styleStart;
 	PLATFORM_ASSERT(lengthStyle == 0 ||
 		(lengthStyle > 0 && lengthStyle + position <= style.Length()));
-	while (lengthStyle--) {
-		const char curVal = style.ValueAt(position);
-		if (curVal != styleValue) {
-			style.SetValueAt(position, styleValue);
+	while (lengthStyle > 0) {
+		// Work on spans that do not cross the gap so the compare and fill are on contiguous memory
+		const Sci::Position gap = style.GapPosition();
+		const Sci::Position lengthSpan = (position < gap) ? std::min(lengthStyle, gap - position) : lengthStyle;
+		char *span = style.RangePointer(position, lengthSpan);
+		char *spanEnd = span + lengthSpan;
+		char *changeStart = std::find_if(span, spanEnd, [styleValue](char ch) noexcept {
+			return ch != styleValue;
+		});
+		if (changeStart != spanEnd) {
+			std::fill(changeStart, spanEnd, styleValue);
 			changed = true;
 		}
-		position++;
+		position += lengthSpan;
+		lengthStyle -= lengthSpan;
+	}
+	return changed;
+}
+
+namespace {
+
+// Blocks are compared with memcmp, which is vectorised by the C runtime, and
+// only differing blocks are examined byte by byte.
+constexpr size_t compareBlock = 64;
+
+size_t FirstDifference(const char *a, const char *b, size_t length) noexcept {
+	size_t i = 0;
+	while ((i + compareBlock <= length) && (memcmp(a + i, b + i, compareBlock) == 0)) {
+		i += compareBlock;
+	}
+	while ((i < length) && (a[i] == b[i])) {
+		i++;
+	}
+	return i;
+}
+
+// Returns one past the last differing position or 0 when identical.
+size_t EndDifference(const char *a, const char *b, size_t length) noexcept {
+	size_t i = length;
+	while ((i >= compareBlock) && (memcmp(a + i - compareBlock, b + i - compareBlock, compareBlock) == 0)) {
+		i -= compareBlock;
+	}
+	while ((i > 0) && (a[i - 1] == b[i - 1])) {
+		i--;
+	}
+	return i;
+}
+
+}
+
+bool CellBuffer::SetStyles(Sci::Position position, Sci::Position lengthStyle, const char *styles,
+	Sci::Position &startChanged, Sci::Position &endChanged) noexcept {
+	if (!hasStyles) {
+		return false;
+	}
+	if (windowedStyles) {
+		styles += ClipToStyleWindow(position, lengthStyle);
+	}
+	bool changed = false;
+	position -= styleStart;
+	PLATFORM_ASSERT(lengthStyle == 0 ||
+		(lengthStyle > 0 && lengthStyle + position <= style.Length()));
+	while (lengthStyle > 0) {
+		const Sci::Position gap = style.GapPosition();
+		const Sci::Position lengthSpan = (position < gap) ? std::min(lengthStyle, gap - position) : lengthStyle;
+		char *span = style.RangePointer(position, lengthSpan);
+		const size_t first = FirstDifference(span, styles, lengthSpan);
+		if (first < static_cast<size_t>(lengthSpan)) {
+			const size_t end = first + EndDifference(span + first, styles + first, lengthSpan - first);
+			memcpy(span + first, styles + first, end - first);
+			if (!changed) {
+				startChanged = styleStart + position + first;
+			}
+			endChanged = styleStart + position + end;
+			changed = true;
+		}
+		position += lengthSpan;
+		styles += lengthSpan;
+		lengthStyle -= lengthSpan;
 	}
 	return changed;
 }
 
 // The char* returned is to an allocation owned by the undo history
-const char *CellBuffer::DeleteChars(Sci::Position position, Sci::Position deleteLength, bool &startSequence) {
+const char *CellBuffer::DeleteChars(Sci::Position position, Sci::Position deleteLength, bool &startSequence, bool keepLines) {
 	// InsertString and DeleteChars are the bottleneck though which all changes occur
 	PLATFORM_ASSERT(deleteLength > 0);
 	const char *data = nullptr;
@@ -754,8 +974,16 @@ const char *CellBuffer::DeleteChars(Sci::Position position, Sci::Position delete
 		if (collectingUndo) {
 			// Save into the undo/redo stack, but only the characters - not the formatting
 			// The gap would be moved to position anyway for the deletion so this doesn't cost extra
-			data = substance.RangePointer(position, deleteLength);
-			data = uh.AppendAction(ActionType::remove, position, data, deleteLength, startSequence);
+			if (pieces) {
+				// Copying avoids joining the pieces, which would also copy
+				std::string removed(deleteLength, '\0');
+				pieces->GetRange(removed.data(), position, deleteLength);
+				data = uh.AppendAction(ActionType::remove, position, removed.data(), deleteLength, startSequence, true, keepLines);
+			} else {
+				DetachSnapshot();
+				data = substance.RangePointer(position, deleteLength);
+				data = uh.AppendAction(ActionType::remove, position, data, deleteLength, startSequence, true, keepLines);
+			}
 		}
 
 		if (changeHistory) {
@@ -763,18 +991,25 @@ const char *CellBuffer::DeleteChars(Sci::Position position, Sci::Position delete
 				uh.BeforeReachableSavePoint(), uh.AfterDetachPoint());
 		}
 
+		if (keepLines) {
+			plv->SetPerLine(nullptr);
+		}
 		BasicDeleteChars(position, deleteLength);
 	}
 	return data;
 }
 
 Sci::Position CellBuffer::Length() const noexcept {
-	return substance.Length();
+	return pieces ? pieces->Length() : substance.Length();
 }
 
 void CellBuffer::Allocate(Sci::Position newSize) {
-	substance.ReAllocate(newSize);
-	if (hasStyles) {
+	DetachSnapshot();
+	if (pieces)
+		pieces->ReAllocate(newSize);
+	else
+		substance.ReAllocate(newSize);
+	if (hasStyles && !windowedStyles) {
 		style.ReAllocate(newSize);
 	}
 }
@@ -811,6 +1046,7 @@ bool CellBuffer::ContainsLineEnd(const char *s, Sci::Position length) const noex
 }
 
 void CellBuffer::SetPerLine(PerLine *pl) noexcept {
+	perLine = pl;
 	plv->SetPerLine(pl);
 }
 
@@ -876,17 +1112,89 @@ bool CellBuffer::HasStyles() const noexcept {
 	return hasStyles;
 }
 
+bool CellBuffer::WindowedStyles() const noexcept {
+	return windowedStyles;
+}
+
+bool CellBuffer::UsesPieceTable() const noexcept {
+	return static_cast<bool>(pieces);
+}
+
+bool CellBuffer::AdoptText(std::shared_ptr<const char[]> text, Sci::Position textLength) {
+	if (!pieces || (Length() != 0) || (textLength <= 0))
+		return false;
+	const char *s = text.get();
+	pieces->SetOriginal(std::move(text), textLength);
+	// The piece table references the text instead of copying it
+	BasicInsertString(0, s, textLength);
+	return true;
+}
+
+Sci::Position CellBuffer::StyleWindowStart() const noexcept {
+	return styleStart;
+}
+
+Sci::Position CellBuffer::StyleWindowEnd() const noexcept {
+	return styleStart + style.Length();
+}
+
+void CellBuffer::SetStyleWindow(Sci::Position start, Sci::Position end) {
+	if (!windowedStyles) {
+		return;
+	}
+	start = std::clamp<Sci::Position>(start, 0, Length());
+	end = std::clamp<Sci::Position>(end, start, Length());
+	const Sci::Position styleEnd = StyleWindowEnd();
+	if ((end <= styleStart) || (start >= styleEnd)) {
+		style.DeleteAll();
+		style.InsertValue(0, end - start, 0);
+	} else {
+		// Trim or extend each side so the overlap keeps its styles
+		if (end < styleEnd) {
+			style.DeleteRange(end - styleStart, styleEnd - end);
+		} else if (end > styleEnd) {
+			style.InsertValue(style.Length(), end - styleEnd, 0);
+		}
+		if (start > styleStart) {
+			style.DeleteRange(0, start - styleStart);
+		} else if (start < styleStart) {
+			style.InsertValue(0, styleStart - start, 0);
+		}
+	}
+	styleStart = start;
+}
+
+// Clip a styling range to the window and return how many leading positions were dropped.
+Sci::Position CellBuffer::ClipToStyleWindow(Sci::Position &position, Sci::Position &lengthStyle) const noexcept {
+	const Sci::Position start = std::max(position, styleStart);
+	const Sci::Position end = std::min(position + lengthStyle, StyleWindowEnd());
+	const Sci::Position skipped = start - position;
+	position = start;
+	lengthStyle = std::max<Sci::Position>(end - start, 0);
+	return skipped;
+}
+
 void CellBuffer::SetSavePoint() {
 	uh.SetSavePoint();
 	if (changeHistory) {
 		changeHistory->SetSavePoint();
 	}
+	unsavedStart = Length();
+	unsavedSuffix = Length();
 }
 
 bool CellBuffer::IsSavePoint() const noexcept {
 	return uh.IsSavePoint();
 }
 
+Sci::Position CellBuffer::UnsavedStart() const noexcept {
+	return unsavedStart;
+}
+
+Sci::Position CellBuffer::UnsavedEnd() const noexcept {
+	return std::max(unsavedStart, Length() - unsavedSuffix);
+}
+
 void CellBuffer::TentativeStart() {
 	uh.TentativeStart();
 }
@@ -915,10 +1223,10 @@ void CellBuffer::RemoveLine(Sci::Line line) {
 
 bool CellBuffer::UTF8LineEndOverlaps(Sci::Position position) const noexcept {
 	const unsigned char bytes[] = {
-		static_cast<unsigned char>(substance.ValueAt(position-2)),
-		static_cast<unsigned char>(substance.ValueAt(position-1)),
-		static_cast<unsigned char>(substance.ValueAt(position)),
-		static_cast<unsigned char>(substance.ValueAt(position+1)),
+		static_cast<unsigned char>(CharAt(position-2)),
+		static_cast<unsigned char>(CharAt(position-1)),
+		static_cast<unsigned char>(CharAt(position)),
+		static_cast<unsigned char>(CharAt(position+1)),
 	};
 	return UTF8IsSeparator(bytes) || UTF8IsSeparator(bytes+1) || UTF8IsNEL(bytes+1);
 }
@@ -932,7 +1240,7 @@ bool CellBuffer::UTF8IsCharacterBoundary(Sci::Position position) const {
 			if (posBack < 0) {
 				return false;
 			}
-			back.insert(0, 1, substance.ValueAt(posBack));
+			back.insert(0, 1, CharAt(posBack));
 			if (!UTF8IsTrailByte(back.front())) {
 				if (i > 0) {
 					// Have reached a non-trail
@@ -946,7 +1254,7 @@ bool CellBuffer::UTF8IsCharacterBoundary(Sci::Position position) const {
 		}
 	}
 	if (position < Length()) {
-		const unsigned char fore = substance.ValueAt(position);
+		const unsigned char fore = CharAt(position);
 		if (UTF8IsTrailByte(fore)) {
 			return false;
 		}
@@ -968,7 +1276,7 @@ void CellBuffer::ResetLineEnds() {
 	unsigned char chBeforePrev = 0;
 	unsigned char chPrev = 0;
 	for (Sci::Position i = 0; i < length; i++) {
-		const unsigned char ch = substance.ValueAt(position + i);
+		const unsigned char ch = CharAt(position + i);
 		if (ch == '\r') {
 			InsertLine(lineInsert, (position + i) + 1, atLineStart);
 			lineInsert++;
@@ -1031,8 +1339,9 @@ void CellBuffer::BasicInsertString(Sci::Position position, const char *s, Sci::P
 	if (insertLength == 0)
 		return;
 	PLATFORM_ASSERT(insertLength > 0);
+	DetachSnapshot();
 
-	const unsigned char chAfter = substance.ValueAt(position);
+	const unsigned char chAfter = CharAt(position);
 	bool breakingUTF8LineEnd = false;
 	if (utf8LineEnds == LineEndType::Unicode && UTF8IsTrailByte(chAfter)) {
 		breakingUTF8LineEnd = UTF8LineEndOverlaps(position);
@@ -1054,16 +1363,27 @@ void CellBuffer::BasicInsertString(Sci::Position position, const char *s, Sci::P
 			UTF8IsValid(std::string_view(s, insertLength));
 	}
 
-	substance.InsertFromArray(position, s, 0, insertLength);
+	if (pieces)
+		pieces->InsertFromArray(position, s, 0, insertLength);
+	else
+		substance.InsertFromArray(position, s, 0, insertLength);
+	unsavedStart = std::min(unsavedStart, position);
+	unsavedSuffix = std::min(unsavedSuffix, Length() - (position + insertLength));
 	if (hasStyles) {
-		style.InsertValue(position, insertLength, 0);
+		const Sci::Position styleEnd = StyleWindowEnd();
+		if (position < styleStart) {
+			styleStart += insertLength;
+		} else if ((position < styleEnd) || ((position == styleEnd) && (styleStart < styleEnd || !windowedStyles))) {
+			// An empty window does not grow so loading text into a windowed buffer allocates no styles
+			style.InsertValue(position - styleStart, insertLength, 0);
+		}
 	}
 
 	const bool atLineStart = plv->LineStart(lineInsert-1) == position;
 	// Point all the lines after the insertion point further along in the buffer
 	plv->InsertText(lineInsert-1, insertLength);
-	unsigned char chBeforePrev = substance.ValueAt(position - 2);
-	unsigned char chPrev = substance.ValueAt(position - 1);
+	unsigned char chBeforePrev = CharAt(position - 2);
+	unsigned char chPrev = CharAt(position - 1);
 	if (chPrev == '\r' && chAfter == '\n') {
 		// Splitting up a crlf pair at position
 		InsertLine(lineInsert, position, false);
@@ -1174,7 +1494,7 @@ void CellBuffer::BasicInsertString(Sci::Position position, const char *s, Sci::P
 		chPrev = ch;
 		// May have end of UTF-8 line end in buffer and start in insertion
 		for (int j = 0; j < UTF8SeparatorLength-1; j++) {
-			const unsigned char chAt = substance.ValueAt(position + insertLength + j);
+			const unsigned char chAt = CharAt(position + insertLength + j);
 			const unsigned char back3[3] = {chBeforePrev, chPrev, chAt};
 			if (UTF8IsSeparator(back3)) {
 				InsertLine(lineInsert, (position + insertLength + j) + 1, atLineStart);
@@ -1201,10 +1521,11 @@ void CellBuffer::BasicInsertString(Sci::Position position, const char *s, Sci::P
 void CellBuffer::BasicDeleteChars(Sci::Position position, Sci::Position deleteLength) {
 	if (deleteLength == 0)
 		return;
+	DetachSnapshot();
 
 	Sci::Line lineRecalculateStart = Sci::invalidPosition;
 
-	if ((position == 0) && (deleteLength == substance.Length())) {
+	if ((position == 0) && (deleteLength == Length())) {
 		// If whole buffer is being deleted, faster to reinitialise lines data
 		// than to delete each line.
 		plv->Init();
@@ -1216,9 +1537,9 @@ void CellBuffer::BasicDeleteChars(Sci::Position position, Sci::Position deleteLe
 		Sci::Line lineRemove = linePosition + 1;
 
 		plv->InsertText(lineRemove-1, - (deleteLength));
-		const unsigned char chPrev = substance.ValueAt(position - 1);
+		const unsigned char chPrev = CharAt(position - 1);
 		const unsigned char chBefore = chPrev;
-		unsigned char chNext = substance.ValueAt(position);
+		unsigned char chNext = CharAt(position);
 
 		// Check for breaking apart a UTF-8 sequence
 		// Needs further checks that text is UTF-8 or that some other break apart is occurring
@@ -1258,7 +1579,7 @@ void CellBuffer::BasicDeleteChars(Sci::Position position, Sci::Position deleteLe
 
 		unsigned char ch = chNext;
 		for (Sci::Position i = 0; i < deleteLength; i++) {
-			chNext = substance.ValueAt(position + i + 1);
+			chNext = CharAt(position + i + 1);
 			if (ch == '\r') {
 				if (chNext != '\n') {
 					RemoveLine(lineRemove);
@@ -1272,7 +1593,7 @@ void CellBuffer::BasicDeleteChars(Sci::Position position, Sci::Position deleteLe
 			} else if (utf8LineEnds == LineEndType::Unicode) {
 				if (!UTF8IsAscii(ch)) {
 					const unsigned char next3[3] = {ch, chNext,
-						static_cast<unsigned char>(substance.ValueAt(position + i + 2))};
+						static_cast<unsigned char>(CharAt(position + i + 2))};
 					if (UTF8IsSeparator(next3) || UTF8IsNEL(next3)) {
 						RemoveLine(lineRemove);
 					}
@@ -1283,19 +1604,31 @@ void CellBuffer::BasicDeleteChars(Sci::Position position, Sci::Position deleteLe
 		}
 		// May have to fix up end if last deletion causes cr to be next to lf
 		// or removes one of a crlf pair
-		const char chAfter = substance.ValueAt(position + deleteLength);
+		const char chAfter = CharAt(position + deleteLength);
 		if (chBefore == '\r' && chAfter == '\n') {
 			// Using lineRemove-1 as cr ended line before start of deletion
 			RemoveLine(lineRemove - 1);
 			plv->SetLineStart(lineRemove - 1, position + 1);
 		}
 	}
-	substance.DeleteRange(position, deleteLength);
+	if (pieces)
+		pieces->DeleteRange(position, deleteLength);
+	else
+		substance.DeleteRange(position, deleteLength);
+	unsavedStart = std::min(unsavedStart, position);
+	unsavedSuffix = std::min(unsavedSuffix, Length() - position);
 	if (lineRecalculateStart >= 0) {
 		RecalculateIndexLineStarts(lineRecalculateStart, lineRecalculateStart);
 	}
 	if (hasStyles) {
-		style.DeleteRange(position, deleteLength);
+		const Sci::Position overlapStart = std::max(position, styleStart);
+		const Sci::Position overlapEnd = std::min(position + deleteLength, StyleWindowEnd());
+		if (overlapEnd > overlapStart) {
+			style.DeleteRange(overlapStart - styleStart, overlapEnd - overlapStart);
+		}
+		if (position < styleStart) {
+			styleStart -= std::min(deleteLength, styleStart - position);
+		}
 	}
 }
 
@@ -1344,7 +1677,7 @@ void CellBuffer::PerformUndoStep() {
 		changeHistory->StartReversion();
 	}
 	if (actionStep.at == ActionType::insert) {
-		if (substance.Length() < actionStep.lenData) {
+		if (Length() < actionStep.lenData) {
 			throw std::runtime_error(
 				"CellBuffer::PerformUndoStep: deletion must be less than document length.");
 		}
@@ -1352,9 +1685,15 @@ void CellBuffer::PerformUndoStep() {
 			changeHistory->DeleteRange(actionStep.position, actionStep.lenData,
 				uh.BeforeSavePoint() && !uh.AfterDetachPoint());
 		}
+		if (actionStep.keepsLines) {
+			plv->SetPerLine(nullptr);
+		}
 		BasicDeleteChars(actionStep.position, actionStep.lenData);
 	} else if (actionStep.at == ActionType::remove) {
 		BasicInsertString(actionStep.position, actionStep.data.get(), actionStep.lenData);
+		if (actionStep.keepsLines) {
+			plv->SetPerLine(perLine);
+		}
 		if (changeHistory) {
 			changeHistory->UndoDeleteStep(actionStep.position, actionStep.lenData, uh.AfterDetachPoint());
 		}
@@ -1378,6 +1717,9 @@ void CellBuffer::PerformRedoStep() {
 	const Action &actionStep = uh.GetRedoStep();
 	if (actionStep.at == ActionType::insert) {
 		BasicInsertString(actionStep.position, actionStep.data.get(), actionStep.lenData);
+		if (actionStep.keepsLines) {
+			plv->SetPerLine(perLine);
+		}
 		if (changeHistory) {
 			changeHistory->Insert(actionStep.position, actionStep.lenData, collectingUndo,
 				uh.BeforeSavePoint() && !uh.AfterDetachPoint());
@@ -1387,6 +1729,9 @@ void CellBuffer::PerformRedoStep() {
 			changeHistory->DeleteRangeSavingHistory(actionStep.position, actionStep.lenData,
 				uh.BeforeReachableSavePoint(), uh.AfterDetachPoint());
 		}
+		if (actionStep.keepsLines) {
+			plv->SetPerLine(nullptr);
+		}
 		BasicDeleteChars(actionStep.position, actionStep.lenData);
 	}
 	if (changeHistory && uh.AfterSavePoint()) {
@@ -26,6 +26,8 @@ class ChangeHistory;
  */
 class ILineVector;
 
+class PieceTable;
+
 enum class ActionType { insert, remove, start, container };
 
 /**
@@ -38,9 +40,12 @@ public:
 	std::unique_ptr<char[]> data;
 	Sci::Position lenData;
 	bool mayCoalesce;
+	/// Half of a replacement of text with text of as many lines, after which each line still
+	/// has its per-line data
+	bool keepsLines;
 
 	Action() noexcept;
-	void Create(ActionType at_, Sci::Position position_=0, const char *data_=nullptr, Sci::Position lenData_=0, bool mayCoalesce_=true);
+	void Create(ActionType at_, Sci::Position position_=0, const char *data_=nullptr, Sci::Position lenData_=0, bool mayCoalesce_=true, bool keepsLines_=false);
 	void Clear() noexcept;
 };
 
@@ -61,7 +66,7 @@ class UndoHistory {
 public:
 	UndoHistory();
 
-	const char *AppendAction(ActionType at, Sci::Position position, const char *data, Sci::Position lengthData, bool &startSequence, bool mayCoalesce=true);
+	const char *AppendAction(ActionType at, Sci::Position position, const char *data, Sci::Position lengthData, bool &startSequence, bool mayCoalesce=true, bool keepsLines=false);
 
 	void BeginUndoAction();
 	void EndUndoAction();
@@ -121,17 +126,47 @@ struct SplitView {
 };
 
 
+struct SnapshotText;
+
+/**
+ * Read-only text of a CellBuffer as it was when the snapshot was taken.
+ * Taking a snapshot does not copy the text: the snapshot reads the buffer until
+ * the buffer is about to change and then, once for all the snapshots still in use,
+ * shares the pieces of its piece table or copies the text of its gap buffer.
+ * Snapshots may be read on any thread while the buffer is changed on its own thread.
+ */
+class TextSnapshot {
+	std::shared_ptr<SnapshotText> text;
+	Sci::Position length = 0;
+public:
+	TextSnapshot() noexcept = default;
+	TextSnapshot(std::shared_ptr<SnapshotText> text_, Sci::Position length_) noexcept;
+
+	Sci::Position Length() const noexcept;
+	/// Copy the text of [position, position + lengthRetrieve) into buffer.
+	/// Each call blocks changes to the buffer while it reads it so read in pieces.
+	/// @return false if the range is outside the snapshot or memory ran out while sharing or copying the text.
+	bool GetCharRange(char *buffer, Sci::Position position, Sci::Position lengthRetrieve) const;
+};
+
 /**
  * Holder for an expandable array of characters that supports undo and line markers.
  * Based on article "Data Structures in a Bit-Mapped Text Editor"
  * by Wilfred J. Hansen, Byte January 1987, page 183.
+ * The text may instead be held in a piece table so that large texts can be adopted
+ * without copying and edited without moving the text.
  */
 class CellBuffer {
 private:
 	bool hasStyles;
 	bool largeDocument;
+	bool windowedStyles;
 	SplitVector<char> substance;
+	/// When set, holds the text instead of substance
+	std::unique_ptr<PieceTable> pieces;
+	/// Styles for [styleStart, styleStart + style.Length()) which is the whole buffer unless windowed.
 	SplitVector<char> style;
+	Sci::Position styleStart;
 	bool readOnly;
 	bool utf8Substance;
 	Scintilla::LineEndType utf8LineEnds;
@@ -141,20 +176,33 @@ private:
 
 	std::unique_ptr<ChangeHistory> changeHistory;
 
+	/// Every insertion and deletion since the save point, including undo and redo, lies in
+	/// [unsavedStart, Length() - unsavedSuffix]
+	Sci::Position unsavedStart;
+	Sci::Position unsavedSuffix;
+
 	std::unique_ptr<ILineVector> plv;
+	/// Kept so it can be detached from plv while lines are replaced
+	PerLine *perLine;
+
+	/// Shared with the snapshots taken since the last change
+	std::shared_ptr<SnapshotText> snapshot;
 
 	bool UTF8LineEndOverlaps(Sci::Position position) const noexcept;
 	bool UTF8IsCharacterBoundary(Sci::Position position) const;
 	void ResetLineEnds();
 	void RecalculateIndexLineStarts(Sci::Line lineFirst, Sci::Line lineLast);
 	bool MaintainingLineCharacterIndex() const noexcept;
+	Sci::Position ClipToStyleWindow(Sci::Position &position, Sci::Position &lengthStyle) const noexcept;
 	/// Actions without undo
 	void BasicInsertString(Sci::Position position, const char *s, Sci::Position insertLength);
 	void BasicDeleteChars(Sci::Position position, Sci::Position deleteLength);
+	/// Called before the text or its layout in substance changes
+	void DetachSnapshot() noexcept;
 
 public:
 
-	CellBuffer(bool hasStyles_, bool largeDocument_);
+	CellBuffer(bool hasStyles_, bool largeDocument_, bool windowedStyles_=false, bool pieceTable_=false);
 	// Deleted so CellBuffer objects can not be copied.
 	CellBuffer(const CellBuffer &) = delete;
 	CellBuffer(CellBuffer &&) = delete;
@@ -169,9 +217,10 @@ public:
 	char StyleAt(Sci::Position position) const noexcept;
 	void GetStyleRange(unsigned char *buffer, Sci::Position position, Sci::Position lengthRetrieve) const;
 	const char *BufferPointer();
-	const char *RangePointer(Sci::Position position, Sci::Position rangeLength) noexcept;
+	const char *RangePointer(Sci::Position position, Sci::Position rangeLength);
 	Sci::Position GapPosition() const noexcept;
-	SplitView AllView() const noexcept;
+	SplitView AllView();
+	TextSnapshot TakeSnapshot();
 
 	Sci::Position Length() const noexcept;
 	void Allocate(Sci::Position newSize);
@@ -191,24 +240,47 @@ public:
 	Sci::Line LineFromPositionIndex(Sci::Position pos, Scintilla::LineCharacterIndexType lineCharacterIndex) const noexcept;
 	void InsertLine(Sci::Line line, Sci::Position position, bool lineStart);
 	void RemoveLine(Sci::Line line);
-	const char *InsertString(Sci::Position position, const char *s, Sci::Position insertLength, bool &startSequence);
+	/// A deletion then an insertion that pass keepLines replace text with text of as many lines.
+	/// The deletion detaches the per-line data and the insertion attaches it again so each line
+	/// keeps its data. Undo and redo of the pair do the same.
+	const char *InsertString(Sci::Position position, const char *s, Sci::Position insertLength, bool &startSequence, bool keepLines=false);
 
 	/// Setting styles for positions outside the range of the buffer is safe and has no effect.
 	/// @return true if the style of a character is changed.
 	bool SetStyleAt(Sci::Position position, char styleValue) noexcept;
 	bool SetStyleFor(Sci::Position position, Sci::Position lengthStyle, char styleValue) noexcept;
+	/// Copy a run of styles into the buffer in one pass.
+	/// @return true if any style changed with [startChanged, endChanged) covering all changes.
+	bool SetStyles(Sci::Position position, Sci::Position lengthStyle, const char *styles,
+		Sci::Position &startChanged, Sci::Position &endChanged) noexcept;
 
-	const char *DeleteChars(Sci::Position position, Sci::Position deleteLength, bool &startSequence);
+	const char *DeleteChars(Sci::Position position, Sci::Position deleteLength, bool &startSequence, bool keepLines=false);
 
 	bool IsReadOnly() const noexcept;
 	void SetReadOnly(bool set) noexcept;
 	bool IsLarge() const noexcept;
 	bool HasStyles() const noexcept;
+	bool WindowedStyles() const noexcept;
+	bool UsesPieceTable() const noexcept;
+	/// Make text, which must not change while it is shared, the contents of an empty buffer
+	/// without copying it. Only possible with a piece table and not undoable.
+	/// @return false if not possible.
+	bool AdoptText(std::shared_ptr<const char[]> text, Sci::Position textLength);
+
+	/// With windowed styles, only positions inside the window have stored styles.
+	/// Moving the window keeps styles where the old and new windows overlap and zeroes the rest.
+	Sci::Position StyleWindowStart() const noexcept;
+	Sci::Position StyleWindowEnd() const noexcept;
+	void SetStyleWindow(Sci::Position start, Sci::Position end);
 
 	/// The save point is a marker in the undo stack where the container has stated that
 	/// the buffer was saved. Undo and redo can move over the save point.
 	void SetSavePoint();
 	bool IsSavePoint() const noexcept;
+	/// Span that may differ from the text at the save point. Text before it and text after it
+	/// (shifted by the change in length) is as it was. Empty at Length() when nothing changed.
+	Sci::Position UnsavedStart() const noexcept;
+	Sci::Position UnsavedEnd() const noexcept;
 
 	void TentativeStart();
 	void TentativeCommit();
@@ -249,13 +249,20 @@ bool ContractionState<LINE>::SetVisible(Sci::Line lineDocStart, Sci::Line lineDo
 		Check();
 		if ((lineDocStart <= lineDocEnd) && (lineDocStart >= 0) && (lineDocEnd < LinesInDoc())) {
 			bool changed = false;
-			for (Sci::Line line = lineDocStart; line <= lineDocEnd; line++) {
-				if (GetVisible(line) != isVisible) {
-					changed = true;
+			const int visibleValue = isVisible ? 1 : 0;
+			for (Sci::Line line = lineDocStart; line <= lineDocEnd;) {
+				// Skip whole runs of lines that already have the wanted visibility
+				if (visible->ValueAt(line_cast(line)) == visibleValue) {
+					line = visible->EndRun(line_cast(line));
+					continue;
+				}
+				const Sci::Line lineRunEnd = std::min<Sci::Line>(visible->EndRun(line_cast(line)), lineDocEnd + 1);
+				for (; line < lineRunEnd; line++) {
 					const int heightLine = heights->ValueAt(line_cast(line));
 					const int difference = isVisible ? heightLine : -heightLine;
 					displayLines->InsertText(line_cast(line), difference);
 				}
+				changed = true;
 			}
 			if (changed) {
 				visible->FillRange(line_cast(lineDocStart), isVisible ? 1 : 0,
@@ -6,6 +6,7 @@
 // The License.txt file describes the conditions under which this software may be distributed.
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
@@ -42,6 +43,7 @@
 #include "PerLine.h"
 #include "CharClassify.h"
 #include "Decoration.h"
+#include "CaseConvert.h"
 #include "CaseFolder.h"
 #include "Document.h"
 #include "RESearch.h"
@@ -51,6 +53,18 @@
 using namespace Scintilla;
 using namespace Scintilla::Internal;
 
+namespace {
+
+// Windowed styles are kept for this many bytes with the requested position at least
+// styleWindowMargin from the start so the text shown before it is styled.
+constexpr Sci::Position styleWindowSize = 0x400000;
+constexpr Sci::Position styleWindowMargin = styleWindowSize / 8;
+constexpr Sci::Line styleCheckpointLines = 1024;
+// Further than this from a checkpoint, lexing starts from the default state instead.
+constexpr Sci::Position styleCatchUpLimit = styleWindowSize * 16;
+
+}
+
 LexInterface::LexInterface(Document *pdoc_) noexcept : pdoc(pdoc_), performingStyle(false) {
 }
 
@@ -138,7 +152,8 @@ CharacterExtracted::CharacterExtracted(const unsigned char *charBytes, size_t wi
 }
 
 Document::Document(DocumentOption options) :
-	cb(!FlagSet(options, DocumentOption::StylesNone), FlagSet(options, DocumentOption::TextLarge)),
+	cb(!FlagSet(options, DocumentOption::StylesNone), FlagSet(options, DocumentOption::TextLarge),
+		FlagSet(options, DocumentOption::StylesWindowed), FlagSet(options, DocumentOption::TextPieces)),
 	durationStyleOneByte(0.000001, 0.0000001, 0.00001) {
 	refCount = 0;
 #ifdef _WIN32
@@ -328,9 +343,11 @@ void Document::TentativeUndo() {
 				}
 				if (steps > 1)
 					modFlags |= ModificationFlags::MultiStepUndoRedo;
-				const Sci::Line linesAdded = LinesTotal() - prevLinesTotal;
-				if (linesAdded != 0)
+				const Sci::Line linesChanged = LinesTotal() - prevLinesTotal;
+				if (linesChanged != 0)
 					multiLine = true;
+				// The halves of a replacement that keeps lines leave them to watchers as they were
+				const Sci::Line linesAdded = action.keepsLines ? 0 : linesChanged;
 				if (step == steps - 1) {
 					modFlags |= ModificationFlags::LastStepInUndoRedo;
 					if (multiLine)
@@ -566,25 +583,37 @@ void Document::ClearLevels() {
 	Levels()->ClearLevels();
 }
 
-static bool IsSubordinate(FoldLevel levelStart, FoldLevel levelTry) noexcept {
-	if (LevelIsWhitespace(levelTry))
-		return true;
-	else
-		return LevelNumber(levelStart) < LevelNumber(levelTry);
-}
-
 Sci::Line Document::GetLastChild(Sci::Line lineParent, std::optional<FoldLevel> level, Sci::Line lastLine) {
 	const FoldLevel levelStart = LevelNumberPart(level ? *level : GetFoldLevel(lineParent));
 	const Sci::Line maxLine = LinesTotal();
 	const Sci::Line lookLastLine = (lastLine != -1) ? std::min(LinesTotal() - 1, lastLine) : -1;
+	// Search in growing chunks, styling each chunk first so that fold levels are current
+	// without styling much further than the end of the fold block.
 	Sci::Line lineMaxSubord = lineParent;
+	Sci::Line lengthChunk = 64;
 	while (lineMaxSubord < maxLine - 1) {
-		EnsureStyledTo(LineStart(lineMaxSubord + 2));
-		if (!IsSubordinate(levelStart, GetFoldLevel(lineMaxSubord + 1)))
-			break;
-		if ((lookLastLine != -1) && (lineMaxSubord >= lookLastLine) && !LevelIsWhitespace(GetFoldLevel(lineMaxSubord)))
+		const Sci::Line lineChunkEnd = std::min(maxLine - 1, lineMaxSubord + lengthChunk);
+		EnsureStyledTo(LineStart(lineChunkEnd + 1));
+		// The first line that is not subordinate ends the block
+		const Sci::Line lineNotSubordinate = Levels()->FindLevelAtMost(lineMaxSubord + 1, lineChunkEnd + 1, levelStart);
+		Sci::Line lineEnd = (lineNotSubordinate >= 0) ? lineNotSubordinate - 1 : lineChunkEnd;
+		bool found = lineNotSubordinate >= 0;
+		if (lookLastLine != -1) {
+			// Stop at the first non-whitespace line after lastLine
+			const Sci::Line lineLook = std::max(lineMaxSubord, lookLastLine);
+			if (lineLook <= lineEnd) {
+				const Sci::Line lineContent = Levels()->FindLevelAtMost(lineLook, lineEnd + 1, FoldLevel::NumberMask);
+				if (lineContent >= 0) {
+					lineEnd = lineContent;
+					found = true;
+				}
+			}
+		}
+		lineMaxSubord = lineEnd;
+		if (found) {
 			break;
-		lineMaxSubord++;
+		}
+		lengthChunk *= 2;
 	}
 	if (lineMaxSubord > lineParent) {
 		if (levelStart > LevelNumberPart(GetFoldLevel(lineMaxSubord + 1))) {
@@ -1219,6 +1248,13 @@ EncodingFamily Document::CodePageFamily() const noexcept {
 void Document::ModifiedAt(Sci::Position pos) noexcept {
 	if (endStyled > pos)
 		endStyled = pos;
+	if (!styleCheckpoints.empty()) {
+		// Checkpoints after the modification may no longer match the text before them
+		const size_t valid = SciLineFromPosition(pos) / styleCheckpointLines;
+		if (valid < styleCheckpoints.size()) {
+			styleCheckpoints.erase(styleCheckpoints.begin() + valid, styleCheckpoints.end());
+		}
+	}
 }
 
 void Document::CheckReadOnly() {
@@ -1338,11 +1374,77 @@ Sci::Position Document::InsertString(Sci::Position position, std::string_view sv
 	return InsertString(position, sv.data(), sv.length());
 }
 
+// Replaces a range with text that has as many lines as a deletion then an insertion in one
+// undo step. The lines in between are not removed and inserted again so each line keeps its
+// markers and other per-line data, and watchers are told of no lines added or removed.
+// The text is inserted as given without an insert check as that could change its lines.
+bool Document::ReplaceKeepingLines(Sci::Position position, Sci::Position deleteLength, std::string_view text) {
+	if ((position < 0) || (deleteLength <= 0) || text.empty() || ((position + deleteLength) > LengthNoExcept()))
+		return false;
+	CheckReadOnly();
+	if (cb.IsReadOnly() || (enteredModification != 0))
+		return false;
+	UndoGroup ug(this);
+	enteredModification++;
+	const Sci::Position insertLength = text.length();
+	const bool startSavePoint = cb.IsSavePoint();
+	NotifyModified(
+		DocModification(
+			ModificationFlags::BeforeDelete | ModificationFlags::User,
+			position, deleteLength,
+			0, nullptr));
+	bool startSequence = false;
+	const char *removed = cb.DeleteChars(position, deleteLength, startSequence, true);
+	NotifyModified(
+		DocModification(
+			ModificationFlags::DeleteText | ModificationFlags::User |
+			(startSequence?ModificationFlags::StartAction:ModificationFlags::None),
+			position, deleteLength,
+			0, removed));
+	NotifyModified(
+		DocModification(
+			ModificationFlags::BeforeInsert | ModificationFlags::User,
+			position, insertLength,
+			0, text.data()));
+	const char *inserted = cb.InsertString(position, text.data(), insertLength, startSequence, true);
+	if (startSavePoint && cb.IsCollectingUndo())
+		NotifySavePoint(false);
+	ModifiedAt(position);
+	NotifyModified(
+		DocModification(
+			ModificationFlags::InsertText | ModificationFlags::User,
+			position, insertLength,
+			0, inserted));
+	enteredModification--;
+	return true;
+}
+
 void Document::ChangeInsertion(const char *s, Sci::Position length) {
 	insertionSet = true;
 	insertion.assign(s, length);
 }
 
+// Makes replacements sorted by position that don't overlap as one undo action. They are made
+// from the start of the document forward so the gap in the buffer only moves forward and watchers
+// are notified of each deletion and insertion at its final position.
+bool Document::ReplaceRanges(std::vector<RangeReplacement> &replacements) {
+	CheckReadOnly();
+	if (cb.IsReadOnly() || (enteredModification != 0)) {
+		return false;
+	}
+	UndoGroup ug(this);
+	Sci::Position shift = 0;
+	for (RangeReplacement &replacement : replacements) {
+		replacement.position += shift;
+		if (replacement.lengthDelete > 0) {
+			DeleteChars(replacement.position, replacement.lengthDelete);
+		}
+		replacement.lengthInserted = InsertString(replacement.position, replacement.text);
+		shift += replacement.lengthInserted - replacement.lengthDelete;
+	}
+	return true;
+}
+
 int SCI_METHOD Document::AddData(const char *data, Sci_Position length) {
 	try {
 		const Sci::Position position = Length();
@@ -1423,9 +1525,11 @@ Sci::Position Document::Undo() {
 				}
 				if (steps > 1)
 					modFlags |= ModificationFlags::MultiStepUndoRedo;
-				const Sci::Line linesAdded = LinesTotal() - prevLinesTotal;
-				if (linesAdded != 0)
+				const Sci::Line linesChanged = LinesTotal() - prevLinesTotal;
+				if (linesChanged != 0)
 					multiLine = true;
+				// The halves of a replacement that keeps lines leave them to watchers as they were
+				const Sci::Line linesAdded = action.keepsLines ? 0 : linesChanged;
 				if (step == steps - 1) {
 					modFlags |= ModificationFlags::LastStepInUndoRedo;
 					if (multiLine)
@@ -1482,9 +1586,11 @@ Sci::Position Document::Redo() {
 				}
 				if (steps > 1)
 					modFlags |= ModificationFlags::MultiStepUndoRedo;
-				const Sci::Line linesAdded = LinesTotal() - prevLinesTotal;
-				if (linesAdded != 0)
+				const Sci::Line linesChanged = LinesTotal() - prevLinesTotal;
+				if (linesChanged != 0)
 					multiLine = true;
+				// The halves of a replacement that keeps lines leave them to watchers as they were
+				const Sci::Line linesAdded = action.keepsLines ? 0 : linesChanged;
 				if (step == steps - 1) {
 					modFlags |= ModificationFlags::LastStepInUndoRedo;
 					if (multiLine)
@@ -1702,42 +1808,346 @@ std::string Document::TransformLineEnds(const char *s, size_t len, EndOfLine eol
 }
 
 void Document::ConvertLineEnds(EndOfLine eolModeSet) {
+	CheckReadOnly();
+	if (cb.IsReadOnly())
+		return;
+	const std::string_view eol = (eolModeSet == EndOfLine::CrLf) ? "\r\n" :
+		((eolModeSet == EndOfLine::Cr) ? "\r" : "\n");
+	const Sci::Position length = Length();
+	const char *text = BufferPointer();
+	const char *const end = text + length;
+
+	// Find the line ends that change in a single pass before changing any of them
+	std::vector<Sci::Position> changes;
+	const char *nextCR = static_cast<const char *>(memchr(text, '\r', length));
+	const char *nextLF = static_cast<const char *>(memchr(text, '\n', length));
+	Sci::Position pos = 0;
+	while (pos < length) {
+		// Only search again for the kind of line end character that has been passed
+		if (nextCR && (nextCR < text + pos))
+			nextCR = static_cast<const char *>(memchr(text + pos, '\r', length - pos));
+		if (nextLF && (nextLF < text + pos))
+			nextLF = static_cast<const char *>(memchr(text + pos, '\n', length - pos));
+		const char *lineEnd = (nextCR && nextLF) ? std::min(nextCR, nextLF) : (nextCR ? nextCR : nextLF);
+		if (!lineEnd)
+			break;
+		const Sci::Position eolStart = lineEnd - text;
+		const bool isCRLF = (*lineEnd == '\r') && (lineEnd + 1 < end) && (lineEnd[1] == '\n');
+		const std::string_view eolCurrent(lineEnd, isCRLF ? 2 : 1);
+		if (eolCurrent != eol)
+			changes.push_back(eolStart);
+		pos = eolStart + eolCurrent.length();
+	}
+	if (changes.empty())
+		return;
+
+	// The text from the first line end that changes to the end of the last one is built with
+	// the new line ends and replaces that span in one deletion and insertion. Each line end
+	// stays a single line end so no line is removed or added and ReplaceKeepingLines leaves
+	// the markers and other data of each line on that line.
+	const Sci::Position spanStart = changes.front();
+	std::string converted;
+	converted.reserve(changes.back() - spanStart + 2 * changes.size());
+	Sci::Position spanEnd = spanStart;
+	for (const Sci::Position change : changes) {
+		converted.append(text + spanEnd, change - spanEnd);
+		converted.append(eol);
+		const bool isCRLF = (text[change] == '\r') && (change + 1 < length) && (text[change + 1] == '\n');
+		spanEnd = change + (isCRLF ? 2 : 1);
+	}
+	ReplaceKeepingLines(spanStart, spanEnd - spanStart, converted);
+}
+
+namespace {
+
+constexpr bool IsSpaceOrTab(char ch) noexcept {
+	return (ch == ' ') || (ch == '\t');
+}
+
+// Follows '' and "" quotes through a line for the whitespace transforms that leave
+// quoted text alone. Inside quotes, a backslash escapes the next character.
+class QuoteState {
+	char quote = 0;
+	bool escaped = false;
+public:
+	bool Quoted() const noexcept {
+		return quote != 0;
+	}
+	void Step(char ch) noexcept {
+		if (escaped) {
+			escaped = false;
+		} else if (quote) {
+			if (ch == '\\')
+				escaped = true;
+			else if (ch == quote)
+				quote = 0;
+		} else if ((ch == '\'') || (ch == '"')) {
+			quote = ch;
+		}
+	}
+};
+
+// Changes the case of the ASCII letters from first to last in 8 bytes that are all below 0x80.
+// No byte can carry into the next one in the additions so each byte gets its own comparison.
+constexpr uint64_t ChangeCaseASCII8(uint64_t bytes, char first, char last) noexcept {
+	constexpr uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t fromFirst = bytes + ones * (0x80 - first);
+	const uint64_t afterLast = bytes + ones * (0x80 - last - 1);
+	const uint64_t inRange = fromFirst & ~afterLast & (ones * 0x80);
+	return bytes ^ (inRange >> 2);
+}
+
+constexpr bool IsLetterCategory(CharacterCategory cc) noexcept {
+	return cc <= ccLo;
+}
+
+// Letters, marks, digits and connectors like '_' continue a word.
+constexpr bool IsWordCategory(CharacterCategory cc) noexcept {
+	return (cc <= ccMe) || (cc == ccNd) || (cc == ccPc);
+}
+
+}
+
+// Calls transform for each line touching [start, end) which appends the new text of the
+// line and returns true when the line changes. Unless wholeLines is set, only the part of
+// the first and last lines inside [start, end) is passed. Each run of adjacent changed lines
+// is replaced together, keeping its line ends, with ReplaceKeepingLines so unchanged lines
+// and the markers on all lines stay as they are, all in one undo step. Returns the number
+// of changed lines.
+template <typename LineTransform>
+Sci::Line Document::TransformLines(Sci::Position start, Sci::Position end, bool wholeLines, Sci::Position *lengthChange, LineTransform transform) {
+	*lengthChange = 0;
+	CheckReadOnly();
+	if (cb.IsReadOnly())
+		return 0;
+	const Sci::Line lineFirst = SciLineFromPosition(start);
+	Sci::Line lineLast = SciLineFromPosition(end);
+	if ((lineLast > lineFirst) && (end == LineStart(lineLast)))
+		lineLast--;
+
+	// The new text of all the runs, with the line ends inside them, is kept in one string
+	struct Run {
+		Sci::Position start;
+		Sci::Position end;
+		size_t replacementEnd;
+		Sci::Line lineFirst;
+		Sci::Line lineLast;
+	};
+	std::vector<Run> runs;
+	std::string replacements;
+	Sci::Line linesChanged = 0;
+	const char *text = BufferPointer();
+	for (Sci::Line line = lineFirst; line <= lineLast; line++) {
+		const Sci::Position lineStart = wholeLines ? LineStart(line) : std::max(LineStart(line), start);
+		const Sci::Position lineEnd = wholeLines ? LineEnd(line) : std::min(LineEnd(line), end);
+		const size_t replacementsLength = replacements.length();
+		const bool extendsRun = !runs.empty() && (runs.back().lineLast == line - 1);
+		if (extendsRun)
+			replacements.append(text + runs.back().end, lineStart - runs.back().end);
+		if (transform(std::string_view(text + lineStart, lineEnd - lineStart), replacements)) {
+			linesChanged++;
+			if (extendsRun) {
+				runs.back().end = lineEnd;
+				runs.back().replacementEnd = replacements.length();
+				runs.back().lineLast = line;
+			} else {
+				runs.push_back({ lineStart, lineEnd, replacements.length(), line, line });
+			}
+		} else {
+			replacements.resize(replacementsLength);
+		}
+	}
+	if (runs.empty())
+		return 0;
+
 	UndoGroup ug(this);
+	size_t replacementStart = 0;
+	for (const Run &run : runs) {
+		Range range(run.start + *lengthChange, run.end + *lengthChange);
+		std::string_view replacement(replacements.data() + replacementStart, run.replacementEnd - replacementStart);
+		replacementStart = run.replacementEnd;
+		*lengthChange += static_cast<Sci::Position>(replacement.length()) - (range.end - range.start);
+		TrimReplacement(replacement, range);
+		if ((run.lineLast > run.lineFirst) && !range.Empty() && !replacement.empty()) {
+			ReplaceKeepingLines(range.start, range.end - range.start, replacement);
+		} else {
+			if (!range.Empty())
+				DeleteChars(range.start, range.end - range.start);
+			if (!replacement.empty())
+				InsertString(range.start, replacement);
+		}
+	}
+	return linesChanged;
+}
 
-	for (Sci::Position pos = 0; pos < Length(); pos++) {
-		const char ch = cb.CharAt(pos);
-		if (ch == '\r') {
-			if (cb.CharAt(pos + 1) == '\n') {
-				// CRLF
-				if (eolModeSet == EndOfLine::Cr) {
-					DeleteChars(pos + 1, 1); // Delete the LF
-				} else if (eolModeSet == EndOfLine::Lf) {
-					DeleteChars(pos, 1); // Delete the CR
+Sci::Line Document::TrimTrailingWhitespace(Sci::Position start, Sci::Position end, Sci::Position *lengthChange) {
+	return TransformLines(start, end, true, lengthChange, [](std::string_view line, std::string &transformed) {
+		if (line.empty() || !IsSpaceOrTab(line.back()))
+			return false;
+		const size_t lastKept = line.find_last_not_of(" \t");
+		transformed.append(line.substr(0, (lastKept == std::string_view::npos) ? 0 : lastKept + 1));
+		return true;
+	});
+}
+
+// Tab stops and the columns below count characters like GetColumn.
+Sci::Line Document::TabsToSpaces(Sci::Position start, Sci::Position end, bool skipQuoted, Sci::Position *lengthChange) {
+	const Sci::Position tabSize = std::max(tabInChars, 1);
+	return TransformLines(start, end, true, lengthChange, [this, tabSize, skipQuoted](std::string_view line, std::string &transformed) {
+		if (line.find('\t') == std::string_view::npos)
+			return false;
+		bool changed = false;
+		QuoteState quotes;
+		Sci::Position column = 0;
+		for (size_t i = 0; i < line.length();) {
+			const char ch = line[i];
+			if (skipQuoted)
+				quotes.Step(ch);
+			if (ch == '\t') {
+				const Sci::Position spaces = tabSize - column % tabSize;
+				if (quotes.Quoted()) {
+					transformed.push_back(ch);
 				} else {
-					pos++;
+					transformed.append(spaces, ' ');
+					changed = true;
 				}
+				column += spaces;
+				i++;
 			} else {
-				// CR
-				if (eolModeSet == EndOfLine::CrLf) {
-					pos += InsertString(pos + 1, "\n", 1); // Insert LF
-				} else if (eolModeSet == EndOfLine::Lf) {
-					pos += InsertString(pos, "\n", 1); // Insert LF
-					DeleteChars(pos, 1); // Delete CR
-					pos--;
+				const size_t width = (dbcsCodePage && (dbcsCodePage != CpUtf8) && IsDBCSLeadByteNoExcept(ch)) ?
+					std::min<size_t>(2, line.length() - i) : 1;
+				transformed.append(line.substr(i, width));
+				if ((dbcsCodePage != CpUtf8) || !UTF8IsTrailByte(static_cast<unsigned char>(ch)))
+					column++;
+				i += width;
+			}
+		}
+		return changed;
+	});
+}
+
+Sci::Line Document::SpacesToTabs(Sci::Position start, Sci::Position end, bool skipQuoted, Sci::Position *lengthChange) {
+	const Sci::Position tabSize = std::max(tabInChars, 1);
+	return TransformLines(start, end, true, lengthChange, [this, tabSize, skipQuoted](std::string_view line, std::string &transformed) {
+		if ((line.find('\t') == std::string_view::npos) && (line.find("  ") == std::string_view::npos))
+			return false;
+		bool changed = false;
+		QuoteState quotes;
+		Sci::Position column = 0;
+		for (size_t i = 0; i < line.length();) {
+			const char ch = line[i];
+			if (IsSpaceOrTab(ch) && !quotes.Quoted()) {
+				// A run of spaces and tabs becomes a tab for each tab stop it reaches then
+				// the spaces after the last one. A single space is left as it is.
+				const Sci::Position columnStart = column;
+				size_t runEnd = i;
+				while ((runEnd < line.length()) && IsSpaceOrTab(line[runEnd])) {
+					column = (line[runEnd] == '\t') ? (column / tabSize + 1) * tabSize : column + 1;
+					runEnd++;
+				}
+				const std::string_view run = line.substr(i, runEnd - i);
+				const Sci::Position tabs = column / tabSize - columnStart / tabSize;
+				if ((tabs > 0) && (run != " ")) {
+					const size_t runStart = transformed.length();
+					transformed.append(tabs, '\t');
+					transformed.append(column % tabSize, ' ');
+					changed = changed || (std::string_view(transformed).substr(runStart) != run);
+				} else {
+					transformed.append(run);
 				}
+				i = runEnd;
+			} else {
+				if (skipQuoted)
+					quotes.Step(ch);
+				const size_t width = (dbcsCodePage && (dbcsCodePage != CpUtf8) && IsDBCSLeadByteNoExcept(ch)) ?
+					std::min<size_t>(2, line.length() - i) : 1;
+				transformed.append(line.substr(i, width));
+				if ((dbcsCodePage != CpUtf8) || !UTF8IsTrailByte(static_cast<unsigned char>(ch)))
+					column++;
+				i += width;
 			}
-		} else if (ch == '\n') {
-			// LF
-			if (eolModeSet == EndOfLine::CrLf) {
-				pos += InsertString(pos, "\r", 1); // Insert CR
-			} else if (eolModeSet == EndOfLine::Cr) {
-				pos += InsertString(pos, "\r", 1); // Insert CR
-				DeleteChars(pos, 1); // Delete LF
-				pos--;
+		}
+		return changed;
+	});
+}
+
+// Upper and lower case use the Unicode tables from CaseConvert in UTF-8 documents, the
+// mappings may change the length of the text. Other encodings only change ASCII letters.
+// Title case converts the first letter of each word to upper case and leaves the others.
+Sci::Line Document::TransformCase(Sci::Position start, Sci::Position end, CaseTransform transform, Sci::Position *lengthChange) {
+	const bool utf8 = dbcsCodePage == CpUtf8;
+	ICaseConverter *converter = ConverterFor(transform == CaseTransform::lower ? CaseConversion::lower : CaseConversion::upper);
+	const char first = transform == CaseTransform::lower ? 'A' : 'a';
+	const char last = transform == CaseTransform::lower ? 'Z' : 'z';
+	return TransformLines(start, end, false, lengthChange, [this, transform, converter, utf8, first, last](std::string_view text, std::string &transformed) {
+		const size_t transformedStart = transformed.length();
+		bool previousInWord = false;
+		for (size_t i = 0; i < text.length();) {
+			const unsigned char ch = text[i];
+			if (transform != CaseTransform::title) {
+				uint64_t bytes = 0;
+				if (i + sizeof(bytes) <= text.length()) {
+					memcpy(&bytes, text.data() + i, sizeof(bytes));
+					if ((bytes & 0x8080808080808080ULL) == 0) {
+						bytes = ChangeCaseASCII8(bytes, first, last);
+						transformed.append(reinterpret_cast<const char *>(&bytes), sizeof(bytes));
+						i += sizeof(bytes);
+						continue;
+					}
+				}
+				if (ch < 0x80) {
+					transformed.push_back(ch >= first && ch <= last ? static_cast<char>(ch ^ 0x20) : static_cast<char>(ch));
+					i++;
+				} else if (utf8) {
+					size_t runEnd = i + 1;
+					while ((runEnd < text.length()) && (static_cast<unsigned char>(text[runEnd]) >= 0x80))
+						runEnd++;
+					const size_t converting = transformed.length();
+					const size_t room = (runEnd - i) * maxExpansionCaseConversion;
+					transformed.resize(converting + room);
+					const size_t lenConverted = converter->CaseConvertString(transformed.data() + converting, room, text.data() + i, runEnd - i);
+					transformed.resize(converting + lenConverted);
+					i = runEnd;
+				} else {
+					const size_t width = (dbcsCodePage && IsDBCSLeadByteNoExcept(ch)) ? std::min<size_t>(2, text.length() - i) : 1;
+					transformed.append(text.substr(i, width));
+					i += width;
+				}
+			} else {
+				// Characters above 0x7F in other encodings count as letters that don't change.
+				int character = ch;
+				size_t width = 1;
+				CharacterCategory cc = ccLo;
+				if (ch < 0x80) {
+					cc = charMap.CategoryFor(character);
+				} else if (utf8) {
+					const int utf8Status = UTF8Classify(text.substr(i));
+					if (utf8Status & UTF8MaskInvalid) {
+						cc = ccCn;
+					} else {
+						width = utf8Status & UTF8MaskWidth;
+						character = UnicodeFromUTF8(reinterpret_cast<const unsigned char *>(text.data() + i));
+						cc = charMap.CategoryFor(character);
+					}
+				} else if (dbcsCodePage && IsDBCSLeadByteNoExcept(ch)) {
+					width = std::min<size_t>(2, text.length() - i);
+				}
+				const bool wordStart = IsLetterCategory(cc) && !previousInWord;
+				const char *upper = (wordStart && utf8 && (character >= 0x80)) ? CaseConvert(character, CaseConversion::upper) : nullptr;
+				if (wordStart && (character >= 'a') && (character <= 'z'))
+					transformed.push_back(static_cast<char>(character ^ 0x20));
+				else if (upper)
+					transformed.append(upper);
+				else
+					transformed.append(text.substr(i, width));
+				// Apostrophes inside words like "don't" don't start new words.
+				const bool apostrophe = (character == '\'') || (character == 0x2019);
+				previousInWord = IsWordCategory(cc) || (apostrophe && previousInWord);
+				i += width;
 			}
 		}
-	}
-
+		return std::string_view(transformed).substr(transformedStart) != text;
+	});
 }
 
 std::string_view Document::EOLString() const noexcept {
@@ -1752,7 +2162,9 @@ std::string_view Document::EOLString() const noexcept {
 
 DocumentOption Document::Options() const noexcept {
 	return (IsLarge() ? DocumentOption::TextLarge : DocumentOption::Default) |
-		(cb.HasStyles() ? DocumentOption::Default : DocumentOption::StylesNone);
+		(cb.HasStyles() ? DocumentOption::Default : DocumentOption::StylesNone) |
+		(cb.WindowedStyles() ? DocumentOption::StylesWindowed : DocumentOption::Default) |
+		(cb.UsesPieceTable() ? DocumentOption::TextPieces : DocumentOption::Default);
 }
 
 bool Document::IsWhiteLine(Sci::Line line) const {
@@ -2325,6 +2737,131 @@ const char *Document::SubstituteByPosition(const char *text, Sci::Position *leng
 		return nullptr;
 }
 
+/**
+ * Replace every match of search between minPos and maxPos.
+ * All the matches are found in the unchanged document first, so anchors and \d
+ * substitutions always see the original text.
+ * When no match or replacement contains a line end and no deletion joins a CR to a LF, the
+ * lines stay the same so the span from the first to the last match is replaced with its new
+ * text by ReplaceKeepingLines: a single deletion and insertion that keep the markers on
+ * each line. Otherwise each match, or run of adjacent matches, is replaced separately so
+ * the lines between the matches keep their markers. Either way it is one undo step.
+ * With FindOption::RegExp the replacement is processed like ReplaceTargetRE.
+ * Returns the number of replacements and sets *lengthChange to the change in document length.
+ */
+Sci::Position Document::ReplaceAll(Sci::Position minPos, Sci::Position maxPos, std::string_view search, std::string_view replacement,
+	FindOption flags, Sci::Position *lengthChange) {
+	*lengthChange = 0;
+	if (search.empty() || (minPos > maxPos))
+		return 0;
+	CheckReadOnly();
+	if (cb.IsReadOnly())
+		return 0;
+	const bool substitute = FlagSet(flags, FindOption::RegExp);
+	// The regular expression engines expect NUL terminated strings
+	const std::string searchText(search);
+	const std::string replacementText(replacement);
+
+	// The new text of all the edits is kept in one string
+	struct Edit {
+		Sci::Position start;
+		Sci::Position end;
+		size_t replacementEnd;
+	};
+	std::vector<Edit> edits;
+	std::string replacements;
+	Sci::Position matches = 0;
+	bool keepsLines = true;
+	Sci::Position pos = minPos;
+	while (pos <= maxPos) {
+		Sci::Position lengthFound = searchText.length();
+		const Sci::Position found = FindText(pos, maxPos, searchText.c_str(), flags, &lengthFound);
+		if (found < 0)
+			break;
+		// A match that goes past the end of its line, or starts inside a CR LF, has a line end
+		if (keepsLines && (found + lengthFound > LineEnd(SciLineFromPosition(found))))
+			keepsLines = false;
+		if (substitute) {
+			Sci::Position lengthSubstituted = replacementText.length();
+			const char *substituted = SubstituteByPosition(replacementText.c_str(), &lengthSubstituted);
+			if (substituted)
+				replacements.append(substituted, lengthSubstituted);
+		} else {
+			replacements.append(replacementText);
+		}
+		if (!edits.empty() && (edits.back().end == found)) {
+			edits.back().end = found + lengthFound;
+			edits.back().replacementEnd = replacements.length();
+		} else {
+			edits.push_back({ found, found + lengthFound, replacements.length() });
+		}
+		matches++;
+		pos = found + lengthFound;
+		if (lengthFound == 0) {
+			// Empty match so step over a character to look for the next match
+			if (pos >= maxPos)
+				break;
+			pos = NextPosition(pos, 1);
+		}
+	}
+	if (matches == 0)
+		return 0;
+	if (keepsLines && ContainsLineEnd(replacements.c_str(), replacements.length()))
+		keepsLines = false;
+	if (keepsLines) {
+		size_t replacementStart = 0;
+		for (const Edit &edit : edits) {
+			// Removing the text between a CR and a LF joins them into one line end
+			if ((edit.replacementEnd == replacementStart) && (CharAt(edit.start - 1) == '\r') && (CharAt(edit.end) == '\n'))
+				keepsLines = false;
+			replacementStart = edit.replacementEnd;
+		}
+	}
+
+	UndoGroup ug(this);
+	if (keepsLines) {
+		Range range(edits.front().start, edits.back().end);
+		std::string text;
+		size_t replacementStart = 0;
+		Sci::Position unchangedStart = range.start;
+		for (const Edit &edit : edits) {
+			const size_t unchangedLength = edit.start - unchangedStart;
+			text.resize(text.length() + unchangedLength);
+			GetCharRange(text.data() + text.length() - unchangedLength, unchangedStart, unchangedLength);
+			text.append(replacements, replacementStart, edit.replacementEnd - replacementStart);
+			replacementStart = edit.replacementEnd;
+			unchangedStart = edit.end;
+		}
+		*lengthChange = static_cast<Sci::Position>(text.length()) - (range.end - range.start);
+		// Leave identical text at the ends of the span alone so it isn't marked as changed
+		std::string_view newText(text);
+		TrimReplacement(newText, range);
+		if (!range.Empty() && !newText.empty()) {
+			ReplaceKeepingLines(range.start, range.end - range.start, newText);
+		} else {
+			if (!range.Empty())
+				DeleteChars(range.start, range.end - range.start);
+			if (!newText.empty())
+				InsertString(range.start, newText);
+		}
+		return matches;
+	}
+	size_t replacementStart = 0;
+	for (const Edit &edit : edits) {
+		Range range(edit.start + *lengthChange, edit.end + *lengthChange);
+		std::string_view text(replacements.data() + replacementStart, edit.replacementEnd - replacementStart);
+		replacementStart = edit.replacementEnd;
+		*lengthChange += static_cast<Sci::Position>(text.length()) - (range.end - range.start);
+		// Leave identical text at the ends of the match alone so it isn't marked as changed
+		TrimReplacement(text, range);
+		if (!range.Empty())
+			DeleteChars(range.start, range.end - range.start);
+		if (!text.empty())
+			InsertString(range.start, text);
+	}
+	return matches;
+}
+
 LineCharacterIndexType Document::LineCharacterIndex() const noexcept {
 	return cb.LineCharacterIndex();
 }
@@ -2391,36 +2928,33 @@ bool SCI_METHOD Document::SetStyles(Sci_Position length, const char *styles) {
 		return false;
 	} else {
 		enteredStyling++;
-		bool didChange = false;
+		PLATFORM_ASSERT(endStyled + length <= Length());
 		Sci::Position startMod = 0;
 		Sci::Position endMod = 0;
-		for (int iPos = 0; iPos < length; iPos++, endStyled++) {
-			PLATFORM_ASSERT(endStyled < Length());
-			if (cb.SetStyleAt(endStyled, styles[iPos])) {
-				if (!didChange) {
-					startMod = endStyled;
-				}
-				didChange = true;
-				endMod = endStyled;
-			}
-		}
-		if (didChange) {
+		if (cb.SetStyles(endStyled, length, styles, startMod, endMod)) {
 			const DocModification mh(ModificationFlags::ChangeStyle | ModificationFlags::User,
-			                   startMod, endMod - startMod + 1);
+			                   startMod, endMod - startMod);
 			NotifyModified(mh);
 		}
+		endStyled += length;
 		enteredStyling--;
 		return true;
 	}
 }
 
 void Document::EnsureStyledTo(Sci::Position pos) {
+	if (cb.WindowedStyles() && (enteredStyling == 0)) {
+		MoveStyleWindow(pos);
+	}
 	if ((enteredStyling == 0) && (pos > GetEndStyled())) {
 		IncrementStyleClock();
 		if (pli && !pli->UseContainerLexing()) {
 			const Sci::Line lineEndStyled = SciLineFromPosition(GetEndStyled());
 			const Sci::Position endStyledTo = LineStart(lineEndStyled);
 			pli->Colourise(endStyledTo, pos);
+			if (cb.WindowedStyles()) {
+				RecordStyleCheckpoints(lineEndStyled, SciLineFromPosition(GetEndStyled()));
+			}
 		} else {
 			// Ask the watchers to style, and stop as soon as one responds.
 			for (std::vector<WatcherWithUserData>::iterator it = watchers.begin();
@@ -2431,6 +2965,86 @@ void Document::EnsureStyledTo(Sci::Position pos) {
 	}
 }
 
+// Move the style window when pos is outside it or too close to its start for the text
+// before pos to be shown. Moving forward keeps styles already lexed in the overlap.
+// Otherwise lexing restarts from the nearest checkpoint, lexing any gap between the
+// checkpoint and the window a window at a time so only the checkpoints are retained.
+// With no checkpoint close enough, lexing starts from the default state at the window.
+void Document::MoveStyleWindow(Sci::Position pos) {
+	const Sci::Position windowStart = cb.StyleWindowStart();
+	const Sci::Position windowEnd = cb.StyleWindowEnd();
+	const Sci::Position wantedStart = std::max<Sci::Position>(pos - styleWindowMargin, 0);
+	const bool backwards = wantedStart < windowStart;
+	if ((windowEnd > windowStart) && (pos <= windowEnd) && !backwards && (endStyled >= windowStart)) {
+		return;
+	}
+
+	// Scrolling backwards places pos near the end of the window so further scrolling is covered
+	const Sci::Position placeStart = backwards ?
+		std::max<Sci::Position>(pos - (styleWindowSize - styleWindowMargin), 0) : wantedStart;
+	const Sci::Line lineStart = SciLineFromPosition(placeStart);
+	const Sci::Position start = LineStart(lineStart);
+	const Sci::Position end = std::min(std::max(start + styleWindowSize, pos), LengthNoExcept());
+	// The window includes the character before its first line as that supplies the initial style
+	const Sci::Position windowFirst = std::max<Sci::Position>(start - 1, 0);
+
+	if ((windowEnd > windowStart) && (windowFirst >= windowStart) && (endStyled >= start)) {
+		cb.SetStyleWindow(windowFirst, end);
+		endStyled = std::min({endStyled, windowEnd, end});
+		return;
+	}
+
+	Sci::Line lineRestart = lineStart;
+	int styleRestart = 0;
+	if (pli && !pli->UseContainerLexing()) {
+		// The start of the document is an implicit checkpoint in the default state
+		size_t checkpoint = std::min<size_t>(lineStart / styleCheckpointLines, styleCheckpoints.size());
+		while ((checkpoint > 0) && (styleCheckpoints[checkpoint - 1] < 0)) {
+			checkpoint--;
+		}
+		const Sci::Line lineCheckpoint = checkpoint * styleCheckpointLines;
+		if (start - LineStart(lineCheckpoint) <= styleCatchUpLimit) {
+			lineRestart = lineCheckpoint;
+			styleRestart = (checkpoint > 0) ? styleCheckpoints[checkpoint - 1] : 0;
+		}
+	}
+
+	Sci::Position stylePos = LineStart(lineRestart);
+	while (true) {
+		Sci::Position stepEnd = end;
+		if (stylePos < start) {
+			stepEnd = std::min(LineStart(SciLineFromPosition(stylePos + styleWindowSize)), start);
+			if (stepEnd <= stylePos) {
+				stepEnd = std::min(LineStart(SciLineFromPosition(stylePos) + 1), start);
+			}
+		}
+		cb.SetStyleWindow(std::max<Sci::Position>(stylePos - 1, 0), stepEnd);
+		if (stylePos > 0) {
+			cb.SetStyleAt(stylePos - 1, static_cast<char>(styleRestart));
+		}
+		endStyled = stylePos;
+		if (stylePos >= start) {
+			break;
+		}
+		const Sci::Line lineStep = SciLineFromPosition(stylePos);
+		pli->Colourise(stylePos, stepEnd);
+		RecordStyleCheckpoints(lineStep, SciLineFromPosition(GetEndStyled()));
+		styleRestart = static_cast<unsigned char>(cb.StyleAt(stepEnd - 1));
+		stylePos = stepEnd;
+	}
+}
+
+void Document::RecordStyleCheckpoints(Sci::Line lineFirst, Sci::Line lineLast) {
+	for (Sci::Line line = (lineFirst / styleCheckpointLines + 1) * styleCheckpointLines;
+		line <= lineLast; line += styleCheckpointLines) {
+		const size_t checkpoint = line / styleCheckpointLines - 1;
+		if (checkpoint >= styleCheckpoints.size()) {
+			styleCheckpoints.resize(checkpoint + 1, -1);
+		}
+		styleCheckpoints[checkpoint] = static_cast<unsigned char>(cb.StyleAt(LineStart(line) - 1));
+	}
+}
+
 void Document::StyleToAdjustingLineDuration(Sci::Position pos) {
 	const Sci::Position stylingStart = GetEndStyled();
 	ElapsedPeriod epStyling;
@@ -2814,6 +3428,23 @@ Sci::Position Document::BraceMatch(Sci::Position position, Sci::Position /*maxRe
 	return - 1;
 }
 
+#ifndef NO_CXX11_REGEX
+
+/**
+ * Compiling a std::regex takes far longer than most searches so the last one
+ * is kept for repeated searches with the same expression.
+ */
+struct Cxx11RegexCache {
+	bool valid = false;
+	std::string pattern;
+	std::regex::flag_type flags {};
+	bool unicode = false;
+	std::regex regexp;
+	std::wregex wregexp;
+};
+
+#endif
+
 /**
  * Implementation of RegexSearchBase for the default built-in regular expression engine
  */
@@ -2830,6 +3461,9 @@ public:
 private:
 	RESearch search;
 	std::string substituted;
+#ifndef NO_CXX11_REGEX
+	Cxx11RegexCache cxx11Cache;
+#endif
 };
 
 namespace {
@@ -3175,7 +3809,7 @@ bool MatchOnLines(const Document *doc, const Regex &regexp, const RESearchRange
 }
 
 Sci::Position Cxx11RegexFindText(const Document *doc, Sci::Position minPos, Sci::Position maxPos, const char *s,
-	bool caseSensitive, Sci::Position *length, RESearch &search) {
+	bool caseSensitive, Sci::Position *length, RESearch &search, Cxx11RegexCache &cache) {
 	const RESearchRange resr(doc, minPos, maxPos);
 	try {
 		//ElapsedPeriod ep;
@@ -3192,17 +3826,26 @@ Sci::Position Cxx11RegexFindText(const Document *doc, Sci::Position minPos, Sci:
 		// Clear the RESearch so can fill in matches
 		search.Clear();
 
-		bool matched = false;
-		if (CpUtf8 == doc->dbcsCodePage) {
-			const std::wstring ws = WStringFromUTF8(s);
-			std::wregex regexp;
-			regexp.assign(ws, flagsRe);
-			matched = MatchOnLines<UTF8Iterator>(doc, regexp, resr, search);
+		const bool unicode = CpUtf8 == doc->dbcsCodePage;
+		if (!cache.valid || cache.pattern != s || cache.flags != flagsRe || cache.unicode != unicode) {
+			cache.valid = false;
+			if (unicode) {
+				const std::wstring ws = WStringFromUTF8(s);
+				cache.wregexp.assign(ws, flagsRe);
+			} else {
+				cache.regexp.assign(s, flagsRe);
+			}
+			cache.pattern = s;
+			cache.flags = flagsRe;
+			cache.unicode = unicode;
+			cache.valid = true;
+		}
 
+		bool matched = false;
+		if (unicode) {
+			matched = MatchOnLines<UTF8Iterator>(doc, cache.wregexp, resr, search);
 		} else {
-			std::regex regexp;
-			regexp.assign(s, flagsRe);
-			matched = MatchOnLines<ByteIterator>(doc, regexp, resr, search);
+			matched = MatchOnLines<ByteIterator>(doc, cache.regexp, resr, search);
 		}
 
 		Sci::Position posMatch = -1;
@@ -3236,7 +3879,7 @@ Sci::Position BuiltinRegex::FindText(Document *doc, Sci::Position minPos, Sci::P
 #ifndef NO_CXX11_REGEX
 	if (FlagSet(flags, FindOption::Cxx11RegEx)) {
 			return Cxx11RegexFindText(doc, minPos, maxPos, s,
-			caseSensitive, length, search);
+			caseSensitive, length, search, cxx11Cache);
 	}
 #endif
 
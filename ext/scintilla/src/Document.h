@@ -20,6 +20,8 @@ class LineAnnotation;
 
 enum class EncodingFamily { eightBit, unicode, dbcs };
 
+enum class CaseTransform { upper, lower, title };
+
 /**
  * The range class represents a range of text in a document.
  * The two values are not sorted as one end may be more significant than the other
@@ -128,6 +130,14 @@ struct StyledText {
 	}
 };
 
+/// One of the replacements made together by Document::ReplaceRanges.
+struct RangeReplacement {
+	Sci::Position position;	///< Start of the range, then where the new text starts once replaced
+	Sci::Position lengthDelete;
+	std::string_view text;
+	Sci::Position lengthInserted = 0;	///< Set once replaced as the container may change the text
+};
+
 class HighlightDelimiter {
 public:
 	HighlightDelimiter() noexcept : isEnabled(false) {
@@ -277,6 +287,8 @@ private:
 	CharacterCategoryMap charMap;
 	std::unique_ptr<CaseFolder> pcf;
 	Sci::Position endStyled;
+	/// With windowed styles, the style before every styleCheckpointLines'th line or -1 when unknown
+	std::vector<int> styleCheckpoints;
 	int styleClock;
 	int enteredModification;
 	int enteredStyling;
@@ -377,7 +389,9 @@ public:
 	bool DeleteChars(Sci::Position pos, Sci::Position len);
 	Sci::Position InsertString(Sci::Position position, const char *s, Sci::Position insertLength);
 	Sci::Position InsertString(Sci::Position position, std::string_view sv);
+	bool ReplaceKeepingLines(Sci::Position position, Sci::Position deleteLength, std::string_view text);
 	void ChangeInsertion(const char *s, Sci::Position length);
+	bool ReplaceRanges(std::vector<RangeReplacement> &replacements);
 	int SCI_METHOD AddData(const char *data, Sci_Position length) override;
 	void * SCI_METHOD ConvertToDocument() override;
 	Sci::Position Undo();
@@ -394,6 +408,8 @@ public:
 	void AddUndoAction(Sci::Position token, bool mayCoalesce) { cb.AddUndoAction(token, mayCoalesce); }
 	void SetSavePoint();
 	bool IsSavePoint() const noexcept { return cb.IsSavePoint(); }
+	Sci::Position UnsavedStart() const noexcept { return cb.UnsavedStart(); }
+	Sci::Position UnsavedEnd() const noexcept { return cb.UnsavedEnd(); }
 
 	void TentativeStart() { cb.TentativeStart(); }
 	void TentativeCommit() { cb.TentativeCommit(); }
@@ -407,7 +423,9 @@ public:
 	[[nodiscard]] Sci::Position EditionNextDelete(Sci::Position pos) const noexcept { return cb.EditionNextDelete(pos); }
 
 	const char * SCI_METHOD BufferPointer() override { return cb.BufferPointer(); }
-	const char *RangePointer(Sci::Position position, Sci::Position rangeLength) noexcept { return cb.RangePointer(position, rangeLength); }
+	const char *RangePointer(Sci::Position position, Sci::Position rangeLength) { return cb.RangePointer(position, rangeLength); }
+	/// Text for reading on other threads while the document is changed on this one
+	TextSnapshot TakeSnapshot() { return cb.TakeSnapshot(); }
 	Sci::Position GapPosition() const noexcept { return cb.GapPosition(); }
 
 	int SCI_METHOD GetLineIndentation(Sci_Position line) override;
@@ -420,6 +438,10 @@ public:
 	void Indent(bool forwards, Sci::Line lineBottom, Sci::Line lineTop);
 	static std::string TransformLineEnds(const char *s, size_t len, Scintilla::EndOfLine eolModeWanted);
 	void ConvertLineEnds(Scintilla::EndOfLine eolModeSet);
+	Sci::Line TrimTrailingWhitespace(Sci::Position start, Sci::Position end, Sci::Position *lengthChange);
+	Sci::Line TabsToSpaces(Sci::Position start, Sci::Position end, bool skipQuoted, Sci::Position *lengthChange);
+	Sci::Line SpacesToTabs(Sci::Position start, Sci::Position end, bool skipQuoted, Sci::Position *lengthChange);
+	Sci::Line TransformCase(Sci::Position start, Sci::Position end, CaseTransform transform, Sci::Position *lengthChange);
 	std::string_view EOLString() const noexcept;
 	void SetReadOnly(bool set) { cb.SetReadOnly(set); }
 	bool IsReadOnly() const noexcept { return cb.IsReadOnly(); }
@@ -486,6 +508,8 @@ public:
 	void SetCaseFolder(std::unique_ptr<CaseFolder> pcf_) noexcept;
 	Sci::Position FindText(Sci::Position minPos, Sci::Position maxPos, const char *search, Scintilla::FindOption flags, Sci::Position *length);
 	const char *SubstituteByPosition(const char *text, Sci::Position *length);
+	Sci::Position ReplaceAll(Sci::Position minPos, Sci::Position maxPos, std::string_view search, std::string_view replacement,
+		Scintilla::FindOption flags, Sci::Position *lengthChange);
 	Scintilla::LineCharacterIndexType LineCharacterIndex() const noexcept;
 	void AllocateLineCharacterIndex(Scintilla::LineCharacterIndexType lineCharacterIndex);
 	void ReleaseLineCharacterIndex(Scintilla::LineCharacterIndexType lineCharacterIndex);
@@ -502,6 +526,8 @@ public:
 	bool SCI_METHOD SetStyles(Sci_Position length, const char *styles) override;
 	Sci::Position GetEndStyled() const noexcept { return endStyled; }
 	void EnsureStyledTo(Sci::Position pos);
+	void MoveStyleWindow(Sci::Position pos);
+	void RecordStyleCheckpoints(Sci::Line lineFirst, Sci::Line lineLast);
 	void StyleToAdjustingLineDuration(Sci::Position pos);
 	int GetStyleClock() const noexcept { return styleClock; }
 	void IncrementStyleClock() noexcept;
@@ -548,6 +574,8 @@ public:
 	Sci::Position BraceMatch(Sci::Position position, Sci::Position maxReStyle, Sci::Position startPos, bool useStartPos) noexcept;
 
 private:
+	template <typename LineTransform>
+	Sci::Line TransformLines(Sci::Position start, Sci::Position end, bool wholeLines, Sci::Position *lengthChange, LineTransform transform);
 	void NotifyModifyAttempt();
 	void NotifySavePoint(bool atSavePoint);
 	void NotifyModified(DocModification mh);
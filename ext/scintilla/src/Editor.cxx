@@ -101,6 +101,23 @@ constexpr bool IsLastStep(const DocModification &mh) noexcept {
 	    && (FlagSet(mh.modificationType, ModificationFlags::MultilineUndoRedo));
 }
 
+class TextSnapshotReader final : public ITextSnapshot {
+	TextSnapshot snapshot;
+public:
+	explicit TextSnapshotReader(TextSnapshot snapshot_) noexcept : snapshot(std::move(snapshot_)) {
+	}
+	int SCI_METHOD Release() override {
+		delete this;
+		return 0;
+	}
+	Sci_Position SCI_METHOD Length() const override {
+		return snapshot.Length();
+	}
+	bool SCI_METHOD GetCharRange(char *buffer, Sci_Position position, Sci_Position lengthRetrieve) const override {
+		return snapshot.GetCharRange(buffer, position, lengthRetrieve);
+	}
+};
+
 }
 
 Timer::Timer() noexcept :
@@ -168,6 +185,7 @@ Editor::Editor() : durationWrapOneByte(0.000001, 0.00000001, 0.00001) {
 	mouseSelectionRectangularSwitch = false;
 	multipleSelection = false;
 	additionalSelectionTyping = false;
+	replacingSelectionsTogether = false;
 	multiPasteMode = MultiPaste::Once;
 	virtualSpaceOptions = VirtualSpace::None;
 
@@ -1941,6 +1959,76 @@ void Editor::FilterSelections() {
 	}
 }
 
+// Replaces the text of multiple selections, or the character after each empty selection when
+// overstriking, with one pass through the document instead of a change for each selection that
+// moves all the others. Returns false without changing anything when the selections have to be
+// handled one at a time because they are rectangular, overlap or include virtual space.
+bool Editor::ReplaceSelectionsTogether(std::string_view text, bool overstrike) {
+	if ((sel.Count() < 2) || sel.IsRectangular()) {
+		return false;
+	}
+	std::vector<SelectionRange *> selPtrs;
+	for (size_t r = 0; r < sel.Count(); r++) {
+		if (sel.Range(r).caret.VirtualSpace() || sel.Range(r).anchor.VirtualSpace()) {
+			return false;
+		}
+		selPtrs.push_back(&sel.Range(r));
+	}
+	std::sort(selPtrs.begin(), selPtrs.end(),
+		[](const SelectionRange *a, const SelectionRange *b) noexcept {return *a < *b;});
+
+	std::vector<RangeReplacement> replacements;
+	std::vector<bool> replaced;
+	Sci::Position previousEnd = 0;
+	for (const SelectionRange *range : selPtrs) {
+		const Sci::Position start = range->Start().Position();
+		Sci::Position lengthDelete = range->Length();
+		if (overstrike && range->Empty() && (start < pdoc->Length()) && !pdoc->IsPositionInLineEnd(start)) {
+			lengthDelete = pdoc->LenChar(start);
+		}
+		if (start < previousEnd) {
+			return false;
+		}
+		previousEnd = std::max(range->End().Position(), start + lengthDelete);
+		const bool replace = (lengthDelete > 0 || !text.empty()) &&
+			!RangeContainsProtected(start, range->End().Position());
+		if (replace) {
+			replacements.push_back({ start, lengthDelete, text });
+		}
+		replaced.push_back(replace);
+	}
+
+	// Many separate changes so redraw once instead of invalidating each one
+	Redraw();
+	replacingSelectionsTogether = true;
+	bool changed = false;
+	try {
+		changed = pdoc->ReplaceRanges(replacements);
+	} catch (...) {
+		replacingSelectionsTogether = false;
+		throw;
+	}
+	replacingSelectionsTogether = false;
+	if (!changed) {
+		return true;
+	}
+
+	// Put each replaced selection after its new text and move the others by the changes before them
+	Sci::Position shift = 0;
+	std::vector<RangeReplacement>::const_iterator replacement = replacements.begin();
+	for (size_t i = 0; i < selPtrs.size(); i++) {
+		if (replaced[i]) {
+			*selPtrs[i] = SelectionRange(replacement->position + replacement->lengthInserted);
+			shift += replacement->lengthInserted - replacement->lengthDelete;
+			++replacement;
+		} else {
+			selPtrs[i]->caret.Add(shift);
+			selPtrs[i]->anchor.Add(shift);
+		}
+	}
+	return true;
+}
+
 // InsertCharacter inserts a character encoded in document code page.
 void Editor::InsertCharacter(std::string_view sv, CharacterSource charSource) {
 	if (sv.empty()) {
@@ -1951,51 +2039,65 @@ void Editor::InsertCharacter(std::string_view sv, CharacterSource charSource) {
 	{
 		UndoGroup ug(pdoc, (sel.Count() > 1) || !sel.Empty() || inOverstrike);
 
-		// Vector elements point into selection in order to change selection.
-		std::vector<SelectionRange *> selPtrs;
-		for (size_t r = 0; r < sel.Count(); r++) {
-			selPtrs.push_back(&sel.Range(r));
-		}
-		// Order selections by position in document.
-		std::sort(selPtrs.begin(), selPtrs.end(),
-			[](const SelectionRange *a, const SelectionRange *b) noexcept {return *a < *b;});
-
-		// Loop in reverse to avoid disturbing positions of selections yet to be processed.
-		for (std::vector<SelectionRange *>::reverse_iterator rit = selPtrs.rbegin();
-			rit != selPtrs.rend(); ++rit) {
-			SelectionRange *currentSel = *rit;
-			if (!RangeContainsProtected(currentSel->Start().Position(),
-				currentSel->End().Position())) {
-				Sci::Position positionInsert = currentSel->Start().Position();
-				if (!currentSel->Empty()) {
-					if (currentSel->Length()) {
-						pdoc->DeleteChars(positionInsert, currentSel->Length());
-						currentSel->ClearVirtualSpace();
-					} else {
-						// Range is all virtual so collapse to start of virtual space
-						currentSel->MinimizeVirtualSpace();
+		if (ReplaceSelectionsTogether(sv, inOverstrike)) {
+			// If in wrap mode rewrap the changed lines so EnsureCaretVisible has accurate information
+			if (Wrapping()) {
+				AutoSurface surface(this);
+				if (surface) {
+					for (size_t r = 0; r < sel.Count(); r++) {
+						if (WrapOneLine(surface, pdoc->SciLineFromPosition(sel.Range(r).caret.Position()))) {
+							wrapOccurred = true;
+						}
 					}
-				} else if (inOverstrike) {
-					if (positionInsert < pdoc->Length()) {
-						if (!pdoc->IsPositionInLineEnd(positionInsert)) {
-							pdoc->DelChar(positionInsert);
+				}
+			}
+		} else {
+			// Vector elements point into selection in order to change selection.
+			std::vector<SelectionRange *> selPtrs;
+			for (size_t r = 0; r < sel.Count(); r++) {
+				selPtrs.push_back(&sel.Range(r));
+			}
+			// Order selections by position in document.
+			std::sort(selPtrs.begin(), selPtrs.end(),
+				[](const SelectionRange *a, const SelectionRange *b) noexcept {return *a < *b;});
+
+			// Loop in reverse to avoid disturbing positions of selections yet to be processed.
+			for (std::vector<SelectionRange *>::reverse_iterator rit = selPtrs.rbegin();
+				rit != selPtrs.rend(); ++rit) {
+				SelectionRange *currentSel = *rit;
+				if (!RangeContainsProtected(currentSel->Start().Position(),
+					currentSel->End().Position())) {
+					Sci::Position positionInsert = currentSel->Start().Position();
+					if (!currentSel->Empty()) {
+						if (currentSel->Length()) {
+							pdoc->DeleteChars(positionInsert, currentSel->Length());
 							currentSel->ClearVirtualSpace();
+						} else {
+							// Range is all virtual so collapse to start of virtual space
+							currentSel->MinimizeVirtualSpace();
+						}
+					} else if (inOverstrike) {
+						if (positionInsert < pdoc->Length()) {
+							if (!pdoc->IsPositionInLineEnd(positionInsert)) {
+								pdoc->DelChar(positionInsert);
+								currentSel->ClearVirtualSpace();
+							}
 						}
 					}
-				}
-				positionInsert = RealizeVirtualSpace(positionInsert, currentSel->caret.VirtualSpace());
-				const Sci::Position lengthInserted = pdoc->InsertString(positionInsert, sv);
-				if (lengthInserted > 0) {
-					currentSel->caret.SetPosition(positionInsert + lengthInserted);
-					currentSel->anchor.SetPosition(positionInsert + lengthInserted);
-				}
-				currentSel->ClearVirtualSpace();
-				// If in wrap mode rewrap current line so EnsureCaretVisible has accurate information
-				if (Wrapping()) {
-					AutoSurface surface(this);
-					if (surface) {
-						if (WrapOneLine(surface, pdoc->SciLineFromPosition(positionInsert))) {
-							wrapOccurred = true;
+					positionInsert = RealizeVirtualSpace(positionInsert, currentSel->caret.VirtualSpace());
+					const Sci::Position lengthInserted = pdoc->InsertString(positionInsert, sv);
+					if (lengthInserted > 0) {
+						currentSel->caret.SetPosition(positionInsert + lengthInserted);
+						currentSel->anchor.SetPosition(positionInsert + lengthInserted);
+					}
+					currentSel->ClearVirtualSpace();
+					// If in wrap mode rewrap current line so EnsureCaretVisible has accurate information
+					if (Wrapping()) {
+						AutoSurface surface(this);
+						if (surface) {
+							if (WrapOneLine(surface, pdoc->SciLineFromPosition(positionInsert))) {
+								wrapOccurred = true;
+							}
 						}
 					}
 				}
@@ -2134,13 +2236,15 @@ void Editor::ClearSelection(bool retainMultipleSelections) {
 	if (!sel.IsRectangular() && !retainMultipleSelections)
 		FilterSelections();
 	UndoGroup ug(pdoc);
-	for (size_t r=0; r<sel.Count(); r++) {
-		if (!sel.Range(r).Empty()) {
-			if (!RangeContainsProtected(sel.Range(r).Start().Position(),
-				sel.Range(r).End().Position())) {
-				pdoc->DeleteChars(sel.Range(r).Start().Position(),
-					sel.Range(r).Length());
-				sel.Range(r) = SelectionRange(sel.Range(r).Start());
+	if (!ReplaceSelectionsTogether({}, false)) {
+		for (size_t r=0; r<sel.Count(); r++) {
+			if (!sel.Range(r).Empty()) {
+				if (!RangeContainsProtected(sel.Range(r).Start().Position(),
+					sel.Range(r).End().Position())) {
+					pdoc->DeleteChars(sel.Range(r).Start().Position(),
+						sel.Range(r).Length());
+					sel.Range(r) = SelectionRange(sel.Range(r).Start());
+				}
 			}
 		}
 	}
@@ -2551,7 +2655,11 @@ void Editor::CheckModificationForWrap(DocModification mh) {
 	if (FlagSet(mh.modificationType, ModificationFlags::InsertText | ModificationFlags::DeleteText)) {
 		view.llc.Invalidate(LineLayout::ValidLevel::checkTextAndStyle);
 		const Sci::Line lineDoc = pdoc->SciLineFromPosition(mh.position);
-		const Sci::Line lines = std::max(static_cast<Sci::Line>(0), mh.linesAdded);
+		Sci::Line lines = std::max(static_cast<Sci::Line>(0), mh.linesAdded);
+		if (FlagSet(mh.modificationType, ModificationFlags::InsertText)) {
+			// Text replacing lines may span lines without adding any
+			lines = std::max(lines, pdoc->SciLineFromPosition(mh.position + mh.length) - lineDoc);
+		}
 		if (Wrapping()) {
 			NeedWrapping(lineDoc, lineDoc + lines + 1);
 		}
@@ -2633,11 +2741,13 @@ void Editor::NotifyModified(Document *, DocModification mh, void *) {
 	} else {
 		// Move selection and brace highlights
 		if (FlagSet(mh.modificationType, ModificationFlags::InsertText)) {
-			sel.MovePositions(true, mh.position, mh.length);
+			if (!replacingSelectionsTogether)
+				sel.MovePositions(true, mh.position, mh.length);
 			braces[0] = MovePositionForInsertion(braces[0], mh.position, mh.length);
 			braces[1] = MovePositionForInsertion(braces[1], mh.position, mh.length);
 		} else if (FlagSet(mh.modificationType, ModificationFlags::DeleteText)) {
-			sel.MovePositions(false, mh.position, mh.length);
+			if (!replacingSelectionsTogether)
+				sel.MovePositions(false, mh.position, mh.length);
 			braces[0] = MovePositionForDeletion(braces[0], mh.position, mh.length);
 			braces[1] = MovePositionForDeletion(braces[1], mh.position, mh.length);
 		}
@@ -2860,6 +2970,7 @@ void Editor::NotifyMacroRecord(Message iMessage, uptr_t wParam, sptr_t lParam) {
 	case Message::LineDuplicate:
 	case Message::LowerCase:
 	case Message::UpperCase:
+	case Message::TitleCase:
 	case Message::LineScrollDown:
 	case Message::LineScrollUp:
 	case Message::DeleteBackNotLine:
@@ -2957,6 +3068,10 @@ void Editor::PageMove(int direction, Selection::SelTypes selt, bool stuttered) {
 }
 
 void Editor::ChangeCaseOfSelection(CaseMapping caseMapping) {
+	if ((pdoc->dbcsCodePage == CpUtf8) && (caseMapping != CaseMapping::same)) {
+		TransformCaseOfSelection((caseMapping == CaseMapping::upper) ? CaseTransform::upper : CaseTransform::lower);
+		return;
+	}
 	UndoGroup ug(pdoc);
 	for (size_t r=0; r<sel.Count(); r++) {
 		SelectionRange current = sel.Range(r);
@@ -3001,6 +3116,27 @@ void Editor::ChangeCaseOfSelection(CaseMapping caseMapping) {
 	}
 }
 
+// Only the changed parts of each line are replaced so markers stay where they are.
+void Editor::TransformCaseOfSelection(CaseTransform transform) {
+	UndoGroup ug(pdoc);
+	for (size_t r=0; r<sel.Count(); r++) {
+		SelectionRange current = sel.Range(r);
+		SelectionRange currentNoVS = current;
+		currentNoVS.ClearVirtualSpace();
+		if (currentNoVS.Length() > 0) {
+			Sci::Position lengthChange = 0;
+			if (pdoc->TransformCase(currentNoVS.Start().Position(), currentNoVS.End().Position(), transform, &lengthChange)) {
+				// Automatic movement changes selection so reset to exactly the same as it was.
+				if (current.anchor > current.caret)
+					current.anchor.Add(lengthChange);
+				else
+					current.caret.Add(lengthChange);
+				sel.Range(r) = current;
+			}
+		}
+	}
+}
+
 void Editor::LineTranspose() {
 	const Sci::Line line = pdoc->SciLineFromPosition(sel.MainCaret());
 	if (line > 0) {
@@ -3958,6 +4094,9 @@ int Editor::KeyCommand(Message iMessage) {
 	case Message::UpperCase:
 		ChangeCaseOfSelection(CaseMapping::upper);
 		break;
+	case Message::TitleCase:
+		TransformCaseOfSelection(CaseTransform::title);
+		break;
 	case Message::ScrollToStart:
 		ScrollTo(0);
 		break;
@@ -4229,6 +4368,36 @@ Sci::Position Editor::SearchInTarget(const char *text, Sci::Position length) {
 	}
 }
 
+Sci::Position Editor::ReplaceAllInTarget(std::string_view search, std::string_view replacement) {
+	if (!pdoc->HasCaseFolder())
+		pdoc->SetCaseFolder(CaseFolderForEncoding());
+	try {
+		Sci::Position lengthChange = 0;
+		const Sci::Position replacements = pdoc->ReplaceAll(targetRange.start.Position(), targetRange.end.Position(),
+			search, replacement, searchFlags, &lengthChange);
+		targetRange.end.SetPosition(targetRange.end.Position() + lengthChange);
+		return replacements;
+	} catch (RegexError &) {
+		errorStatus = Status::RegEx;
+		return -1;
+	}
+}
+
+Sci::Line Editor::TransformWhitespaceInTarget(Message iMessage, bool skipQuoted) {
+	const Sci::Position start = targetRange.start.Position();
+	const Sci::Position end = targetRange.end.Position();
+	Sci::Position lengthChange = 0;
+	Sci::Line linesChanged = 0;
+	if (iMessage == Message::TrimTrailingWhitespaceInTarget)
+		linesChanged = pdoc->TrimTrailingWhitespace(start, end, &lengthChange);
+	else if (iMessage == Message::TabsToSpacesInTarget)
+		linesChanged = pdoc->TabsToSpaces(start, end, skipQuoted, &lengthChange);
+	else
+		linesChanged = pdoc->SpacesToTabs(start, end, skipQuoted, &lengthChange);
+	targetRange.end.SetPosition(std::clamp<Sci::Position>(end + lengthChange, start, pdoc->Length()));
+	return linesChanged;
+}
+
 void Editor::GoToLine(Sci::Line lineNo) {
 	if (lineNo > pdoc->LinesTotal())
 		lineNo = pdoc->LinesTotal();
@@ -5470,7 +5639,7 @@ void Editor::FoldExpand(Sci::Line line, FoldAction action, FoldLevel level) {
 	while (line <= lineMaxSubord) {
 		const FoldLevel levelLine = pdoc->GetFoldLevel(line);
 		if (LevelIsHeader(levelLine)) {
-			SetFoldExpanded(line, expanding);
+			pcs->SetExpanded(line, expanding);
 		}
 		line++;
 	}
@@ -5574,8 +5743,10 @@ void Editor::FoldAll(FoldAction action) {
 		for (; line < maxLine; line++) {
 			const FoldLevel level = pdoc->GetFoldLevel(line);
 			if (LevelIsHeader(level)) {
+				// The whole view is redrawn at the end so contraction state is updated
+				// directly rather than through SetFoldExpanded which redraws the margin.
 				if (FoldLevel::Base == LevelNumberPart(level)) {
-					SetFoldExpanded(line, false);
+					pcs->SetExpanded(line, false);
 					const Sci::Line lineMaxSubord = pdoc->GetLastChild(line);
 					if (lineMaxSubord > line) {
 						pcs->SetVisible(line + 1, lineMaxSubord, false);
@@ -5584,7 +5755,7 @@ void Editor::FoldAll(FoldAction action) {
 						}
 					}
 				} else if (contractAll) {
-					SetFoldExpanded(line, false);
+					pcs->SetExpanded(line, false);
 				}
 			}
 		}
@@ -6112,6 +6283,12 @@ sptr_t Editor::WndProc(Message iMessage, uptr_t wParam, sptr_t lParam) {
 	case Message::GetModify:
 		return !pdoc->IsSavePoint();
 
+	case Message::GetUnsavedStart:
+		return pdoc->UnsavedStart();
+
+	case Message::GetUnsavedEnd:
+		return pdoc->UnsavedEnd();
+
 	case Message::SetSel: {
 			Sci::Position nStart = PositionFromUPtr(wParam);
 			Sci::Position nEnd = lParam;
@@ -6242,6 +6419,18 @@ sptr_t Editor::WndProc(Message iMessage, uptr_t wParam, sptr_t lParam) {
 		PLATFORM_ASSERT(lParam);
 		return SearchInTarget(ConstCharPtrFromSPtr(lParam), PositionFromUPtr(wParam));
 
+	case Message::ReplaceAllInTarget: {
+			PLATFORM_ASSERT(lParam);
+			const TextToReplace *tr = static_cast<const TextToReplace *>(PtrFromSPtr(lParam));
+			return ReplaceAllInTarget(std::string_view(tr->lpstrSearch, tr->searchLength),
+				std::string_view(tr->lpstrReplacement, tr->replacementLength));
+		}
+
+	case Message::TrimTrailingWhitespaceInTarget:
+	case Message::TabsToSpacesInTarget:
+	case Message::SpacesToTabsInTarget:
+		return TransformWhitespaceInTarget(iMessage, wParam != 0);
+
 	case Message::SetSearchFlags:
 		searchFlags = static_cast<FindOption>(wParam);
 		break;
@@ -7943,6 +8132,7 @@ sptr_t Editor::WndProc(Message iMessage, uptr_t wParam, sptr_t lParam) {
 	case Message::LineDuplicate:
 	case Message::LowerCase:
 	case Message::UpperCase:
+	case Message::TitleCase:
 	case Message::LineScrollDown:
 	case Message::LineScrollUp:
 	case Message::WordPartLeft:
@@ -8103,6 +8293,9 @@ sptr_t Editor::WndProc(Message iMessage, uptr_t wParam, sptr_t lParam) {
 			return reinterpret_cast<sptr_t>(static_cast<ILoader *>(doc));
 		}
 
+	case Message::TakeTextSnapshot:
+		return reinterpret_cast<sptr_t>(static_cast<ITextSnapshot *>(new TextSnapshotReader(pdoc->TakeSnapshot())));
+
 	case Message::SetModEventMask:
 		modEventMask = static_cast<ModificationFlags>(wParam);
 		return 0;
@@ -218,6 +218,7 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	bool mouseSelectionRectangularSwitch;
 	bool multipleSelection;
 	bool additionalSelectionTyping;
+	bool replacingSelectionsTogether;	///< Selections are set after the change instead of moved by each part
 	Scintilla::MultiPaste multiPasteMode;
 
 	Scintilla::VirtualSpace virtualSpaceOptions;
@@ -419,6 +420,7 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	void ChangeSize();
 
 	void FilterSelections();
+	bool ReplaceSelectionsTogether(std::string_view text, bool overstrike);
 	Sci::Position RealizeVirtualSpace(Sci::Position position, Sci::Position virtualSpace);
 	SelectionPosition RealizeVirtualSpace(const SelectionPosition &position);
 	void AddChar(char ch);
@@ -479,6 +481,7 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	enum class CaseMapping { same, upper, lower };
 	virtual std::string CaseMapString(const std::string &s, CaseMapping caseMapping);
 	void ChangeCaseOfSelection(CaseMapping caseMapping);
+	void TransformCaseOfSelection(CaseTransform transform);
 	void LineTranspose();
 	void LineReverse();
 	void Duplicate(bool forLine);
@@ -506,6 +509,8 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	void SearchAnchor() noexcept;
 	Sci::Position SearchText(Scintilla::Message iMessage, Scintilla::uptr_t wParam, Scintilla::sptr_t lParam);
 	Sci::Position SearchInTarget(const char *text, Sci::Position length);
+	Sci::Position ReplaceAllInTarget(std::string_view search, std::string_view replacement);
+	Sci::Line TransformWhitespaceInTarget(Scintilla::Message iMessage, bool skipQuoted);
 	void GoToLine(Sci::Line lineNo);
 
 	virtual void CopyToClipboard(const SelectionText &selectedText) = 0;
@@ -212,14 +212,211 @@ void LineMarkers::DeleteMarkFromHandle(int markerHandle) {
 	}
 }
 
+namespace {
+
+constexpr int numberMask = static_cast<int>(Scintilla::FoldLevel::NumberMask);
+constexpr int whiteFlag = static_cast<int>(Scintilla::FoldLevel::WhiteFlag);
+constexpr int headerFlag = static_cast<int>(Scintilla::FoldLevel::HeaderFlag);
+
+constexpr bool IsHeaderBelow(int level, int levelNumber) noexcept {
+	return (level & headerFlag) && ((level & numberMask) < levelNumber);
+}
+
+constexpr bool IsContentAtMost(int level, int levelNumber) noexcept {
+	return !(level & whiteFlag) && ((level & numberMask) <= levelNumber);
+}
+
+// Searches closer than this are performed directly on the levels to avoid refreshing the index
+constexpr Sci::Line linearSearchLines = 256;
+
+}
+
+LevelIndex::Minima LevelIndex::BlockMinima(const SplitVector<int> &levels, Sci::Line lineStart, Sci::Line lineEnd) noexcept {
+	Minima minima { 0xFFFF, 0xFFFF };
+	for (Sci::Line line = lineStart; line < lineEnd; line++) {
+		const int level = levels[line];
+		const unsigned short levelNumber = static_cast<unsigned short>(level & numberMask);
+		if ((level & headerFlag) && (levelNumber < minima.header)) {
+			minima.header = levelNumber;
+		}
+		if (!(level & whiteFlag) && (levelNumber < minima.content)) {
+			minima.content = levelNumber;
+		}
+	}
+	return minima;
+}
+
+void LevelIndex::Clear() noexcept {
+	tree.clear();
+	leaves = 0;
+	linesIndexed = 0;
+	staleStart = 0;
+	staleEnd = 0;
+}
+
+void LevelIndex::Invalidate(Sci::Line lineStart, Sci::Line lineEnd) noexcept {
+	if (staleStart >= staleEnd) {
+		staleStart = lineStart;
+		staleEnd = lineEnd;
+	} else {
+		staleStart = std::min(staleStart, lineStart);
+		staleEnd = std::max(staleEnd, lineEnd);
+	}
+}
+
+void LevelIndex::Refresh(const SplitVector<int> &levels) {
+	const Sci::Line lines = levels.Length();
+	const size_t blocks = static_cast<size_t>((lines + blockSize - 1) / blockSize);
+	if (blocks > leaves) {
+		// Grow with some slack so appending lines does not rebuild every time
+		size_t leavesNew = 1;
+		while (leavesNew < blocks + blocks / 4) {
+			leavesNew *= 2;
+		}
+		tree.assign(leavesNew * 2, Minima { 0xFFFF, 0xFFFF });
+		leaves = leavesNew;
+		staleStart = 0;
+		staleEnd = lines;
+	}
+	if (staleStart >= staleEnd) {
+		linesIndexed = lines;
+		return;
+	}
+	// Blocks that held lines before a deletion also need to be recalculated
+	const Sci::Line lineLast = std::min(staleEnd, std::max(lines, linesIndexed)) - 1;
+	if (lineLast >= staleStart) {
+		const size_t blockFirst = static_cast<size_t>(staleStart / blockSize);
+		const size_t blockLast = std::min(static_cast<size_t>(lineLast / blockSize), leaves - 1);
+		for (size_t block = blockFirst; block <= blockLast; block++) {
+			const Sci::Line lineStart = static_cast<Sci::Line>(block) * blockSize;
+			const Sci::Line lineEnd = std::min(lineStart + blockSize, lines);
+			tree[leaves + block] = BlockMinima(levels, lineStart, lineEnd);
+		}
+		for (size_t first = (leaves + blockFirst) / 2, last = (leaves + blockLast) / 2; first > 0; first /= 2, last /= 2) {
+			for (size_t node = first; node <= last; node++) {
+				const Minima &left = tree[node * 2];
+				const Minima &right = tree[node * 2 + 1];
+				tree[node] = Minima { std::min(left.header, right.header), std::min(left.content, right.content) };
+			}
+		}
+	}
+	linesIndexed = lines;
+	staleStart = 0;
+	staleEnd = 0;
+}
+
+size_t LevelIndex::FirstBlockContentAtMost(size_t block, int levelNumber) const noexcept {
+	if (block >= leaves) {
+		return noBlock;
+	}
+	size_t node = leaves + block;
+	while (tree[node].content > levelNumber) {
+		// Move to the next subtree to the right
+		while (node & 1) {
+			node /= 2;
+		}
+		if (node == 0) {
+			return noBlock;
+		}
+		node++;
+	}
+	while (node < leaves) {
+		node *= 2;
+		if (tree[node].content > levelNumber) {
+			node++;
+		}
+	}
+	return node - leaves;
+}
+
+size_t LevelIndex::LastBlockHeaderBelow(size_t block, int levelNumber) const noexcept {
+	if (leaves == 0) {
+		return noBlock;
+	}
+	size_t node = leaves + std::min(block, leaves - 1);
+	while (tree[node].header >= levelNumber) {
+		// Move to the next subtree to the left
+		while ((node > 1) && !(node & 1)) {
+			node /= 2;
+		}
+		if (node == 1) {
+			return noBlock;
+		}
+		node--;
+	}
+	while (node < leaves) {
+		node = node * 2 + 1;
+		if (tree[node].header >= levelNumber) {
+			node--;
+		}
+	}
+	return node - leaves;
+}
+
+Sci::Line LevelIndex::PreviousHeaderBelow(const SplitVector<int> &levels, Sci::Line line, int levelNumber) const noexcept {
+	Sci::Line lineLook = std::min(line, levels.Length()) - 1;
+	if (lineLook < 0) {
+		return -1;
+	}
+	const Sci::Line blockStart = lineLook - lineLook % blockSize;
+	for (; lineLook >= blockStart; lineLook--) {
+		if (IsHeaderBelow(levels[lineLook], levelNumber)) {
+			return lineLook;
+		}
+	}
+	if (blockStart == 0) {
+		return -1;
+	}
+	const size_t block = LastBlockHeaderBelow(static_cast<size_t>(blockStart / blockSize) - 1, levelNumber);
+	if (block == noBlock) {
+		return -1;
+	}
+	const Sci::Line lineBlock = static_cast<Sci::Line>(block) * blockSize;
+	for (lineLook = lineBlock + blockSize - 1; lineLook >= lineBlock; lineLook--) {
+		if (IsHeaderBelow(levels[lineLook], levelNumber)) {
+			return lineLook;
+		}
+	}
+	return -1;
+}
+
+Sci::Line LevelIndex::NextContentAtMost(const SplitVector<int> &levels, Sci::Line lineStart, Sci::Line lineEnd, int levelNumber) const noexcept {
+	lineEnd = std::min(lineEnd, levels.Length());
+	Sci::Line lineLook = lineStart;
+	const Sci::Line blockEnd = std::min(lineEnd, lineStart - lineStart % blockSize + blockSize);
+	for (; lineLook < blockEnd; lineLook++) {
+		if (IsContentAtMost(levels[lineLook], levelNumber)) {
+			return lineLook;
+		}
+	}
+	if (lineLook >= lineEnd) {
+		return -1;
+	}
+	const size_t block = FirstBlockContentAtMost(static_cast<size_t>(lineLook / blockSize), levelNumber);
+	if (block == noBlock) {
+		return -1;
+	}
+	const Sci::Line lineBlock = static_cast<Sci::Line>(block) * blockSize;
+	const Sci::Line lineBlockEnd = std::min(lineEnd, lineBlock + blockSize);
+	for (lineLook = lineBlock; lineLook < lineBlockEnd; lineLook++) {
+		if (IsContentAtMost(levels[lineLook], levelNumber)) {
+			return lineLook;
+		}
+	}
+	return -1;
+}
+
 void LineLevels::Init() {
 	levels.DeleteAll();
+	index.Clear();
 }
 
 void LineLevels::InsertLine(Sci::Line line) {
 	if (levels.Length()) {
 		const int level = (line < levels.Length()) ? levels[line] : static_cast<int>(Scintilla::FoldLevel::Base);
 		levels.Insert(line, level);
+		// Following lines move so the index is stale from here on
+		index.Invalidate(line, levels.Length());
 	}
 }
 
@@ -227,6 +424,7 @@ void LineLevels::InsertLines(Sci::Line line, Sci::Line lines) {
 	if (levels.Length()) {
 		const int level = (line < levels.Length()) ? levels[line] : static_cast<int>(Scintilla::FoldLevel::Base);
 		levels.InsertValue(line, lines, level);
+		index.Invalidate(line, levels.Length());
 	}
 }
 
@@ -240,15 +438,19 @@ void LineLevels::RemoveLine(Sci::Line line) {
 			levels[line-1] &= ~static_cast<int>(Scintilla::FoldLevel::HeaderFlag);
 		else if (line > 0)
 			levels[line-1] |= firstHeader;
+		index.Invalidate(std::max<Sci::Line>(line - 1, 0), levels.Length() + 1);
 	}
 }
 
 void LineLevels::ExpandLevels(Sci::Line sizeNew) {
+	const Sci::Line sizeOld = levels.Length();
 	levels.InsertValue(levels.Length(), sizeNew - levels.Length(), static_cast<int>(Scintilla::FoldLevel::Base));
+	index.Invalidate(sizeOld, levels.Length());
 }
 
 void LineLevels::ClearLevels() {
 	levels.DeleteAll();
+	index.Clear();
 }
 
 int LineLevels::SetLevel(Sci::Line line, int level, Sci::Line lines) {
@@ -258,7 +460,10 @@ int LineLevels::SetLevel(Sci::Line line, int level, Sci::Line lines) {
 			ExpandLevels(lines + 1);
 		}
 		prev = levels[line];
-		levels[line] = level;
+		if (prev != level) {
+			levels[line] = level;
+			index.Invalidate(line, line + 1);
+		}
 	}
 	return prev;
 }
@@ -279,13 +484,59 @@ Scintilla::FoldLevel LineLevels::GetFoldLevel(Sci::Line line) const noexcept {
 
 Sci::Line LineLevels::GetFoldParent(Sci::Line line) const noexcept {
 	const FoldLevel level = LevelNumberPart(GetFoldLevel(line));
-	for (Sci::Line lineLook = line - 1; lineLook >= 0; lineLook--) {
+	const Sci::Line lineScanEnd = std::max<Sci::Line>(line - linearSearchLines, 0);
+	Sci::Line lineLook = line - 1;
+	for (; lineLook >= lineScanEnd; lineLook--) {
 		const FoldLevel levelTry = GetFoldLevel(lineLook);
 		if (LevelIsHeader(levelTry) && LevelNumberPart(levelTry) < level) {
 			return lineLook;
 		}
 	}
-	return -1;
+	if (lineLook < 0) {
+		return -1;
+	}
+	try {
+		index.Refresh(levels);
+	} catch (...) {
+		// Fall back to scanning when the index can not be allocated
+		for (; lineLook >= 0; lineLook--) {
+			const FoldLevel levelTry = GetFoldLevel(lineLook);
+			if (LevelIsHeader(levelTry) && LevelNumberPart(levelTry) < level) {
+				return lineLook;
+			}
+		}
+		return -1;
+	}
+	return index.PreviousHeaderBelow(levels, lineLook + 1, static_cast<int>(level));
+}
+
+Sci::Line LineLevels::FindLevelAtMost(Sci::Line lineStart, Sci::Line lineEnd, Scintilla::FoldLevel level) const noexcept {
+	const int levelNumber = LevelNumber(level);
+	const Sci::Line lineLevelsEnd = std::min(lineEnd, levels.Length());
+	Sci::Line lineFound = -1;
+	if ((lineLevelsEnd - lineStart) <= linearSearchLines) {
+		for (Sci::Line lineLook = lineStart; lineLook < lineLevelsEnd; lineLook++) {
+			if (IsContentAtMost(levels[lineLook], levelNumber)) {
+				return lineLook;
+			}
+		}
+	} else {
+		try {
+			index.Refresh(levels);
+			lineFound = index.NextContentAtMost(levels, lineStart, lineLevelsEnd, levelNumber);
+		} catch (...) {
+			for (Sci::Line lineLook = lineStart; lineLook < lineLevelsEnd; lineLook++) {
+				if (IsContentAtMost(levels[lineLook], levelNumber)) {
+					return lineLook;
+				}
+			}
+		}
+	}
+	if ((lineFound < 0) && (lineEnd > lineLevelsEnd) && (static_cast<int>(Scintilla::FoldLevel::Base) <= levelNumber)) {
+		// Lines without stored levels are at the base level
+		lineFound = std::max(lineStart, lineLevelsEnd);
+	}
+	return lineFound;
 }
 
 void LineState::Init() {
@@ -61,8 +61,41 @@ public:
 	int NumberFromLine(Sci::Line line, int which) const noexcept;
 };
 
+/**
+ * Summarises fold levels over blocks of lines as a segment tree so the nearest
+ * fold header or fold block end can be found in O(log n) instead of visiting
+ * every line. Changes only mark lines as stale and the tree is brought up to
+ * date for those lines when next searched.
+ */
+class LevelIndex {
+	static constexpr Sci::Line blockSize = 32;
+	static constexpr size_t noBlock = static_cast<size_t>(-1);
+	struct Minima {
+		unsigned short header;	///< Minimum level number of header lines
+		unsigned short content;	///< Minimum level number of non-whitespace lines
+	};
+	std::vector<Minima> tree;	///< tree[1] is the root and leaves start at tree[leaves]
+	size_t leaves = 0;
+	Sci::Line linesIndexed = 0;
+	Sci::Line staleStart = 0;
+	Sci::Line staleEnd = 0;
+
+	static Minima BlockMinima(const SplitVector<int> &levels, Sci::Line lineStart, Sci::Line lineEnd) noexcept;
+	size_t FirstBlockContentAtMost(size_t block, int levelNumber) const noexcept;
+	size_t LastBlockHeaderBelow(size_t block, int levelNumber) const noexcept;
+public:
+	void Clear() noexcept;
+	void Invalidate(Sci::Line lineStart, Sci::Line lineEnd) noexcept;
+	void Refresh(const SplitVector<int> &levels);
+	/// Last header line before line with a level number less than levelNumber or -1.
+	Sci::Line PreviousHeaderBelow(const SplitVector<int> &levels, Sci::Line line, int levelNumber) const noexcept;
+	/// First non-whitespace line in [lineStart, lineEnd) with a level number at most levelNumber or -1.
+	Sci::Line NextContentAtMost(const SplitVector<int> &levels, Sci::Line lineStart, Sci::Line lineEnd, int levelNumber) const noexcept;
+};
+
 class LineLevels : public PerLine {
 	SplitVector<int> levels;
+	mutable LevelIndex index;
 public:
 	LineLevels() {
 	}
@@ -77,6 +110,8 @@ public:
 	int GetLevel(Sci::Line line) const noexcept;
 	FoldLevel GetFoldLevel(Sci::Line line) const noexcept;
 	Sci::Line GetFoldParent(Sci::Line line) const noexcept;
+	/// First line in [lineStart, lineEnd) that is not whitespace with a level number at most level or -1.
+	Sci::Line FindLevelAtMost(Sci::Line lineStart, Sci::Line lineEnd, Scintilla::FoldLevel level) const noexcept;
 };
 
 class LineState : public PerLine {
@@ -0,0 +1,398 @@
+// Scintilla source code edit control
+/** @file PieceTable.h
+ ** Text held as pieces of an unchanging original text and of appended blocks.
+ **/
+// The License.txt file describes the conditions under which this software may be distributed.
+
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+namespace Scintilla::Internal {
+
+/**
+ * Text held as a list of pieces, each a range of either the original text, which never
+ * changes, or of the blocks that inserted text is appended to.
+ * Insertions and deletions only change the list of pieces, so their cost does not depend on
+ * where in the text they are, and the original text can be adopted without copying it.
+ * The methods are those of SplitVector<char> that CellBuffer uses. Contiguous access with
+ * RangePointer, BufferPointer and AllView copies the pieces of the range into a new piece.
+ * Blocks are never moved or changed once written so pointers to text stay valid until
+ * no piece is in them any more: BufferPointer and DeleteAll release them, and so does
+ * Consolidate once it copied half of the text since the last time. GetRange may be called
+ * on other threads while the table is read but not changed on its own thread. ValueAt remembers the last
+ * piece it read so is only for the owning thread.
+ * Share lets the text as it is now be read after the table changes by sharing the
+ * original and the blocks instead of copying them.
+ */
+class PieceTable {
+	static constexpr ptrdiff_t blockSize = 0x10000;
+	std::shared_ptr<const char[]> original;
+	ptrdiff_t originalLength = 0;
+	struct Block {
+		std::shared_ptr<char[]> text;
+		ptrdiff_t size;
+	};
+	std::vector<Block> blocks;
+	char *blockEnd = nullptr;	///< Where text is appended to the last block
+	ptrdiff_t blockSpace = 0;	///< Space left after blockEnd
+	ptrdiff_t copied = 0;	///< Text copied by Consolidate since unused storage was released
+	/// Piece i is the text at pieces[i] of the length of partition i.
+	/// Like the partitions, there is a single empty piece when the text is empty.
+	Partitioning<ptrdiff_t> starts;
+	SplitVector<const char *> pieces;
+	/// The text made by BufferPointer which is followed by a NUL
+	const char *terminated = nullptr;
+	ptrdiff_t terminatedLength = 0;
+	/// ValueAt reads [cachedStart, cachedEnd) from cachedText without searching the pieces
+	mutable ptrdiff_t cachedStart = 0;
+	mutable ptrdiff_t cachedEnd = 0;
+	mutable const char *cachedText = nullptr;
+
+	void Changed() noexcept {
+		cachedStart = 0;
+		cachedEnd = 0;
+		cachedText = nullptr;
+	}
+
+	ptrdiff_t PieceLength(ptrdiff_t piece) const noexcept {
+		return starts.PositionFromPartition(piece + 1) - starts.PositionFromPartition(piece);
+	}
+
+	/// Return space for text of length, in the last block if it fits.
+	char *Allocate(ptrdiff_t length) {
+		if (length > blockSpace) {
+			const ptrdiff_t size = std::max(length, blockSize);
+			blocks.push_back({ std::shared_ptr<char[]>(new char[size]), size });
+			blockEnd = blocks.back().text.get();
+			blockSpace = size;
+		}
+		char *text = blockEnd;
+		blockEnd += length;
+		blockSpace -= length;
+		return text;
+	}
+
+	/// Split the piece containing position so that a piece starts there.
+	/// @return the piece starting at position, or the number of pieces at the end of the text.
+	ptrdiff_t SplitAt(ptrdiff_t position) {
+		if (position >= Length())
+			return Pieces();
+		const ptrdiff_t piece = starts.PartitionFromPosition(position);
+		const ptrdiff_t pieceStart = starts.PositionFromPartition(piece);
+		if (pieceStart == position)
+			return piece;
+		starts.InsertPartition(piece + 1, position);
+		pieces.Insert(piece + 1, pieces[piece] + position - pieceStart);
+		return piece + 1;
+	}
+
+	/// Copy [position, position + rangeLength) into a new block as a single piece.
+	/// @return the piece
+	ptrdiff_t Consolidate(ptrdiff_t position, ptrdiff_t rangeLength) {
+		char *text = Allocate(rangeLength);
+		GetRange(text, position, rangeLength);
+		const ptrdiff_t first = SplitAt(position);
+		const ptrdiff_t last = SplitAt(position + rangeLength);
+		for (ptrdiff_t piece = first + 1; piece < last; piece++) {
+			starts.RemovePartition(first + 1);
+		}
+		pieces.DeleteRange(first + 1, last - first - 1);
+		pieces.SetValueAt(first, text);
+		// The copied text is no longer read from where it was so, once that adds up to half
+		// the text, release what no piece is in
+		copied += rangeLength;
+		if (copied > Length() / 2) {
+			ReleaseUnused();
+		}
+		return first;
+	}
+
+	/// Release the original and the blocks, other than the one appended to, that no piece is in.
+	void ReleaseUnused() {
+		copied = 0;
+		const std::less<const char *> before;
+		std::vector<size_t> order(blocks.size());
+		for (size_t block = 0; block < order.size(); block++) {
+			order[block] = block;
+		}
+		std::sort(order.begin(), order.end(), [&](size_t a, size_t b) noexcept {
+			return before(blocks[a].text.get(), blocks[b].text.get());
+		});
+		std::vector<bool> used(blocks.size());
+		bool originalUsed = false;
+		const ptrdiff_t count = Pieces();
+		for (ptrdiff_t piece = 0; piece < count; piece++) {
+			const char *text = pieces[piece];
+			if (!text)
+				continue;
+			if (original && !before(text, original.get()) && before(text, original.get() + originalLength)) {
+				originalUsed = true;
+				continue;
+			}
+			// The block holding text is the last one starting at or before it
+			const auto it = std::upper_bound(order.begin(), order.end(), text, [&](const char *t, size_t block) noexcept {
+				return before(t, blocks[block].text.get());
+			});
+			if (it != order.begin()) {
+				used[*(it - 1)] = true;
+			}
+		}
+		if (!originalUsed) {
+			original.reset();
+			originalLength = 0;
+		}
+		if (!blocks.empty()) {
+			used.back() = true;
+		}
+		size_t kept = 0;
+		for (size_t block = 0; block < blocks.size(); block++) {
+			if (used[block]) {
+				blocks[kept++] = std::move(blocks[block]);
+			} else if (blocks[block].text.get() == terminated) {
+				// A later block may be allocated at the same address
+				terminated = nullptr;
+			}
+		}
+		blocks.resize(kept);
+	}
+
+public:
+	PieceTable() {
+		pieces.Insert(0, nullptr);
+	}
+
+	ptrdiff_t Length() const noexcept {
+		return starts.Length();
+	}
+
+	ptrdiff_t Pieces() const noexcept {
+		return starts.Partitions();
+	}
+
+	/// The size of the original and the blocks.
+	ptrdiff_t Storage() const noexcept {
+		ptrdiff_t storage = originalLength;
+		for (const Block &block : blocks) {
+			storage += block.size;
+		}
+		return storage;
+	}
+
+	/// Text inserted from inside original is referenced instead of copied.
+	/// Only allowed while the table is empty as the text must not change later.
+	void SetOriginal(std::shared_ptr<const char[]> original_, ptrdiff_t originalLength_) {
+		PLATFORM_ASSERT(Length() == 0);
+		original = std::move(original_);
+		originalLength = originalLength_;
+	}
+
+	/// Make room to append text so the text can grow to newSize.
+	void ReAllocate(ptrdiff_t newSize) {
+		const ptrdiff_t growth = newSize - Length();
+		if (growth > blockSpace) {
+			blocks.push_back({ std::shared_ptr<char[]>(new char[growth]), growth });
+			blockEnd = blocks.back().text.get();
+			blockSpace = growth;
+		}
+	}
+
+	/// Retrieve the character at a particular position.
+	/// Retrieving positions outside the range of the text returns 0.
+	char ValueAt(ptrdiff_t position) const noexcept {
+		if ((position >= cachedStart) && (position < cachedEnd))
+			return cachedText[position - cachedStart];
+		if ((position < 0) || (position >= Length()))
+			return 0;
+		const ptrdiff_t piece = starts.PartitionFromPosition(position);
+		cachedStart = starts.PositionFromPartition(piece);
+		cachedEnd = starts.PositionFromPartition(piece + 1);
+		cachedText = pieces[piece];
+		return cachedText[position - cachedStart];
+	}
+
+	/// Insert text into the table from an array.
+	/// Inserting at positions outside the current range fails.
+	void InsertFromArray(ptrdiff_t positionToInsert, const char s[], ptrdiff_t positionFrom, ptrdiff_t insertLength) {
+		PLATFORM_ASSERT((positionToInsert >= 0) && (positionToInsert <= Length()));
+		if ((insertLength <= 0) || (positionToInsert < 0) || (positionToInsert > Length())) {
+			return;
+		}
+		Changed();
+		const char *text = s + positionFrom;
+		if (!original || (text < original.get()) || (text + insertLength > original.get() + originalLength)) {
+			char *copy = Allocate(insertLength);
+			std::copy(text, text + insertLength, copy);
+			text = copy;
+		}
+		if (Length() == 0) {
+			pieces.SetValueAt(0, text);
+			starts.InsertText(0, insertLength);
+			return;
+		}
+		if (positionToInsert > 0) {
+			// Typing appends to the last block so usually extends the piece before
+			const ptrdiff_t before = starts.PartitionFromPosition(positionToInsert - 1);
+			if ((starts.PositionFromPartition(before + 1) == positionToInsert) &&
+				(pieces[before] + PieceLength(before) == text)) {
+				starts.InsertText(before, insertLength);
+				return;
+			}
+		}
+		// The new piece starts empty at the split then grows by the text.
+		// Partition 0 always starts at 0 so the new start goes after the split.
+		const ptrdiff_t at = SplitAt(positionToInsert);
+		starts.InsertPartition(std::min(at + 1, Pieces()), positionToInsert);
+		pieces.Insert(at, text);
+		starts.InsertText(at, insertLength);
+	}
+
+	/// Delete a range from the table.
+	/// Deleting positions outside the current range fails.
+	void DeleteRange(ptrdiff_t position, ptrdiff_t deleteLength) {
+		PLATFORM_ASSERT((position >= 0) && (position + deleteLength <= Length()));
+		if ((deleteLength <= 0) || (position < 0) || ((position + deleteLength) > Length())) {
+			return;
+		}
+		if ((position == 0) && (deleteLength == Length())) {
+			DeleteAll();
+			return;
+		}
+		Changed();
+		const ptrdiff_t first = SplitAt(position);
+		const ptrdiff_t last = SplitAt(position + deleteLength);
+		// The deleted length goes to the piece before or, at the start, to piece 0 which
+		// then takes the place of the piece after
+		const ptrdiff_t removeAt = (first == 0) ? 1 : first;
+		for (ptrdiff_t piece = first; piece < last; piece++) {
+			starts.RemovePartition(removeAt);
+		}
+		pieces.DeleteRange(first, last - first);
+		starts.InsertText((first == 0) ? 0 : first - 1, -deleteLength);
+	}
+
+	/// Delete all the text, releasing the original and the blocks.
+	void DeleteAll() {
+		original.reset();
+		originalLength = 0;
+		blocks.clear();
+		blockEnd = nullptr;
+		blockSpace = 0;
+		copied = 0;
+		terminated = nullptr;
+		Changed();
+		starts.DeleteAll();
+		pieces.DeleteAll();
+		pieces.Insert(0, nullptr);
+	}
+
+	/// Retrieve a range of text into an array.
+	void GetRange(char *buffer, ptrdiff_t position, ptrdiff_t retrieveLength) const {
+		if (retrieveLength <= 0)
+			return;
+		ptrdiff_t piece = starts.PartitionFromPosition(position);
+		ptrdiff_t offset = position - starts.PositionFromPartition(piece);
+		while (retrieveLength > 0) {
+			const ptrdiff_t lengthCopy = std::min(PieceLength(piece) - offset, retrieveLength);
+			const char *text = pieces[piece] + offset;
+			std::copy(text, text + lengthCopy, buffer);
+			buffer += lengthCopy;
+			retrieveLength -= lengthCopy;
+			piece++;
+			offset = 0;
+		}
+	}
+
+	/// Copy the text into a single piece followed by a NUL and return a pointer to it.
+	/// Releases the original and the blocks the text was in before.
+	const char *BufferPointer() {
+		const ptrdiff_t length = Length();
+		if ((length > 0) && (Pieces() == 1) && (pieces[0] == terminated) && (length == terminatedLength)) {
+			return terminated;
+		}
+		Changed();
+		std::shared_ptr<char[]> block(new char[length + 1]);
+		GetRange(block.get(), 0, length);
+		block[length] = 0;
+		terminated = block.get();
+		terminatedLength = length;
+		original.reset();
+		originalLength = 0;
+		blocks.clear();
+		blocks.push_back({ std::move(block), length + 1 });
+		// Appending after the NUL would not extend the piece so start a new block
+		blockEnd = nullptr;
+		blockSpace = 0;
+		copied = 0;
+		if (length > 0) {
+			const ptrdiff_t last = Pieces();
+			for (ptrdiff_t piece = 1; piece < last; piece++) {
+				starts.RemovePartition(1);
+			}
+			pieces.DeleteRange(1, last - 1);
+		}
+		pieces.SetValueAt(0, terminated);
+		return terminated;
+	}
+
+	/// Append the start and text of each piece, followed by the length of the text, and
+	/// the allocations the pieces are in, which keeps them when the table releases them.
+	void Share(std::vector<ptrdiff_t> &positions, std::vector<const char *> &texts,
+		std::vector<std::shared_ptr<const char[]>> &holders) const {
+		const ptrdiff_t count = Pieces();
+		for (ptrdiff_t piece = 0; piece < count; piece++) {
+			positions.push_back(starts.PositionFromPartition(piece));
+			texts.push_back(pieces[piece]);
+		}
+		positions.push_back(Length());
+		if (original)
+			holders.push_back(original);
+		for (const Block &block : blocks) {
+			holders.push_back(block.text);
+		}
+	}
+
+	/// Whether RangePointer can return the range without copying it.
+	bool IsContiguous(ptrdiff_t position, ptrdiff_t rangeLength) const noexcept {
+		if (position >= Length())
+			return true;
+		const ptrdiff_t piece = starts.PartitionFromPosition(position);
+		return position + rangeLength <= starts.PositionFromPartition(piece + 1);
+	}
+
+	/// Return a pointer to a range of text, first copying it into a single piece if needed.
+	const char *RangePointer(ptrdiff_t position, ptrdiff_t rangeLength) {
+		if (position >= Length()) {
+			const ptrdiff_t last = Pieces() - 1;
+			return pieces[last] ? pieces[last] + PieceLength(last) : nullptr;
+		}
+		if (IsContiguous(position, rangeLength)) {
+			const ptrdiff_t piece = starts.PartitionFromPosition(position);
+			return pieces[piece] + position - starts.PositionFromPartition(piece);
+		}
+		return pieces[Consolidate(position, std::min(rangeLength, Length() - position))];
+	}
+
+	/// The end of the first piece: ranges that end there or start there and stay in one
+	/// piece are available from RangePointer without copying.
+	ptrdiff_t GapPosition() const noexcept {
+		return starts.PositionFromPartition(1);
+	}
+
+	/// The text as at most two contiguous segments: the first piece and all the rest which
+	/// is copied into a single piece if needed.
+	SplitView AllView() {
+		const ptrdiff_t length = Length();
+		const ptrdiff_t length1 = GapPosition();
+		if ((length1 < length) && (Pieces() > 2)) {
+			Consolidate(length1, length - length1);
+		}
+		if ((length1 == 0) || (length1 == length)) {
+			return SplitView{ pieces[0], static_cast<size_t>(length), pieces[0], static_cast<size_t>(length) };
+		}
+		return SplitView{ pieces[0], static_cast<size_t>(length1), pieces[1] - length1, static_cast<size_t>(length) };
+	}
+};
+
+}
+
+#endif
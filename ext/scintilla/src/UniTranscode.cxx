@@ -0,0 +1,438 @@
+// Scintilla source code edit control
+/** @file UniTranscode.cxx
+ ** Transcode between UTF-8 and byte streams of UTF-16 or UTF-32 in either byte order.
+ ** Runs of ASCII and of 2 byte UTF-8 characters are handled 16 bytes at a time with SSE2,
+ ** byte swapping on the way, everything else a character at a time.
+ **/
+// The License.txt file describes the conditions under which this software may be distributed.
+
+#include <cstddef>
+#include <cstring>
+
+#include <string_view>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define UNITRANSCODE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "UniConversion.h"
+#include "UniTranscode.h"
+
+namespace Scintilla::Internal {
+
+namespace {
+
+constexpr unsigned int maxUnicode = 0x10FFFF;
+
+constexpr bool IsSurrogate(unsigned int val) noexcept {
+	return (val >= SURROGATE_LEAD_FIRST) && (val <= SURROGATE_TRAIL_LAST);
+}
+
+constexpr bool IsLeadSurrogate(unsigned int val) noexcept {
+	return (val >= SURROGATE_LEAD_FIRST) && (val <= SURROGATE_LEAD_LAST);
+}
+
+constexpr bool IsTrailSurrogate(unsigned int val) noexcept {
+	return (val >= SURROGATE_TRAIL_FIRST) && (val <= SURROGATE_TRAIL_LAST);
+}
+
+unsigned int Unit16(const unsigned char *p, bool bigEndian) noexcept {
+	return bigEndian ? ((p[0] << 8) | p[1]) : ((p[1] << 8) | p[0]);
+}
+
+unsigned int Unit32(const unsigned char *p, bool bigEndian) noexcept {
+	if (bigEndian)
+		return (static_cast<unsigned int>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	return (static_cast<unsigned int>(p[3]) << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+char *StoreUnit16(char *out, unsigned int val, bool bigEndian) noexcept {
+	const char lo = static_cast<char>(val & 0xFF);
+	const char hi = static_cast<char>(val >> 8);
+	out[0] = bigEndian ? hi : lo;
+	out[1] = bigEndian ? lo : hi;
+	return out + 2;
+}
+
+char *StoreUnit32(char *out, unsigned int val, bool bigEndian) noexcept {
+	for (int i = 0; i < 4; i++) {
+		out[bigEndian ? 3 - i : i] = static_cast<char>((val >> (8 * i)) & 0xFF);
+	}
+	return out + 4;
+}
+
+char *StoreUTF8(char *out, unsigned int val) noexcept {
+	if (val < 0x80) {
+		*out++ = static_cast<char>(val);
+	} else if (val < 0x800) {
+		*out++ = static_cast<char>(0xC0 | (val >> 6));
+		*out++ = static_cast<char>(0x80 | (val & 0x3F));
+	} else if (val < SUPPLEMENTAL_PLANE_FIRST) {
+		*out++ = static_cast<char>(0xE0 | (val >> 12));
+		*out++ = static_cast<char>(0x80 | ((val >> 6) & 0x3F));
+		*out++ = static_cast<char>(0x80 | (val & 0x3F));
+	} else {
+		*out++ = static_cast<char>(0xF0 | (val >> 18));
+		*out++ = static_cast<char>(0x80 | ((val >> 12) & 0x3F));
+		*out++ = static_cast<char>(0x80 | ((val >> 6) & 0x3F));
+		*out++ = static_cast<char>(0x80 | (val & 0x3F));
+	}
+	return out;
+}
+
+char *StoreUTF16(char *out, unsigned int val, bool bigEndian) noexcept {
+	if (val < SUPPLEMENTAL_PLANE_FIRST)
+		return StoreUnit16(out, val, bigEndian);
+	val -= SUPPLEMENTAL_PLANE_FIRST;
+	out = StoreUnit16(out, SURROGATE_LEAD_FIRST + (val >> 10), bigEndian);
+	return StoreUnit16(out, SURROGATE_TRAIL_FIRST + (val & 0x3FF), bigEndian);
+}
+
+// Decode the UTF-8 character at s. Returns the number of bytes used, which covers
+// the maximal invalid part of a bad sequence with val set to U+FFFD. Returns 0 when
+// the sequence is valid so far but cut off by the end of the input.
+size_t DecodeUTF8(const unsigned char *s, size_t available, unsigned int &val) noexcept {
+	const unsigned char lead = s[0];
+	if (lead < 0x80) {
+		val = lead;
+		return 1;
+	}
+	size_t trails = 0;
+	unsigned char low = 0x80;
+	unsigned char high = 0xBF;
+	if (lead >= 0xC2 && lead <= 0xDF) {
+		trails = 1;
+		val = lead & 0x1F;
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		trails = 2;
+		val = lead & 0x0F;
+		if (lead == 0xE0)
+			low = 0xA0;	// Overlong
+		else if (lead == 0xED)
+			high = 0x9F;	// Surrogate
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		trails = 3;
+		val = lead & 0x07;
+		if (lead == 0xF0)
+			low = 0x90;	// Overlong
+		else if (lead == 0xF4)
+			high = 0x8F;	// Beyond U+10FFFF
+	} else {
+		val = unicodeReplacementChar;
+		return 1;
+	}
+	for (size_t i = 1; i <= trails; i++) {
+		if (i >= available)
+			return 0;
+		const unsigned char trail = s[i];
+		if (trail < low || trail > high) {
+			val = unicodeReplacementChar;
+			return i;
+		}
+		low = 0x80;
+		high = 0xBF;
+		val = (val << 6) | (trail & 0x3F);
+	}
+	return trails + 1;
+}
+
+#ifdef UNITRANSCODE_SSE2
+
+__m128i SwapBytes16(__m128i v) noexcept {
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+__m128i SwapBytes32(__m128i v) noexcept {
+	v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+	return SwapBytes16(v);
+}
+
+// Convert whole blocks of 8 UTF-16 code units that are all ASCII or all 2 byte
+// characters. Stops at the first block that is neither.
+size_t UTF8FromUTF16Blocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i maskAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+	const __m128i maskTwo = _mm_set1_epi16(static_cast<short>(0xF800));
+	const __m128i leadBits = _mm_set1_epi16(0xC0);
+	const __m128i trailBits = _mm_set1_epi16(0x80);
+	const __m128i trailMask = _mm_set1_epi16(0x3F);
+	size_t i = 0;
+	while (i + 16 <= len) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		if (bigEndian)
+			v = SwapBytes16(v);
+		const int ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, maskAscii), zero));
+		if (ascii == 0xFFFF) {
+			_mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(v, v));
+			out += 8;
+		} else if ((ascii == 0) &&
+			(_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, maskTwo), zero)) == 0xFFFF)) {
+			// Each unit becomes lead byte then trail byte
+			const __m128i lead = _mm_or_si128(_mm_srli_epi16(v, 6), leadBits);
+			const __m128i trail = _mm_or_si128(_mm_and_si128(v, trailMask), trailBits);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_or_si128(lead, _mm_slli_epi16(trail, 8)));
+			out += 16;
+		} else {
+			break;
+		}
+		i += 16;
+	}
+	return i;
+}
+
+// Convert whole blocks of 8 ASCII UTF-32 code units
+size_t UTF8FromUTF32Blocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i maskAscii = _mm_set1_epi32(static_cast<int>(0xFFFFFF80));
+	size_t i = 0;
+	while (i + 32 <= len) {
+		__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 16));
+		if (bigEndian) {
+			v0 = SwapBytes32(v0);
+			v1 = SwapBytes32(v1);
+		}
+		const __m128i high = _mm_and_si128(_mm_or_si128(v0, v1), maskAscii);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, zero)) != 0xFFFF)
+			break;
+		const __m128i units = _mm_packs_epi32(v0, v1);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(units, units));
+		out += 8;
+		i += 32;
+	}
+	return i;
+}
+
+// Convert whole blocks of 16 ASCII bytes
+size_t UTF16FromASCIIBlocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	while (i + 16 <= len) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		if (_mm_movemask_epi8(v) != 0)
+			break;
+		const __m128i lo = bigEndian ? _mm_unpacklo_epi8(zero, v) : _mm_unpacklo_epi8(v, zero);
+		const __m128i hi = bigEndian ? _mm_unpackhi_epi8(zero, v) : _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), hi);
+		out += 32;
+		i += 16;
+	}
+	return i;
+}
+
+size_t UTF32FromASCIIBlocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+	while (i + 16 <= len) {
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		if (_mm_movemask_epi8(v) != 0)
+			break;
+		__m128i units[2];
+		units[0] = bigEndian ? _mm_unpacklo_epi8(zero, v) : _mm_unpacklo_epi8(v, zero);
+		units[1] = bigEndian ? _mm_unpackhi_epi8(zero, v) : _mm_unpackhi_epi8(v, zero);
+		for (const __m128i &u : units) {
+			const __m128i lo = bigEndian ? _mm_unpacklo_epi16(zero, u) : _mm_unpacklo_epi16(u, zero);
+			const __m128i hi = bigEndian ? _mm_unpackhi_epi16(zero, u) : _mm_unpackhi_epi16(u, zero);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), lo);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 16), hi);
+			out += 32;
+		}
+		i += 16;
+	}
+	return i;
+}
+
+#else
+
+// Without SSE2, take runs of ASCII 8 bytes at a time. Words are read in host order,
+// which is little endian on all targets.
+
+size_t UTF8FromUTF16Blocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	const unsigned long long mask = bigEndian ? 0x80FF80FF80FF80FFULL : 0xFF80FF80FF80FF80ULL;
+	const size_t low = bigEndian ? 1 : 0;
+	size_t i = 0;
+	while (i + 8 <= len) {
+		unsigned long long word;
+		memcpy(&word, in + i, sizeof(word));
+		if (word & mask)
+			break;
+		for (size_t j = 0; j < 8; j += 2)
+			*out++ = static_cast<char>(in[i + j + low]);
+		i += 8;
+	}
+	return i;
+}
+
+size_t UTF8FromUTF32Blocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	const unsigned long long mask = bigEndian ? 0x80FFFFFF80FFFFFFULL : 0xFFFFFF80FFFFFF80ULL;
+	const size_t low = bigEndian ? 3 : 0;
+	size_t i = 0;
+	while (i + 8 <= len) {
+		unsigned long long word;
+		memcpy(&word, in + i, sizeof(word));
+		if (word & mask)
+			break;
+		*out++ = static_cast<char>(in[i + low]);
+		*out++ = static_cast<char>(in[i + 4 + low]);
+		i += 8;
+	}
+	return i;
+}
+
+size_t UTF16FromASCIIBlocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	size_t i = 0;
+	while (i + 8 <= len) {
+		unsigned long long word;
+		memcpy(&word, in + i, sizeof(word));
+		if (word & 0x8080808080808080ULL)
+			break;
+		for (size_t j = 0; j < 8; j++)
+			out = StoreUnit16(out, in[i + j], bigEndian);
+		i += 8;
+	}
+	return i;
+}
+
+size_t UTF32FromASCIIBlocks(const unsigned char *in, size_t len, bool bigEndian, char *&out) noexcept {
+	size_t i = 0;
+	while (i + 8 <= len) {
+		unsigned long long word;
+		memcpy(&word, in + i, sizeof(word));
+		if (word & 0x8080808080808080ULL)
+			break;
+		for (size_t j = 0; j < 8; j++)
+			out = StoreUnit32(out, in[i + j], bigEndian);
+		i += 8;
+	}
+	return i;
+}
+
+#endif
+
+// After a block that the vector code could not take, convert at least this many bytes
+// a character at a time before trying vectors again
+constexpr size_t scalarRun = 16;
+
+}
+
+TranscodeResult UTF8FromUTF16Bytes(std::string_view input, ByteOrder order, bool final, char *output) noexcept {
+	const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+	const size_t len = input.length();
+	const bool bigEndian = order == ByteOrder::BigEndian;
+	char *out = output;
+	size_t i = 0;
+	while (i + 1 < len) {
+		i += UTF8FromUTF16Blocks(in + i, len - i, bigEndian, out);
+		const size_t runEnd = std::min(len, i + scalarRun);
+		while (i + 1 < runEnd) {
+			unsigned int val = Unit16(in + i, bigEndian);
+			if (IsLeadSurrogate(val)) {
+				if (i + 3 >= len) {
+					if (!final)
+						return { i, static_cast<size_t>(out - output) };
+					val = unicodeReplacementChar;
+				} else {
+					const unsigned int trail = Unit16(in + i + 2, bigEndian);
+					if (IsTrailSurrogate(trail)) {
+						val = SUPPLEMENTAL_PLANE_FIRST + ((val - SURROGATE_LEAD_FIRST) << 10) + (trail - SURROGATE_TRAIL_FIRST);
+						i += 2;
+					} else {
+						val = unicodeReplacementChar;
+					}
+				}
+			} else if (IsTrailSurrogate(val)) {
+				val = unicodeReplacementChar;
+			}
+			out = StoreUTF8(out, val);
+			i += 2;
+		}
+	}
+	if ((i < len) && final) {
+		// Half a code unit
+		out = StoreUTF8(out, unicodeReplacementChar);
+		i = len;
+	}
+	return { i, static_cast<size_t>(out - output) };
+}
+
+TranscodeResult UTF8FromUTF32Bytes(std::string_view input, ByteOrder order, bool final, char *output) noexcept {
+	const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+	const size_t len = input.length();
+	const bool bigEndian = order == ByteOrder::BigEndian;
+	char *out = output;
+	size_t i = 0;
+	while (i + 3 < len) {
+		i += UTF8FromUTF32Blocks(in + i, len - i, bigEndian, out);
+		const size_t runEnd = std::min(len, i + scalarRun * 2);
+		while (i + 3 < runEnd) {
+			unsigned int val = Unit32(in + i, bigEndian);
+			if ((val > maxUnicode) || IsSurrogate(val))
+				val = unicodeReplacementChar;
+			out = StoreUTF8(out, val);
+			i += 4;
+		}
+	}
+	if ((i < len) && final) {
+		// Part of a code unit
+		out = StoreUTF8(out, unicodeReplacementChar);
+		i = len;
+	}
+	return { i, static_cast<size_t>(out - output) };
+}
+
+TranscodeResult UTF16BytesFromUTF8(std::string_view input, ByteOrder order, bool final, char *output) noexcept {
+	const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+	const size_t len = input.length();
+	const bool bigEndian = order == ByteOrder::BigEndian;
+	char *out = output;
+	size_t i = 0;
+	while (i < len) {
+		i += UTF16FromASCIIBlocks(in + i, len - i, bigEndian, out);
+		const size_t runEnd = std::min(len, i + scalarRun);
+		while (i < runEnd) {
+			unsigned int val = 0;
+			size_t used = DecodeUTF8(in + i, len - i, val);
+			if (used == 0) {
+				if (!final)
+					return { i, static_cast<size_t>(out - output) };
+				// Valid start of a character that ends too soon
+				val = unicodeReplacementChar;
+				used = len - i;
+			}
+			out = StoreUTF16(out, val, bigEndian);
+			i += used;
+		}
+	}
+	return { i, static_cast<size_t>(out - output) };
+}
+
+TranscodeResult UTF32BytesFromUTF8(std::string_view input, ByteOrder order, bool final, char *output) noexcept {
+	const unsigned char *in = reinterpret_cast<const unsigned char *>(input.data());
+	const size_t len = input.length();
+	const bool bigEndian = order == ByteOrder::BigEndian;
+	char *out = output;
+	size_t i = 0;
+	while (i < len) {
+		i += UTF32FromASCIIBlocks(in + i, len - i, bigEndian, out);
+		const size_t runEnd = std::min(len, i + scalarRun);
+		while (i < runEnd) {
+			unsigned int val = 0;
+			size_t used = DecodeUTF8(in + i, len - i, val);
+			if (used == 0) {
+				if (!final)
+					return { i, static_cast<size_t>(out - output) };
+				val = unicodeReplacementChar;
+				used = len - i;
+			}
+			out = StoreUnit32(out, val, bigEndian);
+			i += used;
+		}
+	}
+	return { i, static_cast<size_t>(out - output) };
+}
+
+}
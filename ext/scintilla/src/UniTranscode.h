@@ -0,0 +1,48 @@
+// Scintilla source code edit control
+/** @file UniTranscode.h
+ ** Transcode between UTF-8 and byte streams of UTF-16 or UTF-32 in either byte order.
+ **/
+// The License.txt file describes the conditions under which this software may be distributed.
+
+#ifndef UNITRANSCODE_H
+#define UNITRANSCODE_H
+
+namespace Scintilla::Internal {
+
+enum class ByteOrder { LittleEndian, BigEndian };
+
+struct TranscodeResult {
+	size_t consumed = 0;	// Bytes of input used
+	size_t written = 0;	// Bytes of output produced
+};
+
+// The transcoders convert a block of a longer stream. When final is false, a character
+// cut off by the end of the block (half a code unit, a lead surrogate, the start of a
+// UTF-8 sequence) is not consumed so the caller can prepend it to the next block.
+// When final is true, such a remainder becomes U+FFFD.
+// Invalid input is replaced with U+FFFD: each unpaired surrogate, each UTF-32 value
+// that is a surrogate or beyond U+10FFFF and each maximal invalid part of a UTF-8
+// sequence. The output buffer must hold the number of bytes given by the matching
+// ...Max... function for the input length.
+
+constexpr size_t UTF8MaxFromUTF16Bytes(size_t lenBytes) noexcept {
+	return (lenBytes / 2) * 3 + 3;
+}
+constexpr size_t UTF8MaxFromUTF32Bytes(size_t lenBytes) noexcept {
+	return lenBytes + 3;
+}
+constexpr size_t UTF16BytesMaxFromUTF8(size_t len) noexcept {
+	return len * 2;
+}
+constexpr size_t UTF32BytesMaxFromUTF8(size_t len) noexcept {
+	return len * 4;
+}
+
+TranscodeResult UTF8FromUTF16Bytes(std::string_view input, ByteOrder order, bool final, char *output) noexcept;
+TranscodeResult UTF8FromUTF32Bytes(std::string_view input, ByteOrder order, bool final, char *output) noexcept;
+TranscodeResult UTF16BytesFromUTF8(std::string_view input, ByteOrder order, bool final, char *output) noexcept;
+TranscodeResult UTF32BytesFromUTF8(std::string_view input, ByteOrder order, bool final, char *output) noexcept;
+
+}
+
+#endif
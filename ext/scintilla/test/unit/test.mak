@@ -26,6 +26,7 @@ TESTEDSRC=\
  ../../src/RESearch.cxx \
  ../../src/RunStyles.cxx \
  ../../src/UniConversion.cxx \
+ ../../src/UniTranscode.cxx \
  ../../src/UniqueString.cxx
 
 TESTS=$(EXE)
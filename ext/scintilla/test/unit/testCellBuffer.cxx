@@ -6,11 +6,18 @@
 #include <cassert>
 #include <cstring>
 #include <stdexcept>
+#include <string>
 #include <string_view>
 #include <vector>
 #include <optional>
 #include <algorithm>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <random>
 
 #include "ScintillaTypes.h"
 
@@ -23,6 +30,7 @@
 #include "SparseVector.h"
 #include "ChangeHistory.h"
 #include "CellBuffer.h"
+#include "PieceTable.h"
 
 #include "catch.hpp"
 
@@ -153,6 +161,121 @@ TEST_CASE("CellBuffer") {
 		REQUIRE(cb.Length() == 0);
 	}
 
+	SECTION("SetStyles") {
+		bool startSequence = false;
+		cb.InsertString(0, sText, sLength, startSequence);
+		// Split the buffer so the styles straddle the gap
+		cb.InsertString(4, "-", 1, startSequence);
+		cb.InsertString(0, "-", 1, startSequence);
+		REQUIRE(cb.Length() == 11);
+		Sci::Position startChanged = -1;
+		Sci::Position endChanged = -1;
+		const char zeroes[11] = {};
+		REQUIRE(!cb.SetStyles(0, 11, zeroes, startChanged, endChanged));
+		REQUIRE(startChanged == -1);
+		const char styles[11] = { 0, 0, 1, 1, 1, 0, 2, 2, 0, 0, 0 };
+		REQUIRE(cb.SetStyles(0, 11, styles, startChanged, endChanged));
+		REQUIRE(startChanged == 2);
+		REQUIRE(endChanged == 8);
+		for (Sci::Position i = 0; i < 11; i++) {
+			REQUIRE(cb.StyleAt(i) == styles[i]);
+		}
+		REQUIRE(!cb.SetStyles(3, 4, styles + 3, startChanged, endChanged));
+		REQUIRE(cb.SetStyleFor(5, 3, 2));
+		REQUIRE(cb.StyleAt(5) == 2);
+		REQUIRE(!cb.SetStyleFor(5, 3, 2));
+	}
+
+	SECTION("SetStylesLong") {
+		bool startSequence = false;
+		const std::string text(1000, 'x');
+		cb.InsertString(0, text.c_str(), text.length(), startSequence);
+		cb.InsertString(300, "y", 1, startSequence);
+		std::vector<char> styles(1001);
+		Sci::Position startChanged = -1;
+		Sci::Position endChanged = -1;
+		REQUIRE(!cb.SetStyles(0, 1001, styles.data(), startChanged, endChanged));
+		styles[130] = 1;
+		styles[700] = 1;
+		REQUIRE(cb.SetStyles(0, 1001, styles.data(), startChanged, endChanged));
+		REQUIRE(startChanged == 130);
+		REQUIRE(endChanged == 701);
+		REQUIRE(cb.StyleAt(129) == 0);
+		REQUIRE(cb.StyleAt(130) == 1);
+		REQUIRE(cb.StyleAt(700) == 1);
+		REQUIRE(cb.StyleAt(701) == 0);
+	}
+
+}
+
+TEST_CASE("CellBufferWindowedStyles") {
+
+	CellBuffer cb(true, false, true);
+	bool startSequence = false;
+	const std::string text(1000, 'x');
+	cb.InsertString(0, text.c_str(), text.length(), startSequence);
+
+	SECTION("LoadAllocatesNoStyles") {
+		REQUIRE(cb.WindowedStyles());
+		REQUIRE(cb.StyleWindowStart() == 0);
+		REQUIRE(cb.StyleWindowEnd() == 0);
+		REQUIRE(!cb.SetStyleAt(10, 1));
+		REQUIRE(cb.StyleAt(10) == 0);
+	}
+
+	SECTION("StylesOnlyInsideWindow") {
+		cb.SetStyleWindow(100, 200);
+		REQUIRE(cb.StyleWindowStart() == 100);
+		REQUIRE(cb.StyleWindowEnd() == 200);
+		REQUIRE(cb.SetStyleFor(50, 200, 3));
+		REQUIRE(cb.StyleAt(99) == 0);
+		REQUIRE(cb.StyleAt(100) == 3);
+		REQUIRE(cb.StyleAt(199) == 3);
+		REQUIRE(cb.StyleAt(200) == 0);
+		const std::vector<char> styles(300, 4);
+		Sci::Position startChanged = -1;
+		Sci::Position endChanged = -1;
+		REQUIRE(cb.SetStyles(0, 300, styles.data(), startChanged, endChanged));
+		REQUIRE(startChanged == 100);
+		REQUIRE(endChanged == 200);
+		unsigned char range[20] {};
+		cb.GetStyleRange(range, 90, 20);
+		REQUIRE(range[9] == 0);
+		REQUIRE(range[10] == 4);
+	}
+
+	SECTION("MoveKeepsOverlap") {
+		cb.SetStyleWindow(100, 200);
+		cb.SetStyleAt(150, 5);
+		cb.SetStyleWindow(140, 300);
+		REQUIRE(cb.StyleWindowStart() == 140);
+		REQUIRE(cb.StyleWindowEnd() == 300);
+		REQUIRE(cb.StyleAt(150) == 5);
+		cb.SetStyleWindow(0, 145);
+		REQUIRE(cb.StyleAt(150) == 0);
+		cb.SetStyleWindow(500, 600);
+		REQUIRE(cb.StyleWindowEnd() == 600);
+		REQUIRE(cb.StyleAt(550) == 0);
+	}
+
+	SECTION("EditsMoveWindow") {
+		cb.SetStyleWindow(100, 200);
+		cb.SetStyleAt(100, 1);
+		cb.InsertString(10, "abc", 3, startSequence);
+		REQUIRE(cb.StyleWindowStart() == 103);
+		REQUIRE(cb.StyleAt(103) == 1);
+		cb.InsertString(150, "abc", 3, startSequence);
+		REQUIRE(cb.StyleWindowEnd() == 206);
+		cb.InsertString(500, "abc", 3, startSequence);
+		REQUIRE(cb.StyleWindowEnd() == 206);
+		// Deletion straddling the window start
+		cb.DeleteChars(93, 20, startSequence);
+		REQUIRE(cb.StyleWindowStart() == 93);
+		REQUIRE(cb.StyleWindowEnd() == 186);
+		cb.DeleteChars(0, 10, startSequence);
+		REQUIRE(cb.StyleWindowStart() == 83);
+	}
+
 }
 
 TEST_CASE("CharacterIndex") {
@@ -1018,4 +1141,580 @@ TEST_CASE("CellBufferLong") {
 		}
 	}
 }
-#endif
\ No newline at end of file
+#endif
+namespace {
+
+std::string Contents(const CellBuffer &cb) {
+	std::string text(cb.Length(), '\0');
+	cb.GetCharRange(text.data(), 0, cb.Length());
+	return text;
+}
+
+// What the file holds after writing only the unsaved span over the saved text:
+// everything from the start of the span when the length changed, else just the span.
+std::string PatchSaved(const CellBuffer &cb, const std::string &saved) {
+	const Sci::Position start = cb.UnsavedStart();
+	const Sci::Position end = cb.UnsavedEnd();
+	const std::string text = Contents(cb);
+	if (start > static_cast<Sci::Position>(saved.length())) {
+		return saved;
+	}
+	std::string result = saved.substr(0, start);
+	if (text.length() == saved.length()) {
+		result += text.substr(start, end - start);
+		result += saved.substr(end);
+	} else {
+		result += text.substr(start);
+	}
+	return result;
+}
+
+}
+
+TEST_CASE("CellBufferUnsavedSpan") {
+
+	CellBuffer cb(true, false);
+	cb.SetUndoCollection(false);
+	const std::string sInsert = "abcdefghijklmnopqrstuvwxyz";
+	bool startSequence = false;
+	cb.InsertString(0, sInsert.c_str(), sInsert.length(), startSequence);
+	cb.SetUndoCollection(true);
+
+	SECTION("NeverSaved") {
+		REQUIRE(cb.UnsavedStart() == 0);
+		REQUIRE(cb.UnsavedEnd() == 26);
+	}
+
+	cb.SetSavePoint();
+
+	SECTION("Unchanged") {
+		REQUIRE(cb.UnsavedStart() == 26);
+		REQUIRE(cb.UnsavedEnd() == 26);
+	}
+
+	SECTION("InsertAndDelete") {
+		cb.InsertString(4, "_", 1, startSequence);
+		cb.DeleteChars(20, 2, startSequence);
+		REQUIRE(cb.UnsavedStart() == 4);
+		REQUIRE(cb.UnsavedEnd() == 20);
+		REQUIRE(PatchSaved(cb, sInsert) == Contents(cb));
+	}
+
+	SECTION("UndoPastSavePoint") {
+		cb.InsertString(4, "_", 1, startSequence);
+		cb.SetSavePoint();
+		const std::string saved = Contents(cb);
+		REQUIRE(cb.UnsavedStart() == 27);
+		REQUIRE(cb.UnsavedEnd() == 27);
+		cb.InsertString(10, "12", 2, startSequence);
+		REQUIRE(cb.UnsavedStart() == 10);
+		REQUIRE(cb.UnsavedEnd() == 12);
+		REQUIRE(PatchSaved(cb, saved) == Contents(cb));
+		UndoBlock(cb);
+		UndoBlock(cb);
+		REQUIRE(cb.UnsavedStart() == 4);
+		REQUIRE(PatchSaved(cb, saved) == Contents(cb));
+		// Redo after a later save: the saved text no longer has the redone insertion
+		cb.SetSavePoint();
+		const std::string savedUndone = Contents(cb);
+		RedoBlock(cb);
+		REQUIRE(cb.UnsavedStart() == 4);
+		REQUIRE(cb.UnsavedEnd() == 5);
+		REQUIRE(PatchSaved(cb, savedUndone) == Contents(cb));
+	}
+
+	SECTION("RandomAgainstFullSave") {
+		RandomSequence rseq;
+		std::string saved = sInsert;
+		for (size_t i = 0l; i < 20000; i++) {
+			const int r = rseq.Next() % 10;
+			if (r <= 2) {
+				const int pos = rseq.Next() % (cb.Length() + 1);
+				const int len = rseq.Next() % 10 + 1;
+				std::string sInserted;
+				for (int j = 0; j < len; j++) {
+					sInserted.push_back(static_cast<char>('A' + (rseq.Next() % 26)));
+				}
+				cb.InsertString(pos, sInserted.c_str(), len, startSequence);
+			} else if (r <= 5) {
+				const Sci::Position pos = rseq.Next() % (cb.Length() + 1);
+				const int len = rseq.Next() % 10 + 1;
+				if (pos + len <= cb.Length()) {
+					cb.DeleteChars(pos, len, startSequence);
+				}
+			} else if (r <= 8) {
+				if (rseq.Next() % 2 == 1) {
+					UndoBlock(cb);
+				} else {
+					RedoBlock(cb);
+				}
+			} else {
+				cb.SetSavePoint();
+				saved = Contents(cb);
+			}
+			REQUIRE(cb.UnsavedStart() <= cb.UnsavedEnd());
+			REQUIRE(PatchSaved(cb, saved) == Contents(cb));
+		}
+	}
+}
+
+namespace {
+
+std::string SnapshotContents(const TextSnapshot &snapshot) {
+	std::string text(snapshot.Length(), '\0');
+	if (!snapshot.GetCharRange(text.data(), 0, snapshot.Length()))
+		text = "failed";
+	return text;
+}
+
+// Readers on other threads check snapshots while this thread changes the buffer
+void CheckReadWhileChanging(CellBuffer &cb) {
+	bool startSequence = false;
+	cb.InsertString(0, "Scintilla", 9, startSequence);
+	std::mutex mutexPending;
+	std::vector<std::pair<TextSnapshot, std::string>> pending;
+	std::atomic<bool> finished = false;
+	std::atomic<int> checked = 0;
+	std::atomic<int> failures = 0;
+	auto reader = [&]() {
+		for (;;) {
+			std::pair<TextSnapshot, std::string> check;
+			{
+				std::lock_guard<std::mutex> guard(mutexPending);
+				if (pending.empty()) {
+					if (finished)
+						return;
+				} else {
+					check = std::move(pending.back());
+					pending.pop_back();
+				}
+			}
+			if (check.first.Length() == 0) {
+				std::this_thread::yield();
+				continue;
+			}
+			// Read in pieces so the changes go on in between
+			const Sci::Position length = check.first.Length();
+			std::string text(length, '\0');
+			for (Sci::Position pos = 0; pos < length; pos += 7) {
+				if (!check.first.GetCharRange(text.data() + pos, pos, std::min<Sci::Position>(7, length - pos)))
+					failures++;
+			}
+			if (text != check.second)
+				failures++;
+			checked++;
+		}
+	};
+	std::vector<std::thread> readers;
+	for (int i = 0; i < 3; i++) {
+		readers.emplace_back(reader);
+	}
+	RandomSequence rseq;
+	for (int i = 0; i < 5000; i++) {
+		const int r = rseq.Next() % 10;
+		if (r <= 3) {
+			const Sci::Position pos = rseq.Next() % (cb.Length() + 1);
+			const std::string inserted(rseq.Next() % 10 + 1, static_cast<char>('a' + (rseq.Next() % 26)));
+			cb.InsertString(pos, inserted.c_str(), inserted.length(), startSequence);
+		} else if (r <= 6) {
+			const Sci::Position pos = rseq.Next() % (cb.Length() + 1);
+			const Sci::Position len = std::min<Sci::Position>(rseq.Next() % 10 + 1, cb.Length() - pos);
+			if (len > 0 && cb.Length() - len > 0) {
+				cb.DeleteChars(pos, len, startSequence);
+			}
+		} else if (r == 7) {
+			UndoBlock(cb);
+		} else if ((r == 8) && (rseq.Next() % 4 == 0)) {
+			// Joins the pieces or moves the gap
+			cb.BufferPointer();
+		} else {
+			std::lock_guard<std::mutex> guard(mutexPending);
+			pending.emplace_back(cb.TakeSnapshot(), Contents(cb));
+		}
+	}
+	finished = true;
+	for (std::thread &t : readers) {
+		t.join();
+	}
+	REQUIRE(pending.empty());
+	REQUIRE(checked > 0);
+	REQUIRE(failures == 0);
+}
+
+}
+
+TEST_CASE("CellBufferSnapshot") {
+
+	const std::string sText = "Scintilla";
+	bool startSequence = false;
+
+	SECTION("Unchanged") {
+		CellBuffer cb(true, false);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		const TextSnapshot snapshot = cb.TakeSnapshot();
+		REQUIRE(snapshot.Length() == 9);
+		REQUIRE(SnapshotContents(snapshot) == sText);
+		char part[4] = "";
+		REQUIRE(snapshot.GetCharRange(part, 3, 3));
+		REQUIRE(std::string_view(part, 3) == "nti");
+	}
+
+	SECTION("OutOfRange") {
+		CellBuffer cb(true, false);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		const TextSnapshot snapshot = cb.TakeSnapshot();
+		char part[10] = "";
+		REQUIRE(!snapshot.GetCharRange(part, -1, 2));
+		REQUIRE(!snapshot.GetCharRange(part, 8, 2));
+		REQUIRE(snapshot.GetCharRange(part, 9, 0));
+		const TextSnapshot empty;
+		REQUIRE(empty.Length() == 0);
+		REQUIRE(!empty.GetCharRange(part, 0, 0));
+	}
+
+	SECTION("Changed") {
+		CellBuffer cb(true, false);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		const TextSnapshot before = cb.TakeSnapshot();
+		const TextSnapshot beforeToo = cb.TakeSnapshot();
+		cb.InsertString(0, "12", 2, startSequence);
+		cb.DeleteChars(5, 3, startSequence);
+		REQUIRE(Contents(cb) == "12Scilla");
+		const TextSnapshot after = cb.TakeSnapshot();
+		cb.InsertString(8, "!", 1, startSequence);
+		REQUIRE(SnapshotContents(before) == sText);
+		REQUIRE(SnapshotContents(beforeToo) == sText);
+		REQUIRE(SnapshotContents(after) == "12Scilla");
+		// Undo changes the text as well
+		UndoBlock(cb);
+		REQUIRE(SnapshotContents(after) == "12Scilla");
+		REQUIRE(SnapshotContents(cb.TakeSnapshot()) == Contents(cb));
+	}
+
+	SECTION("GapMoves") {
+		// Reading the buffer contiguously moves the gap
+		CellBuffer cb(true, false);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		cb.InsertString(4, "-", 1, startSequence);
+		const TextSnapshot snapshot = cb.TakeSnapshot();
+		REQUIRE(std::string_view(cb.RangePointer(2, 6), 6) == "in-til");
+		REQUIRE(std::string_view(cb.BufferPointer(), 10) == "Scin-tilla");
+		REQUIRE(SnapshotContents(snapshot) == "Scin-tilla");
+	}
+
+	SECTION("GapBufferStaysGapBuffer") {
+		// A gap buffer changed while snapshots are read copies its text for them
+		CellBuffer cb(true, false);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		cb.InsertString(4, "-", 1, startSequence);
+		const TextSnapshot unread = cb.TakeSnapshot();
+		cb.InsertString(0, "[", 1, startSequence);
+		REQUIRE(!cb.UsesPieceTable());
+		REQUIRE(SnapshotContents(unread) == "Scin-tilla");
+		const TextSnapshot second = cb.TakeSnapshot();
+		REQUIRE(std::string_view(cb.BufferPointer(), 11) == "[Scin-tilla");
+		cb.DeleteChars(0, cb.Length(), startSequence);
+		REQUIRE(!cb.UsesPieceTable());
+		REQUIRE(cb.Length() == 0);
+		REQUIRE(SnapshotContents(unread) == "Scin-tilla");
+		REQUIRE(SnapshotContents(second) == "[Scin-tilla");
+	}
+
+	SECTION("SharesPieceTable") {
+		CellBuffer cb(true, false, false, true);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		cb.InsertString(4, "-", 1, startSequence);
+		const TextSnapshot unread = cb.TakeSnapshot();
+		cb.InsertString(0, "[", 1, startSequence);
+		REQUIRE(SnapshotContents(unread) == "Scin-tilla");
+		const TextSnapshot joined = cb.TakeSnapshot();
+		// Joining the pieces and deleting everything releases the storage the snapshots share
+		REQUIRE(std::string_view(cb.BufferPointer(), 11) == "[Scin-tilla");
+		cb.DeleteChars(0, cb.Length(), startSequence);
+		REQUIRE(cb.Length() == 0);
+		REQUIRE(SnapshotContents(unread) == "Scin-tilla");
+		REQUIRE(SnapshotContents(joined) == "[Scin-tilla");
+		char part[5] = "";
+		REQUIRE(joined.GetCharRange(part, 3, 4));
+		REQUIRE(std::string_view(part, 4) == "in-t");
+	}
+
+	SECTION("UnreadStaysGapBuffer") {
+		CellBuffer cb(true, false);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		cb.TakeSnapshot();
+		cb.InsertString(0, "[", 1, startSequence);
+		REQUIRE(!cb.UsesPieceTable());
+	}
+
+	SECTION("OutlivesBuffer") {
+		auto cb = std::make_unique<CellBuffer>(true, false);
+		cb->InsertString(0, sText.c_str(), sText.length(), startSequence);
+		const TextSnapshot snapshot = cb->TakeSnapshot();
+		cb.reset();
+		REQUIRE(SnapshotContents(snapshot) == sText);
+	}
+
+	SECTION("ReadWhileChanging") {
+		CellBuffer cb(true, false);
+		CheckReadWhileChanging(cb);
+	}
+
+	SECTION("ReadWhileChangingPieceTable") {
+		CellBuffer cb(true, false, false, true);
+		CheckReadWhileChanging(cb);
+	}
+}
+
+namespace {
+
+void RequireSameLines(const CellBuffer &cb, const CellBuffer &expected) {
+	REQUIRE(cb.Lines() == expected.Lines());
+	for (Sci::Line line = 0; line <= expected.Lines(); line++) {
+		REQUIRE(cb.LineStart(line) == expected.LineStart(line));
+	}
+}
+
+std::string ViewContents(const SplitView &view) {
+	std::string text;
+	for (size_t pos = 0; pos < view.length; pos++) {
+		text.push_back(view.CharAt(pos));
+	}
+	return text;
+}
+
+}
+
+TEST_CASE("CellBufferPieceTable") {
+
+	const std::string sText = "Scintilla";
+	bool startSequence = false;
+
+	SECTION("SameAsGapBuffer") {
+		CellBuffer gap(true, false);
+		CellBuffer cb(true, false, false, true);
+		REQUIRE(!gap.UsesPieceTable());
+		REQUIRE(cb.UsesPieceTable());
+		RandomSequence rseq;
+		for (int i = 0; i < 10000; i++) {
+			const int r = rseq.Next() % 10;
+			if (r <= 3) {
+				const Sci::Position pos = rseq.Next() % (cb.Length() + 1);
+				std::string inserted(rseq.Next() % 10 + 1, static_cast<char>('a' + (rseq.Next() % 26)));
+				inserted[rseq.Next() % inserted.length()] = "\r\nx"[rseq.Next() % 3];
+				gap.InsertString(pos, inserted.c_str(), inserted.length(), startSequence);
+				cb.InsertString(pos, inserted.c_str(), inserted.length(), startSequence);
+			} else if (r <= 6) {
+				const Sci::Position pos = rseq.Next() % (cb.Length() + 1);
+				const Sci::Position len = std::min<Sci::Position>(rseq.Next() % 20 + 1, cb.Length() - pos);
+				if (len > 0) {
+					const std::string removed(gap.DeleteChars(pos, len, startSequence), len);
+					REQUIRE(std::string(cb.DeleteChars(pos, len, startSequence), len) == removed);
+				}
+			} else if (r == 7) {
+				UndoBlock(gap);
+				UndoBlock(cb);
+			} else if (r == 8) {
+				RedoBlock(gap);
+				RedoBlock(cb);
+			} else {
+				// Contiguous access joins pieces without changing the text
+				const Sci::Position pos = rseq.Next() % (cb.Length() + 1);
+				const Sci::Position len = std::min<Sci::Position>(rseq.Next() % 50, cb.Length() - pos);
+				REQUIRE(std::string_view(cb.RangePointer(pos, len), len) ==
+					std::string_view(gap.RangePointer(pos, len), len));
+			}
+			REQUIRE(cb.Length() == gap.Length());
+			if (i % 100 == 0) {
+				REQUIRE(Contents(cb) == Contents(gap));
+				RequireSameLines(cb, gap);
+			}
+		}
+		REQUIRE(Contents(cb) == Contents(gap));
+		RequireSameLines(cb, gap);
+		REQUIRE(ViewContents(cb.AllView()) == Contents(gap));
+		REQUIRE(std::string(cb.BufferPointer()) == std::string(gap.BufferPointer()));
+	}
+
+	SECTION("ContiguousViews") {
+		CellBuffer cb(true, false, false, true);
+		REQUIRE(cb.GapPosition() == 0);
+		REQUIRE(ViewContents(cb.AllView()).empty());
+		REQUIRE(*cb.BufferPointer() == 0);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		cb.InsertString(4, "-", 1, startSequence);
+		cb.InsertString(0, "[", 1, startSequence);
+		cb.InsertString(11, "]", 1, startSequence);
+		REQUIRE(Contents(cb) == "[Scin-tilla]");
+		// The first piece is the text before the first edit position
+		REQUIRE(cb.GapPosition() == 1);
+		REQUIRE(std::string_view(cb.RangePointer(1, 4), 4) == "Scin");
+		REQUIRE(std::string_view(cb.RangePointer(3, 6), 6) == "in-til");
+		REQUIRE(Contents(cb) == "[Scin-tilla]");
+		REQUIRE(std::string_view(cb.RangePointer(12, 0), 0).empty());
+		const SplitView view = cb.AllView();
+		REQUIRE(view.length == 12);
+		REQUIRE(view.length1 == 1);
+		REQUIRE(ViewContents(view) == "[Scin-tilla]");
+		// Joining pieces leaves earlier pointers valid
+		const char *first = cb.RangePointer(0, 1);
+		cb.InsertString(6, "+", 1, startSequence);
+		REQUIRE(std::string_view(cb.RangePointer(1, 10), 10) == "Scin-+till");
+		REQUIRE(cb.RangePointer(0, 1) == first);
+		cb.DeleteChars(6, 1, startSequence);
+		const char *text = cb.BufferPointer();
+		REQUIRE(std::string(text) == "[Scin-tilla]");
+		REQUIRE(cb.BufferPointer() == text);
+		REQUIRE(cb.GapPosition() == 12);
+		cb.InsertString(12, "!", 1, startSequence);
+		REQUIRE(std::string(cb.BufferPointer()) == "[Scin-tilla]!");
+		cb.DeleteChars(12, 1, startSequence);
+		REQUIRE(std::string(cb.BufferPointer()) == "[Scin-tilla]");
+	}
+
+	SECTION("AdoptText") {
+		bool released = false;
+		const std::string sLines = "one\ntwo\r\nthree";
+		std::shared_ptr<char[]> original(new char[sLines.length()], [&released](const char *p) {
+			released = true;
+			delete[]p;
+		});
+		std::copy(sLines.begin(), sLines.end(), original.get());
+
+		CellBuffer gap(true, false);
+		REQUIRE(!gap.AdoptText(original, sLines.length()));
+
+		CellBuffer cb(true, false, false, true);
+		REQUIRE(cb.AdoptText(original, sLines.length()));
+		REQUIRE(!cb.AdoptText(original, sLines.length()));
+		REQUIRE(Contents(cb) == sLines);
+		REQUIRE(cb.Lines() == 3);
+		REQUIRE(cb.LineStart(1) == 4);
+		REQUIRE(cb.LineStart(2) == 9);
+		REQUIRE(!cb.CanUndo());
+		// Not copied
+		REQUIRE(cb.RangePointer(4, 3) == original.get() + 4);
+
+		cb.InsertString(4, "1.5\n", 4, startSequence);
+		cb.DeleteChars(0, 2, startSequence);
+		REQUIRE(Contents(cb) == "e\n1.5\ntwo\r\nthree");
+		REQUIRE(cb.Lines() == 4);
+		REQUIRE(std::string_view(original.get(), sLines.length()) == sLines);
+		UndoBlock(cb);
+		UndoBlock(cb);
+		REQUIRE(Contents(cb) == sLines);
+
+		// The buffer keeps the text until it is all deleted
+		original.reset();
+		REQUIRE(!released);
+		cb.DeleteChars(0, cb.Length(), startSequence);
+		REQUIRE(released);
+		UndoBlock(cb);
+		REQUIRE(Contents(cb) == sLines);
+	}
+
+	SECTION("Snapshot") {
+		CellBuffer cb(true, false, false, true);
+		cb.InsertString(0, sText.c_str(), sText.length(), startSequence);
+		cb.InsertString(4, "-", 1, startSequence);
+		const TextSnapshot snapshot = cb.TakeSnapshot();
+		REQUIRE(SnapshotContents(snapshot) == "Scin-tilla");
+		REQUIRE(std::string_view(cb.RangePointer(2, 6), 6) == "in-til");
+		cb.DeleteChars(0, 4, startSequence);
+		REQUIRE(SnapshotContents(snapshot) == "Scin-tilla");
+		REQUIRE(SnapshotContents(cb.TakeSnapshot()) == "-tilla");
+	}
+
+	SECTION("ReleasesCopiedStorage") {
+		// Each AllView after an edit copies most of the text: the storage it was copied
+		// from has to be released instead of adding up
+		const std::string line = "0123456789abcdefghijklmnopqrstuvwxyz\n";
+		std::string text;
+		while (text.length() < 1000000)
+			text += line;
+		PieceTable table;
+		table.InsertFromArray(0, text.c_str(), 0, text.length());
+		std::mt19937 random(1);
+		for (int cycle = 0; cycle < 50; cycle++) {
+			const ptrdiff_t pos = random() % (table.Length() + 1);
+			table.InsertFromArray(pos, "edit", 0, 4);
+			text.insert(pos, "edit");
+			const SplitView view = table.AllView();
+			REQUIRE(view.length == text.length());
+			REQUIRE(view.CharAt(pos) == 'e');
+			REQUIRE(table.Storage() < 3 * table.Length());
+		}
+		std::string contents(table.Length(), '\0');
+		table.GetRange(contents.data(), 0, table.Length());
+		REQUIRE(contents == text);
+		// Contiguous ranges release storage too
+		for (int cycle = 0; cycle < 50; cycle++) {
+			const ptrdiff_t pos = random() % (table.Length() + 1);
+			table.InsertFromArray(pos, "edit", 0, 4);
+			REQUIRE(table.RangePointer(0, table.Length())[pos] == 'e');
+			REQUIRE(table.Storage() < 3 * table.Length());
+		}
+	}
+}
+
+// Not run by default: unitTest "[.benchmark]"
+TEST_CASE("CellBufferBenchmark", "[.benchmark]") {
+	std::string text;
+	for (int line = 0; line < 500000; line++) {
+		text += "\tconst int value";
+		text += std::to_string(line);
+		text += " = call(argument, another argument, more arguments);\r\n";
+	}
+	std::shared_ptr<char[]> loaded(new char[text.length()]);
+	std::copy(text.begin(), text.end(), loaded.get());
+	for (const bool pieceTable : { false, true }) {
+		const char *kind = pieceTable ? "piece table" : "gap buffer";
+		auto report = [kind](const char *name, std::chrono::steady_clock::time_point start) {
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << kind << " " << name << ": " << static_cast<int>(elapsed.count() * 1000) << " ms\n";
+		};
+		CellBuffer cb(true, true, true, pieceTable);
+		bool startSequence = false;
+
+		// Opening copies the file into a gap buffer but a piece table adopts it.
+		// Styles are windowed as for a large file so they cost the same for both.
+		auto start = std::chrono::steady_clock::now();
+		cb.SetUndoCollection(false);
+		if (pieceTable) {
+			REQUIRE(cb.AdoptText(loaded, text.length()));
+		} else {
+			cb.InsertString(0, loaded.get(), text.length(), startSequence);
+		}
+		cb.SetUndoCollection(true);
+		report("open", start);
+		REQUIRE(cb.Length() == static_cast<Sci::Position>(text.length()));
+
+		std::mt19937 rng(1);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < 2000; i++) {
+			const Sci::Position position = rng() % (cb.Length() + 1);
+			cb.InsertString(position, "word ", 5, startSequence);
+		}
+		report("2000 random inserts", start);
+
+		start = std::chrono::steady_clock::now();
+		Sci::Position lineEnds = 0;
+		for (Sci::Position position = 0; position < cb.Length(); position++) {
+			if (cb.CharAt(position) == '\n')
+				lineEnds++;
+		}
+		report("scan by CharAt", start);
+		REQUIRE(lineEnds == 500000);
+
+		start = std::chrono::steady_clock::now();
+		lineEnds = 0;
+		std::string block(0x10000, '\0');
+		for (Sci::Position position = 0; position < cb.Length(); position += block.length()) {
+			const Sci::Position lengthBlock = std::min<Sci::Position>(block.length(), cb.Length() - position);
+			cb.GetCharRange(block.data(), position, lengthBlock);
+			lineEnds += std::count(block.data(), block.data() + lengthBlock, '\n');
+		}
+		report("scan by GetCharRange", start);
+		REQUIRE(lineEnds == 500000);
+	}
+}
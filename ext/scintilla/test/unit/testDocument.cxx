@@ -11,9 +11,11 @@
 #include <optional>
 #include <algorithm>
 #include <memory>
+#include <functional>
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <chrono>
 
 #include "ScintillaTypes.h"
 
@@ -30,6 +32,7 @@
 #include "CellBuffer.h"
 #include "CharClassify.h"
 #include "Decoration.h"
+#include "CaseConvert.h"
 #include "CaseFolder.h"
 #include "Document.h"
 
@@ -455,6 +458,784 @@ TEST_CASE("Document") {
 
 }
 
+namespace {
+
+std::string Contents(Document &document) {
+	return std::string(document.BufferPointer(), document.Length());
+}
+
+// Replace all occurrences in the whole document
+Sci::Position ReplaceAllInDocument(DocPlus &doc, std::string_view search, std::string_view replacement, FindOption flags) {
+	const Sci::Position lengthBefore = doc.document.Length();
+	Sci::Position lengthChange = 0;
+	const Sci::Position replacements = doc.document.ReplaceAll(0, lengthBefore, search, replacement, flags, &lengthChange);
+	REQUIRE(doc.document.Length() == lengthBefore + lengthChange);
+	return replacements;
+}
+
+// Records the ranges changed in a document
+class ModificationRecorder : public DocWatcher {
+public:
+	std::vector<Range> changed;
+	bool linesAddedOrRemoved = false;
+	void NotifyModifyAttempt(Document *, void *) override {}
+	void NotifySavePoint(Document *, void *, bool) override {}
+	void NotifyModified(Document *, DocModification mh, void *) override {
+		if (FlagSet(mh.modificationType, ModificationFlags::InsertText | ModificationFlags::DeleteText))
+			changed.push_back(Range(mh.position, mh.position + mh.length));
+		if (mh.linesAdded != 0)
+			linesAddedOrRemoved = true;
+	}
+	void NotifyDeleted(Document *, void *) noexcept override {}
+	void NotifyStyleNeeded(Document *, void *, Sci::Position) override {}
+	void NotifyErrorOccurred(Document *, void *, Status) override {}
+};
+
+}
+
+TEST_CASE("ReplaceAll") {
+
+	SECTION("Literal") {
+		DocPlus doc("one two one three one", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "one", "1", FindOption::MatchCase) == 3);
+		REQUIRE(Contents(doc.document) == "1 two 1 three 1");
+		// A single undo step restores the text
+		REQUIRE(!doc.document.IsSavePoint());
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == "one two one three one");
+		doc.document.Redo();
+		REQUIRE(Contents(doc.document) == "1 two 1 three 1");
+	}
+
+	SECTION("NoMatch") {
+		DocPlus doc("abc", 0);
+		doc.document.SetSavePoint();
+		REQUIRE(ReplaceAllInDocument(doc, "x", "y", FindOption::MatchCase) == 0);
+		REQUIRE(Contents(doc.document) == "abc");
+		REQUIRE(doc.document.IsSavePoint());
+	}
+
+	SECTION("Range") {
+		DocPlus doc("aXaXaXa", 0);
+		Sci::Position lengthChange = 0;
+		REQUIRE(doc.document.ReplaceAll(1, 5, "X", "--", FindOption::MatchCase, &lengthChange) == 2);
+		REQUIRE(lengthChange == 2);
+		REQUIRE(Contents(doc.document) == "a--a--aXa");
+	}
+
+	SECTION("CaseInsensitive") {
+		DocPlus doc("Cat cat CAT dog", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "cat", "bird", FindOption::None) == 3);
+		REQUIRE(Contents(doc.document) == "bird bird bird dog");
+	}
+
+	SECTION("ReplacementContainsSearch") {
+		// The replaced text is not searched again
+		DocPlus doc("aaa", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "a", "aa", FindOption::MatchCase) == 3);
+		REQUIRE(Contents(doc.document) == "aaaaaa");
+	}
+
+	SECTION("Delete") {
+		DocPlus doc("a, b, c", 0);
+		REQUIRE(ReplaceAllInDocument(doc, ", ", "", FindOption::MatchCase) == 2);
+		REQUIRE(Contents(doc.document) == "abc");
+	}
+
+	SECTION("MarkersAndSingleChange") {
+		const std::string text = "a=1\nb\nc=3\nd=4\n";
+		DocPlus doc(text, 0);
+		doc.document.AddMark(1, 1);
+		doc.document.AddMark(2, 2);
+		doc.document.AddMark(3, 3);
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		REQUIRE(ReplaceAllInDocument(doc, "=", " = ", FindOption::MatchCase) == 3);
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		REQUIRE(Contents(doc.document) == "a = 1\nb\nc = 3\nd = 4\n");
+		// No line ends are replaced so the span of the matches is replaced in one deletion and
+		// insertion which keeps the lines and their markers
+		REQUIRE(recorder.changed.size() == 2);
+		REQUIRE(!recorder.linesAddedOrRemoved);
+		REQUIRE(doc.document.GetMark(0, false) == 0);
+		REQUIRE(doc.document.GetMark(1, false) == (1 << 1));
+		REQUIRE(doc.document.GetMark(2, false) == (1 << 2));
+		REQUIRE(doc.document.GetMark(3, false) == (1 << 3));
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == text);
+	}
+
+	SECTION("LineEndsReplaced") {
+		// Replacements with line ends change the lines so each match is replaced separately
+		const std::string text = "a,b\nc\nd,e";
+		DocPlus doc(text, 0);
+		doc.document.AddMark(1, 1);
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		REQUIRE(ReplaceAllInDocument(doc, ",", "\n", FindOption::MatchCase) == 2);
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		REQUIRE(Contents(doc.document) == "a\nb\nc\nd\ne");
+		REQUIRE(doc.document.LinesTotal() == 5);
+		REQUIRE(doc.document.GetMark(2, false) == (1 << 1));
+		for (const Range &range : recorder.changed)
+			REQUIRE(!range.ContainsCharacter(4));
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == text);
+		REQUIRE(doc.document.LinesTotal() == 3);
+	}
+
+	SECTION("JoinsCRLF") {
+		// Deleting the text between a CR and a LF removes a line
+		DocPlus doc("a\rX\nb\rX\nc", 0);
+		REQUIRE(doc.document.LinesTotal() == 5);
+		REQUIRE(ReplaceAllInDocument(doc, "X", "", FindOption::MatchCase) == 2);
+		REQUIRE(Contents(doc.document) == "a\r\nb\r\nc");
+		REQUIRE(doc.document.LinesTotal() == 3);
+		REQUIRE(doc.document.LineStart(1) == 3);
+		REQUIRE(doc.document.LineStart(2) == 6);
+	}
+
+	SECTION("AdjacentMatches") {
+		DocPlus doc("xaaay", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "a", "bc", FindOption::MatchCase) == 3);
+		REQUIRE(Contents(doc.document) == "xbcbcbcy");
+	}
+
+	SECTION("EmbeddedNUL") {
+		const std::string text("a\0b\0c", 5);
+		DocPlus doc(text, 0);
+		REQUIRE(ReplaceAllInDocument(doc, std::string_view("\0", 1), std::string_view("-\0-", 3), FindOption::MatchCase) == 2);
+		REQUIRE(Contents(doc.document) == std::string("a-\0-b-\0-c", 9));
+	}
+
+	SECTION("LinesAndUTF8") {
+		DocPlus doc("\xce\xb1=1\r\n\xce\xb2=2\n\xce\xb3=3", CpUtf8);
+		REQUIRE(ReplaceAllInDocument(doc, "=", " := ", FindOption::MatchCase) == 3);
+		REQUIRE(Contents(doc.document) == "\xce\xb1 := 1\r\n\xce\xb2 := 2\n\xce\xb3 := 3");
+		REQUIRE(doc.document.LinesTotal() == 3);
+		REQUIRE(doc.document.LineStart(1) == 9);
+		REQUIRE(doc.document.LineStart(2) == 17);
+	}
+
+	SECTION("RESearchTags") {
+		DocPlus doc("width=10 height=20", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "\\([a-z]+\\)=\\([0-9]+\\)", "\\2:\\1", FindOption::RegExp | FindOption::MatchCase) == 2);
+		REQUIRE(Contents(doc.document) == "10:width 20:height");
+	}
+
+	SECTION("RESearchLineStart") {
+		// Anchors are matched against the original text
+		DocPlus doc("a\nb\nc", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "^", "> ", FindOption::RegExp) == 3);
+		REQUIRE(Contents(doc.document) == "> a\n> b\n> c");
+	}
+
+	SECTION("RESearchLineEnd") {
+		DocPlus doc("a  \nb\t\nc ", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "[ \t]+$", "", FindOption::RegExp) == 3);
+		REQUIRE(Contents(doc.document) == "a\nb\nc");
+	}
+
+	SECTION("Cxx11Tags") {
+		DocPlus doc("x1 y22 z333", CpUtf8);
+		REQUIRE(ReplaceAllInDocument(doc, "([a-z])([0-9]+)", "\\2\\1", FindOption::RegExp | FindOption::Cxx11RegEx) == 3);
+		REQUIRE(Contents(doc.document) == "1x 22y 333z");
+	}
+
+	SECTION("Cxx11EmptyMatches") {
+		DocPlus doc("abc", 0);
+		REQUIRE(ReplaceAllInDocument(doc, "x*", "-", FindOption::RegExp | FindOption::Cxx11RegEx) == 4);
+		REQUIRE(Contents(doc.document) == "-a-b-c-");
+	}
+
+	SECTION("Cxx11Invalid") {
+		DocPlus doc("abc", 0);
+		Sci::Position lengthChange = 0;
+		REQUIRE_THROWS_AS(doc.document.ReplaceAll(0, 3, "(", "", FindOption::RegExp | FindOption::Cxx11RegEx, &lengthChange), RegexError);
+		REQUIRE(Contents(doc.document) == "abc");
+	}
+
+	SECTION("ReadOnly") {
+		DocPlus doc("abc", 0);
+		doc.document.SetReadOnly(true);
+		REQUIRE(ReplaceAllInDocument(doc, "b", "x", FindOption::MatchCase) == 0);
+		REQUIRE(Contents(doc.document) == "abc");
+	}
+
+	SECTION("SameAsReplacingOneByOne") {
+		// Compare with replacing each match in turn the way a replace loop would
+		const std::string pieces[] = { "ab", "b", "a", "\n", "ba", "\r\n" };
+		unsigned int seed = 3;
+		auto next = [&seed]() {
+			seed = seed * 1103515245 + 12345;
+			return (seed >> 16) & 0x7fff;
+		};
+		for (int run = 0; run < 200; run++) {
+			std::string text;
+			const size_t pieceCount = next() % 40;
+			for (size_t i = 0; i < pieceCount; i++)
+				text += pieces[next() % std::size(pieces)];
+			const std::string search = pieces[next() % 3];
+			const std::string replacement = pieces[next() % std::size(pieces)].substr(0, next() % 3);
+
+			std::string expected;
+			Sci::Position expectedCount = 0;
+			for (size_t pos = 0; pos < text.length();) {
+				if (text.compare(pos, search.length(), search) == 0) {
+					expected += replacement;
+					pos += search.length();
+					expectedCount++;
+				} else {
+					expected += text[pos++];
+				}
+			}
+
+			DocPlus doc(text, 0);
+			REQUIRE(ReplaceAllInDocument(doc, search, replacement, FindOption::MatchCase) == expectedCount);
+			REQUIRE(Contents(doc.document) == expected);
+			Sci::Line lines = 1;
+			for (const char ch : expected) {
+				if (ch == '\n')
+					lines++;
+			}
+			for (size_t i = 1; i < expected.length(); i++) {
+				if (expected[i - 1] == '\r' && expected[i] != '\n')
+					lines++;
+			}
+			if (!expected.empty() && expected.back() == '\r')
+				lines++;
+			REQUIRE(doc.document.LinesTotal() == lines);
+			if (expected != text) {
+				doc.document.Undo();
+				REQUIRE(Contents(doc.document) == text);
+			}
+		}
+	}
+}
+
+namespace {
+
+// The previous implementation of Document::ConvertLineEnds that changed each line end in turn
+void ConvertLineEndsOneByOne(Document &document, EndOfLine eolModeSet) {
+	UndoGroup ug(&document);
+
+	for (Sci::Position pos = 0; pos < document.Length(); pos++) {
+		const char ch = document.CharAt(pos);
+		if (ch == '\r') {
+			if (document.CharAt(pos + 1) == '\n') {
+				if (eolModeSet == EndOfLine::Cr) {
+					document.DeleteChars(pos + 1, 1);
+				} else if (eolModeSet == EndOfLine::Lf) {
+					document.DeleteChars(pos, 1);
+				} else {
+					pos++;
+				}
+			} else {
+				if (eolModeSet == EndOfLine::CrLf) {
+					pos += document.InsertString(pos + 1, "\n", 1);
+				} else if (eolModeSet == EndOfLine::Lf) {
+					pos += document.InsertString(pos, "\n", 1);
+					document.DeleteChars(pos, 1);
+					pos--;
+				}
+			}
+		} else if (ch == '\n') {
+			if (eolModeSet == EndOfLine::CrLf) {
+				pos += document.InsertString(pos, "\r", 1);
+			} else if (eolModeSet == EndOfLine::Cr) {
+				pos += document.InsertString(pos, "\r", 1);
+				document.DeleteChars(pos, 1);
+				pos--;
+			}
+		}
+	}
+}
+
+}
+
+TEST_CASE("ConvertLineEnds") {
+
+	SECTION("Modes") {
+		const std::string text = "a\r\nb\rc\nd\r\r\n\n\re";
+		DocPlus docCrLf(text, 0);
+		docCrLf.document.ConvertLineEnds(EndOfLine::CrLf);
+		REQUIRE(Contents(docCrLf.document) == "a\r\nb\r\nc\r\nd\r\n\r\n\r\n\r\ne");
+		DocPlus docCr(text, 0);
+		docCr.document.ConvertLineEnds(EndOfLine::Cr);
+		REQUIRE(Contents(docCr.document) == "a\rb\rc\rd\r\r\r\re");
+		DocPlus docLf(text, 0);
+		docLf.document.ConvertLineEnds(EndOfLine::Lf);
+		REQUIRE(Contents(docLf.document) == "a\nb\nc\nd\n\n\n\ne");
+		REQUIRE(docLf.document.LinesTotal() == 8);
+		// A single undo step restores the text
+		docLf.document.Undo();
+		REQUIRE(Contents(docLf.document) == text);
+		docLf.document.Redo();
+		REQUIRE(Contents(docLf.document) == "a\nb\nc\nd\n\n\n\ne");
+	}
+
+	SECTION("Markers") {
+		// Markers stay on their lines whichever line ends the lines change between
+		for (const std::string_view eolFrom : { "\r\n", "\r", "\n" }) {
+			for (const EndOfLine eolMode : { EndOfLine::CrLf, EndOfLine::Cr, EndOfLine::Lf }) {
+				std::string text;
+				for (int line = 0; line < 10; line++) {
+					text += std::to_string(line);
+					text += eolFrom;
+				}
+				DocPlus doc(text, 0);
+				doc.document.AddMark(3, 1);
+				doc.document.AddMark(7, 2);
+				doc.document.ConvertLineEnds(eolMode);
+				REQUIRE(doc.document.LinesTotal() == 11);
+				for (Sci::Line line = 0; line < doc.document.LinesTotal(); line++) {
+					const int expected = (line == 3) ? (1 << 1) : ((line == 7) ? (1 << 2) : 0);
+					REQUIRE(doc.document.GetMark(line, false) == expected);
+				}
+				if (Contents(doc.document) != text) {
+					doc.document.Undo();
+					REQUIRE(Contents(doc.document) == text);
+					REQUIRE(doc.document.GetMark(3, false) == (1 << 1));
+					REQUIRE(doc.document.GetMark(7, false) == (1 << 2));
+				}
+			}
+		}
+	}
+
+	SECTION("SingleChange") {
+		// The span of the changed line ends is replaced in one deletion and insertion
+		DocPlus doc("a\nb\r\nc\nd\r\ne", 0);
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		doc.document.ConvertLineEnds(EndOfLine::CrLf);
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		REQUIRE(Contents(doc.document) == "a\r\nb\r\nc\r\nd\r\ne");
+		REQUIRE(recorder.changed.size() == 2);
+		REQUIRE(recorder.changed[0] == Range(1, 7));
+		REQUIRE(!recorder.linesAddedOrRemoved);
+		REQUIRE(doc.document.LineStart(4) == 12);
+	}
+
+	SECTION("Unchanged") {
+		DocPlus doc("a\r\nb\r\n", 0);
+		doc.document.SetSavePoint();
+		doc.document.ConvertLineEnds(EndOfLine::CrLf);
+		REQUIRE(Contents(doc.document) == "a\r\nb\r\n");
+		REQUIRE(doc.document.IsSavePoint());
+	}
+
+	SECTION("ReadOnly") {
+		DocPlus doc("a\nb", 0);
+		doc.document.SetReadOnly(true);
+		doc.document.ConvertLineEnds(EndOfLine::CrLf);
+		REQUIRE(Contents(doc.document) == "a\nb");
+	}
+
+	SECTION("SameAsOneByOne") {
+		const std::string pieces[] = { "a", "\xce\xb1", "\r", "\n", "\r\n", "\n\r" };
+		unsigned int seed = 7;
+		auto next = [&seed]() {
+			seed = seed * 1103515245 + 12345;
+			return (seed >> 16) & 0x7fff;
+		};
+		for (int run = 0; run < 300; run++) {
+			std::string text;
+			const size_t pieceCount = next() % 40;
+			for (size_t i = 0; i < pieceCount; i++)
+				text += pieces[next() % std::size(pieces)];
+			for (const EndOfLine eolMode : { EndOfLine::CrLf, EndOfLine::Cr, EndOfLine::Lf }) {
+				DocPlus expected(text, CpUtf8);
+				ConvertLineEndsOneByOne(expected.document, eolMode);
+				DocPlus doc(text, CpUtf8);
+				// Move the gap into the text so conversion sees a split buffer
+				if (!text.empty()) {
+					const Sci::Position middle = next() % text.length();
+					doc.document.InsertString(middle, "x", 1);
+					doc.document.DeleteChars(middle, 1);
+				}
+				doc.document.ConvertLineEnds(eolMode);
+				const std::string converted = Contents(expected.document);
+				REQUIRE(Contents(doc.document) == converted);
+				REQUIRE(doc.document.LinesTotal() == expected.document.LinesTotal());
+				for (Sci::Line line = 0; line < expected.document.LinesTotal(); line++)
+					REQUIRE(doc.document.LineStart(line) == expected.document.LineStart(line));
+				if (converted != text) {
+					expected.document.Undo();
+					doc.document.Undo();
+					REQUIRE(Contents(expected.document) == text);
+					REQUIRE(Contents(doc.document) == text);
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE("WhitespaceTransforms") {
+
+	Sci::Position lengthChange = 0;
+
+	SECTION("Trim") {
+		const std::string text = "a \t\nb\nc  \r\n  \nd\t";
+		DocPlus doc(text, 0);
+		doc.document.AddMark(2, 1);
+		doc.document.AddMark(3, 2);
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		REQUIRE(doc.document.TrimTrailingWhitespace(0, doc.document.Length(), &lengthChange) == 4);
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		REQUIRE(Contents(doc.document) == "a\nb\nc\r\n\nd");
+		REQUIRE(lengthChange == -7);
+		// The unchanged line "b" is not touched and markers stay on their lines
+		for (const Range &range : recorder.changed)
+			REQUIRE(!range.ContainsCharacter(4));
+		REQUIRE(doc.document.GetMark(2, false) == (1 << 1));
+		REQUIRE(doc.document.GetMark(3, false) == (1 << 2));
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == text);
+	}
+
+	SECTION("AdjacentLinesKeepMarkers") {
+		// Adjacent changed lines are replaced together without removing any line
+		std::string text;
+		for (int line = 0; line < 10; line++) {
+			text += "\t";
+			text += std::to_string(line);
+			text += (line % 2) ? "\r\n" : "\n";
+		}
+		DocPlus doc(text, 0);
+		doc.document.tabInChars = 4;
+		doc.document.AddMark(3, 1);
+		doc.document.AddMark(7, 2);
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		REQUIRE(doc.document.TabsToSpaces(0, doc.document.Length(), false, &lengthChange) == 10);
+		REQUIRE(!recorder.linesAddedOrRemoved);
+		REQUIRE(lengthChange == 30);
+		REQUIRE(doc.document.LinesTotal() == 11);
+		REQUIRE(doc.document.LineStart(4) == 4 * 6 + 2);
+		auto requireMarks = [&doc]() {
+			for (Sci::Line line = 0; line < doc.document.LinesTotal(); line++) {
+				const int expected = (line == 3) ? (1 << 1) : ((line == 7) ? (1 << 2) : 0);
+				REQUIRE(doc.document.GetMark(line, false) == expected);
+			}
+		};
+		requireMarks();
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == text);
+		requireMarks();
+		doc.document.Redo();
+		REQUIRE(doc.document.LineStart(4) == 4 * 6 + 2);
+		requireMarks();
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		REQUIRE(!recorder.linesAddedOrRemoved);
+		// Markers still move with lines inserted and removed afterwards
+		doc.document.InsertString(0, "\n", 1);
+		REQUIRE(doc.document.GetMark(4, false) == (1 << 1));
+		doc.document.DeleteChars(0, 1);
+		requireMarks();
+	}
+
+	SECTION("TrimLinesInRange") {
+		DocPlus doc("a \nb \nc \n", 0);
+		REQUIRE(doc.document.TrimTrailingWhitespace(3, 6, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "a \nb\nc \n");
+		REQUIRE(lengthChange == -1);
+	}
+
+	SECTION("Unchanged") {
+		DocPlus doc("a\n\tb\nc d", 0);
+		doc.document.SetSavePoint();
+		REQUIRE(doc.document.TrimTrailingWhitespace(0, doc.document.Length(), &lengthChange) == 0);
+		REQUIRE(doc.document.SpacesToTabs(0, doc.document.Length(), false, &lengthChange) == 0);
+		REQUIRE(lengthChange == 0);
+		REQUIRE(doc.document.IsSavePoint());
+	}
+
+	SECTION("ReadOnly") {
+		DocPlus doc("a \n", 0);
+		doc.document.SetReadOnly(true);
+		REQUIRE(doc.document.TrimTrailingWhitespace(0, doc.document.Length(), &lengthChange) == 0);
+		REQUIRE(Contents(doc.document) == "a \n");
+	}
+
+	SECTION("TabsToSpaces") {
+		DocPlus doc("\tx\ty\n  \tz\nnone", 0);
+		doc.document.tabInChars = 4;
+		REQUIRE(doc.document.TabsToSpaces(0, doc.document.Length(), false, &lengthChange) == 2);
+		REQUIRE(Contents(doc.document) == "    x   y\n    z\nnone");
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == "\tx\ty\n  \tz\nnone");
+	}
+
+	SECTION("TabsToSpacesQuoted") {
+		DocPlus doc("a\t'b\tc'\td\n'a\\'\tb'\tc", 0);
+		doc.document.tabInChars = 4;
+		REQUIRE(doc.document.TabsToSpaces(0, doc.document.Length(), true, &lengthChange) == 2);
+		REQUIRE(Contents(doc.document) == "a   'b\tc'  d\n'a\\'\tb'  c");
+		doc.document.Undo();
+		REQUIRE(doc.document.TabsToSpaces(0, doc.document.Length(), false, &lengthChange) == 2);
+		REQUIRE(Contents(doc.document) == "a   'b  c'  d\n'a\\'    b'  c");
+	}
+
+	SECTION("TabsToSpacesUTF8") {
+		// Columns count characters, not bytes
+		DocPlus doc("\xce\xb1\tx", CpUtf8);
+		doc.document.tabInChars = 4;
+		REQUIRE(doc.document.TabsToSpaces(0, doc.document.Length(), false, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "\xce\xb1   x");
+	}
+
+	SECTION("SpacesToTabs") {
+		DocPlus doc("        x\na   b\nab c\nabc d\n  \tx\n     x\nx\t", 0);
+		doc.document.tabInChars = 4;
+		REQUIRE(doc.document.SpacesToTabs(0, doc.document.Length(), false, &lengthChange) == 4);
+		REQUIRE(Contents(doc.document) == "\t\tx\na\tb\nab c\nabc d\n\tx\n\t x\nx\t");
+	}
+
+	SECTION("SpacesToTabsQuoted") {
+		DocPlus doc("\"a    b\"    c", 0);
+		doc.document.tabInChars = 4;
+		REQUIRE(doc.document.SpacesToTabs(0, doc.document.Length(), true, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "\"a    b\"\tc");
+	}
+
+	SECTION("SameLayout") {
+		// Converting spaces to tabs and back gives the same text as converting tabs to spaces
+		const char pieces[] = { 'a', ' ', ' ', '\t', '\n' };
+		unsigned int seed = 11;
+		auto next = [&seed]() {
+			seed = seed * 1103515245 + 12345;
+			return (seed >> 16) & 0x7fff;
+		};
+		for (int run = 0; run < 300; run++) {
+			std::string text;
+			const size_t length = next() % 60;
+			for (size_t i = 0; i < length; i++)
+				text += pieces[next() % std::size(pieces)];
+			DocPlus expanded(text, 0);
+			expanded.document.tabInChars = 1 + next() % 8;
+			expanded.document.TabsToSpaces(0, expanded.document.Length(), false, &lengthChange);
+			DocPlus tabbed(text, 0);
+			tabbed.document.tabInChars = expanded.document.tabInChars;
+			const Sci::Line linesChanged = tabbed.document.SpacesToTabs(0, tabbed.document.Length(), false, &lengthChange);
+			REQUIRE(tabbed.document.Length() == static_cast<Sci::Position>(text.length()) + lengthChange);
+			tabbed.document.TabsToSpaces(0, tabbed.document.Length(), false, &lengthChange);
+			REQUIRE(Contents(tabbed.document) == Contents(expanded.document));
+			if (linesChanged) {
+				// Back to the tabbed text then to the original with one undo each
+				tabbed.document.Undo();
+				tabbed.document.Undo();
+				REQUIRE(Contents(tabbed.document) == text);
+			}
+		}
+	}
+}
+
+TEST_CASE("TransformCase") {
+
+	Sci::Position lengthChange = 0;
+
+	SECTION("ASCII") {
+		// Long enough to go through the 8 byte blocks with a partial block at the end
+		const std::string text = "Hello, World! [@`{] azAZ 0123456789 xyz";
+		DocPlus doc(text, 0);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::upper, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "HELLO, WORLD! [@`{] AZAZ 0123456789 XYZ");
+		REQUIRE(lengthChange == 0);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::lower, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "hello, world! [@`{] azaz 0123456789 xyz");
+		doc.document.Undo();
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == text);
+	}
+
+	SECTION("PartOfLines") {
+		DocPlus doc("abc def\nghi jkl\nmno", 0);
+		doc.document.AddMark(1, 1);
+		REQUIRE(doc.document.TransformCase(5, 10, CaseTransform::upper, &lengthChange) == 2);
+		REQUIRE(Contents(doc.document) == "abc dEF\nGHi jkl\nmno");
+		REQUIRE(doc.document.GetMark(1, false) == (1 << 1));
+	}
+
+	SECTION("UTF8") {
+		DocPlus doc("stra\xc3\x9f" "e \xc3\xa9t\xc3\xa9 \xce\xb1\xce\xb2", CpUtf8);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::upper, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "STRASSE \xc3\x89T\xc3\x89 \xce\x91\xce\x92");
+		REQUIRE(lengthChange == 0);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::lower, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "strasse \xc3\xa9t\xc3\xa9 \xce\xb1\xce\xb2");
+	}
+
+	SECTION("UTF8LengthChange") {
+		// U+0130 lower case is 'i' followed by a combining dot above
+		DocPlus doc("a\xc4\xb0z", CpUtf8);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::lower, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "ai\xcc\x87z");
+		REQUIRE(lengthChange == 1);
+	}
+
+	SECTION("Title") {
+		DocPlus doc("hello wORLD, don't stop-me 3rd \xc3\xa9t\xc3\xa9\n_x \xe2\x80\x99tis it\xe2\x80\x99s", CpUtf8);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::title, &lengthChange) == 2);
+		REQUIRE(Contents(doc.document) == "Hello WORLD, Don't Stop-Me 3rd \xc3\x89t\xc3\xa9\n_x \xe2\x80\x99Tis It\xe2\x80\x99s");
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::title, &lengthChange) == 0);
+	}
+
+	SECTION("DBCS") {
+		// The trail byte 0x61 of the Shift-JIS character is not a letter
+		DocPlus doc("a\x82\x61" "b", 932);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::upper, &lengthChange) == 1);
+		REQUIRE(Contents(doc.document) == "A\x82\x61" "B");
+	}
+
+	SECTION("ReadOnly") {
+		DocPlus doc("abc", 0);
+		doc.document.SetReadOnly(true);
+		REQUIRE(doc.document.TransformCase(0, doc.document.Length(), CaseTransform::upper, &lengthChange) == 0);
+		REQUIRE(Contents(doc.document) == "abc");
+	}
+
+	SECTION("SameAsCaseConvert") {
+		const char *pieces[] = { "a", "Z", "q", " ", "\n", "1", "\xc3\x9f", "\xc3\x89", "\xce\xb1", "\xc4\xb0", "\xe1\xba\x9e", "\xef\xac\x80" };
+		unsigned int seed = 7;
+		auto next = [&seed]() {
+			seed = seed * 1103515245 + 12345;
+			return (seed >> 16) & 0x7fff;
+		};
+		for (int run = 0; run < 300; run++) {
+			std::string text;
+			const size_t length = next() % 40;
+			for (size_t i = 0; i < length; i++)
+				text += pieces[next() % std::size(pieces)];
+			for (const CaseConversion conversion : { CaseConversion::upper, CaseConversion::lower }) {
+				DocPlus doc(text, CpUtf8);
+				const CaseTransform transform = conversion == CaseConversion::upper ? CaseTransform::upper : CaseTransform::lower;
+				doc.document.TransformCase(0, doc.document.Length(), transform, &lengthChange);
+				const std::string expected = CaseConvertString(text, conversion);
+				REQUIRE(Contents(doc.document) == expected);
+				REQUIRE(lengthChange == static_cast<Sci::Position>(expected.length() - text.length()));
+			}
+		}
+	}
+}
+
+namespace {
+
+// Upper cases text as it is inserted, like a container could
+class UpperCaseInserter : public ModificationRecorder {
+public:
+	void NotifyModified(Document *doc, DocModification mh, void *userData) override {
+		if (FlagSet(mh.modificationType, ModificationFlags::InsertCheck)) {
+			const std::string upper = CaseConvertString(std::string(mh.text, mh.length), CaseConversion::upper);
+			doc->ChangeInsertion(upper.c_str(), upper.length());
+		}
+		ModificationRecorder::NotifyModified(doc, mh, userData);
+	}
+};
+
+}
+
+TEST_CASE("ReplaceRanges") {
+
+	SECTION("Replace") {
+		DocPlus doc("abc def ghi", 0);
+		std::vector<RangeReplacement> replacements {
+			{ 0, 1, "XY" },
+			{ 4, 0, "-" },
+			{ 8, 3, "" },
+			{ 11, 0, "!" },
+		};
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		REQUIRE(doc.document.ReplaceRanges(replacements));
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		REQUIRE(Contents(doc.document) == "XYbc -def !");
+		REQUIRE(replacements[0].position == 0);
+		REQUIRE(replacements[0].lengthInserted == 2);
+		REQUIRE(replacements[1].position == 5);
+		REQUIRE(replacements[2].position == 10);
+		REQUIRE(replacements[2].lengthInserted == 0);
+		REQUIRE(replacements[3].position == 10);
+		// Each change is notified at its final position, working forward
+		REQUIRE(recorder.changed.size() == 5);
+		for (size_t i = 1; i < recorder.changed.size(); i++)
+			REQUIRE(recorder.changed[i - 1].start <= recorder.changed[i].start);
+		// One undo action
+		doc.document.Undo();
+		REQUIRE(Contents(doc.document) == "abc def ghi");
+		doc.document.Redo();
+		REQUIRE(Contents(doc.document) == "XYbc -def !");
+	}
+
+	SECTION("ChangedInsertion") {
+		DocPlus doc("a b c", 0);
+		std::vector<RangeReplacement> replacements {
+			{ 0, 0, "x" },
+			{ 2, 1, "yy" },
+			{ 4, 0, "z" },
+		};
+		UpperCaseInserter inserter;
+		doc.document.AddWatcher(&inserter, nullptr);
+		REQUIRE(doc.document.ReplaceRanges(replacements));
+		doc.document.RemoveWatcher(&inserter, nullptr);
+		REQUIRE(Contents(doc.document) == "Xa YY Zc");
+		REQUIRE(replacements[1].position == 3);
+		REQUIRE(replacements[1].lengthInserted == 2);
+		REQUIRE(replacements[2].position == 6);
+	}
+
+	SECTION("ReadOnly") {
+		DocPlus doc("abc", 0);
+		doc.document.SetReadOnly(true);
+		std::vector<RangeReplacement> replacements { { 1, 1, "x" } };
+		REQUIRE(!doc.document.ReplaceRanges(replacements));
+		REQUIRE(Contents(doc.document) == "abc");
+	}
+
+	SECTION("SameAsSeparateChanges") {
+		const char *texts[] = { "", "a", "\n", "bc", "\r\n" };
+		unsigned int seed = 5;
+		auto next = [&seed]() {
+			seed = seed * 1103515245 + 12345;
+			return (seed >> 16) & 0x7fff;
+		};
+		for (int run = 0; run < 300; run++) {
+			std::string text;
+			const size_t length = next() % 50;
+			for (size_t i = 0; i < length; i++)
+				text += "ab\nc "[next() % 5];
+			std::vector<RangeReplacement> replacements;
+			Sci::Position position = 0;
+			while (true) {
+				position += next() % 8;
+				const Sci::Position lengthDelete = next() % 3;
+				if (position + lengthDelete > static_cast<Sci::Position>(text.length()))
+					break;
+				replacements.push_back({ position, lengthDelete, texts[next() % std::size(texts)] });
+				position += lengthDelete;
+			}
+			DocPlus separate(text, 0);
+			for (auto it = replacements.rbegin(); it != replacements.rend(); ++it) {
+				separate.document.DeleteChars(it->position, it->lengthDelete);
+				separate.document.InsertString(it->position, it->text);
+			}
+			DocPlus together(text, 0);
+			REQUIRE(together.document.ReplaceRanges(replacements));
+			REQUIRE(Contents(together.document) == Contents(separate.document));
+			REQUIRE(together.document.LinesTotal() == separate.document.LinesTotal());
+			for (const RangeReplacement &replacement : replacements) {
+				REQUIRE(Contents(together.document).substr(replacement.position, replacement.lengthInserted) == replacement.text);
+			}
+			const bool changed = std::any_of(replacements.begin(), replacements.end(),
+				[](const RangeReplacement &replacement) { return replacement.lengthDelete || !replacement.text.empty(); });
+			if (changed) {
+				together.document.Undo();
+				REQUIRE(Contents(together.document) == text);
+			}
+		}
+	}
+}
+
 TEST_CASE("Words") {
 
 	SECTION("WordsInText") {
@@ -671,3 +1452,293 @@ TEST_CASE("PerLine") {
 		REQUIRE(doc.document.AnnotationLines(2) == 0);
 	}
 }
+
+namespace {
+
+// The fold block search as performed by scanning each line
+Sci::Line LastChildByScan(const Document &doc, Sci::Line lineParent, Sci::Line lastLine) {
+	const FoldLevel levelStart = LevelNumberPart(doc.GetFoldLevel(lineParent));
+	const Sci::Line maxLine = doc.LinesTotal();
+	const Sci::Line lookLastLine = (lastLine != -1) ? std::min(maxLine - 1, lastLine) : -1;
+	Sci::Line lineMaxSubord = lineParent;
+	while (lineMaxSubord < maxLine - 1) {
+		const FoldLevel levelTry = doc.GetFoldLevel(lineMaxSubord + 1);
+		if (!LevelIsWhitespace(levelTry) && (LevelNumber(levelStart) >= LevelNumber(levelTry)))
+			break;
+		if ((lookLastLine != -1) && (lineMaxSubord >= lookLastLine) && !LevelIsWhitespace(doc.GetFoldLevel(lineMaxSubord)))
+			break;
+		lineMaxSubord++;
+	}
+	if (lineMaxSubord > lineParent) {
+		if (levelStart > LevelNumberPart(doc.GetFoldLevel(lineMaxSubord + 1))) {
+			if (LevelIsWhitespace(doc.GetFoldLevel(lineMaxSubord))) {
+				lineMaxSubord--;
+			}
+		}
+	}
+	return lineMaxSubord;
+}
+
+}
+
+TEST_CASE("Folding") {
+
+	SECTION("LastChildMatchesScan") {
+		constexpr int base = static_cast<int>(FoldLevel::Base);
+		const std::string text(3000, '\n');
+		DocPlus doc(text, 0);
+		const Sci::Line lines = doc.document.LinesTotal();
+		int depth = 0;
+		for (Sci::Line line = 0; line < lines; line++) {
+			// Deeply nested blocks with occasional whitespace lines
+			const int next = std::clamp(depth + ((line * 7) % 5 < 3 ? 1 : -1), 0, 40);
+			int level = base + depth;
+			if (next > depth) {
+				level |= static_cast<int>(FoldLevel::HeaderFlag);
+			} else if (line % 11 == 0) {
+				level |= static_cast<int>(FoldLevel::WhiteFlag);
+			}
+			doc.document.SetLevel(line, level);
+			depth = next;
+		}
+		for (Sci::Line line = 0; line < lines; line += 3) {
+			REQUIRE(doc.document.GetLastChild(line) == LastChildByScan(doc.document, line, -1));
+			const Sci::Line lastLine = line + 100;
+			REQUIRE(doc.document.GetLastChild(line, {}, lastLine) == LastChildByScan(doc.document, line, lastLine));
+		}
+		HighlightDelimiter hd;
+		doc.document.GetHighlightDelimiters(hd, 1500, 1600);
+		REQUIRE(hd.beginFoldBlock <= 1500);
+		REQUIRE(hd.endFoldBlock >= 1500);
+	}
+}
+
+namespace {
+
+// Lexer where text between braces is style 1 so styles depend on lines far before them
+class BraceLexer final : public ILexer5 {
+public:
+	int SCI_METHOD Version() const override { return lvRelease5; }
+	void SCI_METHOD Release() override { delete this; }
+	const char *SCI_METHOD PropertyNames() override { return ""; }
+	int SCI_METHOD PropertyType(const char *) override { return 0; }
+	const char *SCI_METHOD DescribeProperty(const char *) override { return ""; }
+	Sci_Position SCI_METHOD PropertySet(const char *, const char *) override { return -1; }
+	const char *SCI_METHOD DescribeWordListSets() override { return ""; }
+	Sci_Position SCI_METHOD WordListSet(int, const char *) override { return -1; }
+	void SCI_METHOD Lex(Sci_PositionU startPos, Sci_Position lengthDoc, int initStyle, IDocument *pAccess) override {
+		std::string text(lengthDoc, '\0');
+		pAccess->GetCharRange(text.data(), startPos, lengthDoc);
+		char state = static_cast<char>(initStyle);
+		for (char &ch : text) {
+			if (ch == '{') {
+				state = 1;
+			}
+			const char style = state;
+			if (ch == '}') {
+				state = 0;
+			}
+			ch = style;
+		}
+		pAccess->StartStyling(startPos);
+		pAccess->SetStyles(lengthDoc, text.data());
+	}
+	void SCI_METHOD Fold(Sci_PositionU, Sci_Position, int, IDocument *) override {}
+	void *SCI_METHOD PrivateCall(int, void *) override { return nullptr; }
+	int SCI_METHOD LineEndTypesSupported() override { return 0; }
+	int SCI_METHOD AllocateSubStyles(int, int) override { return -1; }
+	int SCI_METHOD SubStylesStart(int) override { return -1; }
+	int SCI_METHOD SubStylesLength(int) override { return 0; }
+	int SCI_METHOD StyleFromSubStyle(int subStyle) override { return subStyle; }
+	int SCI_METHOD PrimaryStyleFromStyle(int style) override { return style; }
+	void SCI_METHOD FreeSubStyles() override {}
+	void SCI_METHOD SetIdentifiers(int, const char *) override {}
+	int SCI_METHOD DistanceToSecondaryStyles() override { return 0; }
+	const char *SCI_METHOD GetSubStyleBases() override { return ""; }
+	int SCI_METHOD NamedStyles() override { return 2; }
+	const char *SCI_METHOD NameOfStyle(int) override { return ""; }
+	const char *SCI_METHOD TagsOfStyle(int) override { return ""; }
+	const char *SCI_METHOD DescriptionOfStyle(int) override { return ""; }
+	const char *SCI_METHOD GetName() override { return "brace"; }
+	int SCI_METHOD GetIdentifier() override { return 0; }
+	const char *SCI_METHOD PropertyGet(const char *) override { return ""; }
+};
+
+void SetBraceLexer(Document &document) {
+	auto pli = std::make_unique<LexInterface>(&document);
+	pli->SetInstance(new BraceLexer());
+	document.SetLexInterface(std::move(pli));
+}
+
+void RequireSameStyles(const Document &windowed, const Document &full, Sci::Position start, Sci::Position end) {
+	for (Sci::Position pos = start; pos < end; pos++) {
+		REQUIRE(windowed.StyleAt(pos) == full.StyleAt(pos));
+	}
+}
+
+}
+
+TEST_CASE("WindowedStyles") {
+
+	// Blocks span thousands of lines so a window often starts inside one
+	std::string text;
+	for (int line = 0; line < 250000; line++) {
+		text += "line " + std::to_string(line);
+		if (line % 7000 == 10) {
+			text += " {";
+		} else if (line % 7000 == 3000) {
+			text += " }";
+		}
+		text += " some text\n";
+	}
+	Document full(DocumentOption::Default);
+	full.InsertString(0, text.c_str(), text.length());
+	SetBraceLexer(full);
+	full.EnsureStyledTo(full.Length());
+
+	Document windowed(DocumentOption::StylesWindowed);
+	windowed.InsertString(0, text.c_str(), text.length());
+	SetBraceLexer(windowed);
+	REQUIRE(FlagSet(windowed.Options(), DocumentOption::StylesWindowed));
+
+	SECTION("JumpsMatchFullStyling") {
+		const Sci::Position length = windowed.Length();
+		for (const Sci::Position pos : { length / 10, length / 2, length / 2 + 100000, length / 3, length, Sci::Position(2000) }) {
+			windowed.EnsureStyledTo(pos);
+			RequireSameStyles(windowed, full, std::max<Sci::Position>(pos - 100000, 0), pos);
+		}
+	}
+
+	SECTION("EditInvalidatesCheckpoints") {
+		const Sci::Position pos = windowed.Length() * 3 / 4;
+		windowed.EnsureStyledTo(pos);
+		// Remove the first opening brace so all later blocks end before they start
+		const Sci::Position brace = static_cast<Sci::Position>(text.find('{'));
+		windowed.DeleteChars(brace, 1);
+		full.DeleteChars(brace, 1);
+		full.EnsureStyledTo(full.Length());
+		windowed.EnsureStyledTo(1000);
+		windowed.EnsureStyledTo(pos);
+		RequireSameStyles(windowed, full, pos - 100000, pos);
+	}
+}
+
+TEST_CASE("TextPieces") {
+
+	Document gap(DocumentOption::Default);
+	Document pieces(DocumentOption::TextPieces);
+	REQUIRE(!FlagSet(gap.Options(), DocumentOption::TextPieces));
+	REQUIRE(FlagSet(pieces.Options(), DocumentOption::TextPieces));
+	REQUIRE(!FlagSet(pieces.Options(), DocumentOption::StylesNone));
+	gap.SetCaseFolder(std::make_unique<CaseFolderTable>());
+	pieces.SetCaseFolder(std::make_unique<CaseFolderTable>());
+
+	// Edits at many places so the text is spread over many pieces
+	const std::string_view line = "Needle in a haystack\n";
+	for (int i = 0; i < 200; i++) {
+		const Sci::Position pos = (gap.Length() * 7 / 13) % (gap.Length() + 1);
+		for (Document *doc : { &gap, &pieces }) {
+			doc->InsertString(pos, line.data(), line.length());
+			if (i % 3 == 0) {
+				doc->DeleteChars(pos / 2, 1);
+			}
+		}
+	}
+	REQUIRE(pieces.Length() == gap.Length());
+	REQUIRE(pieces.LinesTotal() == gap.LinesTotal());
+	REQUIRE(std::string_view(pieces.BufferPointer(), pieces.Length()) == std::string_view(gap.BufferPointer(), gap.Length()));
+
+	SECTION("FindText") {
+		pieces.InsertString(pieces.Length() / 3, "needle", 6);
+		gap.InsertString(gap.Length() / 3, "needle", 6);
+		for (const FindOption option : { FindOption::MatchCase, FindOption::None }) {
+			for (const bool forward : { true, false }) {
+				Sci::Position startGap = forward ? 0 : gap.Length();
+				Sci::Position startPieces = startGap;
+				for (;;) {
+					Sci::Position lengthGap = 6;
+					Sci::Position lengthPieces = 6;
+					const Sci::Position endPos = forward ? gap.Length() : 0;
+					const Sci::Position foundGap = gap.FindText(startGap, endPos, "needle", option, &lengthGap);
+					const Sci::Position foundPieces = pieces.FindText(startPieces, endPos, "needle", option, &lengthPieces);
+					REQUIRE(foundPieces == foundGap);
+					if (foundGap < 0)
+						break;
+					startGap = startPieces = forward ? foundGap + 1 : foundGap;
+					if (!forward && (foundGap == 0))
+						break;
+				}
+			}
+		}
+	}
+
+	SECTION("RangePointer") {
+		const Sci::Position length = gap.Length();
+		for (Sci::Position pos = 0; pos < length; pos += length / 17) {
+			const Sci::Position lengthRange = std::min<Sci::Position>(100, length - pos);
+			REQUIRE(std::string_view(pieces.RangePointer(pos, lengthRange), lengthRange) ==
+				std::string_view(gap.RangePointer(pos, lengthRange), lengthRange));
+		}
+	}
+}
+
+// Not run by default: unitTest "[.benchmark]"
+TEST_CASE("TransformBenchmark", "[.benchmark]") {
+	std::string tabbed;
+	for (int line = 0; line < 400000; line++) {
+		tabbed += "\t\tint value";
+		tabbed += std::to_string(line);
+		tabbed += " = \tcall(argument);  \r\n";
+	}
+	Sci::Position lengthChange = 0;
+	auto time = [](const char *name, std::function<void(Document &)> run, const std::string &text) {
+		DocPlus doc("", 0);
+		doc.document.tabInChars = 4;
+		const auto start = std::chrono::steady_clock::now();
+		doc.document.InsertString(0, text);
+		run(doc.document);
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << name << ": " << static_cast<int>(elapsed.count() * 1000) << " ms\n";
+	};
+	time("load", [](Document &) {}, tabbed);
+	time("trim", [&lengthChange](Document &doc) {
+		doc.TrimTrailingWhitespace(0, doc.Length(), &lengthChange);
+	}, tabbed);
+	time("tabs to spaces", [&lengthChange](Document &doc) {
+		doc.TabsToSpaces(0, doc.Length(), false, &lengthChange);
+	}, tabbed);
+	DocPlus expanded(tabbed, 0);
+	expanded.document.tabInChars = 4;
+	expanded.document.TabsToSpaces(0, expanded.document.Length(), false, &lengthChange);
+	time("spaces to tabs", [&lengthChange](Document &doc) {
+		doc.SpacesToTabs(0, doc.Length(), false, &lengthChange);
+	}, Contents(expanded.document));
+	time("line ends to LF", [](Document &doc) {
+		doc.ConvertLineEnds(EndOfLine::Lf);
+	}, tabbed);
+}
+
+// Not run by default: unitTest "[.benchmark]"
+TEST_CASE("ReplaceAllBenchmark", "[.benchmark]") {
+	std::string text;
+	for (int line = 0; line < 1000000; line++) {
+		text += "value";
+		text += std::to_string(line);
+		text += "=call(value, other);\r\n";
+	}
+	auto time = [&text](const char *name, std::string_view search, std::string_view replacement, FindOption flags) {
+		DocPlus doc(text, 0);
+		ModificationRecorder recorder;
+		doc.document.AddWatcher(&recorder, nullptr);
+		const auto start = std::chrono::steady_clock::now();
+		Sci::Position lengthChange = 0;
+		const Sci::Position replacements = doc.document.ReplaceAll(0, doc.document.Length(), search, replacement, flags, &lengthChange);
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		doc.document.RemoveWatcher(&recorder, nullptr);
+		std::cout << name << ": " << replacements << " replacements, " << recorder.changed.size() << " changes, " <<
+			static_cast<int>(elapsed.count() * 1000) << " ms\n";
+	};
+	time("literal", "value", "v", FindOption::MatchCase);
+	time("regex", "\\([a-z]+\\)\\([0-9]+\\)=", "\\2\\1 := ", FindOption::MatchCase | FindOption::RegExp);
+	time("line ends", ";\r\n", ";\n", FindOption::MatchCase);
+}
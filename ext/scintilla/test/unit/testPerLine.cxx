@@ -11,6 +11,7 @@
 #include <optional>
 #include <algorithm>
 #include <memory>
+#include <random>
 
 #include "ScintillaTypes.h"
 
@@ -233,6 +234,70 @@ TEST_CASE("LineLevels") {
 		REQUIRE(2 == ll.GetLevel(4));
 		REQUIRE(FoldBase == ll.GetLevel(5));
 	}
+
+	SECTION("SearchMatchesScan") {
+		// Compare indexed searches over many lines with straightforward scans
+		constexpr int headerFlag = static_cast<int>(Scintilla::FoldLevel::HeaderFlag);
+		constexpr int whiteFlag = static_cast<int>(Scintilla::FoldLevel::WhiteFlag);
+		constexpr int numberMask = static_cast<int>(Scintilla::FoldLevel::NumberMask);
+		std::minstd_rand rng(1);
+		Sci::Line lines = 5000;
+		auto setLevels = [&]() {
+			int depth = 0;
+			for (Sci::Line line = 0; line < lines; line++) {
+				const int next = std::clamp(depth + static_cast<int>(rng() % 3) - 1, 0, 9);
+				int level = FoldBase + depth;
+				if (next > depth) {
+					level |= headerFlag;
+				} else if (rng() % 8 == 0) {
+					level |= whiteFlag;
+				}
+				ll.SetLevel(line, level, lines);
+				depth = next;
+			}
+		};
+		auto check = [&]() {
+			for (Sci::Line line = 0; line < lines; line += 7) {
+				const int level = ll.GetLevel(line) & numberMask;
+				Sci::Line parent = -1;
+				for (Sci::Line lineLook = line - 1; lineLook >= 0; lineLook--) {
+					const int levelLook = ll.GetLevel(lineLook);
+					if ((levelLook & headerFlag) && ((levelLook & numberMask) < level)) {
+						parent = lineLook;
+						break;
+					}
+				}
+				REQUIRE(parent == ll.GetFoldParent(line));
+				const int levelMost = FoldBase + static_cast<int>(line % 5);
+				Sci::Line found = -1;
+				for (Sci::Line lineLook = line; lineLook < lines; lineLook++) {
+					const int levelLook = ll.GetLevel(lineLook);
+					if (!(levelLook & whiteFlag) && ((levelLook & numberMask) <= levelMost)) {
+						found = lineLook;
+						break;
+					}
+				}
+				REQUIRE(found == ll.FindLevelAtMost(line, lines, static_cast<Scintilla::FoldLevel>(levelMost)));
+			}
+		};
+		setLevels();
+		check();
+		for (int change = 0; change < 50; change++) {
+			const Sci::Line line = rng() % lines;
+			if (change % 3 == 0) {
+				ll.InsertLines(line, 40);
+				lines += 40;
+			} else if (change % 3 == 1) {
+				ll.RemoveLine(line);
+				lines--;
+			} else {
+				ll.SetLevel(line, FoldBase | headerFlag, lines);
+			}
+			check();
+		}
+		setLevels();
+		check();
+	}
 }
 
 TEST_CASE("LineState") {
@@ -0,0 +1,386 @@
+/** @file testUniTranscode.cxx
+ ** Unit Tests for Scintilla internal data structures
+ **/
+
+#include <cstring>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <iostream>
+
+#include "Debugging.h"
+
+#include "UniConversion.h"
+#include "UniTranscode.h"
+
+#include "catch.hpp"
+
+using namespace Scintilla::Internal;
+
+// Test UniTranscode against a simple reference that goes through code points.
+
+namespace {
+
+constexpr char32_t replacement = 0xFFFD;
+
+// Well-formed UTF-8 byte sequences, table 3-7 of the Unicode standard
+struct UTF8Row {
+	unsigned char lead[2];
+	unsigned char trail[3][2];
+	int trails;
+};
+constexpr UTF8Row utf8Rows[] = {
+	{ { 0xC2, 0xDF }, { { 0x80, 0xBF } }, 1 },
+	{ { 0xE0, 0xE0 }, { { 0xA0, 0xBF }, { 0x80, 0xBF } }, 2 },
+	{ { 0xE1, 0xEC }, { { 0x80, 0xBF }, { 0x80, 0xBF } }, 2 },
+	{ { 0xED, 0xED }, { { 0x80, 0x9F }, { 0x80, 0xBF } }, 2 },
+	{ { 0xEE, 0xEF }, { { 0x80, 0xBF }, { 0x80, 0xBF } }, 2 },
+	{ { 0xF0, 0xF0 }, { { 0x90, 0xBF }, { 0x80, 0xBF }, { 0x80, 0xBF } }, 3 },
+	{ { 0xF1, 0xF3 }, { { 0x80, 0xBF }, { 0x80, 0xBF }, { 0x80, 0xBF } }, 3 },
+	{ { 0xF4, 0xF4 }, { { 0x80, 0x8F }, { 0x80, 0xBF }, { 0x80, 0xBF } }, 3 },
+};
+
+// Decode with each maximal invalid part replaced by one U+FFFD
+std::u32string ReferenceFromUTF8(std::string_view sv) {
+	std::u32string result;
+	size_t i = 0;
+	while (i < sv.length()) {
+		const unsigned char lead = sv[i];
+		if (lead < 0x80) {
+			result.push_back(lead);
+			i++;
+			continue;
+		}
+		const UTF8Row *row = nullptr;
+		for (const UTF8Row &r : utf8Rows) {
+			if (lead >= r.lead[0] && lead <= r.lead[1])
+				row = &r;
+		}
+		if (!row) {
+			result.push_back(replacement);
+			i++;
+			continue;
+		}
+		char32_t value = lead & (0x3F >> row->trails);
+		int k = 0;
+		for (; k < row->trails; k++) {
+			if (i + 1 + k >= sv.length())
+				break;
+			const unsigned char trail = sv[i + 1 + k];
+			if (trail < row->trail[k][0] || trail > row->trail[k][1])
+				break;
+			value = (value << 6) | (trail & 0x3F);
+		}
+		result.push_back((k == row->trails) ? value : replacement);
+		i += 1 + k;
+	}
+	return result;
+}
+
+std::u32string ReferenceFromUTF16(std::string_view sv, ByteOrder order) {
+	std::vector<char32_t> units;
+	for (size_t i = 0; i + 1 < sv.length(); i += 2) {
+		const unsigned char b0 = sv[i];
+		const unsigned char b1 = sv[i + 1];
+		units.push_back((order == ByteOrder::BigEndian) ? (b0 << 8 | b1) : (b1 << 8 | b0));
+	}
+	std::u32string result;
+	for (size_t i = 0; i < units.size(); i++) {
+		const char32_t u = units[i];
+		if (u >= 0xD800 && u <= 0xDBFF && i + 1 < units.size() && units[i + 1] >= 0xDC00 && units[i + 1] <= 0xDFFF) {
+			result.push_back(0x10000 + ((u - 0xD800) << 10) + (units[i + 1] - 0xDC00));
+			i++;
+		} else if (u >= 0xD800 && u <= 0xDFFF) {
+			result.push_back(replacement);
+		} else {
+			result.push_back(u);
+		}
+	}
+	if (sv.length() % 2)
+		result.push_back(replacement);
+	return result;
+}
+
+std::u32string ReferenceFromUTF32(std::string_view sv, ByteOrder order) {
+	std::u32string result;
+	for (size_t i = 0; i + 3 < sv.length(); i += 4) {
+		char32_t u = 0;
+		for (int b = 0; b < 4; b++) {
+			const unsigned char byte = sv[i + ((order == ByteOrder::BigEndian) ? b : 3 - b)];
+			u = (u << 8) | byte;
+		}
+		result.push_back(((u >= 0xD800 && u <= 0xDFFF) || u > 0x10FFFF) ? replacement : u);
+	}
+	if (sv.length() % 4)
+		result.push_back(replacement);
+	return result;
+}
+
+std::string ReferenceUTF8(const std::u32string &s) {
+	std::string result;
+	for (const char32_t ch : s) {
+		char buf[UTF8MaxBytes + 1];
+		UTF8FromUTF32Character(ch, buf);
+		result.append(buf, std::max<size_t>(1, strlen(buf)));	// U+0000 is one byte too
+	}
+	return result;
+}
+
+std::string ReferenceUTF16(const std::u32string &s, ByteOrder order) {
+	std::string result;
+	for (const char32_t ch : s) {
+		wchar_t buf[2];
+		const unsigned int units = UTF16FromUTF32Character(ch, buf);
+		for (unsigned int u = 0; u < units; u++) {
+			const char hi = static_cast<char>((buf[u] >> 8) & 0xFF);
+			const char lo = static_cast<char>(buf[u] & 0xFF);
+			result.push_back((order == ByteOrder::BigEndian) ? hi : lo);
+			result.push_back((order == ByteOrder::BigEndian) ? lo : hi);
+		}
+	}
+	return result;
+}
+
+std::string ReferenceUTF32(const std::u32string &s, ByteOrder order) {
+	std::string result;
+	for (const char32_t ch : s) {
+		for (int b = 0; b < 4; b++) {
+			const int shift = (order == ByteOrder::BigEndian) ? 24 - 8 * b : 8 * b;
+			result.push_back(static_cast<char>((ch >> shift) & 0xFF));
+		}
+	}
+	return result;
+}
+
+using Transcoder = TranscodeResult (*)(std::string_view, ByteOrder, bool, char *) noexcept;
+using MaxLength = size_t (*)(size_t) noexcept;
+
+// Feed input in blocks ending at the given split points, carrying over what each
+// call leaves unconsumed, as a caller reading a file in blocks does
+std::string TranscodeInBlocks(Transcoder transcoder, MaxLength maxLength, std::string_view input,
+	ByteOrder order, const std::vector<size_t> &splits) {
+	std::string result;
+	std::string pending;
+	size_t start = 0;
+	for (size_t s = 0; s <= splits.size(); s++) {
+		const bool final = s == splits.size();
+		const size_t end = final ? input.length() : splits[s];
+		pending.append(input.substr(start, end - start));
+		start = end;
+		std::string out(maxLength(pending.length()), '\0');
+		const TranscodeResult res = transcoder(pending, order, final, out.data());
+		REQUIRE(res.written <= out.length());
+		REQUIRE(res.consumed <= pending.length());
+		if (final) {
+			REQUIRE(res.consumed == pending.length());
+		} else {
+			// Only part of a character may be left over
+			REQUIRE(pending.length() - res.consumed < 4);
+		}
+		result.append(out, 0, res.written);
+		pending.erase(0, res.consumed);
+	}
+	return result;
+}
+
+std::string TranscodeWhole(Transcoder transcoder, MaxLength maxLength, std::string_view input, ByteOrder order) {
+	return TranscodeInBlocks(transcoder, maxLength, input, order, {});
+}
+
+// Random text that is mostly made of valid characters from a few ranges, so that
+// runs of ASCII and of 2 byte characters reach the vector code
+std::u32string RandomCharacters(std::mt19937 &rng, size_t length) {
+	constexpr char32_t ranges[][2] = {
+		{ 0x20, 0x7E }, { 0x20, 0x7E }, { 0x80, 0x7FF }, { 0x391, 0x3C9 },
+		{ 0x800, 0xD7FF }, { 0xE000, 0xFFFF }, { 0x10000, 0x10FFFF },
+	};
+	std::u32string result;
+	size_t range = 0;
+	for (size_t i = 0; i < length; i++) {
+		if (rng() % 16 == 0)
+			range = rng() % std::size(ranges);
+		const char32_t first = ranges[range][0];
+		const char32_t last = ranges[range][1];
+		result.push_back(first + rng() % (last - first + 1));
+	}
+	return result;
+}
+
+// Damage some bytes so invalid sequences are covered too
+std::string Damage(std::mt19937 &rng, std::string s, int percent) {
+	for (char &ch : s) {
+		if (static_cast<int>(rng() % 100) < percent)
+			ch = static_cast<char>(rng() & 0xFF);
+	}
+	return s;
+}
+
+std::vector<size_t> RandomSplits(std::mt19937 &rng, size_t length) {
+	std::vector<size_t> splits;
+	if (length > 0) {
+		const size_t count = rng() % 4;
+		for (size_t i = 0; i < count; i++)
+			splits.push_back(rng() % (length + 1));
+		std::sort(splits.begin(), splits.end());
+	}
+	return splits;
+}
+
+constexpr ByteOrder orders[] = { ByteOrder::LittleEndian, ByteOrder::BigEndian };
+
+}
+
+TEST_CASE("UniTranscode") {
+
+	SECTION("Empty") {
+		char out[4] {};
+		for (const ByteOrder order : orders) {
+			REQUIRE(UTF8FromUTF16Bytes("", order, true, out).written == 0U);
+			REQUIRE(UTF8FromUTF32Bytes("", order, true, out).written == 0U);
+			REQUIRE(UTF16BytesFromUTF8("", order, true, out).written == 0U);
+			REQUIRE(UTF32BytesFromUTF8("", order, true, out).written == 0U);
+		}
+	}
+
+	SECTION("UTF16") {
+		// a, e acute, euro, gothic hwair
+		const std::string u8 = "a\xC3\xA9\xE2\x82\xAC\xF0\x90\x8D\x88";
+		const std::string le("a\0\xE9\0\xAC\x20\x00\xD8\x48\xDF", 10);
+		const std::string be("\0a\0\xE9\x20\xAC\xD8\x00\xDF\x48", 10);
+		REQUIRE(TranscodeWhole(UTF16BytesFromUTF8, UTF16BytesMaxFromUTF8, u8, ByteOrder::LittleEndian) == le);
+		REQUIRE(TranscodeWhole(UTF16BytesFromUTF8, UTF16BytesMaxFromUTF8, u8, ByteOrder::BigEndian) == be);
+		REQUIRE(TranscodeWhole(UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, le, ByteOrder::LittleEndian) == u8);
+		REQUIRE(TranscodeWhole(UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, be, ByteOrder::BigEndian) == u8);
+	}
+
+	SECTION("UTF32") {
+		const std::string u8 = "a\xC3\xA9\xE2\x82\xAC\xF0\x90\x8D\x88";
+		const std::string le("a\0\0\0\xE9\0\0\0\xAC\x20\0\0\x48\x03\x01\0", 16);
+		const std::string be("\0\0\0a\0\0\0\xE9\0\0\x20\xAC\0\x01\x03\x48", 16);
+		REQUIRE(TranscodeWhole(UTF32BytesFromUTF8, UTF32BytesMaxFromUTF8, u8, ByteOrder::LittleEndian) == le);
+		REQUIRE(TranscodeWhole(UTF32BytesFromUTF8, UTF32BytesMaxFromUTF8, u8, ByteOrder::BigEndian) == be);
+		REQUIRE(TranscodeWhole(UTF8FromUTF32Bytes, UTF8MaxFromUTF32Bytes, le, ByteOrder::LittleEndian) == u8);
+		REQUIRE(TranscodeWhole(UTF8FromUTF32Bytes, UTF8MaxFromUTF32Bytes, be, ByteOrder::BigEndian) == u8);
+	}
+
+	SECTION("SurrogatePairSplitAcrossBlocks") {
+		// 20 ASCII units then a pair, split between the lead and trail surrogate
+		std::string le;
+		for (int i = 0; i < 20; i++)
+			le.append("x", 2);
+		le.append("\x00\xD8\x48\xDF", 4);
+		const std::string expected = std::string(20, 'x') + "\xF0\x90\x8D\x88";
+		for (size_t split = 36; split <= 44; split++) {
+			REQUIRE(TranscodeInBlocks(UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, le, ByteOrder::LittleEndian, { split }) == expected);
+		}
+	}
+
+	SECTION("Invalid") {
+		// Lone trail, lead followed by ASCII, lead at end
+		const std::string le("\x48\xDF" "a\0" "\x00\xD8" "b\0" "\x00\xD8", 10);
+		REQUIRE(TranscodeWhole(UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, le, ByteOrder::LittleEndian) ==
+			"\xEF\xBF\xBD" "a" "\xEF\xBF\xBD" "b" "\xEF\xBF\xBD");
+		// Odd byte at end
+		REQUIRE(TranscodeWhole(UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, std::string("a\0b", 3), ByteOrder::LittleEndian) ==
+			"a\xEF\xBF\xBD");
+		// Surrogate and beyond U+10FFFF in UTF-32
+		const std::string be("\0\0\xD8\0" "\0\x11\0\0" "\0\0\0c", 12);
+		REQUIRE(TranscodeWhole(UTF8FromUTF32Bytes, UTF8MaxFromUTF32Bytes, be, ByteOrder::BigEndian) ==
+			"\xEF\xBF\xBD\xEF\xBF\xBD" "c");
+		// Overlong, encoded surrogate, truncated sequence then ASCII, truncated at end
+		const std::string u8 = "\xC0\xAF" "\xED\xA0\x80" "\xE2\x82" "d" "\xF0\x90\x8D";
+		REQUIRE(ReferenceFromUTF8(u8) == U"\xFFFD\xFFFD\xFFFD\xFFFD\xFFFD\xFFFD" "d" "\xFFFD");
+		REQUIRE(TranscodeWhole(UTF32BytesFromUTF8, UTF32BytesMaxFromUTF8, u8, ByteOrder::LittleEndian) ==
+			ReferenceUTF32(ReferenceFromUTF8(u8), ByteOrder::LittleEndian));
+	}
+
+	SECTION("NotFinalLeavesPartialCharacter") {
+		char out[64] {};
+		const TranscodeResult r16 = UTF8FromUTF16Bytes(std::string_view("a\0\x00\xD8", 4), ByteOrder::LittleEndian, false, out);
+		REQUIRE(r16.consumed == 2U);
+		REQUIRE(r16.written == 1U);
+		const TranscodeResult r8 = UTF16BytesFromUTF8("ab\xF0\x90\x8D", ByteOrder::LittleEndian, false, out);
+		REQUIRE(r8.consumed == 2U);
+		REQUIRE(r8.written == 4U);
+		const TranscodeResult r32 = UTF8FromUTF32Bytes(std::string_view("a\0\0\0b\0", 6), ByteOrder::LittleEndian, false, out);
+		REQUIRE(r32.consumed == 4U);
+		REQUIRE(r32.written == 1U);
+	}
+
+	SECTION("FuzzAgainstReference") {
+		std::mt19937 rng(20261019);
+		for (int iteration = 0; iteration < 3000; iteration++) {
+			const size_t length = rng() % 200;
+			const std::u32string text = RandomCharacters(rng, length);
+			const int percent = (iteration % 3) * 2;
+			for (const ByteOrder order : orders) {
+				// From UTF-8
+				const std::string u8 = Damage(rng, ReferenceUTF8(text), percent);
+				const std::u32string fromU8 = ReferenceFromUTF8(u8);
+				REQUIRE(TranscodeInBlocks(UTF16BytesFromUTF8, UTF16BytesMaxFromUTF8, u8, order, RandomSplits(rng, u8.length())) ==
+					ReferenceUTF16(fromU8, order));
+				REQUIRE(TranscodeInBlocks(UTF32BytesFromUTF8, UTF32BytesMaxFromUTF8, u8, order, RandomSplits(rng, u8.length())) ==
+					ReferenceUTF32(fromU8, order));
+
+				// To UTF-8
+				const std::string u16 = Damage(rng, ReferenceUTF16(text, order), percent);
+				REQUIRE(TranscodeInBlocks(UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, u16, order, RandomSplits(rng, u16.length())) ==
+					ReferenceUTF8(ReferenceFromUTF16(u16, order)));
+				const std::string u32 = Damage(rng, ReferenceUTF32(text, order), percent);
+				REQUIRE(TranscodeInBlocks(UTF8FromUTF32Bytes, UTF8MaxFromUTF32Bytes, u32, order, RandomSplits(rng, u32.length())) ==
+					ReferenceUTF8(ReferenceFromUTF32(u32, order)));
+			}
+		}
+	}
+}
+
+// Not run by default: unitTest "[.benchmark]"
+TEST_CASE("UniTranscodeBenchmark", "[.benchmark]") {
+	std::mt19937 rng(1);
+	std::string ascii;
+	for (size_t i = 0; i < (1 << 20); i++)
+		ascii.push_back(static_cast<char>(0x20 + rng() % 0x5F));
+	std::u32string greek;
+	for (size_t i = 0; i < (1 << 20); i++)
+		greek.push_back((i % 8 == 7) ? U' ' : static_cast<char32_t>(0x3B1 + i % 24));
+	std::u32string cjk;
+	for (size_t i = 0; i < (1 << 20); i++)
+		cjk.push_back(static_cast<char32_t>(0x4E00 + rng() % 0x5000));
+	const std::pair<const char *, std::string> texts[] = {
+		{ "ascii", ascii }, { "greek", ReferenceUTF8(greek) }, { "cjk", ReferenceUTF8(cjk) },
+	};
+	for (const auto &[name, u8] : texts) {
+		for (const ByteOrder order : orders) {
+			const char *orderName = (order == ByteOrder::BigEndian) ? "BE" : "LE";
+			const std::string u16 = ReferenceUTF16(ReferenceFromUTF8(u8), order);
+			const std::string u32 = ReferenceUTF32(ReferenceFromUTF8(u8), order);
+			const struct {
+				const char *direction;
+				Transcoder transcoder;
+				MaxLength maxLength;
+				const std::string &input;
+			} runs[] = {
+				{ "UTF-16 to UTF-8", UTF8FromUTF16Bytes, UTF8MaxFromUTF16Bytes, u16 },
+				{ "UTF-32 to UTF-8", UTF8FromUTF32Bytes, UTF8MaxFromUTF32Bytes, u32 },
+				{ "UTF-8 to UTF-16", UTF16BytesFromUTF8, UTF16BytesMaxFromUTF8, u8 },
+				{ "UTF-8 to UTF-32", UTF32BytesFromUTF8, UTF32BytesMaxFromUTF8, u8 },
+			};
+			for (const auto &run : runs) {
+				std::string out(run.maxLength(run.input.length()), '\0');
+				constexpr int repeats = 20;
+				const auto start = std::chrono::steady_clock::now();
+				for (int r = 0; r < repeats; r++)
+					run.transcoder(run.input, order, true, out.data());
+				const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				const double mbPerSecond = run.input.length() * repeats / elapsed.count() / 1e6;
+				std::cout << name << " " << orderName << " " << run.direction << ": " << static_cast<int>(mbPerSecond) << " MB/s\n";
+			}
+		}
+	}
+}
@@ -101,6 +101,7 @@ $(DIR_O)/CellBuffer.o: \
 	../src/SparseVector.h \
 	../src/ChangeHistory.h \
 	../src/CellBuffer.h \
+	../src/PieceTable.h \
 	../src/UniConversion.h
 $(DIR_O)/ChangeHistory.o: \
 	../src/ChangeHistory.cxx \
@@ -439,6 +440,9 @@ $(DIR_O)/Style.o: \
 $(DIR_O)/UniConversion.o: \
 	../src/UniConversion.cxx \
 	../src/UniConversion.h
+$(DIR_O)/UniTranscode.o: \
+	../src/UniTranscode.cxx \
+	../src/UniTranscode.h
 $(DIR_O)/UniqueString.o: \
 	../src/UniqueString.cxx \
 	../src/UniqueString.h
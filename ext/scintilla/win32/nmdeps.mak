@@ -101,6 +101,7 @@ $(DIR_O)/CellBuffer.obj: \
 	../src/SparseVector.h \
 	../src/ChangeHistory.h \
 	../src/CellBuffer.h \
+	../src/PieceTable.h \
 	../src/UniConversion.h
 $(DIR_O)/ChangeHistory.obj: \
 	../src/ChangeHistory.cxx \
@@ -439,6 +440,9 @@ $(DIR_O)/Style.obj: \
 $(DIR_O)/UniConversion.obj: \
 	../src/UniConversion.cxx \
 	../src/UniConversion.h
+$(DIR_O)/UniTranscode.obj: \
+	../src/UniTranscode.cxx \
+	../src/UniTranscode.h
 $(DIR_O)/UniqueString.obj: \
 	../src/UniqueString.cxx \
 	../src/UniqueString.h
@@ -105,6 +105,7 @@ SRC_OBJS=\
 	$(DIR_O)\Selection.obj \
 	$(DIR_O)\Style.obj \
 	$(DIR_O)\UniConversion.obj \
+	$(DIR_O)\UniTranscode.obj \
 	$(DIR_O)\UniqueString.obj \
 	$(DIR_O)\ViewStyle.obj \
 	$(DIR_O)\XPM.obj
@@ -218,3 +218,206 @@ bool CDirFileEnum::NextFile(std::wstring& sResult, bool* pbIsDirectory, bool rec
         return false;
     }
 }
+
+/*
+ * Implementation notes for CParallelDirFileEnum:
+ *
+ * m_pendingDirs counts the directories that are queued or being read.
+ * A directory is counted before it is queued and uncounted only after
+ * all its subdirectories were queued, so the count can only drop to zero
+ * once the whole tree was read.
+ *
+ * Idle workers sleep on m_workAvailable. A worker that queues a directory
+ * first increments m_queuedDirs and then checks m_idleThreads, an idle
+ * worker first increments m_idleThreads and then checks m_queuedDirs,
+ * so at least one of them sees the other and no wakeup gets lost.
+ *
+ * The number of batches waiting for the caller is limited, so a slow
+ * caller slows down the workers instead of the batches piling up.
+ */
+
+constexpr size_t maxWaitingBatches = 64;
+
+CParallelDirFileEnum::CParallelDirFileEnum(const std::wstring& dirName, bool recurse)
+    : m_root(dirName)
+    , m_recurse(recurse)
+    , m_attrToIgnore(0)
+    , m_threadCount((std::min)(8u, (std::max)(1u, std::thread::hardware_concurrency())))
+    , m_batchSize(512)
+    , m_started(false)
+    , m_pendingDirs(0)
+    , m_queuedDirs(0)
+    , m_idleThreads(0)
+    , m_stop(false)
+    , m_runningThreads(0)
+{
+}
+
+CParallelDirFileEnum::~CParallelDirFileEnum()
+{
+    Stop();
+}
+
+void CParallelDirFileEnum::Start()
+{
+    m_started = true;
+    for (unsigned i = 0; i < m_threadCount; ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+    ++m_pendingDirs;
+    PushDir(0, m_root);
+    m_runningThreads = m_threadCount;
+    for (unsigned i = 0; i < m_threadCount; ++i)
+        m_threads.emplace_back(&CParallelDirFileEnum::WorkerThread, this, i);
+}
+
+void CParallelDirFileEnum::Stop()
+{
+    m_stop = true;
+    {
+        std::lock_guard<std::mutex> lock(m_idleGuard);
+        m_workAvailable.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_batchGuard);
+        m_batchTaken.notify_all();
+        m_batchAvailable.notify_all();
+    }
+    for (auto& thread : m_threads)
+        thread.join();
+    m_threads.clear();
+}
+
+bool CParallelDirFileEnum::NextBatch(std::vector<Entry>& batch)
+{
+    if (!m_started)
+        Start();
+
+    std::unique_lock<std::mutex> lock(m_batchGuard);
+    m_batchAvailable.wait(lock, [this]() { return !m_batches.empty() || m_runningThreads == 0 || m_stop; });
+    if (m_batches.empty() || m_stop)
+        return false;
+    batch = std::move(m_batches.front());
+    m_batches.pop_front();
+    m_batchTaken.notify_one();
+    return true;
+}
+
+void CParallelDirFileEnum::PushDir(size_t index, std::wstring dir)
+{
+    {
+        auto&                       queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.guard);
+        queue.dirs.push_back(std::move(dir));
+    }
+    ++m_queuedDirs;
+    if (m_idleThreads > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_idleGuard);
+        m_workAvailable.notify_one();
+    }
+}
+
+bool CParallelDirFileEnum::PopDir(size_t index, std::wstring& dir)
+{
+    // own queue first, newest directory: depth-first, close to the last one read
+    {
+        auto&                       queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.guard);
+        if (!queue.dirs.empty())
+        {
+            dir = std::move(queue.dirs.back());
+            queue.dirs.pop_back();
+            --m_queuedDirs;
+            return true;
+        }
+    }
+    // then steal the oldest directory of another worker
+    for (size_t i = 1; i < m_queues.size(); ++i)
+    {
+        auto&                       queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.guard);
+        if (!queue.dirs.empty())
+        {
+            dir = std::move(queue.dirs.front());
+            queue.dirs.pop_front();
+            --m_queuedDirs;
+            return true;
+        }
+    }
+    return false;
+}
+
+void CParallelDirFileEnum::ReadDir(size_t index, const std::wstring& dir, std::vector<Entry>& batch)
+{
+    CSimpleFileFind finder(dir);
+    while (!m_stop && finder.FindNextFileNoDots(m_attrToIgnore))
+    {
+        auto path  = finder.GetFilePath();
+        bool isDir = finder.IsDirectory();
+        if (isDir)
+        {
+            if (m_recurse && (!m_folderExcluded || !m_folderExcluded(path)))
+            {
+                ++m_pendingDirs;
+                PushDir(index, path);
+            }
+        }
+        else if (m_fileWanted && !m_fileWanted(path))
+            continue;
+
+        const auto* data = finder.GetFileFindData();
+        batch.push_back({std::move(path), data->dwFileAttributes, data->ftLastWriteTime,
+                         (static_cast<uint64_t>(data->nFileSizeHigh) << 32) | data->nFileSizeLow, isDir});
+        if (batch.size() >= m_batchSize)
+            Deliver(batch);
+    }
+}
+
+void CParallelDirFileEnum::Deliver(std::vector<Entry>& batch)
+{
+    std::unique_lock<std::mutex> lock(m_batchGuard);
+    m_batchTaken.wait(lock, [this]() { return m_batches.size() < maxWaitingBatches || m_stop; });
+    m_batches.push_back(std::move(batch));
+    batch = {};
+    batch.reserve(m_batchSize);
+    m_batchAvailable.notify_one();
+}
+
+void CParallelDirFileEnum::WorkerThread(size_t index)
+{
+    std::vector<Entry> batch;
+    batch.reserve(m_batchSize);
+    std::wstring dir;
+    while (!m_stop)
+    {
+        if (PopDir(index, dir))
+        {
+            ReadDir(index, dir, batch);
+            if (--m_pendingDirs == 0)
+            {
+                std::lock_guard<std::mutex> lock(m_idleGuard);
+                m_workAvailable.notify_all();
+            }
+            continue;
+        }
+
+        // nothing to read right now: hand over what was collected so far,
+        // then wait for another worker to queue a directory
+        if (!batch.empty())
+            Deliver(batch);
+        std::unique_lock<std::mutex> lock(m_idleGuard);
+        ++m_idleThreads;
+        m_workAvailable.wait(lock, [this]() { return m_queuedDirs > 0 || m_pendingDirs == 0 || m_stop; });
+        --m_idleThreads;
+        if (m_pendingDirs == 0)
+            break;
+    }
+
+    std::lock_guard<std::mutex> lock(m_batchGuard);
+    if (!batch.empty() && !m_stop)
+        m_batches.push_back(std::move(batch));
+    if (--m_runningThreads == 0)
+        m_batchAvailable.notify_all();
+    else
+        m_batchAvailable.notify_one();
+}
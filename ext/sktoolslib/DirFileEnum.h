@@ -19,7 +19,17 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 /**
  * Enumerates over a directory tree, non-recursively.
@@ -343,3 +353,137 @@ public:
         return 0;
     }
 };
+
+/**
+ * Enumerates over a directory tree, recursively, reading several
+ * directories at the same time.
+ *
+ * Each worker thread keeps its own queue of directories still to read and
+ * works depth-first through it; a worker that runs out of directories
+ * takes the oldest queued directory of another worker, which usually is
+ * the root of a large subtree.
+ * The entries are handed to the caller in batches, in no particular order:
+ * all entries of one directory are in order, but entries of different
+ * directories are interleaved.
+ *
+ * Unlike CDirFileEnum, excluded folders and unwanted files are dropped by
+ * the worker threads, so excluded subtrees are never read at all.
+ */
+class CParallelDirFileEnum
+{
+public:
+    struct Entry
+    {
+        std::wstring path;
+        DWORD        attributes;
+        FILETIME     lastWriteTime;
+        uint64_t     fileSize;
+        bool         isDirectory;
+    };
+
+    /**
+     * Predicate on a full path. It is called on the worker threads, so
+     * it must not touch data that other threads modify.
+     */
+    using PathFilter = std::function<bool(const std::wstring& path)>;
+
+    /**
+     * Prepares the enumeration of the specified directory. The worker
+     * threads start with the first call to NextBatch().
+     *
+     * \param dirName The directory to search in.
+     * \param recurse true if recursing into subdirectories is requested.
+     */
+    CParallelDirFileEnum(const std::wstring& dirName, bool recurse = true);
+
+    /**
+     * Destructor. Stops and waits for the worker threads.
+     */
+    ~CParallelDirFileEnum();
+
+    CParallelDirFileEnum(const CParallelDirFileEnum&)            = delete;
+    CParallelDirFileEnum& operator=(const CParallelDirFileEnum&) = delete;
+
+    /**
+     * Get the next batch of entries. Blocks until a batch is available.
+     *
+     * \param batch On successful return, holds the entries of the batch.
+     * \return true if a batch was returned, false at the end of the iteration.
+     */
+    bool NextBatch(std::vector<Entry>& batch);
+
+    /**
+     * Ends the enumeration early: the worker threads stop reading and
+     * NextBatch() returns false.
+     */
+    void Stop();
+
+    /**
+     * Set a mask of file attributes to ignore, see CDirFileEnum::SetAttributesToIgnore().
+     */
+    void SetAttributesToIgnore(DWORD attr) { m_attrToIgnore = attr; }
+
+    /**
+     * Folders for which \c excluded returns true are returned, but not
+     * recursed into.
+     */
+    void SetFolderExclusion(PathFilter excluded) { m_folderExcluded = std::move(excluded); }
+
+    /**
+     * Only files for which \c wanted returns true are returned. Folders
+     * are not passed to this filter.
+     */
+    void SetFileFilter(PathFilter wanted) { m_fileWanted = std::move(wanted); }
+
+    /**
+     * Sets the number of worker threads. The default is the number of
+     * logical processors, but at most 8.
+     */
+    void SetThreadCount(unsigned count) { m_threadCount = (std::max)(1u, count); }
+
+    /**
+     * Sets the number of entries a worker collects before it hands them
+     * over to the caller. Workers also hand over what they have whenever
+     * they run out of directories to read.
+     */
+    void SetBatchSize(size_t size) { m_batchSize = (std::max)(size_t(1), size); }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex               guard;
+        std::deque<std::wstring> dirs;
+    };
+
+    void Start();
+    void WorkerThread(size_t index);
+    void PushDir(size_t index, std::wstring dir);
+    bool PopDir(size_t index, std::wstring& dir);
+    void ReadDir(size_t index, const std::wstring& dir, std::vector<Entry>& batch);
+    void Deliver(std::vector<Entry>& batch);
+
+    std::wstring m_root;
+    bool         m_recurse;
+    DWORD        m_attrToIgnore;
+    PathFilter   m_folderExcluded;
+    PathFilter   m_fileWanted;
+    unsigned     m_threadCount;
+    size_t       m_batchSize;
+    bool         m_started;
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread>                m_threads;
+    // directories queued or being read; the enumeration is done when it drops to zero
+    std::atomic<size_t>                     m_pendingDirs;
+    std::atomic<size_t>                     m_queuedDirs;
+    std::atomic<unsigned>                   m_idleThreads;
+    std::atomic<bool>                       m_stop;
+    std::mutex                              m_idleGuard;
+    std::condition_variable                 m_workAvailable;
+
+    std::mutex                     m_batchGuard;
+    std::condition_variable        m_batchAvailable;
+    std::condition_variable        m_batchTaken;
+    std::deque<std::vector<Entry>> m_batches;
+    unsigned                       m_runningThreads;
+};
@@ -0,0 +1,506 @@
+﻿// sktoolslib - common files for SK tools
+
+// Copyright (C) 2024 - Stefan Kueng
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#include "stdafx.h"
+#include "EncodingDetect.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#    define ENCODINGDETECT_SSE2
+#    include <emmintrin.h>
+#endif
+
+namespace
+{
+constexpr int cpAnsi    = 0;     // CP_ACP
+constexpr int cpUtf8    = 65001; // CP_UTF8
+constexpr int cpUtf16Le = 1200;
+constexpr int cpUtf16Be = 1201;
+constexpr int cpUtf32Le = 12000;
+constexpr int cpUtf32Be = 12001;
+
+constexpr size_t chunkSize = 256;
+
+constexpr uint64_t lowBits  = 0x0101010101010101;
+constexpr uint64_t highBits = 0x8080808080808080;
+
+/// returns the top bit of every byte that either has the top bit set or is
+/// zero. (word - lowBits) & ~word can flag bytes above a zero byte too, so
+/// the result is only good for a yes/no answer.
+constexpr uint64_t SpecialBytes(uint64_t word) noexcept
+{
+    return (word | ((word - lowBits) & ~word)) & highBits;
+}
+
+struct ChunkInfo
+{
+    /// number of zero dwords at dword aligned offsets
+    size_t zeroDwords;
+    /// no byte has the top bit set and no byte is zero
+    bool   plainAscii;
+};
+
+/// scans chunkSize bytes: the UTF-8 check can skip plain ASCII chunks
+/// completely, and the zero dwords for the binary check are counted for
+/// every chunk.
+ChunkInfo ScanChunk(const uint8_t* data) noexcept
+{
+#ifdef ENCODINGDETECT_SSE2
+    const __m128i zero       = _mm_setzero_si128();
+    __m128i       zeroDwords = zero;
+    __m128i       special    = zero;
+    for (size_t i = 0; i < chunkSize; i += sizeof(__m128i))
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        // a matching dword compares to -1
+        zeroDwords = _mm_sub_epi32(zeroDwords, _mm_cmpeq_epi32(bytes, zero));
+        special    = _mm_or_si128(special, _mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, zero)));
+    }
+    zeroDwords = _mm_add_epi32(zeroDwords, _mm_shuffle_epi32(zeroDwords, _MM_SHUFFLE(1, 0, 3, 2)));
+    zeroDwords = _mm_add_epi32(zeroDwords, _mm_shuffle_epi32(zeroDwords, _MM_SHUFFLE(2, 3, 0, 1)));
+    return {static_cast<size_t>(_mm_cvtsi128_si32(zeroDwords)), _mm_movemask_epi8(special) == 0};
+#else
+    size_t   zeroDwords = 0;
+    uint64_t special    = 0;
+    for (size_t i = 0; i < chunkSize; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        zeroDwords += ((word & 0xFFFFFFFF) == 0) + ((word >> 32) == 0);
+        special |= SpecialBytes(word);
+    }
+    return {zeroDwords, special == 0};
+#endif
+}
+
+constexpr size_t utf8BlockSize = 16;
+
+#ifdef ENCODINGDETECT_SSE2
+/// returns a mask of the bytes that are >= limit
+__m128i AtLeast(__m128i bytes, uint8_t limit) noexcept
+{
+    return _mm_cmpeq_epi8(_mm_max_epu8(bytes, _mm_set1_epi8(static_cast<char>(limit))), bytes);
+}
+
+/// checks utf8BlockSize bytes the way Utf8Validator does, but all at once:
+/// every byte must be a continuation byte exactly when one of the three
+/// bytes before it is a lead byte that expects that many trail bytes.
+/// Null chars and invalid lead bytes fail the check. Reads three bytes
+/// before data. Returns false if the bytes have to be checked one by one.
+bool IsValidUtf8Block(const uint8_t* data, int& needData, bool& nonAnsi) noexcept
+{
+    const auto    load     = [data](int offset) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)); };
+    const __m128i bytes    = load(0);
+    const __m128i required = _mm_or_si128(_mm_or_si128(AtLeast(load(-1), 0xC0), AtLeast(load(-2), 0xE0)), AtLeast(load(-3), 0xF0));
+    const __m128i trail    = _mm_andnot_si128(AtLeast(bytes, 0xC0), AtLeast(bytes, 0x80));
+    const __m128i invalid  = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_setzero_si128()), AtLeast(bytes, 0xF5)),
+                                          _mm_cmpeq_epi8(_mm_and_si128(bytes, _mm_set1_epi8(static_cast<char>(0xFE))), _mm_set1_epi8(static_cast<char>(0xC0))));
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_xor_si128(required, trail), invalid)) != 0)
+        return false;
+    nonAnsi  = nonAnsi || _mm_movemask_epi8(bytes) != 0;
+    // a sequence that is not complete yet can only start in the last three bytes
+    needData = 0;
+    for (int back = 1; back <= 3; ++back)
+    {
+        const uint8_t ch = data[utf8BlockSize - back];
+        if (ch >= 0xC0)
+        {
+            needData = (std::max)((ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : 1) - (back - 1), 0);
+            break;
+        }
+    }
+    return true;
+}
+#endif
+
+/// checks for illegal UTF-8 sequences, one byte at a time
+class Utf8Validator
+{
+public:
+    explicit Utf8Validator(size_t length)
+        // count the null chars, we do not want to treat an ASCII/UTF8 file
+        // as UTF16 just because of some null chars that might be accidentally
+        // in the file.
+        // Use an arbitrary value of one fiftieth of the file length as
+        // the limit after which a file is considered UTF16.
+        : m_maxNull(length / 50)
+    {
+    }
+
+    bool NeedsData() const noexcept { return m_needData != 0; }
+
+    /// checks the bytes [begin, end). Returns true once the encoding is decided.
+    bool Validate(const uint8_t* data, size_t begin, size_t end) noexcept
+    {
+        size_t nullCount = m_nullCount;
+        int    needData  = m_needData;
+        bool   nonAnsi   = m_nonAnsi;
+        size_t i         = begin;
+        while (i < end)
+        {
+#ifdef ENCODINGDETECT_SSE2
+            // the block check looks back three bytes for lead bytes, which
+            // only matches the state here if no null char reset it
+            if (i >= 3 && i + utf8BlockSize <= end && data[i - 1] && data[i - 2] && data[i - 3] &&
+                IsValidUtf8Block(data + i, needData, nonAnsi))
+            {
+                i += utf8BlockSize;
+                continue;
+            }
+#endif
+            const size_t blockEnd = (std::min)(i + utf8BlockSize, end);
+            for (; i < blockEnd; ++i)
+            {
+                if (needData == 0 && i + sizeof(uint64_t) <= end)
+                {
+                    // skip runs of plain ASCII a word at a time
+                    uint64_t word;
+                    memcpy(&word, data + i, sizeof(word));
+                    if (SpecialBytes(word) == 0)
+                    {
+                        i += sizeof(uint64_t) - 1;
+                        continue;
+                    }
+                }
+                const uint8_t ch = data[i];
+                if ((ch & 0x80) == 0) // ASCII
+                {
+                    if (ch == 0)
+                    {
+                        // null-chars are not allowed for ASCII or UTF8, that means
+                        // this file is most likely UTF16 encoded
+                        if (++nullCount > m_maxNull)
+                            return Decide(i % 2 ? cpUtf16Le : cpUtf16Be, 0);
+                        needData = 0;
+                    }
+                    else if (needData)
+                        return Decide(cpAnsi, needData);
+                    continue;
+                }
+                nonAnsi = true;
+                if ((ch & 0x40) == 0) // top bit
+                {
+                    if (!needData)
+                        return Decide(cpAnsi, 0);
+                    --needData;
+                    continue;
+                }
+                if (needData)
+                    return Decide(cpAnsi, needData);
+                int trail = 0;
+                if ((ch & 0x20) == 0) // top two bits
+                {
+                    if (ch <= 0xC1)
+                        return Decide(cpAnsi, 0);
+                    trail = 1;
+                }
+                else if ((ch & 0x10) == 0) // top three bits
+                    trail = 2;
+                else if ((ch & 0x08) == 0) // top four bits
+                {
+                    if (ch >= 0xF5)
+                        return Decide(cpAnsi, 0);
+                    trail = 3;
+                }
+                else
+                    return Decide(cpAnsi, 0);
+                // a complete sequence is skipped at once, anything else goes
+                // through the byte by byte checks above
+                if (i + trail < end && std::all_of(data + i + 1, data + i + 1 + trail, [](uint8_t c) { return (c & 0xC0) == 0x80; }))
+                    i += trail;
+                else
+                    needData = trail;
+            }
+        }
+        m_nullCount = nullCount;
+        m_needData  = needData;
+        m_nonAnsi   = nonAnsi;
+        return false;
+    }
+
+    int Result(bool& inconclusive, int& skip) const noexcept
+    {
+        if (m_decided)
+        {
+            skip = m_skip;
+            return m_codepage;
+        }
+        if (m_nonAnsi && m_needData == 0)
+            return cpUtf8;
+        inconclusive = true;
+        skip         = m_needData;
+        return cpAnsi;
+    }
+
+private:
+    bool Decide(int codepage, int skip) noexcept
+    {
+        m_decided  = true;
+        m_codepage = codepage;
+        m_skip     = skip;
+        return true;
+    }
+
+    size_t m_maxNull;
+    size_t m_nullCount = 0;
+    int    m_needData  = 0;
+    bool   m_nonAnsi   = false;
+    bool   m_decided   = false;
+    int    m_codepage  = cpAnsi;
+    int    m_skip      = 0;
+};
+
+struct CharsetCodepage
+{
+    std::string_view charset;
+    int              codepage;
+};
+
+// the names CompactEncDet returns from MimeEncodingName(), plus aliases
+// that show up in html/xml headers. The Tamil and Hindi font encodings
+// CompactEncDet knows (tscii, jagran, x-tam-*, ...) have no codepage.
+constexpr CharsetCodepage charsetCodepages[] = {
+    {"UTF-8", 65001},
+    {"UTF-7", 65000},
+    {"UTF-16LE", 1200},
+    {"UTF-16BE", 1201},
+    {"UTF-32LE", 12000},
+    {"UTF-32BE", 12001},
+    {"US-ASCII", 20127},
+    {"ISO-8859-1", 28591},
+    {"csISOLatin1", 28591},
+    {"l1", 28591},
+    {"ISO-8859-2", 28592},
+    {"csn_369103", 28592}, // Czech ISO-8859-2 variant
+    {"ISO-8859-3", 28593},
+    {"latin3", 28593},
+    {"csISOLatin3", 28593},
+    {"iso-ir-109", 28593},
+    {"l3", 28593},
+    {"ISO-8859-4", 28594},
+    {"ISO-8859-5", 28595},
+    {"ISO-8859-6", 28596},
+    {"ISO-8859-7", 28597},
+    {"ISO-8859-8", 28598},
+    {"ISO-8859-8-I", 38598},
+    {"ISO-8859-9", 28599},
+    {"ISO-8859-11", 874},
+    {"ISO-8859-13", 28603},
+    {"iso-celtic", 28604},
+    {"latin8", 28604},
+    {"ISO_8859-14", 28604},
+    {"ISO-8859-14", 28604},
+    {"l8", 28604},
+    {"iso-ir-199", 28604},
+    {"Latin-9", 28605},
+    {"ISO_8859-15", 28605},
+    {"ISO-8859-15", 28605},
+    {"windows-874", 874},
+    {"tis-620", 874},
+    {"windows-1250", 1250},
+    {"windows-1251", 1251},
+    {"windows-1252", 1252},
+    {"windows-1253", 1253},
+    {"windows-1254", 1254},
+    {"windows-1255", 1255},
+    {"windows-1256", 1256},
+    {"windows-1257", 1257},
+    {"windows-1258", 1258},
+    {"KOI8-R", 20866},
+    {"koi8_r", 20866},
+    {"KOI8-U", 21866},
+    {"koi8_u", 21866},
+    {"MACINTOSH", 10000},
+    {"x-mac-cyrillic", 10007},
+    {"xmaccyrillic", 10007},
+    {"Shift_JIS", 932},
+    {"CP932", 932},
+    {"EUC-JP", 51932},
+    {"ISO-2022-JP", 50220},
+    {"GB2312", 936},
+    {"GBK", 936},
+    {"EUC-CN", 936},
+    {"GB18030", 54936},
+    {"HZ-GB-2312", 52936},
+    {"ISO-2022-CN", 50227},
+    {"Big5", 950},
+    {"BIG5-CP950", 950},
+    {"EUC", 20000}, // CompactEncDet's name for EUC-TW
+    {"CNS", 20000},
+    {"BIG5-HKSCS", 950},
+    {"EUC-KR", 51949},
+    {"csEUCKR", 51949},
+    {"windows-949", 949},
+    {"ISO-2022-KR", 50225},
+    {"IBM437", 437},
+    {"cp437", 437},
+    {"437", 437},
+    {"csPC8CodePage437", 437},
+    {"IBM720", 720},
+    {"cp720", 720},
+    {"oem720", 720},
+    {"720", 720},
+    {"IBM737", 737},
+    {"cp737", 737},
+    {"oem737", 737},
+    {"737", 737},
+    {"IBM775", 775},
+    {"cp775", 775},
+    {"oem775", 775},
+    {"775", 775},
+    {"IBM850", 850},
+    {"cp850", 850},
+    {"oem850", 850},
+    {"850", 850},
+    {"IBM852", 852},
+    {"cp852", 852},
+    {"oem852", 852},
+    {"852", 852},
+    {"IBM855", 855},
+    {"cp855", 855},
+    {"oem855", 855},
+    {"855", 855},
+    {"csIBM855", 855},
+    {"IBM857", 857},
+    {"cp857", 857},
+    {"oem857", 857},
+    {"857", 857},
+    {"IBM858", 858},
+    {"cp858", 858},
+    {"oem858", 858},
+    {"858", 858},
+    {"IBM860", 860},
+    {"cp860", 860},
+    {"oem860", 860},
+    {"860", 860},
+    {"IBM861", 861},
+    {"cp861", 861},
+    {"oem861", 861},
+    {"861", 861},
+    {"IBM862", 862},
+    {"cp862", 862},
+    {"oem862", 862},
+    {"862", 862},
+    {"IBM863", 863},
+    {"cp863", 863},
+    {"oem863", 863},
+    {"863", 863},
+    {"IBM865", 865},
+    {"cp865", 865},
+    {"oem865", 865},
+    {"865", 865},
+    {"IBM866", 866},
+    {"cp866", 866},
+    {"oem866", 866},
+    {"866", 866},
+    {"IBM869", 869},
+    {"cp869", 869},
+    {"oem869", 869},
+    {"869", 869},
+};
+
+bool EqualsNoCase(std::string_view lhs, std::string_view rhs) noexcept
+{
+    return std::ranges::equal(lhs, rhs, [](char a, char b) {
+        const auto lower = [](char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; };
+        return lower(a) == lower(b);
+    });
+}
+} // namespace
+
+int DetectCodepage(const void* buffer, size_t length, bool& hasBOM, bool& inconclusive, int& skip)
+{
+    inconclusive = false;
+    hasBOM       = false;
+    skip         = 0;
+    if (length < 2)
+    {
+        inconclusive = true;
+        return cpAnsi;
+    }
+    const auto* const data = static_cast<const uint8_t*>(buffer);
+    if (length >= 4)
+    {
+        if (data[0] == 0xFF && data[1] == 0xFE && data[2] == 0 && data[3] == 0)
+        {
+            hasBOM = true;
+            return cpUtf32Le;
+        }
+        if (data[0] == 0 && data[1] == 0 && data[2] == 0xFE && data[3] == 0xFF)
+        {
+            hasBOM = true;
+            return cpUtf32Be;
+        }
+    }
+    int bomCodepage = cpAnsi;
+    if (data[0] == 0xFF && data[1] == 0xFE)
+        bomCodepage = cpUtf16Le;
+    else if (data[0] == 0xFE && data[1] == 0xFF)
+        bomCodepage = cpUtf16Be;
+    else if (length >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF)
+        bomCodepage = cpUtf8;
+
+    // a buffer with more 0x00000000 dwords than this is assumed to be binary,
+    // no matter what the BOM or the UTF-8 check say
+    const size_t  maxNull    = std::max<size_t>(1, length / 4 / 256);
+    size_t        nullDwords = 0;
+    Utf8Validator utf8(length);
+    bool          decided = bomCodepage != cpAnsi || length < 3;
+    size_t        pos     = 0;
+    for (; pos + chunkSize <= length; pos += chunkSize)
+    {
+        const ChunkInfo chunk = ScanChunk(data + pos);
+        nullDwords += chunk.zeroDwords;
+        if (nullDwords > maxNull)
+            return -1;
+        if (!decided && !(chunk.plainAscii && !utf8.NeedsData()))
+            decided = utf8.Validate(data, pos, pos + chunkSize);
+    }
+    for (size_t i = pos; i + 4 <= length; i += 4)
+    {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 0 && data[i + 3] == 0 && ++nullDwords > maxNull)
+            return -1;
+    }
+    if (!decided)
+        utf8.Validate(data, pos, length);
+
+    if (bomCodepage != cpAnsi)
+    {
+        hasBOM = true;
+        return bomCodepage;
+    }
+    if (length < 3)
+    {
+        inconclusive = true;
+        return cpAnsi;
+    }
+    return utf8.Result(inconclusive, skip);
+}
+
+int CodepageFromCharset(std::string_view charset)
+{
+    for (const auto& entry : charsetCodepages)
+    {
+        if (EqualsNoCase(entry.charset, charset))
+            return entry.codepage;
+    }
+    return 0;
+}
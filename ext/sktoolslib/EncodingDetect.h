@@ -0,0 +1,39 @@
+﻿// sktoolslib - common files for SK tools
+
+// Copyright (C) 2024 - Stefan Kueng
+
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+//
+
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+// Text encoding detection that only works on bytes, so it does not depend on
+// the Windows API and can be used and tested on any platform.
+
+/// determines the codepage from a text buffer. Returns -1 for binary.
+/// Binary detection, the BOM checks, UTF-8 validation and the UTF-16 null
+/// heuristic are all done in one pass over the buffer.
+/// \param hasBOM set to true if the buffer starts with a BOM
+/// \param inconclusive set to true if the buffer is valid UTF-8 but contains
+///                     only ASCII or ends in an incomplete sequence
+/// \param skip number of trailing bytes of an incomplete UTF-8 sequence
+int DetectCodepage(const void* buffer, size_t length, bool& hasBOM, bool& inconclusive, int& skip);
+
+/// returns the Windows codepage for a charset name as returned by
+/// MimeEncodingName() or used in html/xml headers. The lookup is case
+/// insensitive. Returns 0 if the charset is not known.
+int CodepageFromCharset(std::string_view charset);
@@ -19,6 +19,7 @@
 
 #include "stdafx.h"
 #include "UnicodeUtils.h"
+#include "EncodingDetect.h"
 #include <memory>
 
 CUnicodeUtils::CUnicodeUtils()
@@ -207,147 +208,5 @@ int LoadStringEx(HINSTANCE hInstance, UINT uID, LPWSTR lpBuffer, int nBufferMax,
 
 int GetCodepageFromBuf(LPVOID pBuffer, int cb, bool& hasBOM, bool& inconclusive, int& skip)
 {
-    inconclusive = false;
-    hasBOM       = false;
-    skip         = 0;
-    if (cb < 2)
-    {
-        inconclusive = true;
-        return CP_ACP;
-    }
-    const UINT32* const pVal32 = static_cast<UINT32*>(pBuffer);
-    const UINT16* const pVal16 = static_cast<UINT16*>(pBuffer);
-    const UINT8* const  pVal8  = static_cast<UINT8*>(pBuffer);
-    if (cb >= 4)
-    {
-        if (*pVal32 == 0x0000FEFF)
-        {
-            hasBOM = true;
-            return 12000; // UTF32_LE
-        }
-        if (*pVal32 == 0xFFFE0000)
-        {
-            hasBOM = true;
-            return 12001; // UTF32_BE
-        }
-    }
-    // scan the whole buffer for a 0x00000000 sequence
-    // if found, we assume a binary file
-    int nDwords = cb / 4;
-    int nullCount = 0;
-    int maxNull   = max(1, nDwords / 256);
-    for (int i = 0; i < nDwords; ++i)
-    {
-        if (0x00000000 == pVal32[i])
-            ++nullCount;
-        if (nullCount > maxNull)
-            return -1;
-    }
-    if (*pVal16 == 0xFEFF)
-    {
-        hasBOM = true;
-        return 1200; // UTF16_LE
-    }
-    if (*pVal16 == 0xFFFE)
-    {
-        hasBOM = true;
-        return 1201; // UTF16_BE
-    }
-    if (cb < 3)
-    {
-        inconclusive = true;
-        return CP_ACP;
-    }
-    if (*pVal16 == 0xBBEF)
-    {
-        if (pVal8[2] == 0xBF)
-        {
-            hasBOM = true;
-            return CP_UTF8;
-        }
-    }
-    // check for illegal UTF8 sequences
-    bool bNonAnsi  = false;
-    int  nNeedData = 0;
-    int  i         = 0;
-    nullCount = 0;
-    for (; i < cb; ++i)
-    {
-        UINT8 zChar = pVal8[i];
-        if ((zChar & 0x80) == 0) // ASCII
-        {
-            if (zChar == 0)
-            {
-                ++nullCount;
-                // count the null chars, we do not want to treat an ASCII/UTF8 file
-                // as UTF16 just because of some null chars that might be accidentally
-                // in the file.
-                // Use an arbitrary value of one fiftieth of the file length as
-                // the limit after which a file is considered UTF16.
-                if (nullCount > (cb / 50))
-                {
-                    // null-chars are not allowed for ASCII or UTF8, that means
-                    // this file is most likely UTF16 encoded
-                    if (i % 2)
-                        return 1200; // UTF16_LE
-                    else
-                        return 1201; // UTF16_BE
-                }
-                nNeedData = 0;
-            }
-            else if (nNeedData)
-            {
-                skip = nNeedData;
-                return CP_ACP;
-            }
-            continue;
-        }
-        else
-            bNonAnsi = true;
-        if ((zChar & 0x40) == 0) // top bit
-        {
-            if (!nNeedData)
-                return CP_ACP;
-            --nNeedData;
-        }
-        else if (nNeedData)
-        {
-            skip = nNeedData;
-            return CP_ACP;
-        }
-        else if ((zChar & 0x20) == 0) // top two bits
-        {
-            if (zChar <= 0xC1)
-            {
-                skip = nNeedData;
-                return CP_ACP;
-            }
-            nNeedData = 1;
-        }
-        else if ((zChar & 0x10) == 0) // top three bits
-        {
-            nNeedData = 2;
-        }
-        else if ((zChar & 0x08) == 0) // top four bits
-        {
-            if (zChar >= 0xf5)
-            {
-                skip = nNeedData;
-                return CP_ACP;
-            }
-            nNeedData = 3;
-        }
-        else
-        {
-            skip = nNeedData;
-            return CP_ACP;
-        }
-    }
-    if (bNonAnsi && nNeedData == 0)
-        return CP_UTF8;
-
-    inconclusive = true;
-    skip         = nNeedData;
-
-    return CP_ACP;
+    return DetectCodepage(pBuffer, cb > 0 ? static_cast<size_t>(cb) : 0, hasBOM, inconclusive, skip);
 }
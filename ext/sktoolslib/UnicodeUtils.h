@@ -45,6 +45,7 @@ std::wstring MultibyteToWide(const std::string& multibyte, bool stopAtNull = tru
 std::wstring UTF8ToWide(const std::string& multibyte, bool stopAtNull = true);
 
 /// determines the codepage from a text buffer. Returns -1 for binary
+/// \see DetectCodepage
 int GetCodepageFromBuf(LPVOID pBuffer, int cb, bool& hasBOM, bool& inconclusive, int& skip);
 
 #ifdef UNICODE
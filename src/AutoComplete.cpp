@@ -22,6 +22,7 @@
 #include "StringUtils.h"
 #include "UnicodeUtils.h"
 #include "DirFileEnum.h"
+#include "FileNameIndex.h"
 #include "SmartHandle.h"
 #include "OnOutOfScope.h"
 #include "SciLexer.h"
@@ -29,6 +30,7 @@
 #include "DarkModeHelper.h"
 #include "LexStyles.h"
 #include "../ext/tinyexpr/tinyexpr.h"
+#include <algorithm>
 #include <chrono>
 
 
@@ -643,23 +645,43 @@ void CAutoComplete::HandleAutoComplete(const SCNotification* scn)
             if (pathToMatch.ends_with(':'))
                 pathToMatch += '\\';
             SearchReplace(pathToMatch, L"/", L"\\");
-            CDirFileEnum   fileFinder(pathToMatch);
-            bool           bIsDirectory;
-            std::wstring   filename;
-
-            auto           startTime   = std::chrono::steady_clock::now();
-            constexpr auto maxPathTime = std::chrono::milliseconds(400);
-            auto           rootDir     = rawPath.substr(0, rawPath.find_last_of(L"\\/") + 1);
-            while (fileFinder.NextFile(filename, &bIsDirectory, false))
-            {
+            auto rootDir       = rawPath.substr(0, rawPath.find_last_of(L"\\/") + 1);
+            auto addCompletion = [&](std::wstring filename) {
                 if (rootDir.size() < filename.size())
                 {
                     filename = rootDir + filename.substr(rootDir.size());
                     pathComplete += (CUnicodeUtils::StdGetUTF8(filename) + typeSeparator + std::to_string(static_cast<int>(AutoCompleteType::Path)) + wordSeparator);
                 }
-                auto elapsedPeriod = std::chrono::steady_clock::now() - startTime;
-                if (elapsedPeriod > maxPathTime)
-                    break;
+            };
+            // the file name index lists the folder without the disk if it covers it;
+            // sort the names like the file system returns them
+            std::vector<std::wstring> indexedNames;
+            if (CFileNameIndex::Instance().Enumerate(pathToMatch, false, nullptr, [&](const std::wstring& filename, bool) {
+                    indexedNames.push_back(filename);
+                    return true;
+                }))
+            {
+                std::sort(indexedNames.begin(), indexedNames.end(), [](const std::wstring& lhs, const std::wstring& rhs) {
+                    return CompareStringOrdinal(lhs.c_str(), static_cast<int>(lhs.size()), rhs.c_str(), static_cast<int>(rhs.size()), TRUE) == CSTR_LESS_THAN;
+                });
+                for (auto& filename : indexedNames)
+                    addCompletion(std::move(filename));
+            }
+            else
+            {
+                CDirFileEnum   fileFinder(pathToMatch);
+                bool           bIsDirectory;
+                std::wstring   filename;
+
+                auto           startTime   = std::chrono::steady_clock::now();
+                constexpr auto maxPathTime = std::chrono::milliseconds(400);
+                while (fileFinder.NextFile(filename, &bIsDirectory, false))
+                {
+                    addCompletion(filename);
+                    auto elapsedPeriod = std::chrono::steady_clock::now() - startTime;
+                    if (elapsedPeriod > maxPathTime)
+                        break;
+                }
             }
             if (!pathComplete.empty())
             {
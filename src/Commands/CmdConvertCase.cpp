@@ -16,77 +16,35 @@
 //
 #include "stdafx.h"
 #include "CmdConvertCase.h"
-#include "UnicodeUtils.h"
+#include "ScintillaMessages.h"
 
-#include <functional>
-
-bool ChangeCase(Scintilla::ScintillaCall&                  scintillaCall,
-                std::function<void(std::wstring& selText)> changeFunc)
+namespace
 {
-    scintillaCall.BeginUndoAction();
-
-    auto numSelections = scintillaCall.Selections();
-    for (decltype(numSelections) i = 0; i < numSelections; ++i)
+// Scintilla converts the selections in place with the Unicode case tables,
+// this only makes a lone empty selection cover the current line first.
+bool ChangeCase(Scintilla::ScintillaCall& scintillaCall, Scintilla::Message message)
+{
+    if ((scintillaCall.Selections() == 1) && scintillaCall.SelectionEmpty())
     {
-        auto selStart = scintillaCall.SelectionNStart(i);
-        auto selEnd   = scintillaCall.SelectionNEnd(i);
-
-        if ((selStart == selEnd) && (numSelections == 1))
-        {
-            auto curLine = scintillaCall.LineFromPosition(scintillaCall.CurrentPos());
-            selStart     = scintillaCall.PositionFromLine(curLine);
-            selEnd       = scintillaCall.LineEndPosition(curLine);
-        }
-
-        auto          strBuf = std::make_unique<char[]>(abs(selEnd - selStart) + 5);
-        Sci_TextRange rangeStart{};
-        rangeStart.chrg.cpMin = static_cast<Sci_PositionCR>(selStart);
-        rangeStart.chrg.cpMax = static_cast<Sci_PositionCR>(selEnd);
-        rangeStart.lpstrText  = strBuf.get();
-        scintillaCall.GetTextRange(&rangeStart);
-
-        std::wstring selText = CUnicodeUtils::StdGetUnicode(strBuf.get());
-        changeFunc(selText);
-        std::string sUpper = CUnicodeUtils::StdGetUTF8(selText);
-
-        scintillaCall.SetTargetStart(selStart);
-        scintillaCall.SetTargetEnd(selEnd);
-        scintillaCall.ReplaceTarget(-1, sUpper.c_str());
-        scintillaCall.SetSelectionNStart(i, selStart);
-        scintillaCall.SetSelectionNEnd(i, selEnd);
+        auto curLine = scintillaCall.LineFromPosition(scintillaCall.CurrentPos());
+        scintillaCall.SetSelection(scintillaCall.LineEndPosition(curLine), scintillaCall.PositionFromLine(curLine));
     }
-    scintillaCall.EndUndoAction();
-
+    scintillaCall.Call(message);
     return true;
 }
+} // namespace
 
 bool CCmdConvertUppercase::Execute()
 {
-    return ChangeCase(CCmdConvertUppercase::Scintilla(), [](auto& selText) { CharUpper(selText.data()); });
+    return ChangeCase(CCmdConvertUppercase::Scintilla(), Scintilla::Message::UpperCase);
 }
 
 bool CCmdConvertLowercase::Execute()
 {
-    return ChangeCase(CCmdConvertLowercase::Scintilla(), [](auto& selText) { CharLower(selText.data()); });
+    return ChangeCase(CCmdConvertLowercase::Scintilla(), Scintilla::Message::LowerCase);
 }
 
 bool CCmdConvertTitlecase::Execute()
 {
-    return ChangeCase(CCmdConvertTitlecase::Scintilla(), [](auto& selText) {
-        if (selText.length() > 0)
-        {
-            wchar_t upperChar[] = {selText[0], 0};
-            CharUpper(upperChar);
-            selText[0] = upperChar[0];
-            for (std::wstring::iterator it = selText.begin() + 1; it != selText.end(); ++it)
-            {
-                if (!IsCharAlpha(*(it - 1)) && IsCharLower(*it))
-                {
-                    upperChar[0] = *it;
-                    CharUpper(upperChar);
-                    *it = upperChar[0];
-                }
-            }
-        }
-    });
+    return ChangeCase(CCmdConvertTitlecase::Scintilla(), Scintilla::Message::TitleCase);
 }
@@ -24,6 +24,7 @@
 #include "PathUtils.h"
 #include "DocumentManager.h"
 #include "DirFileEnum.h"
+#include "FileNameIndex.h"
 #include "LexStyles.h"
 #include "OnOutOfScope.h"
 #include "ResString.h"
@@ -341,6 +342,23 @@ std::wstring CFindReplaceDlg::OfferFileSuggestion(
     if (currentValue.find_first_of(L";*?") != std::wstring::npos)
         return suggestedFilename; // Should be empty.
 
+    // The file name index answers this without touching storage and has
+    // no time limit, so it finds matches in deep folder structures too.
+    std::vector<std::wstring> candidates;
+    auto                      isExcludedFolder = [this](const std::wstring& folder) { return IsExcludedFolder(folder); };
+    if (CFileNameIndex::Instance().FindFiles(searchFolder, searchSubFolders, currentValue, FileNameMatch::Prefix, 1000, isExcludedFolder, candidates))
+    {
+        for (const auto& candidate : candidates)
+        {
+            if (IsExcludedFile(candidate))
+                continue;
+            auto filename = CPathUtils::GetFileName(candidate);
+            if (suggestedFilename.empty() || filename.length() < suggestedFilename.length())
+                suggestedFilename = std::move(filename);
+        }
+        return suggestedFilename;
+    }
+
     constexpr auto maxSearchTime = std::chrono::milliseconds(200);
     CDirFileEnum   enumerator(searchFolder);
     bool           bIsDir = false;
@@ -1588,53 +1606,40 @@ void CFindReplaceDlg::DoReplace(int id)
             }
         }
     }
+    else if (id == IDC_REPLACEALLBTN)
+    {
+        // Replaces everything in the target in one undo step.
+        Scintilla().SetSearchFlags(g_searchFlags);
+        Sci_TextToReplace tr = {0};
+        tr.lpstrSearch       = g_findString.c_str();
+        tr.searchLength      = static_cast<Sci_Position>(g_findString.length());
+        tr.lpstrReplacement  = sReplaceString.c_str();
+        tr.replacementLength = static_cast<Sci_Position>(sReplaceString.length());
+        replaceCount         = (std::max)(0, static_cast<int>(Scintilla().ReplaceAllInTarget(&tr)));
+    }
     else
     {
         Scintilla().SetSearchFlags(g_searchFlags);
-        sptr_t findRet = -1;
-        Scintilla().BeginUndoAction();
-        do
+        // note: our regex search implementation returns -2 if the regex is invalid
+        sptr_t findRet = Scintilla().SearchInTarget(g_findString.length(), g_findString.c_str());
+        if (findRet == -1)
         {
+            SetInfoText(IDS_FINDRETRYWRAP);
+            // Retry from the start of the doc.
+            Scintilla().SetTargetStart(0);
+            Scintilla().SetTargetEnd(Scintilla().CurrentPos());
             findRet = Scintilla().SearchInTarget(g_findString.length(), g_findString.c_str());
-            // note: our regex search implementation returns -2 if the regex is invalid
-            if (findRet == -1 && id == IDC_REPLACEBTN)
-            {
-                SetInfoText(IDS_FINDRETRYWRAP);
-                // Retry from the start of the doc.
-                Scintilla().SetTargetStart(0);
-                Scintilla().SetTargetEnd(Scintilla().CurrentPos());
-                findRet = Scintilla().SearchInTarget(g_findString.length(), g_findString.c_str());
-            }
-            if (findRet >= 0)
-            {
-                if ((g_searchFlags & Scintilla::FindOption::RegExp) != Scintilla::FindOption::None)
-                    Scintilla().ReplaceTargetRE(sReplaceString.length(), sReplaceString.c_str());
-                else
-                    Scintilla().ReplaceTarget(sReplaceString.length(), sReplaceString.c_str());
-
-                ++replaceCount;
-                auto targetStart = Scintilla().TargetStart();
-                auto targetEnd   = Scintilla().TargetEnd();
-                if (id == IDC_REPLACEBTN)
-                    Center(targetStart, targetEnd);
+        }
+        if (findRet >= 0)
+        {
+            if ((g_searchFlags & Scintilla::FindOption::RegExp) != Scintilla::FindOption::None)
+                Scintilla().ReplaceTargetRE(sReplaceString.length(), sReplaceString.c_str());
+            else
+                Scintilla().ReplaceTarget(sReplaceString.length(), sReplaceString.c_str());
 
-                //if ((targetEnd > targetStart || sReplaceString.empty()) && (targetStart != targetEnd) && !g_findString.contains('$'))
-                if ((targetEnd > targetStart || sReplaceString.empty()) && (targetStart != targetEnd) && (g_findString.find('$') == std::string::npos))
-                    Scintilla().SetTargetStart(targetEnd);
-                else
-                    Scintilla().SetTargetStart(targetEnd + 1);
-                if (bReplaceOnlyInSelection)
-                    Scintilla().SetTargetEnd(selEnd);
-                else
-                {
-                    auto docLen = Scintilla().Length();
-                    Scintilla().SetTargetEnd(docLen);
-                    if (docLen == targetEnd)
-                        break;
-                }
-            }
-        } while (id == IDC_REPLACEALLBTN && findRet >= 0);
-        Scintilla().EndUndoAction();
+            ++replaceCount;
+            Center(Scintilla().TargetStart(), Scintilla().TargetEnd());
+        }
     }
     if (id == IDC_REPLACEALLBTN || id == IDC_REPLACEALLINTABSBTN)
     {
@@ -1975,42 +1980,19 @@ void CFindReplaceDlg::FocusOnFirstListItem(bool keepAnyExistingSelection)
     }
 }
 
-bool CFindReplaceDlg::IsMatchingFile(const std::wstring& path, const std::vector<std::wstring>& filesToFind) const
+bool CFindReplaceDlg::IsMatchingFile(const std::wstring& path, const CGlobSet& filesToFind) const
 {
-    bool matched = false;
-    if (filesToFind.size() > 0)
-    {
-        auto targetName = CPathUtils::GetFileName(path);
-        auto whereAt    = std::find_if(filesToFind.begin(), filesToFind.end(),
-                                    [&](const std::wstring& fileToFind) {
-                                        bool match = !!PathMatchSpec(targetName.c_str(), fileToFind.c_str());
-                                        return match;
-                                    });
-        matched         = (whereAt != filesToFind.end());
-    }
-    return matched;
+    return filesToFind.Matches(CGlobSet::FileNamePart(path));
 }
 
 bool CFindReplaceDlg::IsExcludedFile(const std::wstring& path) const
 {
-    auto ext = CPathUtils::GetFileExtension(path);
-    for (const auto& e : m_excludedExtensions)
-    {
-        if (_wcsicmp(ext.c_str(), e.c_str()) == 0)
-            return true;
-    }
-    return false;
+    return m_excludedFiles.Matches(CGlobSet::FileNamePart(path));
 }
 
 bool CFindReplaceDlg::IsExcludedFolder(const std::wstring& path) const
 {
-    auto targetName = CPathUtils::GetFileName(path);
-    for (const auto& e : m_excludedFolders)
-    {
-        if (_wcsicmp(targetName.c_str(), e.c_str()) == 0)
-            return true;
-    }
-    return false;
+    return m_excludedFolders.Matches(CGlobSet::FileNamePart(path));
 }
 
 void CFindReplaceDlg::SearchThread(
@@ -2032,39 +2014,69 @@ void CFindReplaceDlg::SearchThread(
     auto searchWnd = std::make_unique<CScintillaWnd>(g_hRes);
     searchWnd->InitScratch(g_hRes);
 
-    CDirFileEnum     enumerator(searchPath);
-    bool             bIsDir = false;
-    std::wstring     path;
+    std::wstring path;
     auto         manager = std::make_unique<CDocumentManager>();
-    bool             searchSubFoldersFlag = searchSubFolders;
 
     // Note that on some versions of Windows, e.g. Window 7, paths like "*.cpp" will
-    // actually match "*.cpp*" which is strange but it's seems a quirk of the OS not CDirFileEnum.
-    while (enumerator.NextFile(path, &bIsDir, searchSubFoldersFlag) && !m_bStop)
+    // actually match "*.cpp*" which is strange but it's seems a quirk of the OS.
+    // The patterns are compiled once here instead of being matched one by one for every file.
+    CGlobSet filesToFindSet(filesToFind);
+    auto     isWantedFile = [&](const std::wstring& filePath) {
+        if (filesToFindSet.Empty()) // If we using implicit matching....
+            return !IsExcludedFile(filePath); // If we implicitly don't want this, reject it.
+        return IsMatchingFile(filePath, filesToFindSet); // Using explicit matching.
+    };
+    auto isExcludedFolder = [this](const std::wstring& folder) { return IsExcludedFolder(folder); };
+
+    // Take the file list from the file name index if it covers the folder,
+    // otherwise enumerate the folder. Either way excluded folders are never
+    // entered and only the files of interest are returned.
+    std::vector<std::wstring>                indexedFiles;
+    size_t                                   nextIndexedFile = 0;
+    std::unique_ptr<CParallelDirFileEnum>    enumerator;
+    std::vector<CParallelDirFileEnum::Entry> batch;
+    size_t                                   nextInBatch = 0;
+    bool                                     indexed     = CFileNameIndex::Instance().Enumerate(
+        searchPath, searchSubFolders, isExcludedFolder,
+        [&](const std::wstring& filePath, bool isDir) {
+            if (!isDir && isWantedFile(filePath))
+                indexedFiles.push_back(filePath);
+            return !m_bStop;
+        });
+    if (!indexed)
     {
-        if (bIsDir)
-        {
-            searchSubFoldersFlag = IsExcludedFolder(path) ? false : searchSubFolders;
-            continue;
-        }
-        searchSubFoldersFlag = searchSubFolders;
-
-        // We must continue to the top of the loop and onto the next file
-        // if we don't want the current file.
-
-        bool match = false;
-        if (filesToFind.size() == 0) // If we using implicit matching....
+        enumerator = std::make_unique<CParallelDirFileEnum>(searchPath, searchSubFolders);
+        enumerator->SetFolderExclusion(isExcludedFolder);
+        enumerator->SetFileFilter(isWantedFile);
+    }
+    auto nextFile = [&]() {
+        if (!enumerator)
         {
-            if (!IsExcludedFile(path))
-                match = true; // If we implicitly don't want this, reject it.
+            if (nextIndexedFile >= indexedFiles.size())
+                return false;
+            path = std::move(indexedFiles[nextIndexedFile++]);
+            return true;
         }
-        else // Using explicit matching.
+        for (;;)
         {
-            match = IsMatchingFile(path, filesToFind);
+            while (nextInBatch < batch.size())
+            {
+                auto& entry = batch[nextInBatch++];
+                if (!entry.isDirectory)
+                {
+                    path = std::move(entry.path);
+                    return true;
+                }
+            }
+            batch.clear();
+            nextInBatch = 0;
+            if (!enumerator->NextBatch(batch))
+                return false;
         }
-        if (!match)
-            continue; // Not a match.
+    };
 
+    while (nextFile() && !m_bStop)
+    {
         // If we reach here, the file is of interest to the user.
         if (id == IDC_FINDFILES)
         {
@@ -2331,35 +2343,19 @@ int CFindReplaceDlg::ReplaceDocument(CDocument& doc, const std::string& sFindStr
     m_searchWnd.Scintilla().SetTargetStart(0);
     m_searchWnd.Scintilla().SetSearchFlags(searchFlags);
     m_searchWnd.Scintilla().SetTargetEnd(m_searchWnd.Scintilla().Length());
-    m_searchWnd.Scintilla().BeginUndoAction();
-    OnOutOfScope(
-        m_searchWnd.Scintilla().EndUndoAction();
-        m_searchWnd.Scintilla().SetDocPointer(nullptr););
-
-    sptr_t findRet      = -1;
-    int    replaceCount = 0;
-    do
-    {
-        findRet = m_searchWnd.Scintilla().SearchInTarget(sFindString.length(), sFindString.c_str());
-        if (findRet >= 0)
-        {
-            if ((g_searchFlags & Scintilla::FindOption::RegExp) != Scintilla::FindOption::None)
-                m_searchWnd.Scintilla().ReplaceTargetRE(sReplaceString.length(), sReplaceString.c_str());
-            else
-                m_searchWnd.Scintilla().ReplaceTarget(sReplaceString.length(), sReplaceString.c_str());
-            ++replaceCount;
-            auto targetStart = m_searchWnd.Scintilla().TargetStart();
-            auto targetEnd   = m_searchWnd.Scintilla().TargetEnd();
-            if ((targetEnd > targetStart) || (sReplaceString.empty()))
-                m_searchWnd.Scintilla().SetTargetStart(targetEnd);
-            else
-                m_searchWnd.Scintilla().SetTargetStart(targetEnd + 1);
-
-            m_searchWnd.Scintilla().SetTargetEnd(m_searchWnd.Scintilla().Length());
-            doc.m_bIsDirty = true;
-        }
-    } while (findRet >= 0);
-    return replaceCount;
+    OnOutOfScope(m_searchWnd.Scintilla().SetDocPointer(nullptr););
+
+    // negative if the regex is invalid
+    Sci_TextToReplace tr = {0};
+    tr.lpstrSearch       = sFindString.c_str();
+    tr.searchLength      = static_cast<Sci_Position>(sFindString.length());
+    tr.lpstrReplacement  = sReplaceString.c_str();
+    tr.replacementLength = static_cast<Sci_Position>(sReplaceString.length());
+    auto replaceCount    = m_searchWnd.Scintilla().ReplaceAllInTarget(&tr);
+    if (replaceCount <= 0)
+        return 0;
+    doc.m_bIsDirty = true;
+    return static_cast<int>(replaceCount);
 }
 
 void CFindReplaceDlg::InitResultsList()
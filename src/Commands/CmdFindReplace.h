@@ -18,6 +18,7 @@
 #pragma once
 #include "ICommand.h"
 #include "ScintillaWnd.h"
+#include "GlobSet.h"
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
@@ -142,7 +143,7 @@ protected:
     LRESULT GetListItemDispInfo(NMLVDISPINFO* pDispInfo);
     void    HandleButtonDropDown(const NMBCDROPDOWN* pDropDown);
 
-    bool IsMatchingFile(const std::wstring& path, const std::vector<std::wstring>& filesToFind) const;
+    bool IsMatchingFile(const std::wstring& path, const CGlobSet& filesToFind) const;
 
     bool IsExcludedFile(const std::wstring& path) const;
     bool IsExcludedFolder(const std::wstring& path) const;
@@ -235,19 +236,17 @@ private:
     // Some types usually best avoided while searching.
     // The user can explicitly override these if they want them though.
     // REVIEW: consider making this list configurable?
-    // NOTE: Keep filenames lower case as code assumes that.
-    const std::vector<std::wstring> m_excludedExtensions = {
+    const CGlobSet m_excludedFiles = CGlobSet({
         // Binary types.
-        L"exe", L"dll", L"obj", L"lib", L"ilk", L"iobj", L"ipdb", L"idb",
-        L"pch", L"ipch", L"sdf", L"pdb", L"res", L"sdf", L"db", L"iso",
+        L"*.exe", L"*.dll", L"*.obj", L"*.lib", L"*.ilk", L"*.iobj", L"*.ipdb", L"*.idb",
+        L"*.pch", L"*.ipch", L"*.sdf", L"*.pdb", L"*.res", L"*.sdf", L"*.db", L"*.iso",
         // Common temporary VC project types.
-        L"tlog",
+        L"*.tlog",
         // svn types.
-        L"svn-base",
+        L"*.svn-base",
         // Image types.
-        L"bmp", L"png", L"jpg", L"ico", L"cur"};
-    const std::vector<std::wstring> m_excludedFolders = {
-        L".svn", L".git"};
+        L"*.bmp", L"*.png", L"*.jpg", L"*.ico", L"*.cur"});
+    const CGlobSet m_excludedFolders = CGlobSet({L".svn", L".git"});
 };
 
 class CCmdFindReplace : public ICommand
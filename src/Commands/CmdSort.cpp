@@ -17,14 +17,12 @@
 
 #include "stdafx.h"
 #include "CmdSort.h"
-#include "StringUtils.h"
-#include "UnicodeUtils.h"
 #include "Resource.h"
 #include "BaseDialog.h"
 #include "Theme.h"
 #include "ResString.h"
-
-#include <algorithm>
+#include "UnicodeUtils.h"
+#include "LineSorter.h"
 
 extern HINSTANCE g_hRes;
 
@@ -32,92 +30,45 @@ extern HINSTANCE g_hRes;
 //
 // Sort Current Selection with Ascending | Descending
 // and case Sensitive | Insensitive and  Numeric options.
+// Lines are compared by the whole line, a delimited field, a regex
+// capture group or, for rectangular selections, the selected columns,
+// as text, numbers or dates.
 // Handles regular or rectangular selections.
 // Does not handle multiple selections but support is possible.
-// May wish to handle multiple selections and custom delimiters as
-// future improvements.
 
 // No need to expose these types. Internal only.
 namespace
 {
-enum class SortAction
-{
-    None,
-    Sort
-};
-enum class SortOrder
-{
-    Ascending,
-    Descending
-};
-enum class SortCase
-{
-    Sensitive,
-    Insensitive
-};
-enum class SortDigits
-{
-    AsDigits,
-    AsNumbers
-};
-
-struct SortOptions
-{
-    SortOptions(
-        SortAction sortAction,
-        SortOrder  sortOrder,
-        SortCase   sortCase,
-        SortDigits sortDigits,
-        bool       removeDuplicateLines)
-        : sortAction(sortAction)
-        , sortOrder(sortOrder)
-        , sortCase(sortCase)
-        , sortDigits(sortDigits)
-        , removeDuplicateLines(removeDuplicateLines)
-    {
-    }
-    // Default constructor sets sensible default options
-    // for sorting, but defaults to not actually sorting.
-    // Set sort action explicitly to Sort invoke any sorting.
-    SortOptions()
-        : sortAction(SortAction::None)
-        , sortOrder(SortOrder::Ascending)
-        , sortCase(SortCase::Sensitive)
-        , sortDigits(SortDigits::AsDigits)
-        , removeDuplicateLines(false)
-    {
-    }
-    SortAction sortAction;
-    SortOrder  sortOrder;
-    SortCase   sortCase;
-    SortDigits sortDigits;
-    bool       removeDuplicateLines;
-};
+// in the order of the entries in the key combo box
+constexpr CLineSorter::KeySource keySources[] = {
+    CLineSorter::KeySource::Line,
+    CLineSorter::KeySource::Field,
+    CLineSorter::KeySource::Regex,
+    CLineSorter::KeySource::Column};
 
 class CSortDlg : public CDialog // No need to be ICommand connected as yet.
 {
 public:
-    CSortDlg();
+    CSortDlg(bool rectangular);
     ~CSortDlg() override;
 
 protected:
     LRESULT CALLBACK DlgFunc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam) override;
     LRESULT          DoCommand(int id, int msg);
+    void             EnableKeyControls();
+    bool             ReadOptions();
 
 public:
-    bool sortDescending;
-    bool sortCaseInsensitive;
-    bool sortDigitsAsNumbers;
-    bool removeDuplicateLines;
+    CLineSorter::Options options;
+
+private:
+    bool m_rectangular;
 };
 
 }; // anonymous namespace
 
-CSortDlg::CSortDlg()
-    : sortDescending(false)
-    , sortCaseInsensitive(false)
-    , sortDigitsAsNumbers(false)
-    , removeDuplicateLines(false)
+CSortDlg::CSortDlg(bool rectangular)
+    : m_rectangular(rectangular)
 {
 }
 
@@ -134,6 +85,23 @@ LRESULT CSortDlg::DlgFunc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam)
         {
             InitDialog(hwndDlg, 0);// IDI_BOWPAD);
             CTheme::Instance().SetThemeForDialog(*this, CTheme::Instance().IsDarkTheme());
+
+            auto hKeyCombo = GetDlgItem(*this, IDC_SORTDLG_KEY);
+            ComboBox_AddString(hKeyCombo, ResString(g_hRes, IDS_SORTKEY_LINE));
+            ComboBox_AddString(hKeyCombo, ResString(g_hRes, IDS_SORTKEY_FIELD));
+            ComboBox_AddString(hKeyCombo, ResString(g_hRes, IDS_SORTKEY_REGEX));
+            if (m_rectangular)
+                ComboBox_AddString(hKeyCombo, ResString(g_hRes, IDS_SORTKEY_COLUMNS));
+            ComboBox_SetCurSel(hKeyCombo, 0);
+            auto hKeyTypeCombo = GetDlgItem(*this, IDC_SORTDLG_KEYTYPE);
+            ComboBox_AddString(hKeyTypeCombo, ResString(g_hRes, IDS_SORTKEYTYPE_TEXT));
+            ComboBox_AddString(hKeyTypeCombo, ResString(g_hRes, IDS_SORTKEYTYPE_NUMBER));
+            ComboBox_AddString(hKeyTypeCombo, ResString(g_hRes, IDS_SORTKEYTYPE_DATE));
+            ComboBox_SetCurSel(hKeyTypeCombo, 0);
+            SetDlgItemText(*this, IDC_SORTDLG_DELIMITER, L",");
+            SetDlgItemText(*this, IDC_SORTDLG_FIELD, L"1");
+            SetDlgItemText(*this, IDC_SORTDLG_GROUP, L"1");
+            EnableKeyControls();
         }
             return FALSE;
         case WM_COMMAND:
@@ -157,26 +125,79 @@ LRESULT CSortDlg::DlgFunc(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lParam)
     return FALSE;
 }
 
-LRESULT CSortDlg::DoCommand(int id, int /*msg*/)
+LRESULT CSortDlg::DoCommand(int id, int msg)
 {
     switch (id)
     {
         case IDOK:
-            this->sortDescending       = IsDlgButtonChecked(*this, IDC_SORTDLG_ORDER_CHECK) != FALSE;
-            this->sortCaseInsensitive  = IsDlgButtonChecked(*this, IDC_SORTDLG_CASE_CHECK) != FALSE;
-            this->sortDigitsAsNumbers  = IsDlgButtonChecked(*this, IDC_SORTDLG_NUM_CHECK) != FALSE;
-            this->removeDuplicateLines = IsDlgButtonChecked(*this, IDC_REMOVEDUPLICATES) != FALSE;
-            EndDialog(*this, id);
+            if (ReadOptions())
+                EndDialog(*this, id);
             break;
         case IDCANCEL:
             EndDialog(*this, id);
             break;
+        case IDC_SORTDLG_KEY:
+            if (msg == CBN_SELCHANGE)
+                EnableKeyControls();
+            break;
         default:
             break;
     }
     return 1;
 }
 
+void CSortDlg::EnableKeyControls()
+{
+    auto keySource = keySources[ComboBox_GetCurSel(GetDlgItem(*this, IDC_SORTDLG_KEY))];
+    DialogEnableWindow(IDC_SORTDLG_DELIMITER, keySource == CLineSorter::KeySource::Field);
+    DialogEnableWindow(IDC_SORTDLG_FIELD, keySource == CLineSorter::KeySource::Field);
+    DialogEnableWindow(IDC_SORTDLG_REGEX, keySource == CLineSorter::KeySource::Regex);
+    DialogEnableWindow(IDC_SORTDLG_GROUP, keySource == CLineSorter::KeySource::Regex);
+}
+
+bool CSortDlg::ReadOptions()
+{
+    options.descending       = IsDlgButtonChecked(*this, IDC_SORTDLG_ORDER_CHECK) != FALSE;
+    options.caseInsensitive  = IsDlgButtonChecked(*this, IDC_SORTDLG_CASE_CHECK) != FALSE;
+    options.digitsAsNumbers  = IsDlgButtonChecked(*this, IDC_SORTDLG_NUM_CHECK) != FALSE;
+    options.removeDuplicates = IsDlgButtonChecked(*this, IDC_REMOVEDUPLICATES) != FALSE;
+    options.keySource        = keySources[ComboBox_GetCurSel(GetDlgItem(*this, IDC_SORTDLG_KEY))];
+    options.keyType          = static_cast<CLineSorter::KeyType>(ComboBox_GetCurSel(GetDlgItem(*this, IDC_SORTDLG_KEYTYPE)));
+
+    // a tab can't be typed into the edit control
+    auto delimiter     = CUnicodeUtils::StdGetUTF8(GetDlgItemText(IDC_SORTDLG_DELIMITER).get());
+    options.delimiter  = delimiter.empty() ? ',' : (delimiter == "\\t" ? '\t' : delimiter[0]);
+    options.field      = (std::max)(1u, GetDlgItemInt(*this, IDC_SORTDLG_FIELD, nullptr, FALSE)) - 1;
+    options.regex      = CUnicodeUtils::StdGetUTF8(GetDlgItemText(IDC_SORTDLG_REGEX).get());
+    options.regexGroup = GetDlgItemInt(*this, IDC_SORTDLG_GROUP, nullptr, FALSE);
+    if (options.keySource == CLineSorter::KeySource::Regex)
+    {
+        try
+        {
+            std::regex regex(options.regex, std::regex_constants::ECMAScript);
+        }
+        catch (const std::regex_error& e)
+        {
+            ShowEditBalloon(IDC_SORTDLG_REGEX, ResString(g_hRes, IDS_REGEX_NOTOK), CUnicodeUtils::StdGetUnicode(e.what()).c_str());
+            return false;
+        }
+    }
+    // sorted runs go to temp files once the keys of a selection need more memory than this.
+    // The copy of the selection isn't counted, the sorted lines go into the document as they're merged.
+    options.memoryBudget = static_cast<size_t>((std::max)(16LL, GetInt64(DEFAULTS_SECTION, L"SortMemoryBudgetMB", 512))) * 1024 * 1024;
+    return true;
+}
+
+static bool GetSortOptions(HWND hWnd, bool rectangular, CLineSorter::Options& options)
+{
+    CSortDlg sortDlg(rectangular);
+
+    if (sortDlg.DoModal(g_hRes, IDD_SORTDLG, hWnd) != IDOK)
+        return false;
+    options = sortDlg.options;
+    return true;
+}
+
 bool CCmdSort::Execute()
 {
     // Could provide error messages here but have chosen
@@ -191,20 +212,20 @@ bool CCmdSort::Execute()
         return false;
 
     // Determine the line endings used/to use.
-    std::wstring eol;
+    std::string eol;
     switch (Scintilla().EOLMode())
     {
         case Scintilla::EndOfLine::CrLf:
-            eol = L"\r\n";
+            eol = "\r\n";
             break;
         case Scintilla::EndOfLine::Lf:
-            eol = L"\n";
+            eol = "\n";
             break;
         case Scintilla::EndOfLine::Cr:
-            eol = L"\r";
+            eol = "\r";
             break;
         default:
-            eol = L"\r\n";
+            eol = "\r\n";
             //APPVERIFY(false); // Shouldn't happen.
     }
 
@@ -223,35 +244,77 @@ bool CCmdSort::Execute()
     if (lineCount <= 1)
         return true;
 
+    CLineSorter::Options options;
+    if (!GetSortOptions(GetHwnd(), isRectangular, options))
+        return true;
+    // Lines sort like CompareStringEx orders them for the user's locale,
+    // with a sort key built once per line instead of comparing the lines.
+    DWORD mapFlags = LCMAP_SORTKEY;
+    if (options.caseInsensitive)
+        mapFlags |= LINGUISTIC_IGNORECASE;
+    if (options.digitsAsNumbers)
+        mapFlags |= SORT_DIGITSASNUMBERS;
+    options.collator = [mapFlags](std::string_view text, std::string& key) {
+        if (text.empty())
+            return true;
+        thread_local std::wstring wide;
+        wide.resize(text.size());
+        int wideLength = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), wide.data(), static_cast<int>(wide.size()));
+        int keyLength  = wideLength ? LCMapStringEx(LOCALE_NAME_USER_DEFAULT, mapFlags, wide.data(), wideLength, nullptr, 0, nullptr, nullptr, 0) : 0;
+        if (keyLength <= 0)
+            return false;
+        auto keyStart = key.size();
+        key.resize(keyStart + keyLength);
+        keyLength = LCMapStringEx(LOCALE_NAME_USER_DEFAULT, mapFlags, wide.data(), wideLength, reinterpret_cast<LPWSTR>(key.data() + keyStart), keyLength, nullptr, nullptr, 0);
+        // the key ends with a zero byte that isn't needed to compare it
+        key.resize(keyLength > 0 ? keyStart + keyLength - 1 : keyStart);
+        return keyLength > 0;
+    };
+    if (isRectangular && options.keySource == CLineSorter::KeySource::Column)
+    {
+        // The whole lines are sorted by the characters in the
+        // columns that are selected in the first row.
+        auto rowStart       = Scintilla().GetLineSelStartPosition(lineStart);
+        auto rowEnd         = Scintilla().GetLineSelEndPosition(lineStart);
+        options.firstColumn = static_cast<size_t>(Scintilla().CountCharacters(Scintilla().PositionFromLine(lineStart), rowStart));
+        options.columnCount = static_cast<size_t>((std::max)(sptr_t(1), Scintilla().CountCharacters(rowStart, rowEnd)));
+        selStart            = Scintilla().PositionFromLine(lineStart);
+        selEnd              = Scintilla().LineEndPosition(lineEnd);
+        isRectangular       = false;
+    }
+
     if (isRectangular) // Find and sort lines in rectangular selections.
     {
-        std::vector<std::wstring> lines;
-        std::vector<sptr_t>       positions;
+        std::vector<std::string>      lineTexts;
+        std::vector<std::string_view> lines;
+        std::vector<sptr_t>           positions;
         for (sptr_t lineNum = lineStart; lineNum <= lineEnd; ++lineNum)
         {
-            auto         lineSelStart = Scintilla().GetLineSelStartPosition(lineNum);
-            auto         lineSelEnd   = Scintilla().GetLineSelEndPosition(lineNum);
-            std::wstring line         = CUnicodeUtils::StdGetUnicode(GetTextRange(lineSelStart, lineSelEnd));
-            lines.push_back(std::move(line));
+            auto lineSelStart = Scintilla().GetLineSelStartPosition(lineNum);
+            auto lineSelEnd   = Scintilla().GetLineSelEndPosition(lineNum);
+            lineTexts.push_back(GetTextRange(lineSelStart, lineSelEnd));
             positions.push_back(lineSelStart);
         }
+        lines.assign(lineTexts.begin(), lineTexts.end());
 
         // The all important sort bit. Doesn't effect the document yet.
-        if (Sort(lines))
+        lines = CLineSorter(options).Sort(lines);
+
+        // Use may want to undo this so make it possible
+        // We're changing the document from here on in.
+
+        Scintilla().BeginUndoAction();
+        size_t ln    = 0;
+        sptr_t moved = 0; // rows before this one that got longer or shorter
+        for (sptr_t line = lineStart; line <= lineEnd; ++line, ++ln)
         {
-            // Use may want to undo this so make it possible
-            // We're changing the document from here on in.
-
-            Scintilla().BeginUndoAction();
-            size_t ln = 0;
-            for (sptr_t line = lineStart; line <= lineEnd; ++line, ++ln)
-            {
-                const auto& lineText = CUnicodeUtils::StdGetUTF8(lines[ln]);
-                Scintilla().DeleteRange(positions[ln], lineText.length());
-                Scintilla().InsertText(positions[ln], lineText.c_str());
-            }
-            Scintilla().EndUndoAction();
+            // removed duplicates leave the rest of the rows empty
+            std::string lineText(ln < lines.size() ? lines[ln] : std::string_view());
+            Scintilla().DeleteRange(positions[ln] + moved, lineTexts[ln].length());
+            Scintilla().InsertText(positions[ln] + moved, lineText.c_str());
+            moved += static_cast<sptr_t>(lineText.length()) - static_cast<sptr_t>(lineTexts[ln].length());
         }
+        Scintilla().EndUndoAction();
     }
     else // Find an sort lines for regular (non rectangular selections).
     {
@@ -261,80 +324,54 @@ bool CCmdSort::Execute()
             --lineEnd;
             selEnd = Scintilla().LineEndPosition(lineEnd);
         }
-        std::wstring selText = CUnicodeUtils::StdGetUnicode(GetSelectedText(SelectionHandling::None));
-        // Whatever the line breaks type is current, standardize on "\n".
-        // When re-inserting the lines later we'll use whatever line
+        // Sort the selected text, whatever the line breaks are.
+        // When re-inserting the lines we'll use whatever line
         // break type is appropriate for the document.
-        SearchReplace(selText, L"\r\n", L"\n");
-        SearchReplace(selText, L"\r", L"\n");
-        std::vector<std::wstring> lines;
-        stringtok(lines, selText, false, L"\n");
-
-        // The all important sort bit. Doesn't effect the document yet.
-        if (Sort(lines))
+        std::string selText = GetTextRange(selStart, selEnd);
+
+        // Use may want to undo this so make it possible
+        // We're changing the document from here on in.
+
+        Scintilla().BeginUndoAction();
+        Scintilla().DeleteRange(selStart, selEnd - selStart);
+        // The sorted lines are inserted in blocks as they come so huge
+        // selections don't need another copy of the sorted text.
+        constexpr size_t blockSize = 1024 * 1024;
+        std::string      block;
+        sptr_t           insertPos = selStart;
+        auto             insert    = [&]() {
+            Scintilla().SetTargetRange(insertPos, insertPos);
+            insertPos += Scintilla().ReplaceTarget(block);
+            block.clear();
+        };
+        bool firstLine = true;
+
+        // The all important sort bit.
+        // Huge selections are sorted in parts that go to temp files.
+        bool sorted = CLineSorter(options).SortText(selText, [&](std::string_view line) {
+            if (!firstLine) // No new line on the last line.
+                block += eol;
+            block += line;
+            firstLine = false;
+            if (block.size() >= blockSize)
+                insert();
+        });
+        if (sorted)
         {
-            selText.clear();
-            for (size_t lineNum = 0; lineNum < lines.size(); ++lineNum)
-            {
-                selText += lines[lineNum];
-                if (lineNum < lines.size() - 1) // No new line on the last line.
-                    selText += eol;
-            }
-
-            // Use may want to undo this so make it possible
-            // We're changing the document from here on in.
-
-            Scintilla().BeginUndoAction();
-            Scintilla().SetSel(selStart, selEnd);
-            std::string sSortedText = CUnicodeUtils::StdGetUTF8(selText);
-            Scintilla().ReplaceSel(sSortedText.c_str());
+            insert();
             // Put the selection back where it was so the user
             // can see still see what they sorted and possibly do more with it.
             Scintilla().SetSel(origSelStart, origSelEnd);
-            Scintilla().EndUndoAction();
+        }
+        Scintilla().EndUndoAction();
+        if (!sorted)
+        {
+            // Puts back the lines if some were sorted before a temp file failed
+            Scintilla().Undo();
+            ::MessageBox(GetHwnd(), ResString(g_hRes, IDS_SORT_TEMPFILEERROR), ResString(g_hRes, IDS_APP_TITLE), MB_ICONERROR);
+            return false;
         }
     }
 
     return true;
 }
-
-static SortOptions GetSortOptions(HWND hWnd)
-{
-    CSortDlg sortDlg;
-
-    auto result = sortDlg.DoModal(g_hRes, IDD_SORTDLG, hWnd);
-
-    if (result == IDOK)
-        return SortOptions(SortAction::Sort,
-                           sortDlg.sortDescending ? SortOrder::Descending : SortOrder::Ascending,
-                           sortDlg.sortCaseInsensitive ? SortCase::Insensitive : SortCase::Sensitive,
-                           sortDlg.sortDigitsAsNumbers ? SortDigits::AsNumbers : SortDigits::AsDigits,
-                           sortDlg.removeDuplicateLines);
-
-    return SortOptions(); // Means don't sort.
-}
-
-bool CCmdSort::Sort(std::vector<std::wstring>& lines) const
-{
-    SortOptions so = GetSortOptions(GetHwnd());
-    if (so.sortAction == SortAction::None)
-        return false;
-
-    DWORD cmpFlags = 0;
-    if (so.sortCase == SortCase::Insensitive)
-        cmpFlags |= LINGUISTIC_IGNORECASE;
-    if (so.sortDigits == SortDigits::AsNumbers)
-        cmpFlags |= SORT_DIGITSASNUMBERS;
-
-    std::sort(std::begin(lines), std::end(lines),
-              [&](const std::wstring& lhs, const std::wstring& rhs) -> bool {
-                  auto res = CompareStringEx(nullptr, cmpFlags,
-                                             lhs.data(), static_cast<int>(lhs.length()),
-                                             rhs.data(), static_cast<int>(rhs.length()),
-                                             nullptr, nullptr, 0);
-                  return so.sortOrder == SortOrder::Ascending ? res == CSTR_LESS_THAN : res == CSTR_GREATER_THAN;
-              });
-    if (so.removeDuplicateLines)
-        lines.erase(std::unique(lines.begin(), lines.end()), lines.end());
-    return true;
-}
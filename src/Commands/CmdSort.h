@@ -18,9 +18,6 @@
 #pragma once
 #include "ICommand.h"
 
-#include <string>
-#include <vector>
-
 class CCmdSort : public ICommand
 {
 public:
@@ -32,7 +29,4 @@ public:
 
     UINT GetCmdId() override { return cmdSort; }
     bool Execute() override;
-
-private:
-    bool Sort(std::vector<std::wstring>& lines) const;
 };
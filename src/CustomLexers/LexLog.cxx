@@ -21,16 +21,19 @@
 #include <cassert>
 #include <ctype.h>
 #include <string>
+#include <string_view>
 #include <vector>
-
-#include "StringUtils.h"
+#include <array>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <thread>
 
 #include "ILexer.h"
 #include "Scintilla.h"
 #include "SciLexer.h"
 
 #include "../lexilla/lexlib/LexAccessor.h"
-#include "../lexilla/lexlib/StyleContext.h"
 #include "../lexilla/lexlib/CharacterSet.h"
 #include "../lexilla/lexlib/LexerModule.h"
 #include "../lexilla/lexlib/OptionSet.h"
@@ -71,112 +74,306 @@ enum LogStates
     Error
 };
 
-bool hasTokenAsWord(const std::string& token, const std::string_view& sLine)
+// Styles for each severity are the None styles offset by this many times the severity
+constexpr int severityStyleStep = LogStyles::InfoDefault - LogStyles::Default;
+
+int SeverityOffset(LogStates state)
 {
-    if (auto pos = sLine.find(token); pos != std::string::npos)
+    switch (state)
     {
-        auto boundaryBefore = pos == 0 || !isalpha(sLine[pos - 1]);
-        auto boundaryAfter  = pos == (sLine.size() - token.size()) || !isalpha(sLine[pos + token.size()]);
-        if (boundaryBefore && boundaryAfter)
-            return true;
+        case LogStates::Info:
+            return severityStyleStep;
+        case LogStates::Warn:
+            return 2 * severityStyleStep;
+        case LogStates::Error:
+            return 3 * severityStyleStep;
+        default:
+            return 0;
     }
-    return false;
 }
 
-LogStyles GetLogStyle(LogStyles style, LogStates state)
+// All severity tokens indexed by their first byte so a line is scanned once
+// with a table lookup per byte instead of one search per token.
+class SeverityMatcher
 {
-    switch (style)
+    struct Token
+    {
+        std::string text;
+        LogStates   state;
+    };
+    std::vector<Token>                     tokens;
+    std::array<std::vector<size_t>, 256>   byFirstByte;
+    std::array<unsigned char, 256>         lowerCase{};
+
+public:
+    SeverityMatcher()
+    {
+        for (size_t i = 0; i < lowerCase.size(); ++i)
+            lowerCase[i] = static_cast<unsigned char>(MakeLowerCase(static_cast<int>(i)));
+    }
+
+    void Set(const std::vector<std::string>& debugTokens, const std::vector<std::string>& infoTokens,
+             const std::vector<std::string>& warnTokens, const std::vector<std::string>& errorTokens)
     {
-        case LogStyles::Default:
-            switch (state)
+        tokens.clear();
+        for (auto& indexes : byFirstByte)
+            indexes.clear();
+        // the most severe tokens go first so a line can stop at the first error token
+        for (const auto& [list, state] : {std::make_pair(&errorTokens, LogStates::Error), std::make_pair(&warnTokens, LogStates::Warn),
+                                          std::make_pair(&infoTokens, LogStates::Info), std::make_pair(&debugTokens, LogStates::Debug)})
+        {
+            for (const auto& token : *list)
             {
-                default:
-                case LogStates::None:
-                    return style;
-                case LogStates::Debug:
-                    return style;
-                case LogStates::Info:
-                    return LogStyles::InfoDefault;
-                case LogStates::Warn:
-                    return LogStyles::WarnDefault;
-                case LogStates::Error:
-                    return LogStyles::ErrorDefault;
+                if (token.empty())
+                    continue;
+                const auto first = static_cast<unsigned char>(token[0]);
+                byFirstByte[first].push_back(tokens.size());
+                if (IsLowerCase(first))
+                    byFirstByte[first - 'a' + 'A'].push_back(tokens.size());
+                tokens.push_back({token, state});
             }
-        case LogStyles::Block:
-            switch (state)
+        }
+    }
+
+    // The most severe state of any token found as a whole word in the line
+    LogStates Classify(const char* line, size_t length) const
+    {
+        LogStates result = LogStates::None;
+        if (tokens.empty())
+            return result;
+        for (size_t pos = 0; pos < length; ++pos)
+        {
+            const auto& candidates = byFirstByte[static_cast<unsigned char>(line[pos])];
+            if (candidates.empty())
+                continue;
+            if (pos > 0 && IsUpperOrLowerCase(line[pos - 1]))
+                continue;
+            for (const size_t index : candidates)
             {
-                default:
-                case LogStates::None:
-                    return style;
-                case LogStates::Debug:
-                    return style;
-                case LogStates::Info:
-                    return LogStyles::InfoBlock;
-                case LogStates::Warn:
-                    return LogStyles::WarnBlock;
-                case LogStates::Error:
-                    return LogStyles::ErrorBlock;
+                const auto& token = tokens[index];
+                if (token.state <= result)
+                    break;
+                const size_t tokenEnd = pos + token.text.size();
+                if (tokenEnd > length || (tokenEnd < length && IsUpperOrLowerCase(line[tokenEnd])))
+                    continue;
+                size_t i = 1;
+                while (i < token.text.size() && lowerCase[static_cast<unsigned char>(line[pos + i])] == static_cast<unsigned char>(token.text[i]))
+                    ++i;
+                if (i == token.text.size())
+                {
+                    result = token.state;
+                    if (result == LogStates::Error)
+                        return result;
+                    break;
+                }
             }
-        case LogStyles::String:
-            switch (state)
+        }
+        return result;
+    }
+};
+
+bool IsQuote(int ch)
+{
+    return ch == '\'' || ch == '"';
+}
+
+bool IsNumberChar(int ch, bool isHex)
+{
+    const int lower = MakeLowerCase(ch);
+    if (isHex)
+        return lower == 'x' || lower == 'e' || IsADigit(ch, 16) || ch == '.' || ch == '-' || ch == '+';
+    return lower == 'e' || IsADigit(ch) || ch == '.' || ch == '-' || ch == '+';
+}
+
+bool IsBlockEnd(int bracketStart, int ch)
+{
+    return (bracketStart == '{' && ch == '}') || (bracketStart == '[' && ch == ']') || (bracketStart == '(' && ch == ')');
+}
+
+// Characters that may start a number, string or block: default text between them is skipped
+const std::array<bool, 256> stateStartChars = []() {
+    std::array<bool, 256> chars{};
+    for (const unsigned char ch : std::string_view("0123456789.-+eE'\"{[("))
+        chars[ch] = true;
+    return chars;
+}();
+
+// Styles one line including its line end. Lines are independent: severity is
+// decided by the whole line and strings and blocks end with the line.
+// Runs are found with tight scans and written with memset but produce the same
+// styles as the character by character StyleContext state machine did within a line.
+void StyleLine(const char* line, size_t length, bool hasLineEnd, LogStates severity, char* styles)
+{
+    const int offset       = SeverityOffset(severity);
+    int       state        = LogStyles::Default;
+    size_t    runStart     = 0;
+    bool      numberIsHex  = false;
+    int       bracketStart = 0;
+    // the line end character, which ends strings and blocks, is the last one
+    const size_t lineEnd   = hasLineEnd ? length - 1 : length;
+    auto      charAt       = [line, length](size_t pos) -> int {
+        return pos < length ? static_cast<unsigned char>(line[pos]) : 0;
+    };
+    auto setState = [&](size_t pos, int newState) {
+        const char style = static_cast<char>(state + offset);
+        // most runs are a few characters so avoid a call for them
+        if (pos - runStart < 16)
+        {
+            for (size_t i = runStart; i < pos; ++i)
+                styles[i] = style;
+        }
+        else
+        {
+            memset(styles + runStart, style, pos - runStart);
+        }
+        runStart = pos;
+        state    = newState;
+    };
+
+    size_t pos = 0;
+    while (pos < length)
+    {
+        switch (state)
+        {
+            case LogStyles::Number:
             {
-                default:
-                case LogStates::None:
-                    return style;
-                case LogStates::Debug:
-                    return style;
-                case LogStates::Info:
-                    return LogStyles::InfoString;
-                case LogStates::Warn:
-                    return LogStyles::WarnString;
-                case LogStates::Error:
-                    return LogStyles::ErrorString;
+                const int ch = charAt(pos);
+                if (!IsAlphaNumeric(ch))
+                {
+                    setState(pos, LogStyles::Default);
+                }
+                else if (!IsNumberChar(ch, numberIsHex))
+                {
+                    // not a number after all
+                    numberIsHex = false;
+                    state       = LogStyles::Default;
+                    setState(pos, LogStyles::Default);
+                }
+                else
+                {
+                    ++pos;
+                }
+                break;
             }
-        case LogStyles::Number:
-            switch (state)
+            case LogStyles::String:
+                while (pos < lineEnd && !(IsQuote(line[pos]) && charAt(pos - 1) != '\\'))
+                    ++pos;
+                if (pos < lineEnd)
+                {
+                    setState(++pos, LogStyles::Default);
+                }
+                else if (pos < length)
+                {
+                    // unterminated strings are not highlighted
+                    state = LogStyles::Default;
+                    setState(++pos, LogStyles::Default);
+                }
+                break;
+            case LogStyles::Block:
+                while (pos < lineEnd && !IsBlockEnd(bracketStart, line[pos]))
+                    ++pos;
+                if (pos < lineEnd)
+                    setState(++pos, LogStyles::Default);
+                if (pos == lineEnd && pos < length)
+                {
+                    state = LogStyles::Block;
+                    setState(++pos, LogStyles::Default);
+                }
+                break;
+            default:
             {
-                default:
-                case LogStates::None:
-                    return style;
-                case LogStates::Debug:
-                    return style;
-                case LogStates::Info:
-                    return LogStyles::InfoNumber;
-                case LogStates::Warn:
-                    return LogStyles::WarnNumber;
-                case LogStates::Error:
-                    return LogStyles::ErrorNumber;
+                // Determine if a new state should be entered.
+                while (pos < length && !stateStartChars[static_cast<unsigned char>(line[pos])])
+                    ++pos;
+                if (pos >= length)
+                    break;
+                const int ch     = charAt(pos);
+                const int chNext = charAt(pos + 1);
+                if (!IsAlphaNumeric(charAt(pos - 1)) &&
+                    (IsADigit(ch) ||
+                     (ch == '.' && IsADigit(chNext)) ||
+                     ((ch == '-' || ch == '+') && (IsADigit(chNext) || chNext == '.')) ||
+                     (MakeLowerCase(ch) == 'e' && (IsADigit(chNext) || chNext == '+' || chNext == '-'))))
+                {
+                    if ((ch == '0' && MakeLowerCase(chNext) == 'x') ||
+                        ((ch == '-' || ch == '+') && chNext == '0' && MakeLowerCase(charAt(pos + 2)) == 'x'))
+                    {
+                        numberIsHex = true;
+                    }
+                    setState(pos, LogStyles::Number);
+                }
+                else if (IsQuote(ch))
+                {
+                    setState(pos, LogStyles::String);
+                }
+                else if (ch == '{' || ch == '[' || ch == '(')
+                {
+                    setState(pos, LogStyles::Block);
+                    bracketStart = ch;
+                }
+                ++pos;
+                break;
             }
-        case InfoDefault:
-            break;
-        case InfoBlock:
-            break;
-        case InfoString:
-            break;
-        case InfoNumber:
-            break;
-        case WarnDefault:
-            break;
-        case WarnBlock:
-            break;
-        case WarnString:
-            break;
-        case WarnNumber:
-            break;
-        case ErrorDefault:
-            break;
-        case ErrorBlock:
-            break;
-        case ErrorString:
-            break;
-        case ErrorNumber:
-            break;
-        default:
-            break;
+        }
     }
-    return style;
+    setState(length, state);
+}
+
+bool IsLineEndChar(char ch)
+{
+    return ch == '\r' || ch == '\n';
 }
 
+// Styles the complete lines in [start, end) of text.
+void StyleLines(const SeverityMatcher& matcher, const char* text, size_t start, size_t end, char* styles)
+{
+    size_t lineStart = start;
+    while (lineStart < end)
+    {
+        const char* lineEndChar = std::find_if(text + lineStart, text + end, IsLineEndChar);
+        const size_t contentEnd  = lineEndChar - text;
+        size_t       lineEnd     = contentEnd;
+        if (lineEnd < end)
+        {
+            lineEnd += (text[lineEnd] == '\r' && lineEnd + 1 < end && text[lineEnd + 1] == '\n') ? 2 : 1;
+        }
+        const auto severity = matcher.Classify(text + lineStart, contentEnd - lineStart);
+        StyleLine(text + lineStart, lineEnd - lineStart, lineEnd > contentEnd, severity, styles + lineStart);
+        lineStart = lineEnd;
+    }
+}
+
+// Position after the line end at or after pos.
+size_t NextLineStart(const char* text, size_t pos, size_t end)
+{
+    const char* lineEndChar = std::find_if(text + pos, text + end, IsLineEndChar);
+    size_t      next        = lineEndChar - text;
+    if (next < end)
+        next += (text[next] == '\r' && next + 1 < end && text[next + 1] == '\n') ? 2 : 1;
+    return next;
+}
+
+// Splits text at spaces, tabs and line ends into the non-empty tokens.
+void SplitTokens(std::vector<std::string>& tokens, const std::string& text)
+{
+    tokens.clear();
+    constexpr const char* delimiters = " \t\n";
+    size_t                pos        = text.find_first_not_of(delimiters);
+    while (pos != std::string::npos)
+    {
+        const size_t end = text.find_first_of(delimiters, pos);
+        tokens.push_back(text.substr(pos, end - pos));
+        pos = text.find_first_not_of(delimiters, end);
+    }
+}
+
+// Text is fetched and styled in blocks of about this size so memory stays bounded
+constexpr Sci_Position lexBlockSize = 0x400000;
+// Each thread styles at least this much text: styling 1 MB takes several milliseconds,
+// far more than starting a thread, and most Lex calls are for a screen of text
+// or a few typed lines so they run on the calling thread
+constexpr size_t parallelPartMinimum = 0x100000;
+
 } // namespace
 
 struct OptionsSimple
@@ -206,6 +403,7 @@ class LexerLog : public DefaultLexer
 {
     OptionsSimple   options;
     OptionSetSimple osSimple;
+    SeverityMatcher matcher;
 
 public:
     LexerLog()
@@ -281,183 +479,73 @@ Sci_Position SCI_METHOD LexerLog::PropertySet(const char* key, const char* val)
         if (strcmp(key, "debugstrings") == 0)
         {
             std::transform(options.debugstrings.begin(), options.debugstrings.end(), options.debugstrings.begin(), [](char c) { return static_cast<char>(::tolower(c)); });
-            stringtok(options.debugTokens, options.debugstrings, true, " \t\n", false);
+            SplitTokens(options.debugTokens, options.debugstrings);
         }
         if (strcmp(key, "infostrings") == 0)
         {
             std::transform(options.infostrings.begin(), options.infostrings.end(), options.infostrings.begin(), [](char c) { return static_cast<char>(::tolower(c)); });
-            stringtok(options.infoTokens, options.infostrings, true, " \t\n", false);
+            SplitTokens(options.infoTokens, options.infostrings);
         }
         if (strcmp(key, "warnstrings") == 0)
         {
             std::transform(options.warnstrings.begin(), options.warnstrings.end(), options.warnstrings.begin(), [](char c) { return static_cast<char>(::tolower(c)); });
-            stringtok(options.warnTokens, options.warnstrings, true, " \t\n", false);
+            SplitTokens(options.warnTokens, options.warnstrings);
         }
         if (strcmp(key, "errorstrings") == 0)
         {
             std::transform(options.errorstrings.begin(), options.errorstrings.end(), options.errorstrings.begin(), [](char c) { return static_cast<char>(::tolower(c)); });
-            stringtok(options.errorTokens, options.errorstrings, true, " \t\n", false);
+            SplitTokens(options.errorTokens, options.errorstrings);
         }
+        matcher.Set(options.debugTokens, options.infoTokens, options.warnTokens, options.errorTokens);
 
         return 0;
     }
     return -1;
 }
 
-void SCI_METHOD LexerLog::Lex(Sci_PositionU startPos, Sci_Position length, int initStyle, IDocument* pAccess)
+void SCI_METHOD LexerLog::Lex(Sci_PositionU startPos, Sci_Position length, int /*initStyle*/, IDocument* pAccess)
 {
-    bool   numberIsHex = false;
-    size_t lineSize    = 1000;
-    auto   line        = std::make_unique<char[]>(lineSize);
-
-    LexAccessor  styler(pAccess);
-    StyleContext sc(startPos, length, initStyle, styler);
-
-    int       bracketStart = 0;
-    LogStates logState     = LogStates::None;
-    for (; sc.More(); sc.Forward())
+    // Log lines carry no state between them, so each block of lines is classified
+    // and styled independently, in parallel for big blocks, and written with one SetStyles call.
+    const Sci_Position endPos     = static_cast<Sci_Position>(startPos) + length;
+    Sci_Position       blockStart = static_cast<Sci_Position>(startPos);
+    std::string        text;
+    std::string        styles;
+    while (blockStart < endPos)
     {
-        if (sc.atLineStart)
+        const Sci_Position blockTarget = std::min<Sci_Position>(blockStart + lexBlockSize, endPos);
+        // fetch complete lines so the last line is classified with all its text
+        const Sci_Position textEnd     = pAccess->LineStart(pAccess->LineFromPosition(blockTarget - 1) + 1);
+        const Sci_Position blockEnd    = std::min<Sci_Position>(textEnd, endPos);
+        text.resize(textEnd - blockStart);
+        styles.resize(text.size());
+        pAccess->GetCharRange(text.data(), blockStart, textEnd - blockStart);
+
+        const size_t   textLength = text.size();
+        const unsigned threads    = static_cast<unsigned>((std::min)({static_cast<size_t>(std::thread::hardware_concurrency()), size_t(8), textLength / parallelPartMinimum}));
+        if (threads > 1)
         {
-            logState     = LogStates::None;
-            auto lineEnd = pAccess->LineEnd(sc.currentLine);
-            auto lineLen = lineEnd - sc.currentPos + 2;
-            if (lineSize < lineLen)
-            {
-                lineSize = lineLen + 200;
-                line     = std::make_unique<char[]>(lineSize);
-            }
-            pAccess->GetCharRange(line.get(), sc.currentPos, lineEnd - sc.currentPos);
-            for (size_t i = 0; i < lineLen; ++i)
-                line[i] = ::tolower(line[i]);
-            std::string_view sLine(line.get(), lineEnd - sc.currentPos + 2);
-            for (const auto& token : options.debugTokens)
-            {
-                if (hasTokenAsWord(token, sLine))
-                    logState = LogStates::Debug;
-            }
-            for (const auto& token : options.infoTokens)
-            {
-                if (hasTokenAsWord(token, sLine))
-                    logState = LogStates::Info;
-            }
-            for (const auto& token : options.warnTokens)
-            {
-                if (hasTokenAsWord(token, sLine))
-                    logState = LogStates::Warn;
-            }
-            for (const auto& token : options.errorTokens)
+            std::vector<std::thread> workers;
+            size_t                   partStart = 0;
+            for (unsigned part = 1; part < threads && partStart < textLength; ++part)
             {
-                if (hasTokenAsWord(token, sLine))
-                    logState = LogStates::Error;
+                const size_t partEnd = NextLineStart(text.data(), std::max<size_t>(textLength * part / threads, partStart), textLength);
+                workers.emplace_back(StyleLines, std::cref(matcher), text.data(), partStart, partEnd, styles.data());
+                partStart = partEnd;
             }
-            sc.SetState(GetLogStyle(LogStyles::Default, logState));
+            StyleLines(matcher, text.data(), partStart, textLength, styles.data());
+            for (auto& worker : workers)
+                worker.join();
         }
-        // Determine if the current state should terminate.
-        switch (sc.state)
+        else
         {
-            case LogStyles::Number:
-            case LogStyles::InfoNumber:
-            case LogStyles::WarnNumber:
-            case LogStyles::ErrorNumber:
-                if (!IsAlphaNumeric(sc.ch))
-                {
-                    sc.SetState(GetLogStyle(LogStyles::Default, logState));
-                }
-                else if ((numberIsHex && !(MakeLowerCase(sc.ch) == 'x' || MakeLowerCase(sc.ch) == 'e' ||
-                                           IsADigit(sc.ch, 16) || sc.ch == '.' || sc.ch == '-' || sc.ch == '+')) ||
-                         (!numberIsHex && !(MakeLowerCase(sc.ch) == 'e' || IsADigit(sc.ch) || sc.ch == '.' || sc.ch == '-' || sc.ch == '+')))
-                {
-                    // check '-' for possible -10e-5. Add '+' as well.
-                    numberIsHex    = false;
-                    auto baseStyle = GetLogStyle(LogStyles::Default, logState);
-                    sc.ChangeState(baseStyle);
-                    sc.SetState(baseStyle);
-                }
-                break;
-            case LogStyles::String:
-            case LogStyles::InfoString:
-            case LogStyles::WarnString:
-            case LogStyles::ErrorString:
-                if ((sc.ch == '\'' || sc.ch == '"') && sc.chPrev != '\\')
-                {
-                    sc.ForwardSetState(GetLogStyle(LogStyles::Default, logState));
-                }
-                else if (sc.atLineEnd)
-                {
-                    sc.ChangeState(GetLogStyle(LogStyles::Default, logState));
-                    sc.ForwardSetState(GetLogStyle(LogStyles::Default, logState));
-                }
-                break;
-            case LogStyles::Block:
-            case LogStyles::InfoBlock:
-            case LogStyles::WarnBlock:
-            case LogStyles::ErrorBlock:
-                switch (bracketStart)
-                {
-                    case '{':
-                        if (sc.ch == '}')
-                            sc.ForwardSetState(GetLogStyle(LogStyles::Default, logState));
-                        break;
-                    case '[':
-                        if (sc.ch == ']')
-                            sc.ForwardSetState(GetLogStyle(LogStyles::Default, logState));
-                        break;
-                    case '(':
-                        if (sc.ch == ')')
-                            sc.ForwardSetState(GetLogStyle(LogStyles::Default, logState));
-                        break;
-                    default:
-                        break;
-                }
-                if (sc.atLineEnd)
-                {
-                    sc.ChangeState(GetLogStyle(LogStyles::Block, logState));
-                    sc.ForwardSetState(GetLogStyle(LogStyles::Default, logState));
-                }
-                break;
-            default:
-                break;
-        }
-
-        // Determine if a new state should be entered.
-        if ((sc.state == LogStyles::Default) ||
-            (sc.state == LogStyles::InfoDefault) ||
-            (sc.state == LogStyles::WarnDefault) ||
-            (sc.state == LogStyles::ErrorDefault))
-        {
-            if (!IsAlphaNumeric(sc.chPrev) &&
-                (IsADigit(sc.ch) ||
-                 (sc.ch == '.' && IsADigit(sc.chNext)) ||
-                 ((sc.ch == '-' || sc.ch == '+') && (IsADigit(sc.chNext) || sc.chNext == '.')) ||
-                 (MakeLowerCase(sc.ch) == 'e' && (IsADigit(sc.chNext) || sc.chNext == '+' || sc.chNext == '-'))))
-            {
-                if ((sc.ch == '0' && MakeLowerCase(sc.chNext) == 'x') ||
-                    ((sc.ch == '-' || sc.ch == '+') && sc.chNext == '0' && MakeLowerCase(sc.GetRelative(2)) == 'x'))
-                {
-                    numberIsHex = true;
-                }
-                sc.SetState(GetLogStyle(LogStyles::Number, logState));
-            }
-            else if (sc.ch == '\'' || sc.ch == '"')
-            {
-                sc.SetState(GetLogStyle(LogStyles::String, logState));
-            }
-            else if (sc.ch == '{' || sc.ch == '[' || sc.ch == '(')
-            {
-                sc.SetState(GetLogStyle(LogStyles::Block, logState));
-                bracketStart = sc.ch;
-            }
+            StyleLines(matcher, text.data(), 0, textLength, styles.data());
         }
 
-        if (sc.atLineEnd)
-        {
-            // Reset states to begining of colourise so no surprises
-            // if different sets of lines lexed.
-            numberIsHex = false;
-        }
+        pAccess->StartStyling(blockStart);
+        pAccess->SetStyles(blockEnd - blockStart, styles.data());
+        blockStart = blockEnd;
     }
-    sc.Complete();
 }
 
 void SCI_METHOD LexerLog::Fold(Sci_PositionU /*startPos*/, Sci_Position /*length*/, int /*initStyle*/, IDocument* /*pAccess*/)
@@ -83,6 +83,7 @@ public:
         , m_bIsReadonly(false)
         , m_bIsWriteProtected(false)
         , m_bDoSaveAs(false)
+        , m_bSavePointOnDisk(false)
         , m_tabSpace(TabSpace::Default)
         , m_readDir(Scintilla::Bidirectional::Disabled)
     {
@@ -110,7 +111,8 @@ public:
     bool                     m_bNeedsSaving;
     bool                     m_bIsReadonly;
     bool                     m_bIsWriteProtected;
-    bool                     m_bDoSaveAs; ///< even if m_path is set, always ask where to save
+    bool                     m_bDoSaveAs;        ///< even if m_path is set, always ask where to save
+    bool                     m_bSavePointOnDisk; ///< the file at m_path holds the text at the save point
     FILETIME                 m_lastWriteTime;
     CPosData                 m_position;
     TabSpace                 m_tabSpace;
@@ -19,6 +19,7 @@
 #include "DocumentManager.h"
 #include "SmartHandle.h"
 #include "UnicodeUtils.h"
+#include "EncodingDetect.h"
 #include "SysInfo.h"
 #include "StringUtils.h"
 #include "PathUtils.h"
@@ -27,11 +28,13 @@
 #include "OnOutOfScope.h"
 #include "ILoader.h"
 #include "ResString.h"
+#include "IncrementalSave.h"
 #include "../ext/sktoolslib/FormatMessageWrapper.h"
+#include "../ext/scintilla/src/UniTranscode.h"
 #include <stdexcept>
+#include <future>
+#include <string_view>
 #include <Shobjidl.h>
-#include <mlang.h>
-#include <wrl/client.h>
 
 #include "../ext/compact_enc_det/compact_enc_det/compact_enc_det.h"
 #include "../ext/compact_enc_det/util/encodings/encodings.pb.h"
@@ -41,127 +44,16 @@
 
 namespace
 {
-struct ICaseComp
-{
-    bool operator()(const std::string& lhs, const std::string& rhs) const
-    {
-        return _stricmp(lhs.c_str(), rhs.c_str()) < 0;
-    }
-};
-std::map<std::string, int, ICaseComp> encodings = {
-    {"csISOLatin1 ", 28591},
-    {"l1", 28591},
-    {"latin3", 28593},
-    {"csISOLatin3", 28593},
-    {"iso-ir-109", 28593},
-    {"l3", 28593},
-    {"ISO-8859-13", 28603},
-    {"ISO-8859-13", 28603},
-    {"iso-celtic", 28604},
-    {"latin8", 28604},
-    {"ISO_8859-14", 28604},
-    {"ISO-8859-14", 28604},
-    {"18", 28604},
-    {"iso-ir-199", 28604},
-    {"Latin-9", 28605},
-    {"ISO_8859-15", 28605},
-    {"ISO-8859-15", 28605},
-    {"IBM437", 437},
-    {"cp437", 437},
-    {"437", 437},
-    {"csPC8CodePage437", 437},
-    {"IBM720", 720},
-    {"cp720", 720},
-    {"oem720", 720},
-    {"720", 720},
-    {"IBM737", 737},
-    {"cp737", 737},
-    {"oem737", 737},
-    {"737", 737},
-    {"IBM775", 775},
-    {"cp775", 775},
-    {"oem775", 775},
-    {"775", 775},
-    {"IBM850", 850},
-    {"cp850", 850},
-    {"oem850", 850},
-    {"850", 850},
-    {"oem852", 852},
-    {"852", 852},
-    {"IBM855", 855},
-    {"cp855", 855},
-    {"oem855", 855},
-    {"855", 855},
-    {"csIBM855", 855},
-    {"IBM857", 857},
-    {"cp857", 857},
-    {"oem857", 857},
-    {"857", 857},
-    {"IBM858", 858},
-    {"cp858", 858},
-    {"oem858", 858},
-    {"858", 858},
-    {"IBM860", 860},
-    {"cp860", 860},
-    {"oem860", 860},
-    {"860", 860},
-    {"IBM861", 861},
-    {"cp861", 861},
-    {"oem861", 861},
-    {"861", 861},
-    {"IBM862", 862},
-    {"cp862", 862},
-    {"oem862", 862},
-    {"862", 862},
-    {"IBM863", 863},
-    {"cp863", 863},
-    {"oem863", 863},
-    {"863", 863},
-    {"IBM865", 865},
-    {"cp865", 865},
-    {"oem865", 865},
-    {"865", 865},
-    {"oem866", 866},
-    {"866", 866},
-    {"IBM869", 869},
-    {"cp869", 869},
-    {"oem869", 869},
-    {"869", 869},
-    {"gb18030", 936},
-    {"windows-949", 949},
-    {"csEUCKR", 51949},
-    {"tis-620", 874},
-    {"x-mac-cyrillic", 10007},
-    {"xmaccyrillic", 10007},
-    {"koi8_u", 21866},
-    {"koi8_r", 20866}};
+using Scintilla::Internal::ByteOrder;
+using Scintilla::Internal::UTF16BytesFromUTF8;
+using Scintilla::Internal::UTF16BytesMaxFromUTF8;
+using Scintilla::Internal::UTF32BytesFromUTF8;
+using Scintilla::Internal::UTF32BytesMaxFromUTF8;
+using Scintilla::Internal::UTF8FromUTF16Bytes;
+using Scintilla::Internal::UTF8FromUTF32Bytes;
 
 CDocument g_emptyDoc;
 
-wchar_t   WideCharSwap(wchar_t nValue)
-{
-    return (((nValue >> 8)) | (nValue << 8));
-}
-
-UINT64 WordSwapBytes(UINT64 nValue)
-{
-    return ((nValue & 0xff00ff00ff00ff) << 8) | ((nValue >> 8) & 0xff00ff00ff00ff); // swap BYTESs in WORDs
-}
-
-UINT32 DwordSwapBytes(UINT32 nValue)
-{
-    UINT32 nRet = (nValue << 16) | (nValue >> 16);                     // swap WORDs
-    nRet        = ((nRet & 0xff00ff) << 8) | ((nRet >> 8) & 0xff00ff); // swap BYTESs in WORDs
-    return nRet;
-}
-
-UINT64 DwordSwapBytes(UINT64 nValue)
-{
-    UINT64 nRet = ((nValue & 0xffff0000ffffL) << 16) | ((nValue >> 16) & 0xffff0000ffffL); // swap WORDs in DWORDs
-    nRet        = ((nRet & 0xff00ff00ff00ff) << 8) | ((nRet >> 8) & 0xff00ff00ff00ff);     // swap BYTESs in WORDs
-    return nRet;
-}
-
 EOLFormat SenseEOLFormat(const char* data, DWORD len)
 {
     for (size_t i = 0; i < len; i++)
@@ -212,112 +104,32 @@ void LoadSomeUtf8(Scintilla::ILoader& edit, bool hasBOM, bool bFirst, DWORD& len
         lenFile += 3;
 }
 
-void loadSomeUtf16Le(Scintilla::ILoader& edit, bool hasBOM, bool bFirst, DWORD& lenFile,
-                     char* data, char* charBuf, int charBufSize, wchar_t* wideBuf, EOLFormat& eolFormat, TabSpace& tabSpace)
+void LoadSomeUtf16Or32(Scintilla::ILoader& edit, int encoding, bool hasBOM, bool bFirst, bool bLast, DWORD& lenFile,
+                       int& incompleteMultiByteChar, char* data, char* charBuf, EOLFormat& eolFormat, TabSpace& tabSpace)
 {
-    char* pData = data;
+    const bool  utf32  = encoding == 12000 || encoding == 12001;
+    const auto  order  = (encoding == 1201 || encoding == 12001) ? ByteOrder::BigEndian : ByteOrder::LittleEndian;
+    const DWORD bomLen = utf32 ? 4 : 2;
+    char*       pData  = data;
     if (bFirst && hasBOM)
     {
-        pData += 2;
-        lenFile -= 2;
+        pData += bomLen;
+        lenFile -= bomLen;
     }
-    memcpy(wideBuf, pData, lenFile);
-    int charLen = WideCharToMultiByte(CP_UTF8, 0, wideBuf, lenFile / 2, charBuf, charBufSize, nullptr, nullptr);
+    // the transcoders swap bytes on the fly; a code unit or surrogate pair cut
+    // by the end of the block is left for the next block
+    const std::string_view input(pData, lenFile);
+    const auto             converted = utf32 ? UTF8FromUTF32Bytes(input, order, bLast, charBuf)
+                                             : UTF8FromUTF16Bytes(input, order, bLast, charBuf);
+    incompleteMultiByteChar          = static_cast<int>(lenFile - converted.consumed);
+    const auto charLen               = static_cast<DWORD>(converted.written);
     if (eolFormat == EOLFormat::Unknown_Format)
         eolFormat = SenseEOLFormat(charBuf, charLen);
     if (tabSpace != TabSpace::Tabs)
         CheckForTabs(charBuf, charLen, tabSpace);
     edit.AddData(charBuf, charLen);
     if (bFirst && hasBOM)
-        lenFile += 2;
-}
-
-void loadSomeUtf16Be(Scintilla::ILoader& edit, bool hasBOM, bool bFirst, DWORD& lenFile,
-                     char* data, char* charBuf, int charBufSize, wchar_t* wideBuf, EOLFormat& eolFormat, TabSpace& tabSpace)
-{
-    char* pData = data;
-    if (bFirst && hasBOM)
-    {
-        pData += 2;
-        lenFile -= 2;
-    }
-    memcpy(wideBuf, pData, lenFile);
-    // make in place WORD BYTEs swap
-    UINT64* pQw     = reinterpret_cast<UINT64*>(wideBuf);
-    int     nQWords = lenFile / 8;
-    for (int nQWord = 0; nQWord < nQWords; nQWord++)
-        pQw[nQWord] = WordSwapBytes(pQw[nQWord]);
-
-    wchar_t* pW     = reinterpret_cast<wchar_t*>(pQw);
-    int      nWords = lenFile / 2;
-    for (int nWord = nQWords * 4; nWord < nWords; nWord++)
-        pW[nWord] = WideCharSwap(pW[nWord]);
-
-    int charLen = WideCharToMultiByte(CP_UTF8, 0, wideBuf, lenFile / 2, charBuf, charBufSize, nullptr, nullptr);
-    if (eolFormat == EOLFormat::Unknown_Format)
-        eolFormat = SenseEOLFormat(charBuf, charLen);
-    if (tabSpace != TabSpace::Tabs)
-        CheckForTabs(charBuf, charLen, tabSpace);
-    edit.AddData(charBuf, charLen);
-    if (bFirst && hasBOM)
-        lenFile += 2;
-}
-
-void loadSomeUtf32Be(DWORD lenFile, char* data)
-{
-    UINT64* p64     = reinterpret_cast<UINT64*>(data);
-    int     nQWords = lenFile / 8;
-    for (int nQWord = 0; nQWord < nQWords; nQWord++)
-        p64[nQWord] = DwordSwapBytes(p64[nQWord]);
-
-    UINT32* p32     = reinterpret_cast<UINT32*>(p64);
-    int     nDWords = lenFile / 4;
-    for (int nDword = nQWords * 2; nDword < nDWords; nDword++)
-        p32[nDword] = DwordSwapBytes(p32[nDword]);
-}
-
-void loadSomeUtf32Le(Scintilla::ILoader& edit, bool hasBOM, bool bFirst, DWORD& lenFile,
-                     char* data, char* charBuf, int charBufSize, wchar_t* wideBuf, EOLFormat& eolFormat, TabSpace& tabSpace)
-{
-    char* pData = data;
-    if (bFirst && hasBOM)
-    {
-        pData += 4;
-        lenFile -= 4;
-    }
-    // UTF32 have four bytes per char
-    int      nReadChars = lenFile / 4;
-    UINT32*  p32        = reinterpret_cast<UINT32*>(pData);
-
-    // fill buffer
-    wchar_t* pOut       = static_cast<wchar_t*>(wideBuf);
-    for (int i = 0; i < nReadChars; ++i, ++pOut)
-    {
-        UINT32 zChar = p32[i];
-        if (zChar >= 0x110000)
-        {
-            *pOut = 0xfffd; // ? mark
-        }
-        else if (zChar >= 0x10000)
-        {
-            zChar -= 0x10000;
-            pOut[0] = ((zChar >> 10) & 0x3ff) | 0xd800; // lead surrogate
-            pOut[1] = (zChar & 0x7ff) | 0xdc00;         // trail surrogate
-            pOut++;
-        }
-        else
-        {
-            *pOut = static_cast<wchar_t>(zChar);
-        }
-    }
-    int charLen = WideCharToMultiByte(CP_UTF8, 0, wideBuf, nReadChars, charBuf, charBufSize, nullptr, nullptr);
-    if (eolFormat == EOLFormat::Unknown_Format)
-        eolFormat = SenseEOLFormat(charBuf, charLen);
-    if (tabSpace != TabSpace::Tabs)
-        CheckForTabs(charBuf, charLen, tabSpace);
-    edit.AddData(charBuf, charLen);
-    if (bFirst && hasBOM)
-        lenFile += 4;
+        lenFile += bomLen;
 }
 
 void LoadSomeOther(Scintilla::ILoader& edit, int encoding, DWORD lenFile,
@@ -570,6 +382,7 @@ CDocument CDocumentManager::LoadFile(/*HWND hWnd,*/ const std::wstring& path, in
     doc.m_bIsReadonly                    = (fi.dwFileAttributes & (FILE_ATTRIBUTE_HIDDEN | FILE_ATTRIBUTE_READONLY | FILE_ATTRIBUTE_SYSTEM)) != 0;
     doc.m_lastWriteTime                  = fi.ftLastWriteTime;
     doc.m_path                           = path;
+    doc.m_bSavePointOnDisk               = true;
     unsigned __int64 fileSize            = static_cast<__int64>(fi.nFileSizeHigh) << 32 | fi.nFileSizeLow;
     // add more room for Scintilla (usually 1/6 more for editing)
     unsigned __int64 bufferSizeRequested = fileSize + min(1 << 20, fileSize / 6);
@@ -588,8 +401,9 @@ CDocument CDocumentManager::LoadFile(/*HWND hWnd,*/ const std::wstring& path, in
     m_scratchScintilla.Scintilla().ClearAll();
     m_scratchScintilla.Scintilla().SetCodePage(CP_UTF8);
     Scintilla::DocumentOption docOptions = Scintilla::DocumentOption::Default;
+    // huge files only keep styles around the visible text so they can still be lexed
     if (bufferSizeRequested > INT_MAX)
-        docOptions = Scintilla::DocumentOption::TextLarge | Scintilla::DocumentOption::StylesNone;
+        docOptions = Scintilla::DocumentOption::TextLarge | Scintilla::DocumentOption::StylesWindowed;
     Scintilla::ILoader* pdocLoad = static_cast<Scintilla::ILoader*>(m_scratchScintilla.Scintilla().CreateLoader(static_cast<uptr_t>(bufferSizeRequested), docOptions));
     if (pdocLoad == nullptr)
     {
@@ -624,7 +438,16 @@ CDocument CDocumentManager::LoadFile(/*HWND hWnd,*/ const std::wstring& path, in
                     encoding = CP_UTF8;
                 if (useCed)
                 {
-                    int  bytesConsumed = 0;
+                    // look at stripes from the start, middle and end of the block
+                    // instead of all of it, and stop as soon as the result is clear
+                    static const CompactEncDet::DetectEncodingOptions cedOptions = []() {
+                        CompactEncDet::DetectEncodingOptions options;
+                        options.sample_max_kb         = 256;
+                        options.sample_strategy       = CompactEncDet::SAMPLE_STRIPES;
+                        options.early_exit_difference = 2 * options.reliable_difference;
+                        return options;
+                    }();
+                    static thread_local CompactEncDet::DetectEncodingContext cedContext;
                     bool isReliable = false;
                     auto enc = CompactEncDet::DetectEncoding(m_data + incompleteMultiByteChar,
                         lenFile - incompleteMultiByteChar,
@@ -633,27 +456,14 @@ CDocument CDocumentManager::LoadFile(/*HWND hWnd,*/ const std::wstring& path, in
                         Language::UNKNOWN_LANGUAGE,
                         CompactEncDet::WEB_CORPUS,
                         true,
-                        &bytesConsumed,
+                        cedOptions,
+                        &cedContext,
+                        nullptr,
                         &isReliable);
-                    auto charset = MimeEncodingName(enc);
                     if (isReliable || !ignoreUnreliable)
                     {
-                        Microsoft::WRL::ComPtr<IMultiLanguage> ml;
-                        if (SUCCEEDED(CoCreateInstance(CLSID_CMultiLanguage, nullptr,
-                            CLSCTX_ALL,
-                            IID_IMultiLanguage, (void**)&ml)))
-                        {
-                            MIMECSETINFO charsetInfo{};
-                            _bstr_t      wCs = CUnicodeUtils::StdGetUnicode(charset).c_str();
-                            if (SUCCEEDED(ml->GetCharsetInfo(wCs, &charsetInfo)))
-                            {
-                                encoding = charsetInfo.uiInternetEncoding;
-                            }
-                            else if (encodings.contains(charset))
-                            {
-                                encoding = encodings.at(charset);
-                            }
-                        }
+                        if (int cp = CodepageFromCharset(MimeEncodingName(enc)); cp != 0)
+                            encoding = cp;
                     }
                 }
             }
@@ -668,17 +478,11 @@ CDocument CDocumentManager::LoadFile(/*HWND hWnd,*/ const std::wstring& path, in
             case CP_UTF8:
                 LoadSomeUtf8(edit, doc.m_bHasBOM, bFirst, lenFile, m_data, doc.m_format, doc.m_tabSpace);
                 break;
-            case 1200: // UTF16_LE
-                loadSomeUtf16Le(edit, doc.m_bHasBOM, bFirst, lenFile, m_data, m_charBuf.get(), m_charBufSize, m_wideBuf.get(), doc.m_format, doc.m_tabSpace);
-                break;
-            case 1201: // UTF16_BE
-                loadSomeUtf16Be(edit, doc.m_bHasBOM, bFirst, lenFile, m_data, m_charBuf.get(), m_charBufSize, m_wideBuf.get(), doc.m_format, doc.m_tabSpace);
-                break;
-            case 12001:                           // UTF32_BE
-                loadSomeUtf32Be(lenFile, m_data); // Doesn't load, falls through to load.
-                [[fallthrough]];
+            case 1200:  // UTF16_LE
+            case 1201:  // UTF16_BE
             case 12000: // UTF32_LE
-                loadSomeUtf32Le(edit, doc.m_bHasBOM, bFirst, lenFile, m_data, m_charBuf.get(), m_charBufSize, m_wideBuf.get(), doc.m_format, doc.m_tabSpace);
+            case 12001: // UTF32_BE
+                LoadSomeUtf16Or32(edit, encoding, doc.m_bHasBOM, bFirst, lenFile < ReadBlockSize, lenFile, incompleteMultiByteChar, m_data, m_charBuf.get(), doc.m_format, doc.m_tabSpace);
                 break;
             default:
                 LoadSomeOther(edit, encoding, lenFile, incompleteMultiByteChar, m_data, m_charBuf.get(), m_charBufSize, m_wideBuf.get(), doc.m_format, doc.m_tabSpace);
@@ -712,10 +516,140 @@ CDocument CDocumentManager::LoadFile(/*HWND hWnd,*/ const std::wstring& path, in
     return doc;
 }
 
-static bool SaveAsUtf16(const CDocument& doc, char* buf, size_t lengthDoc, CAutoFile& hFile, std::wstring& err)
+// The document text as the two segments either side of the Scintilla gap.
+// Saving from these avoids CharacterPointer(), which moves the gap to the end.
+struct TextSegments
+{
+    const char* segment1 = nullptr;
+    size_t      length1  = 0;
+    const char* segment2 = nullptr;
+    size_t      length2  = 0;
+};
+
+// Calls fn for blocks of at most WriteBlockSize bytes that end on character boundaries.
+// A character cut in two by the gap is copied into a small block of its own.
+template <typename Fn>
+static bool ForEachTextBlock(const TextSegments& text, Fn&& fn)
+{
+    auto forRange = [&](const char* range, size_t length) {
+        while (length > 0)
+        {
+            int blockLen = static_cast<int>(min(static_cast<size_t>(WriteBlockSize), length));
+            if (static_cast<size_t>(blockLen) < length)
+            {
+                // range[blockLen] is inside the range, so this may look at it
+                if (int charStart = UTF8Helper::characterStart(range, blockLen); charStart > 0)
+                    blockLen = charStart;
+            }
+            if (!fn(range, static_cast<size_t>(blockLen)))
+                return false;
+            range += blockLen;
+            length -= blockLen;
+        }
+        return true;
+    };
+
+    size_t tail1     = 0; // start of a character at the end of segment1
+    size_t head2     = 0; // its continuation bytes at the start of segment2
+    char   stitch[8] = {};
+    while (head2 < min(text.length2, static_cast<size_t>(3)) && UTF8Helper::isContinuation(text.segment2[head2]))
+        ++head2;
+    if (head2 > 0)
+    {
+        while (tail1 < min(text.length1, static_cast<size_t>(3)) && UTF8Helper::isContinuation(text.segment1[text.length1 - 1 - tail1]))
+            ++tail1;
+        if (tail1 < text.length1)
+            ++tail1; // the lead byte
+        else
+            tail1 = 0;
+        if (tail1 > 0)
+            memcpy(stitch, text.segment1 + text.length1 - tail1, tail1);
+        memcpy(stitch + tail1, text.segment2, head2);
+    }
+    return forRange(text.segment1, text.length1 - tail1) &&
+           forRange(stitch, tail1 + head2) &&
+           forRange(text.segment2 + head2, text.length2 - head2);
+}
+
+// Returns ERROR_SUCCESS or the error of the failed WriteFile
+static DWORD WriteAll(HANDLE hFile, const char* data, size_t length)
+{
+    constexpr size_t maxWriteLen = 64 * 1024 * 1024;
+    while (length > 0)
+    {
+        DWORD writeLen     = static_cast<DWORD>(min(maxWriteLen, length));
+        DWORD bytesWritten = 0;
+        if (!WriteFile(hFile, data, writeLen, &bytesWritten, nullptr))
+            return GetLastError();
+        if (bytesWritten != writeLen)
+            return ERROR_WRITE_FAULT;
+        data += writeLen;
+        length -= writeLen;
+    }
+    return ERROR_SUCCESS;
+}
+
+// Two output buffers used in turn: while one is written to the file on a worker
+// thread, the next block is converted into the other.
+class CDoubleBufferedWriter
+{
+public:
+    CDoubleBufferedWriter(HANDLE hFile, size_t bufferSize)
+        : m_hFile(hFile)
+    {
+        m_buffers[0] = std::make_unique<char[]>(bufferSize);
+        m_buffers[1] = std::make_unique<char[]>(bufferSize);
+    }
+    ~CDoubleBufferedWriter()
+    {
+        Finish();
+    }
+
+    char* Buffer() const { return m_buffers[m_current].get(); }
+
+    // starts writing the first length bytes of Buffer() and switches to the other buffer
+    bool Commit(size_t length)
+    {
+        if (!Finish())
+            return false;
+        m_pending = std::async(std::launch::async, WriteAll, m_hFile, Buffer(), length);
+        m_current ^= 1;
+        return true;
+    }
+
+    // waits for the last write; false if any write failed
+    bool Finish()
+    {
+        if (m_pending.valid())
+        {
+            DWORD error = m_pending.get();
+            if (m_error == ERROR_SUCCESS)
+                m_error = error;
+        }
+        return m_error == ERROR_SUCCESS;
+    }
+
+    DWORD Error() const { return m_error; }
+
+private:
+    HANDLE                  m_hFile;
+    std::unique_ptr<char[]> m_buffers[2];
+    int                     m_current = 0;
+    std::future<DWORD>      m_pending;
+    DWORD                   m_error = ERROR_SUCCESS;
+};
+
+static bool FinishWriting(CDoubleBufferedWriter& writer, bool ok, std::wstring& err)
+{
+    if (writer.Finish() && ok)
+        return true;
+    CFormatMessageWrapper errMsg(writer.Error());
+    err = errMsg.c_str();
+    return false;
+}
+
+static bool SaveAsUtf16(const CDocument& doc, const TextSegments& text, CAutoFile& hFile, std::wstring& err)
 {
-    constexpr int writeWideBufSize = WriteBlockSize * 2;
-    auto          wideBuf          = std::make_unique<wchar_t[]>(writeWideBufSize);
     err.clear();
     DWORD bytesWritten = 0;
 
@@ -741,43 +675,21 @@ static bool SaveAsUtf16(const CDocument& doc, char* buf, size_t lengthDoc, CAuto
             return false;
         }
     }
-    char* writeBuf = buf;
-    do
-    {
-        int charStart = UTF8Helper::characterStart(writeBuf, static_cast<int>(min(WriteBlockSize, lengthDoc)));
-        int wideLen   = MultiByteToWideChar(CP_UTF8, 0, writeBuf, charStart, wideBuf.get(), writeWideBufSize);
-        if (encoding == 1201)
-        {
-            UINT64* pQw     = reinterpret_cast<UINT64*>(wideBuf.get());
-            int     nQWords = wideLen / 4;
-            for (int nQWord = 0; nQWord < nQWords; nQWord++)
-                pQw[nQWord] = WordSwapBytes(pQw[nQWord]);
-            auto* pW     = reinterpret_cast<wchar_t*>(pQw);
-            int   nWords = wideLen;
-            for (int nWord = nQWords * 4; nWord < nWords; nWord++)
-                pW[nWord] = WideCharSwap(pW[nWord]);
-        }
-        if (!WriteFile(hFile, wideBuf.get(), wideLen * 2, &bytesWritten, nullptr) || wideLen != static_cast<int>(bytesWritten / 2))
-        {
-            CFormatMessageWrapper errMsg;
-            err = errMsg.c_str();
-            return false;
-        }
-        writeBuf += charStart;
-        lengthDoc -= charStart;
-    } while (lengthDoc > 0);
-    return true;
+    const auto            order = encoding == 1201 ? ByteOrder::BigEndian : ByteOrder::LittleEndian;
+    CDoubleBufferedWriter writer(hFile, UTF16BytesMaxFromUTF8(WriteBlockSize));
+    bool                  ok = ForEachTextBlock(text, [&](const char* block, size_t length) {
+        auto converted = UTF16BytesFromUTF8(std::string_view(block, length), order, true, writer.Buffer());
+        return writer.Commit(converted.written);
+    });
+    return FinishWriting(writer, ok, err);
 }
 
-static bool SaveAsUtf32(const CDocument& doc, char* buf, size_t lengthDoc, CAutoFile& hFile, std::wstring& err)
+static bool SaveAsUtf32(const CDocument& doc, const TextSegments& text, CAutoFile& hFile, std::wstring& err)
 {
-    constexpr int writeWideBufSize = WriteBlockSize * 2;
-    auto          writeWideBuf     = std::make_unique<wchar_t[]>(writeWideBufSize);
-    auto          writeWide32Buf   = std::make_unique<wchar_t[]>(writeWideBufSize * 2);
-    DWORD         bytesWritten     = 0;
-    BOOL          result           = FALSE;
+    DWORD bytesWritten = 0;
+    BOOL  result       = FALSE;
 
-    auto          encoding         = doc.m_encoding;
+    auto  encoding     = doc.m_encoding;
     if (doc.m_encodingSaving != -1)
         encoding = doc.m_encodingSaving;
 
@@ -791,55 +703,16 @@ static bool SaveAsUtf32(const CDocument& doc, char* buf, size_t lengthDoc, CAuto
         err = errMsg.c_str();
         return false;
     }
-    char* writeBuf = buf;
-    do
-    {
-        int     charStart = UTF8Helper::characterStart(writeBuf, static_cast<int>(min(WriteBlockSize, lengthDoc)));
-        int     wideLen   = MultiByteToWideChar(CP_UTF8, 0, writeBuf, charStart, writeWideBuf.get(), writeWideBufSize);
-
-        LPCWSTR pIn       = static_cast<LPCWSTR>(writeWideBuf.get());
-        UINT32* pOut      = reinterpret_cast<UINT32*>(writeWide32Buf.get());
-        int     nOutDWord = 0;
-        for (int nInWord = 0; nInWord < wideLen; nInWord++, nOutDWord++)
-        {
-            UINT32 zChar = pIn[nInWord];
-            if ((zChar & 0xfc00) == 0xd800) // lead surrogate
-            {
-                if (nInWord + 1 < wideLen && (pIn[nInWord + 1] & 0xfc00) == 0xdc00) // trail surrogate follows
-                    zChar = 0x10000 + ((zChar & 0x3ff) << 10) + (pIn[++nInWord] & 0x3ff);
-                else
-                    zChar = 0xfffd; // ? mark
-            }
-            else if ((zChar & 0xfc00) == 0xdc00) // trail surrogate without lead
-                zChar = 0xfffd;                  // ? mark
-            pOut[nOutDWord] = zChar;
-        }
-
-        if (encoding == 12001)
-        {
-            UINT64* p64     = reinterpret_cast<UINT64*>(writeWide32Buf.get());
-            int     nQWords = wideLen / 2;
-            for (int nQWord = 0; nQWord < nQWords; nQWord++)
-                p64[nQWord] = DwordSwapBytes(p64[nQWord]);
-
-            UINT32* p32     = reinterpret_cast<UINT32*>(p64);
-            int     nDWords = wideLen;
-            for (int nDword = nQWords * 2; nDword < nDWords; nDword++)
-                p32[nDword] = DwordSwapBytes(p32[nDword]);
-        }
-        if (!WriteFile(hFile, writeWide32Buf.get(), wideLen * 4, &bytesWritten, nullptr) || wideLen != static_cast<int>(bytesWritten / 4))
-        {
-            CFormatMessageWrapper errMsg;
-            err = errMsg.c_str();
-            return false;
-        }
-        writeBuf += charStart;
-        lengthDoc -= charStart;
-    } while (lengthDoc > 0);
-    return true;
+    const auto            order = encoding == 12001 ? ByteOrder::BigEndian : ByteOrder::LittleEndian;
+    CDoubleBufferedWriter writer(hFile, UTF32BytesMaxFromUTF8(WriteBlockSize));
+    bool                  ok = ForEachTextBlock(text, [&](const char* block, size_t length) {
+        auto converted = UTF32BytesFromUTF8(std::string_view(block, length), order, true, writer.Buffer());
+        return writer.Commit(converted.written);
+    });
+    return FinishWriting(writer, ok, err);
 }
 
-static bool SaveAsUtf8(const CDocument& doc, char* buf, size_t lengthDoc, CAutoFile& hFile, std::wstring& err)
+static bool SaveAsUtf8(const CDocument& doc, const TextSegments& text, CAutoFile& hFile, std::wstring& err)
 {
     // UTF8: save the buffer as it is
     DWORD bytesWritten = 0;
@@ -856,110 +729,261 @@ static bool SaveAsUtf8(const CDocument& doc, char* buf, size_t lengthDoc, CAutoF
             return false;
         }
     }
-    do
+    // nothing to convert, so the segments are written straight from the document
+    DWORD error = WriteAll(hFile, text.segment1, text.length1);
+    if (error == ERROR_SUCCESS)
+        error = WriteAll(hFile, text.segment2, text.length2);
+    if (error != ERROR_SUCCESS)
     {
-        DWORD writeLen = static_cast<DWORD>(min(WriteBlockSize, lengthDoc));
-        if (!WriteFile(hFile, buf, writeLen, &bytesWritten, nullptr))
-        {
-            CFormatMessageWrapper errMsg;
-            err = errMsg.c_str();
-            return false;
-        }
-        lengthDoc -= writeLen;
-        buf += writeLen;
-    } while (lengthDoc > 0);
+        CFormatMessageWrapper errMsg(error);
+        err = errMsg.c_str();
+        return false;
+    }
     return true;
 }
 
-static bool SaveAsOther(const CDocument& doc, char* buf, size_t lengthDoc, CAutoFile& hFile, std::wstring& err)
+static bool SaveAsOther(const CDocument& doc, const TextSegments& text, CAutoFile& hFile, std::wstring& err)
 {
     constexpr int wideBufSize  = WriteBlockSize * 2;
     auto          wideBuf      = std::make_unique<wchar_t[]>(wideBufSize);
     constexpr int charBufSize  = wideBufSize * 2;
-    auto          charBuf      = std::make_unique<char[]>(charBufSize);
     // first convert to wide char, then to the requested codepage
-    DWORD         bytesWritten = 0;
     auto          encoding     = doc.m_encoding;
     if (doc.m_encodingSaving != -1)
         encoding = doc.m_encodingSaving;
 
-    char* writeBuf = buf;
-    do
-    {
-        int  charStart       = UTF8Helper::characterStart(writeBuf, static_cast<int>(min(WriteBlockSize, lengthDoc)));
-        int  wideLen         = MultiByteToWideChar(CP_UTF8, 0, writeBuf, charStart, wideBuf.get(), wideBufSize);
+    CDoubleBufferedWriter writer(hFile, charBufSize);
+    bool                  ok = ForEachTextBlock(text, [&](const char* block, size_t length) {
+        int  blockLen        = static_cast<int>(length);
+        int  wideLen         = MultiByteToWideChar(CP_UTF8, 0, block, blockLen, wideBuf.get(), wideBufSize);
         BOOL usedDefaultChar = FALSE;
-        int  charLen         = WideCharToMultiByte(encoding < 0 ? CP_ACP : encoding, 0, wideBuf.get(), wideLen, charBuf.get(), charBufSize, nullptr, &usedDefaultChar);
+        int  charLen         = WideCharToMultiByte(encoding < 0 ? CP_ACP : encoding, 0, wideBuf.get(), wideLen, writer.Buffer(), charBufSize, nullptr, &usedDefaultChar);
         if (usedDefaultChar && doc.m_encodingSaving == -1)
         {
             // stream could not be properly converted to ANSI, write it 'as is'
-            if (!WriteFile(hFile, writeBuf, charStart, &bytesWritten, nullptr) || charStart != static_cast<int>(bytesWritten))
-            {
-                CFormatMessageWrapper errMsg;
-                err = errMsg.c_str();
-                return false;
-            }
+            memcpy(writer.Buffer(), block, length);
+            charLen = blockLen;
         }
-        else
-        {
-            if (!WriteFile(hFile, charBuf.get(), charLen, &bytesWritten, nullptr) || charLen != static_cast<int>(bytesWritten))
-            {
-                CFormatMessageWrapper errMsg;
-                err = errMsg.c_str();
-                return false;
-            }
-        }
-        writeBuf += charStart;
-        lengthDoc -= charStart;
-    } while (lengthDoc > 0);
-    return true;
+        return writer.Commit(charLen);
+    });
+    return FinishWriting(writer, ok, err);
 }
 
-bool CDocumentManager::SaveDoc(/*HWND hWnd,*/ const std::wstring& path, const CDocument& doc) const
+// Size the saved file is expected to have, so its space can be reserved in one piece up front
+static LONGLONG ExpectedFileSize(int encoding, size_t lengthDoc)
 {
-    if (path.empty())
-        return false;
-    CAutoFile hFile = CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!hFile.IsValid())
+    switch (encoding)
     {
-        CFormatMessageWrapper errMsg;
-        ShowFileSaveError(/*hWnd,*/ path, errMsg);
-        return false;
+        case 1200:
+        case 1201:
+            return static_cast<LONGLONG>(lengthDoc) * 2 + 2;
+        case 12000:
+        case 12001:
+            return static_cast<LONGLONG>(lengthDoc) * 4 + 4;
+        default:
+            return static_cast<LONGLONG>(lengthDoc) + 3;
     }
+}
 
-    m_scratchScintilla.Scintilla().SetDocPointer(doc.m_document);
-    size_t       lengthDoc = m_scratchScintilla.Scintilla().Length();
-    // get characters directly from Scintilla buffer
-    char*        buf       = static_cast<char*>(m_scratchScintilla.Scintilla().CharacterPointer());
-    bool         ok        = false;
-    std::wstring err;
-    auto         encoding = doc.m_encoding;
-    if (doc.m_encodingSaving != -1)
-        encoding = doc.m_encodingSaving;
+// Moves the fully written temp file over path. ReplaceFile keeps the attributes,
+// ACLs and creation time of the file it replaces; a file that does not exist yet
+// just gets the temp file renamed to it.
+static bool ReplaceWithTempFile(const std::wstring& path, const std::wstring& tempPath)
+{
+    if (ReplaceFile(path.c_str(), tempPath.c_str(), nullptr, REPLACEFILE_IGNORE_MERGE_ERRORS | REPLACEFILE_IGNORE_ACL_ERRORS, nullptr, nullptr))
+        return true;
+    DWORD err = GetLastError();
+    if (err != ERROR_FILE_NOT_FOUND && err != ERROR_UNABLE_TO_REMOVE_REPLACED)
+        return false;
+    return MoveFileEx(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+}
 
+// A symbolic link or junction, or a file with more than one hard link, would be
+// replaced by a new file that the other names don't refer to, so these are
+// written in place instead of through a temp file.
+static bool CanReplaceWithTempFile(const std::wstring& path)
+{
+    CAutoFile hFile = CreateFile(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT | FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (!hFile.IsValid())
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    BY_HANDLE_FILE_INFORMATION fi;
+    if (!GetFileInformationByHandle(hFile, &fi))
+        return false;
+    return (fi.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0 && fi.nNumberOfLinks <= 1;
+}
+
+static bool SaveText(const CDocument& doc, int encoding, const TextSegments& text, CAutoFile& hFile, std::wstring& err)
+{
     switch (encoding)
     {
         case CP_UTF8:
         case -1:
-            ok = SaveAsUtf8(doc, buf, lengthDoc, hFile, err);
-            break;
+            return SaveAsUtf8(doc, text, hFile, err);
         case 1200: // UTF16_LE
         case 1201: // UTF16_BE
-            ok = SaveAsUtf16(doc, buf, lengthDoc, hFile, err);
-            break;
+            return SaveAsUtf16(doc, text, hFile, err);
         case 12000: // UTF32_LE
         case 12001: // UTF32_BE
-            ok = SaveAsUtf32(doc, buf, lengthDoc, hFile, err);
-            break;
+            return SaveAsUtf32(doc, text, hFile, err);
         default:
-            ok = SaveAsOther(doc, buf, lengthDoc, hFile, err);
-            break;
+            return SaveAsOther(doc, text, hFile, err);
     }
+}
+
+// Writes the bytes [from, to) of the document text
+static DWORD WriteTextRange(HANDLE hFile, const TextSegments& text, size_t from, size_t to)
+{
+    DWORD error = ERROR_SUCCESS;
+    if (from < text.length1)
+        error = WriteAll(hFile, text.segment1 + from, min(to, text.length1) - from);
+    if (error == ERROR_SUCCESS && to > text.length1)
+    {
+        size_t from2 = max(from, text.length1) - text.length1;
+        error        = WriteAll(hFile, text.segment2 + from2, to - text.length1 - from2);
+    }
+    return error;
+}
+
+// Saving a large UTF-8 document back to the file it was loaded from or last saved to
+// only rewrites what changed since then, see PlanIncrementalSave.
+// Returns false without touching the file if the file doesn't hold the text at the save point,
+// so the caller can do a full save instead.
+static bool SaveIncremental(const std::wstring& path, const CDocument& doc, const TextSegments& text, Scintilla::Position unsavedStart, Scintilla::Position unsavedEnd, bool& ok, std::wstring& err)
+{
+    constexpr size_t minIncrementalSize = 4 * 1024 * 1024;
+    const size_t     lengthDoc          = text.length1 + text.length2;
+    if (lengthDoc < minIncrementalSize || doc.m_encodingSaving != -1 || (doc.m_encoding != CP_UTF8 && doc.m_encoding != -1))
+        return false;
+    if (!doc.m_bSavePointOnDisk || doc.m_path.empty() || CPathUtils::PathCompare(doc.m_path, path) != 0)
+        return false;
+    if (GetInt64(DEFAULTS_SECTION, L"IncrementalSave", 1) == 0)
+        return false;
+
+    CAutoFile hFile = CreateFile(path.c_str(), GENERIC_WRITE | GENERIC_READ, FILE_SHARE_DELETE | FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (!hFile.IsValid())
+        return false;
+    BY_HANDLE_FILE_INFORMATION fi;
+    if (!GetFileInformationByHandle(hFile, &fi))
+        return false;
+    const bool          sameWriteTime = CompareFileTime(&doc.m_lastWriteTime, &fi.ftLastWriteTime) == 0;
+    const std::uint64_t fileSize      = (static_cast<std::uint64_t>(fi.nFileSizeHigh) << 32) | fi.nFileSizeLow;
+    const auto          plan          = PlanIncrementalSave(doc.m_bSavePointOnDisk, sameWriteTime, fileSize, doc.m_bHasBOM ? 3 : 0, lengthDoc,
+                                                            static_cast<size_t>(unsavedStart), static_cast<size_t>(unsavedEnd));
+    if (!plan.possible)
+        return false;
+
+    LARGE_INTEGER offset = {};
+    offset.QuadPart      = static_cast<LONGLONG>(plan.offset);
+    DWORD error          = ERROR_SUCCESS;
+    if (!SetFilePointerEx(hFile, offset, nullptr, FILE_BEGIN))
+        error = GetLastError();
+    if (error == ERROR_SUCCESS)
+        error = WriteTextRange(hFile, text, plan.start, plan.end);
+    if (error == ERROR_SUCCESS && plan.truncate && !SetEndOfFile(hFile))
+        error = GetLastError();
+    if (error == ERROR_SUCCESS && !FlushFileBuffers(hFile))
+        error = GetLastError();
+    ok = error == ERROR_SUCCESS;
     if (!ok)
-        ShowFileSaveError(/*hWnd,*/ path, err.c_str());
+    {
+        CFormatMessageWrapper errMsg(error);
+        err = errMsg.c_str();
+    }
     return true;
 }
 
+bool CDocumentManager::SaveDoc(/*HWND hWnd,*/ const std::wstring& path, const CDocument& doc) const
+{
+    if (path.empty())
+        return false;
+    auto encoding = doc.m_encoding;
+    if (doc.m_encodingSaving != -1)
+        encoding = doc.m_encodingSaving;
+
+    m_scratchScintilla.Scintilla().SetDocPointer(doc.m_document);
+    // get characters directly from Scintilla buffer, a range on each side of the gap
+    // so the gap stays where it is
+    auto&        sci       = m_scratchScintilla.Scintilla();
+    auto         lengthDoc = sci.Length();
+    auto         gap       = sci.GapPosition();
+    TextSegments text;
+    if (gap > 0)
+        text = {static_cast<const char*>(sci.RangePointer(0, gap)), static_cast<size_t>(gap)};
+    if (gap < lengthDoc)
+    {
+        text.segment2 = static_cast<const char*>(sci.RangePointer(gap, lengthDoc - gap));
+        text.length2  = static_cast<size_t>(lengthDoc - gap);
+    }
+    std::wstring err;
+    bool         ok = false;
+    if (SaveIncremental(path, doc, text, sci.UnsavedStart(), sci.UnsavedEnd(), ok, err))
+    {
+        if (!ok)
+            ShowFileSaveError(/*hWnd,*/ path, err.c_str());
+        return ok;
+    }
+
+    // Unless disabled, write a temp file next to the target and only replace the target once
+    // the temp file is complete and flushed, so a crash or a full disk never leaves a truncated file.
+    // If the temp file can't be created (e.g. no rights on the folder), write the target in place.
+    std::wstring tempPath;
+    CAutoFile    hFile;
+    if (GetInt64(DEFAULTS_SECTION, L"AtomicSave", 1) != 0 && CanReplaceWithTempFile(path))
+    {
+        tempPath = CStringUtils::Format(L"%s.%lu.n4dsave", path.c_str(), GetCurrentProcessId());
+        hFile    = CreateFile(tempPath.c_str(), GENERIC_WRITE | DELETE, FILE_SHARE_DELETE | FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (!hFile.IsValid())
+            tempPath.clear();
+    }
+    OnOutOfScope(if (!tempPath.empty()) DeleteFile(tempPath.c_str()));
+    auto openInPlace = [&]() {
+        hFile = CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (hFile.IsValid())
+            return true;
+        CFormatMessageWrapper errMsg;
+        ShowFileSaveError(/*hWnd,*/ path, errMsg);
+        return false;
+    };
+    if (!hFile.IsValid() && !openInPlace())
+        return false;
+
+    if (tempPath.empty())
+    {
+        ok = SaveText(doc, encoding, text, hFile, err);
+        if (!ok)
+            ShowFileSaveError(/*hWnd,*/ path, err.c_str());
+        return ok;
+    }
+
+    // reserving the space up front lets the file system lay the file out in one run;
+    // the reservation is only a hint, so a failure doesn't matter
+    FILE_ALLOCATION_INFO allocInfo    = {};
+    allocInfo.AllocationSize.QuadPart = ExpectedFileSize(encoding, static_cast<size_t>(lengthDoc));
+    SetFileInformationByHandle(hFile, FileAllocationInfo, &allocInfo, sizeof(allocInfo));
+    if (!SaveText(doc, encoding, text, hFile, err) || !FlushFileBuffers(hFile))
+    {
+        // the target is untouched; report why the temp file could not be written
+        if (err.empty())
+        {
+            CFormatMessageWrapper errMsg;
+            err = errMsg.c_str();
+        }
+        ShowFileSaveError(/*hWnd,*/ path, err.c_str());
+        return false;
+    }
+    hFile.CloseHandle();
+    if (ReplaceWithTempFile(path, tempPath))
+        return true;
+    // the target can't be replaced, e.g. another program has it open without
+    // allowing it to be deleted: fall back to overwriting it in place
+    if (!openInPlace())
+        return false;
+    ok = SaveText(doc, encoding, text, hFile, err);
+    if (!ok)
+        ShowFileSaveError(/*hWnd,*/ path, err.c_str());
+    return ok;
+}
+
 bool CDocumentManager::SaveFile(/*HWND hWnd, */CDocument& doc, bool& bTabMoved) const
 {
     bTabMoved = false;
@@ -967,8 +991,9 @@ bool CDocumentManager::SaveFile(/*HWND hWnd, */CDocument& doc, bool& bTabMoved)
         return false;
     DWORD     attributes = INVALID_FILE_ATTRIBUTES;
     DWORD     err        = 0;
-    // when opening files, always 'share' as much as possible to reduce problems with virus scanners
-    CAutoFile hFile      = CreateFile(doc.m_path.c_str(), GENERIC_WRITE, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    // when opening files, always 'share' as much as possible to reduce problems with virus scanners.
+    // This only checks that the file can be written: don't truncate it, SaveDoc may write a temp file first
+    CAutoFile hFile      = CreateFile(doc.m_path.c_str(), GENERIC_WRITE, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
     if (!hFile.IsValid())
         err = GetLastError();
     // If the file can't be created, check if the file attributes are the reason we can't open
@@ -984,7 +1009,7 @@ bool CDocumentManager::SaveFile(/*HWND hWnd, */CDocument& doc, bool& bTabMoved)
             DWORD desiredAttributes = attributes & ~undesiredAttributes;
             if (SetFileAttributes(doc.m_path.c_str(), desiredAttributes))
             {
-                hFile = CreateFile(doc.m_path.c_str(), GENERIC_WRITE, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+                hFile = CreateFile(doc.m_path.c_str(), GENERIC_WRITE, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
             }
         }
     }
@@ -1008,7 +1033,9 @@ bool CDocumentManager::SaveFile(/*HWND hWnd, */CDocument& doc, bool& bTabMoved)
                         Sleep(100);
                         if (!PathFileExists(tempPath.c_str()))
                         {
-                            bTabMoved = true;
+                            // the other instance wrote the file, not from this save point
+                            doc.m_bSavePointOnDisk = false;
+                            bTabMoved              = true;
                             return true;
                         }
                     }
@@ -1027,11 +1054,13 @@ bool CDocumentManager::SaveFile(/*HWND hWnd, */CDocument& doc, bool& bTabMoved)
         return false;
     }
     hFile.CloseHandle();
-    if (SaveDoc(doc.m_path, doc))
+    bool saved = SaveDoc(doc.m_path, doc);
+    // a failed save may have written part of the file
+    doc.m_bSavePointOnDisk = saved;
+    if (saved)
     {
         m_scratchScintilla.Scintilla().SetSavePoint();
         m_scratchScintilla.EnableChangeHistory();
-        m_scratchScintilla.Scintilla().SetDocPointer(nullptr);
         if (doc.m_encodingSaving != -1)
         {
             doc.m_encoding       = doc.m_encodingSaving;
@@ -1040,12 +1069,14 @@ bool CDocumentManager::SaveFile(/*HWND hWnd, */CDocument& doc, bool& bTabMoved)
             doc.m_bHasBOMSaving  = false;
         }
     }
+    m_scratchScintilla.Scintilla().SetDocPointer(nullptr);
     if (attributes != INVALID_FILE_ATTRIBUTES)
     {
         // reset the file attributes after saving
         SetFileAttributes(doc.m_path.c_str(), attributes);
     }
-    return true;
+    // a failed save leaves the document modified
+    return saved;
 }
 
 bool CDocumentManager::SaveFile(CDocument& doc, const std::wstring& path) const
@@ -74,7 +74,7 @@ struct hash<DocID>
 } // namespace std
 
 constexpr int ReadBlockSize  = 128 * 1024; //128 kB
-constexpr int WriteBlockSize = 128 * 1024; //128 kB
+constexpr int WriteBlockSize = 1024 * 1024; //1 MB, large so handing a block to the writer thread costs little
 
 class CDocumentManager
 {
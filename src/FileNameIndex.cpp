@@ -0,0 +1,885 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+
+#include "stdafx.h"
+#include "FileNameIndex.h"
+#include "PathWatcher.h"
+#include "AppUtils.h"
+#include "DirFileEnum.h"
+#include "PathUtils.h"
+#include "SmartHandle.h"
+#include "StringUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+namespace
+{
+constexpr uint32_t noNode        = UINT32_MAX;
+constexpr uint32_t indexVersion  = 1;
+constexpr char     indexMagic[8] = {'N', '4', 'D', 'F', 'I', 'D', 'X', '\0'};
+constexpr auto     pollInterval  = std::chrono::milliseconds(500);
+constexpr size_t   maxUnsorted   = 4096; // names added since the last sort that the queries check one by one
+} // namespace
+
+struct FileNameTree
+{
+    struct Node
+    {
+        uint32_t parent     = noNode;
+        uint32_t nameOffset = 0;
+        uint16_t nameLength = 0;
+        bool     isDir      = false;
+        bool     removed    = false;
+        bool     unread     = false; ///< a folder that is a link: listed, but its content isn't indexed
+        uint64_t lastWrite  = 0;     ///< folders: the last write time when the folder was read
+    };
+
+    std::wstring                                        root;         ///< the indexed folder, nodes[0]
+    std::wstring                                        names;        ///< the names of all nodes in node order, each followed by a '\0'
+    std::wstring                                        lowerNames;   ///< names in lower case, for matching
+    std::vector<Node>                                   nodes;        ///< parents come before their children
+    std::vector<uint64_t>                               charMasks;    ///< per node: bit c % 64 is set for every character c of the lower case name
+    std::unordered_map<uint32_t, std::vector<uint32_t>> children;     ///< folder node -> child nodes
+    std::vector<uint32_t>                               sortedFiles;  ///< file nodes sorted by lower case name
+    std::vector<uint32_t>                               suffixes;     ///< offsets into the lower case file names, sorted by the text up to the end of the name
+    std::vector<uint32_t>                               links;        ///< the unread folder nodes, removed ones included
+    uint32_t                                            sortedCount  = 0; ///< nodes before this one are in sortedFiles and suffixes
+    uint32_t                                            removedCount = 0;
+};
+static_assert(std::is_trivially_copyable_v<FileNameTree::Node>, "nodes are saved as they are in memory");
+
+namespace
+{
+// An entry read from disk. parent is the index of its folder in the same list,
+// or noNode for entries directly in the folder that was read.
+struct ScannedEntry
+{
+    uint32_t     parent;
+    std::wstring name;
+    bool         isDir;
+    bool         unread;
+    uint64_t     lastWrite;
+};
+
+uint64_t ToUInt64(const FILETIME& ft)
+{
+    return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+}
+
+std::wstring ToLower(std::wstring_view text)
+{
+    std::wstring lower(text);
+    if (!lower.empty())
+        CharLowerBuff(lower.data(), static_cast<DWORD>(lower.size()));
+    return lower;
+}
+
+uint64_t CharMask(std::wstring_view lowerName)
+{
+    uint64_t mask = 0;
+    for (auto c : lowerName)
+        mask |= 1ULL << (c % 64);
+    return mask;
+}
+
+std::wstring_view Name(const FileNameTree& tree, uint32_t id)
+{
+    return {tree.names.data() + tree.nodes[id].nameOffset, tree.nodes[id].nameLength};
+}
+
+std::wstring_view LowerName(const FileNameTree& tree, uint32_t id)
+{
+    return {tree.lowerNames.data() + tree.nodes[id].nameOffset, tree.nodes[id].nameLength};
+}
+
+std::wstring JoinPath(const std::wstring& folder, std::wstring_view name)
+{
+    std::wstring path = folder;
+    if (!path.empty() && path.back() != '\\' && path.back() != '/')
+        path += '\\';
+    path.append(name);
+    return path;
+}
+
+uint32_t AddNode(FileNameTree& tree, uint32_t parent, std::wstring_view name, std::wstring_view lowerName, bool isDir, bool unread, uint64_t lastWrite)
+{
+    FileNameTree::Node node;
+    node.parent     = parent;
+    node.nameOffset = static_cast<uint32_t>(tree.names.size());
+    node.nameLength = static_cast<uint16_t>(name.size());
+    node.isDir      = isDir;
+    node.unread     = unread;
+    node.lastWrite  = lastWrite;
+    tree.names.append(name);
+    tree.names.push_back('\0');
+    tree.lowerNames.append(lowerName);
+    tree.lowerNames.push_back('\0');
+    tree.charMasks.push_back(CharMask(lowerName));
+    auto id = static_cast<uint32_t>(tree.nodes.size());
+    tree.nodes.push_back(node);
+    if (parent != noNode)
+        tree.children[parent].push_back(id);
+    if (unread)
+        tree.links.push_back(id);
+    return id;
+}
+
+uint32_t AddNode(FileNameTree& tree, uint32_t parent, std::wstring_view name, bool isDir, bool unread, uint64_t lastWrite)
+{
+    return AddNode(tree, parent, name, ToLower(name), isDir, unread, lastWrite);
+}
+
+void Graft(FileNameTree& tree, uint32_t parent, const std::vector<ScannedEntry>& entries)
+{
+    std::vector<uint32_t> ids(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const auto& entry = entries[i];
+        ids[i]            = AddNode(tree, entry.parent == noNode ? parent : ids[entry.parent], entry.name, entry.isDir, entry.unread, entry.lastWrite);
+    }
+}
+
+// removes the node and everything below it
+void RemoveNode(FileNameTree& tree, uint32_t id)
+{
+    if (auto it = tree.children.find(tree.nodes[id].parent); it != tree.children.end())
+        std::erase(it->second, id);
+    std::vector<uint32_t> pending{id};
+    while (!pending.empty())
+    {
+        auto node = pending.back();
+        pending.pop_back();
+        tree.nodes[node].removed = true;
+        ++tree.removedCount;
+        if (auto it = tree.children.find(node); it != tree.children.end())
+        {
+            pending.insert(pending.end(), it->second.begin(), it->second.end());
+            tree.children.erase(it);
+        }
+    }
+}
+
+uint32_t FindChild(const FileNameTree& tree, uint32_t parent, std::wstring_view lowerName)
+{
+    auto it = tree.children.find(parent);
+    if (it == tree.children.end())
+        return noNode;
+    for (auto child : it->second)
+    {
+        if (LowerName(tree, child) == lowerName)
+            return child;
+    }
+    return noNode;
+}
+
+// returns the node for path, or noNode if path isn't in the index
+uint32_t FindNode(const FileNameTree& tree, const std::wstring& path)
+{
+    const auto& root = tree.root;
+    if (path.size() < root.size() ||
+        CompareStringOrdinal(path.c_str(), static_cast<int>(root.size()), root.c_str(), static_cast<int>(root.size()), TRUE) != CSTR_EQUAL)
+        return noNode;
+    std::wstring_view rest(path.c_str() + root.size(), path.size() - root.size());
+    if (!rest.empty() && root.back() != '\\' && rest.front() != '\\' && rest.front() != '/')
+        return noNode;
+    uint32_t node = 0;
+    while (!rest.empty() && node != noNode)
+    {
+        auto sep       = rest.find_first_of(L"\\/");
+        auto component = rest.substr(0, sep);
+        rest           = sep == std::wstring_view::npos ? std::wstring_view() : rest.substr(sep + 1);
+        if (!component.empty())
+            node = FindChild(tree, node, ToLower(component));
+    }
+    return node;
+}
+
+// returns the path of id, which must be below base
+std::wstring NodePath(const FileNameTree& tree, uint32_t id, const std::wstring& basePath, uint32_t base)
+{
+    std::vector<uint32_t> chain;
+    for (auto node = id; node != base; node = tree.nodes[node].parent)
+        chain.push_back(node);
+    std::wstring path = basePath;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+        path = JoinPath(path, Name(tree, *it));
+    return path;
+}
+
+// Whether a recursive query of folderNode has to go into a link. The index doesn't
+// follow links, and changes in their targets aren't watched, so such queries are
+// left to the disk walkers. Links in folders skipFolder leaves out don't matter.
+bool HasLinkBelow(const FileNameTree& tree, uint32_t folderNode, const std::wstring& folder, const FolderFilter& skipFolder)
+{
+    for (auto link : tree.links)
+    {
+        if (tree.nodes[link].removed || link == folderNode)
+            continue;
+        auto node = tree.nodes[link].parent;
+        while (node != noNode && node != folderNode)
+            node = tree.nodes[node].parent;
+        if (node == noNode)
+            continue;
+        bool skipped = false;
+        for (node = link; skipFolder && node != folderNode && !skipped; node = tree.nodes[node].parent)
+            skipped = skipFolder(NodePath(tree, node, folder, folderNode));
+        if (!skipped)
+            return true;
+    }
+    return false;
+}
+
+// the node whose name contains the character at offset in lowerNames
+uint32_t NodeAt(const FileNameTree& tree, uint32_t offset)
+{
+    auto it = std::upper_bound(tree.nodes.begin(), tree.nodes.end(), offset,
+                               [](uint32_t off, const FileNameTree::Node& node) { return off < node.nameOffset; });
+    return static_cast<uint32_t>(it - tree.nodes.begin()) - 1;
+}
+
+// a copy without the removed nodes
+FileNameTree Compacted(const FileNameTree& tree)
+{
+    FileNameTree result;
+    result.root = tree.root;
+    result.nodes.reserve(tree.nodes.size() - tree.removedCount);
+    result.charMasks.reserve(tree.nodes.size() - tree.removedCount);
+    std::vector<uint32_t> newIds(tree.nodes.size(), noNode);
+    for (uint32_t id = 0; id < tree.nodes.size(); ++id)
+    {
+        const auto& node = tree.nodes[id];
+        if (node.removed)
+            continue;
+        newIds[id] = AddNode(result, node.parent == noNode ? noNode : newIds[node.parent], Name(tree, id), LowerName(tree, id),
+                             node.isDir, node.unread, node.lastWrite);
+    }
+    return result;
+}
+
+// sorts the file names and all their suffixes, so prefix and substring queries are binary searches
+void SortNames(FileNameTree& tree)
+{
+    const wchar_t* lower = tree.lowerNames.c_str();
+    tree.sortedFiles.clear();
+    tree.suffixes.clear();
+    for (uint32_t id = 0; id < tree.nodes.size(); ++id)
+    {
+        const auto& node = tree.nodes[id];
+        if (node.removed || node.isDir)
+            continue;
+        tree.sortedFiles.push_back(id);
+        for (uint32_t i = 0; i < node.nameLength; ++i)
+            tree.suffixes.push_back(node.nameOffset + i);
+    }
+    std::sort(tree.sortedFiles.begin(), tree.sortedFiles.end(), [&](uint32_t lhs, uint32_t rhs) {
+        return wcscmp(lower + tree.nodes[lhs].nameOffset, lower + tree.nodes[rhs].nameOffset) < 0;
+    });
+    std::sort(tree.suffixes.begin(), tree.suffixes.end(), [lower](uint32_t lhs, uint32_t rhs) {
+        return wcscmp(lower + lhs, lower + rhs) < 0;
+    });
+    tree.sortedCount = static_cast<uint32_t>(tree.nodes.size());
+}
+
+// Scores how well the characters of pattern appear in order in name: a point for
+// every character, more for characters that follow the previous match directly or
+// start a word. Returns -1 if not all characters appear.
+int FuzzyScore(std::wstring_view name, std::wstring_view pattern)
+{
+    int    score    = 0;
+    size_t previous = std::wstring_view::npos;
+    size_t pos      = 0;
+    for (auto c : pattern)
+    {
+        pos = name.find(c, pos);
+        if (pos == std::wstring_view::npos)
+            return -1;
+        score += 1;
+        if (previous != std::wstring_view::npos && pos == previous + 1)
+            score += 3;
+        if (pos == 0 || wcschr(L" ._-", name[pos - 1]) != nullptr)
+            score += 2;
+        previous = pos++;
+    }
+    return score;
+}
+
+// Lists folder and, if recursive is set, everything below it. Links to other folders
+// are listed but not entered, so a link can't make the scan go round in circles.
+template <typename StopCheck>
+std::vector<ScannedEntry> ScanFolder(const std::wstring& folder, bool recursive, StopCheck stop)
+{
+    std::vector<ScannedEntry>                      entries;
+    std::vector<std::pair<uint32_t, std::wstring>> pending{{noNode, folder}};
+    while (!pending.empty() && !stop())
+    {
+        auto [parent, path] = std::move(pending.back());
+        pending.pop_back();
+        CSimpleFileFind finder(path);
+        while (finder.FindNextFileNoDots(0))
+        {
+            const auto* data   = finder.GetFileFindData();
+            const bool  isDir  = finder.IsDirectory();
+            const bool  isLink = isDir && (data->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+            auto        id     = static_cast<uint32_t>(entries.size());
+            entries.push_back({parent, data->cFileName, isDir, isLink, ToUInt64(data->ftLastWriteTime)});
+            if (recursive && isDir && !isLink)
+                pending.emplace_back(id, finder.GetFilePath());
+        }
+    }
+    return entries;
+}
+
+std::wstring IndexFilePath(const std::wstring& root)
+{
+    auto hash = std::hash<std::wstring>()(ToLower(root));
+    return CStringUtils::Format(L"%s\\fileindex\\%016llx.n4didx", CAppUtils::GetDataPath().c_str(), static_cast<unsigned long long>(hash));
+}
+
+struct IndexFileHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t rootLength;
+    uint32_t nodeCount;
+    uint32_t namesLength;
+};
+
+std::unique_ptr<FileNameTree> LoadTree(const std::wstring& root)
+{
+    CAutoFile hFile = CreateFile(IndexFilePath(root).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (!hFile.IsValid())
+        return nullptr;
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart < static_cast<LONGLONG>(sizeof(IndexFileHeader)) || fileSize.QuadPart > MAXDWORD)
+        return nullptr;
+    std::vector<char> data(static_cast<size_t>(fileSize.QuadPart));
+    DWORD             bytesRead = 0;
+    if (!ReadFile(hFile, data.data(), static_cast<DWORD>(data.size()), &bytesRead, nullptr) || bytesRead != data.size())
+        return nullptr;
+
+    IndexFileHeader header;
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.version != indexVersion || header.nodeCount == 0)
+        return nullptr;
+    const size_t expectedSize = sizeof(header) + (static_cast<size_t>(header.rootLength) + header.namesLength) * sizeof(wchar_t) +
+                                static_cast<size_t>(header.nodeCount) * sizeof(FileNameTree::Node);
+    if (data.size() != expectedSize)
+        return nullptr;
+    const char* pos  = data.data() + sizeof(header);
+    auto        tree = std::make_unique<FileNameTree>();
+    tree->root.assign(reinterpret_cast<const wchar_t*>(pos), header.rootLength);
+    pos += header.rootLength * sizeof(wchar_t);
+    if (CPathUtils::PathCompare(tree->root, root) != 0)
+        return nullptr; // another folder with the same hash
+    tree->names.assign(reinterpret_cast<const wchar_t*>(pos), header.namesLength);
+    pos += header.namesLength * sizeof(wchar_t);
+    tree->nodes.resize(header.nodeCount);
+    memcpy(tree->nodes.data(), pos, header.nodeCount * sizeof(FileNameTree::Node));
+
+    tree->lowerNames = ToLower(tree->names);
+    tree->charMasks.reserve(tree->nodes.size());
+    for (uint32_t id = 0; id < tree->nodes.size(); ++id)
+    {
+        const auto& node = tree->nodes[id];
+        if (node.removed || static_cast<size_t>(node.nameOffset) + node.nameLength >= tree->names.size() ||
+            (id == 0 ? node.parent != noNode : node.parent >= id || !tree->nodes[node.parent].isDir))
+            return nullptr;
+        tree->charMasks.push_back(CharMask(LowerName(*tree, id)));
+        if (id > 0)
+            tree->children[node.parent].push_back(id);
+        if (node.unread)
+            tree->links.push_back(id);
+    }
+    return tree;
+}
+
+bool SaveTree(const FileNameTree& tree)
+{
+    IndexFileHeader header = {};
+    memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version     = indexVersion;
+    header.rootLength  = static_cast<uint32_t>(tree.root.size());
+    header.nodeCount   = static_cast<uint32_t>(tree.nodes.size());
+    header.namesLength = static_cast<uint32_t>(tree.names.size());
+    std::vector<char> data(sizeof(header));
+    memcpy(data.data(), &header, sizeof(header));
+    auto append = [&](const void* p, size_t len) {
+        data.insert(data.end(), static_cast<const char*>(p), static_cast<const char*>(p) + len);
+    };
+    append(tree.root.data(), tree.root.size() * sizeof(wchar_t));
+    append(tree.names.data(), tree.names.size() * sizeof(wchar_t));
+    append(tree.nodes.data(), tree.nodes.size() * sizeof(FileNameTree::Node));
+    if (data.size() > MAXDWORD)
+        return false;
+
+    // write a new file and replace the old one with it, so a crash never leaves a half written index
+    auto path     = IndexFilePath(tree.root);
+    auto tempPath = path + L".tmp";
+    CreateDirectory(CPathUtils::GetParentDirectory(path).c_str(), nullptr);
+    {
+        CAutoFile hFile = CreateFile(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (!hFile.IsValid())
+            return false;
+        DWORD written = 0;
+        if (!WriteFile(hFile, data.data(), static_cast<DWORD>(data.size()), &written, nullptr) || written != data.size())
+        {
+            hFile.CloseHandle();
+            DeleteFile(tempPath.c_str());
+            return false;
+        }
+    }
+    return MoveFileEx(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+}
+} // namespace
+
+CFileNameIndex& CFileNameIndex::Instance()
+{
+    static CFileNameIndex instance;
+    return instance;
+}
+
+CFileNameIndex::CFileNameIndex()
+{
+    m_thread = std::thread(&CFileNameIndex::WorkerThread, this);
+}
+
+CFileNameIndex::~CFileNameIndex()
+{
+    Stop();
+}
+
+void CFileNameIndex::SetRoot(const std::wstring& root)
+{
+    std::wstring newRoot;
+    // network folders are left alone: reading and watching them is slow
+    if (GetInt64(DEFAULTS_SECTION, L"FileNameIndex", 1) != 0 && !root.empty() && !PathIsNetworkPath(root.c_str()))
+    {
+        newRoot = root;
+        // keep the backslash of a drive root only
+        while (newRoot.size() > 3 && (newRoot.back() == '\\' || newRoot.back() == '/'))
+            newRoot.pop_back();
+    }
+    {
+        std::unique_lock lock(m_requestGuard);
+        if (m_stop)
+            return;
+        m_requestedRoot = std::move(newRoot);
+        m_rootRequested = true;
+    }
+    m_requestCondition.notify_one();
+}
+
+void CFileNameIndex::Stop()
+{
+    {
+        std::unique_lock lock(m_requestGuard);
+        m_stop = true;
+    }
+    m_requestCondition.notify_one();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool CFileNameIndex::Interrupted() const
+{
+    std::unique_lock lock(m_requestGuard);
+    return m_stop || m_rootRequested;
+}
+
+void CFileNameIndex::WorkerThread()
+{
+    for (;;)
+    {
+        std::wstring root;
+        bool         rootRequested = false;
+        {
+            std::unique_lock lock(m_requestGuard);
+            m_requestCondition.wait_for(lock, pollInterval, [this]() { return m_stop || m_rootRequested; });
+            if (m_stop)
+                break;
+            rootRequested   = m_rootRequested;
+            m_rootRequested = false;
+            root            = m_requestedRoot;
+        }
+        if (rootRequested)
+        {
+            if (m_tree && CPathUtils::PathCompare(m_tree->root, root) == 0)
+                continue;
+            CloseRoot();
+            if (!root.empty() && PathIsDirectory(root.c_str()))
+                OpenRoot(root);
+        }
+        else if (m_tree)
+        {
+            ApplyChanges();
+            RebuildIfNeeded(false);
+        }
+    }
+    CloseRoot();
+}
+
+void CFileNameIndex::OpenRoot(const std::wstring& root)
+{
+    // watch first, so nothing that changes while the index is loaded or built gets lost
+    m_watcher = std::make_unique<CPathWatcher>();
+    m_watcher->AddPath(root, true);
+
+    auto tree   = LoadTree(root);
+    bool loaded = tree != nullptr;
+    if (!loaded)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA fad = {};
+        GetFileAttributesEx(root.c_str(), GetFileExInfoStandard, &fad);
+        tree       = std::make_unique<FileNameTree>();
+        tree->root = root;
+        AddNode(*tree, noNode, {}, true, false, ToUInt64(fad.ftLastWriteTime));
+        auto entries = ScanFolder(root, true, [this]() { return Interrupted(); });
+        if (Interrupted())
+            return;
+        Graft(*tree, 0, entries);
+    }
+    {
+        std::unique_lock lock(m_guard);
+        m_tree      = std::move(tree);
+        m_validated = !loaded;
+    }
+    m_dirty = !loaded;
+    // the queries work with the unsorted names too, just slower
+    if (loaded)
+        Validate();
+    if (Interrupted())
+        return;
+    RebuildIfNeeded(true);
+    if (m_dirty && !Interrupted())
+    {
+        Save();
+        m_dirty = false;
+    }
+}
+
+void CFileNameIndex::CloseRoot()
+{
+    if (m_tree && m_dirty)
+        Save();
+    m_dirty = false;
+    m_watcher.reset();
+    std::unique_lock lock(m_guard);
+    m_tree.reset();
+    m_validated = false;
+}
+
+void CFileNameIndex::Save() const
+{
+    if (m_tree->removedCount == 0)
+        SaveTree(*m_tree);
+    else
+        SaveTree(Compacted(*m_tree));
+}
+
+// Reads the folders again whose last write time changed while nothing watched them.
+// Adding, removing or renaming an entry changes the last write time of its folder,
+// so folders with the saved time can't have changed.
+// Until that is done the index may miss files, so the queries aren't answered from it.
+void CFileNameIndex::Validate()
+{
+    {
+        std::unique_lock lock(m_guard);
+        m_validated = false;
+    }
+    const auto count = static_cast<uint32_t>(m_tree->nodes.size());
+    for (uint32_t id = 0; id < count && !Interrupted(); ++id)
+    {
+        const auto node = m_tree->nodes[id];
+        if (!node.isDir || node.removed || node.unread)
+            continue;
+        auto                      path = NodePath(*m_tree, id, m_tree->root, 0);
+        WIN32_FILE_ATTRIBUTE_DATA fad  = {};
+        if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &fad) || (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+        {
+            if (id != 0)
+            {
+                std::unique_lock lock(m_guard);
+                RemoveNode(*m_tree, id);
+                m_dirty = true;
+            }
+            continue;
+        }
+        if (ToUInt64(fad.ftLastWriteTime) != node.lastWrite)
+            RefreshFolder(id, path, ToUInt64(fad.ftLastWriteTime));
+    }
+    if (!Interrupted())
+    {
+        std::unique_lock lock(m_guard);
+        m_validated = true;
+    }
+}
+
+// brings the entries directly in a folder in line with the disk
+void CFileNameIndex::RefreshFolder(uint32_t id, const std::wstring& path, uint64_t lastWrite)
+{
+    auto interrupted = [this]() { return Interrupted(); };
+    auto listed      = ScanFolder(path, false, interrupted);
+
+    std::vector<uint32_t>                                      removed;
+    std::vector<std::pair<ScannedEntry, std::vector<ScannedEntry>>> added;
+    std::unordered_map<std::wstring, uint32_t>                 existing;
+    if (auto it = m_tree->children.find(id); it != m_tree->children.end())
+    {
+        for (auto child : it->second)
+            existing.emplace(LowerName(*m_tree, child), child);
+    }
+    for (auto& entry : listed)
+    {
+        auto it = existing.find(ToLower(entry.name));
+        if (it != existing.end() && m_tree->nodes[it->second].isDir == entry.isDir)
+        {
+            existing.erase(it);
+            continue;
+        }
+        std::vector<ScannedEntry> content;
+        if (entry.isDir && !entry.unread)
+            content = ScanFolder(JoinPath(path, entry.name), true, interrupted);
+        added.emplace_back(std::move(entry), std::move(content));
+    }
+    for (const auto& [name, child] : existing)
+        removed.push_back(child);
+
+    std::unique_lock lock(m_guard);
+    for (auto child : removed)
+        RemoveNode(*m_tree, child);
+    for (const auto& [entry, content] : added)
+    {
+        auto child = AddNode(*m_tree, id, entry.name, entry.isDir, entry.unread, entry.lastWrite);
+        Graft(*m_tree, child, content);
+    }
+    m_tree->nodes[id].lastWrite = lastWrite;
+    m_dirty                     = true;
+}
+
+// updates the entry for path, and everything below it, to what is on disk now
+void CFileNameIndex::SyncPath(const std::wstring& path)
+{
+    auto parent = FindNode(*m_tree, CPathUtils::GetParentDirectory(path));
+    if (parent == noNode || !m_tree->nodes[parent].isDir || m_tree->nodes[parent].unread)
+        return;
+    auto                      name     = CPathUtils::GetFileName(path);
+    auto                      existing = FindChild(*m_tree, parent, ToLower(name));
+    WIN32_FILE_ATTRIBUTE_DATA fad      = {};
+    if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &fad))
+    {
+        if (existing != noNode)
+        {
+            std::unique_lock lock(m_guard);
+            RemoveNode(*m_tree, existing);
+            m_dirty = true;
+        }
+        return;
+    }
+    const bool isDir = (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    if (existing != noNode && m_tree->nodes[existing].isDir == isDir)
+        return;
+    const bool                isLink = isDir && (fad.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+    std::vector<ScannedEntry> content;
+    if (isDir && !isLink)
+        content = ScanFolder(path, true, [this]() { return Interrupted(); });
+
+    std::unique_lock lock(m_guard);
+    if (existing != noNode)
+        RemoveNode(*m_tree, existing);
+    auto id = AddNode(*m_tree, parent, name, isDir, isLink, ToUInt64(fad.ftLastWriteTime));
+    Graft(*m_tree, id, content);
+    m_dirty = true;
+}
+
+void CFileNameIndex::ApplyChanges()
+{
+    for (const auto& [action, path] : m_watcher->GetChangedPaths())
+    {
+        if (Interrupted())
+            return;
+        if (action == PATH_CHANGES_LOST)
+            Validate();
+        else
+            SyncPath(path);
+    }
+}
+
+// Sorts the names again once enough were added or removed since they were last sorted,
+// on a copy so the queries can go on meanwhile.
+void CFileNameIndex::RebuildIfNeeded(bool force)
+{
+    const size_t unsorted = m_tree->nodes.size() - m_tree->sortedCount;
+    if (unsorted == 0 && m_tree->removedCount == 0)
+        return;
+    if (!force && unsorted < maxUnsorted && m_tree->removedCount < m_tree->nodes.size() / 4)
+        return;
+    auto rebuilt = std::make_unique<FileNameTree>(Compacted(*m_tree));
+    SortNames(*rebuilt);
+    std::unique_lock lock(m_guard);
+    m_tree = std::move(rebuilt);
+}
+
+bool CFileNameIndex::Enumerate(const std::wstring& folder, bool recursive, const FolderFilter& skipFolder, const IndexVisitor& visit) const
+{
+    std::shared_lock lock(m_guard);
+    if (!m_tree || !m_validated)
+        return false;
+    const auto& tree       = *m_tree;
+    auto        folderNode = FindNode(tree, folder);
+    if (folderNode == noNode || !tree.nodes[folderNode].isDir || tree.nodes[folderNode].unread)
+        return false;
+    if (recursive && HasLinkBelow(tree, folderNode, folder, skipFolder))
+        return false;
+
+    std::vector<std::pair<uint32_t, std::wstring>> pending{{folderNode, folder}};
+    while (!pending.empty())
+    {
+        auto [dir, dirPath] = std::move(pending.back());
+        pending.pop_back();
+        auto it = tree.children.find(dir);
+        if (it == tree.children.end())
+            continue;
+        for (auto child : it->second)
+        {
+            auto       path  = JoinPath(dirPath, Name(tree, child));
+            const bool isDir = tree.nodes[child].isDir;
+            if (!visit(path, isDir))
+                return true;
+            if (isDir && recursive && !(skipFolder && skipFolder(path)))
+                pending.emplace_back(child, std::move(path));
+        }
+    }
+    return true;
+}
+
+bool CFileNameIndex::FindFiles(const std::wstring& folder, bool recursive, std::wstring_view text, FileNameMatch match, size_t maxResults,
+                               const FolderFilter& skipFolder, std::vector<std::wstring>& results) const
+{
+    std::shared_lock lock(m_guard);
+    if (!m_tree || !m_validated)
+        return false;
+    const auto& tree       = *m_tree;
+    auto        folderNode = FindNode(tree, folder);
+    if (folderNode == noNode || !tree.nodes[folderNode].isDir || tree.nodes[folderNode].unread)
+        return false;
+    if (recursive && HasLinkBelow(tree, folderNode, folder, skipFolder))
+        return false;
+
+    // whether files in a folder are wanted, remembered per folder: 0 unknown, 1 yes, 2 no
+    std::vector<uint8_t>          wantedFolders(tree.nodes.size());
+    std::function<bool(uint32_t)> isWantedFolder = [&](uint32_t dir) -> bool {
+        if (dir == folderNode)
+            return true;
+        if (!recursive || dir == noNode)
+            return false;
+        if (wantedFolders[dir] == 0)
+        {
+            bool wanted        = isWantedFolder(tree.nodes[dir].parent) &&
+                          !(skipFolder && skipFolder(NodePath(tree, dir, folder, folderNode)));
+            wantedFolders[dir] = wanted ? 1 : 2;
+        }
+        return wantedFolders[dir] == 1;
+    };
+    auto isWantedFile = [&](uint32_t id) {
+        const auto& node = tree.nodes[id];
+        return !node.removed && !node.isDir && isWantedFolder(node.parent);
+    };
+
+    results.clear();
+    const auto     lowerText = ToLower(text);
+    const wchar_t* lower     = tree.lowerNames.c_str();
+    auto           add       = [&](uint32_t id) {
+        if (isWantedFile(id))
+            results.push_back(NodePath(tree, id, folder, folderNode));
+        return results.size() < maxResults;
+    };
+    auto lessThanText = [&](uint32_t offset, const std::wstring& t) {
+        return wcsncmp(lower + offset, t.c_str(), t.size()) < 0;
+    };
+    auto textLessThan = [&](const std::wstring& t, uint32_t offset) {
+        return wcsncmp(lower + offset, t.c_str(), t.size()) > 0;
+    };
+    if (maxResults == 0)
+        return true;
+
+    switch (match)
+    {
+        case FileNameMatch::Prefix:
+        {
+            auto nameOffset = [&](uint32_t id) { return tree.nodes[id].nameOffset; };
+            auto first      = std::lower_bound(tree.sortedFiles.begin(), tree.sortedFiles.end(), lowerText,
+                                          [&](uint32_t id, const std::wstring& t) { return lessThanText(nameOffset(id), t); });
+            auto last       = std::upper_bound(first, tree.sortedFiles.end(), lowerText,
+                                         [&](const std::wstring& t, uint32_t id) { return textLessThan(t, nameOffset(id)); });
+            for (auto it = first; it != last; ++it)
+            {
+                if (!add(*it))
+                    return true;
+            }
+            for (uint32_t id = tree.sortedCount; id < tree.nodes.size(); ++id)
+            {
+                if (LowerName(tree, id).starts_with(lowerText) && !add(id))
+                    return true;
+            }
+        }
+        break;
+        case FileNameMatch::Substring:
+        {
+            auto first = std::lower_bound(tree.suffixes.begin(), tree.suffixes.end(), lowerText, lessThanText);
+            auto last  = std::upper_bound(first, tree.suffixes.end(), lowerText, textLessThan);
+            for (auto it = first; it != last; ++it)
+            {
+                auto id = NodeAt(tree, *it);
+                // a name that contains the text more than once is only added for the first one
+                if (LowerName(tree, id).find(lowerText) == *it - tree.nodes[id].nameOffset && !add(id))
+                    return true;
+            }
+            for (uint32_t id = tree.sortedCount; id < tree.nodes.size(); ++id)
+            {
+                if (LowerName(tree, id).find(lowerText) != std::wstring_view::npos && !add(id))
+                    return true;
+            }
+        }
+        break;
+        case FileNameMatch::Fuzzy:
+        {
+            const auto                       mask = CharMask(lowerText);
+            std::vector<std::pair<int, uint32_t>> scored;
+            for (uint32_t id = 0; id < tree.nodes.size(); ++id)
+            {
+                if ((tree.charMasks[id] & mask) != mask)
+                    continue;
+                int score = FuzzyScore(LowerName(tree, id), lowerText);
+                if (score >= 0 && isWantedFile(id))
+                    scored.emplace_back(score, id);
+            }
+            auto better = [&](const auto& lhs, const auto& rhs) {
+                if (lhs.first != rhs.first)
+                    return lhs.first > rhs.first;
+                return tree.nodes[lhs.second].nameLength < tree.nodes[rhs.second].nameLength;
+            };
+            auto count = (std::min)(maxResults, scored.size());
+            std::partial_sort(scored.begin(), scored.begin() + count, scored.end(), better);
+            for (size_t i = 0; i < count; ++i)
+                results.push_back(NodePath(tree, scored[i].second, folder, folderNode));
+        }
+        break;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct FileNameTree;
+class CPathWatcher;
+
+enum class FileNameMatch
+{
+    Prefix,    ///< the name starts with the text
+    Substring, ///< the name contains the text
+    Fuzzy,     ///< the name contains the characters of the text in that order
+};
+
+using FolderFilter = std::function<bool(const std::wstring& folderPath)>;
+using IndexVisitor = std::function<bool(const std::wstring& path, bool isDir)>;
+
+/**
+ * \ingroup Utils
+ * Keeps the names of all files and folders below the folder shown in the
+ * file tree, so looking for a file by name doesn't have to enumerate the disk.
+ *
+ * A background thread builds the index, keeps it up to date with the
+ * notifications of a CPathWatcher and saves it in the data folder, so opening
+ * the same folder again only checks the folder timestamps instead of
+ * reading every folder again.
+ *
+ * The queries return false if the folder isn't covered by a complete index:
+ * while a loaded index is checked against the disk, and for recursive queries
+ * that would have to go into a linked folder, which the index doesn't follow.
+ * Callers then enumerate the disk as before.
+ */
+class CFileNameIndex
+{
+public:
+    static CFileNameIndex& Instance();
+
+    /**
+     * Indexes \c root instead of the current folder. Returns immediately,
+     * the index is loaded or built in the background.
+     */
+    void SetRoot(const std::wstring& root);
+
+    /**
+     * Saves the index and stops the background thread.
+     */
+    void Stop();
+
+    /**
+     * Calls \c visit for every file and folder in \c folder and, if \c recursive is set,
+     * in its subfolders, stopping when \c visit returns false. Folders for which
+     * \c skipFolder returns true are visited but not entered.
+     * The paths start with \c folder as passed.
+     */
+    bool Enumerate(const std::wstring& folder, bool recursive, const FolderFilter& skipFolder, const IndexVisitor& visit) const;
+
+    /**
+     * Finds up to \c maxResults files in \c folder (and its subfolders if \c recursive is set)
+     * whose name matches \c text, ignoring case. Files in folders for which \c skipFolder
+     * returns true are left out. Fuzzy matches are sorted with the best match first.
+     */
+    bool FindFiles(const std::wstring& folder, bool recursive, std::wstring_view text, FileNameMatch match, size_t maxResults,
+                   const FolderFilter& skipFolder, std::vector<std::wstring>& results) const;
+
+private:
+    CFileNameIndex();
+    ~CFileNameIndex();
+
+    void WorkerThread();
+    bool Interrupted() const;
+    void OpenRoot(const std::wstring& root);
+    void CloseRoot();
+    void ApplyChanges();
+    void SyncPath(const std::wstring& path);
+    void Validate();
+    void RefreshFolder(uint32_t id, const std::wstring& path, uint64_t lastWrite);
+    void RebuildIfNeeded(bool force);
+    void Save() const;
+
+private:
+    mutable std::shared_mutex     m_guard;  ///< the worker changes m_tree only while holding this exclusively
+    std::unique_ptr<FileNameTree> m_tree;   ///< read by the queries, written by the worker thread only
+    bool                          m_dirty = false; ///< the tree differs from the saved index
+    bool                          m_validated = false; ///< the tree was checked against the disk, guarded by m_guard
+
+    mutable std::mutex            m_requestGuard;
+    std::condition_variable       m_requestCondition;
+    std::wstring                  m_requestedRoot;
+    bool                          m_rootRequested = false;
+    bool                          m_stop          = false;
+
+    std::unique_ptr<CPathWatcher> m_watcher;
+    std::thread                   m_thread;
+};
@@ -24,6 +24,7 @@
 #include "OnOutOfScope.h"
 #include "DarkModeHelper.h"
 #include "MainWindow.h"
+#include "FileNameIndex.h"
 
 #include <thread>
 #include <vector>
@@ -140,6 +141,7 @@ void CFileTree::SetPath(const std::wstring& path, bool forceRefresh)
             Refresh(TVI_ROOT);
         }
     }
+    CFileNameIndex::Instance().SetRoot(m_path);
 }
 
 bool CFileTree::Init(HWND hParent)
@@ -882,6 +884,9 @@ void CFileTree::HandleChangeNotifications()
                     }
                 }
                 break;
+                case PATH_CHANGES_LOST:
+                    refreshRoot = true;
+                    break;
                 default:
                     break;
             }
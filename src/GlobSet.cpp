@@ -0,0 +1,254 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include "stdafx.h"
+#include "GlobSet.h"
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+wchar_t Upper(wchar_t c)
+{
+    if (c < 128)
+        return (c >= L'a' && c <= L'z') ? static_cast<wchar_t>(c - (L'a' - L'A')) : c;
+    return static_cast<wchar_t>(towupper(c));
+}
+
+// In the automaton a '*' state stays active on every character and also
+// activates the state after it without consuming one. Consecutive '*' are
+// merged when compiling, so one step of this is enough.
+void SkipStars(uint64_t* states, const uint64_t* starStates, size_t words)
+{
+    uint64_t carry = 0;
+    for (size_t w = 0; w < words; ++w)
+    {
+        uint64_t stars = states[w] & starStates[w];
+        states[w] |= (stars << 1) | carry;
+        carry = stars >> 63;
+    }
+}
+} // namespace
+
+size_t CGlobSet::NoCaseHash::operator()(std::wstring_view s) const
+{
+    size_t hash = 14695981039346656037ULL;
+    for (auto c : s)
+    {
+        hash ^= Upper(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool CGlobSet::NoCaseEqual::operator()(std::wstring_view lhs, std::wstring_view rhs) const
+{
+    if (lhs.size() != rhs.size())
+        return false;
+    for (size_t i = 0; i < lhs.size(); ++i)
+    {
+        if (lhs[i] != rhs[i] && Upper(lhs[i]) != Upper(rhs[i]))
+            return false;
+    }
+    return true;
+}
+
+CGlobSet::CGlobSet(const std::vector<std::wstring>& patterns)
+{
+    for (const auto& pattern : patterns)
+    {
+        m_empty = false;
+        // PathMatchSpec() matches every name for this one, even names without a dot
+        if (pattern == L"*.*")
+        {
+            m_matchAll = true;
+            continue;
+        }
+        std::wstring_view masks = pattern;
+        while (!masks.empty())
+        {
+            auto start = masks.find_first_not_of(L' ');
+            if (start == std::wstring_view::npos)
+                break;
+            masks.remove_prefix(start);
+            auto end = masks.find(L';');
+            AddMask(masks.substr(0, end));
+            if (end == std::wstring_view::npos)
+                break;
+            masks.remove_prefix(end + 1);
+        }
+    }
+    Compile();
+}
+
+std::wstring_view CGlobSet::FileNamePart(std::wstring_view path)
+{
+    auto slashPos = path.find_last_of(L"\\/");
+    if (slashPos != std::wstring_view::npos)
+        path.remove_prefix(slashPos + 1);
+    return path;
+}
+
+void CGlobSet::AddMask(std::wstring_view mask)
+{
+    // an empty mask only matches an empty name
+    if (mask.empty())
+        return;
+    if (mask.find_first_of(L"*?") == std::wstring_view::npos)
+        m_names.emplace(mask);
+    else if (mask.size() >= 2 && mask[0] == L'*' && mask[1] == L'.' && mask.find_first_of(L"*?", 2) == std::wstring_view::npos)
+        m_extensions.emplace(mask.substr(2));
+    else if (mask.find_first_not_of(L'*') == std::wstring_view::npos)
+        m_matchAll = true;
+    else
+        AddToAutomaton(mask);
+}
+
+void CGlobSet::AddToAutomaton(std::wstring_view mask)
+{
+    for (size_t i = 0; i < mask.size(); ++i)
+    {
+        if (mask[i] == L'*' && i > 0 && mask[i - 1] == L'*')
+            continue;
+        m_pattern.push_back(Upper(mask[i]));
+    }
+    m_pattern.push_back(0);
+}
+
+void CGlobSet::Compile()
+{
+    m_words = (m_pattern.size() + 63) / 64;
+    if (m_words == 0)
+        return;
+    m_startStates.assign(m_words, 0);
+    m_acceptStates.assign(m_words, 0);
+    m_starStates.assign(m_words, 0);
+    m_anyCharStates.assign(m_words, 0);
+    m_asciiStates.assign(128 * m_words, 0);
+
+    bool atStart = true;
+    for (size_t i = 0; i < m_pattern.size(); ++i)
+    {
+        auto    bit  = uint64_t(1) << (i % 64);
+        auto    word = i / 64;
+        wchar_t c    = m_pattern[i];
+        if (atStart)
+            m_startStates[word] |= bit;
+        atStart = c == 0;
+        if (c == 0)
+            m_acceptStates[word] |= bit;
+        else if (c == L'*')
+            m_starStates[word] |= bit;
+        else if (c == L'?')
+            m_anyCharStates[word] |= bit;
+        else if (c < 128)
+            m_asciiStates[c * m_words + word] |= bit;
+        else
+        {
+            auto& states = m_otherStates[c];
+            states.resize(m_words);
+            states[word] |= bit;
+        }
+    }
+    // the pattern characters are upper case: lower case letters advance the same states
+    for (wchar_t c = L'a'; c <= L'z'; ++c)
+        std::copy_n(&m_asciiStates[Upper(c) * m_words], m_words, &m_asciiStates[c * m_words]);
+    // and '?' advances on any character
+    for (size_t c = 0; c < 128; ++c)
+    {
+        for (size_t w = 0; w < m_words; ++w)
+            m_asciiStates[c * m_words + w] |= m_anyCharStates[w];
+    }
+    for (auto& [c, states] : m_otherStates)
+    {
+        for (size_t w = 0; w < m_words; ++w)
+            states[w] |= m_anyCharStates[w];
+    }
+    SkipStars(m_startStates.data(), m_starStates.data(), m_words);
+}
+
+bool CGlobSet::Matches(std::wstring_view name) const
+{
+    if (m_matchAll)
+        return true;
+    if (!m_names.empty() && m_names.find(name) != m_names.end())
+        return true;
+    if (!m_extensions.empty())
+    {
+        // "*.ext" matches the text after any dot, e.g. "*.tar.gz" and "*.gz" both match "a.tar.gz"
+        for (auto dotPos = name.find(L'.'); dotPos != std::wstring_view::npos; dotPos = name.find(L'.', dotPos + 1))
+        {
+            if (m_extensions.find(name.substr(dotPos + 1)) != m_extensions.end())
+                return true;
+        }
+    }
+    return m_words > 0 && RunAutomaton(name);
+}
+
+bool CGlobSet::RunAutomaton(std::wstring_view name) const
+{
+    uint64_t              localStates[16];
+    std::vector<uint64_t> allocatedStates;
+    uint64_t*             active = localStates;
+    if (m_words > 8)
+    {
+        allocatedStates.resize(2 * m_words);
+        active = allocatedStates.data();
+    }
+    uint64_t* next = active + m_words;
+    std::copy_n(m_startStates.data(), m_words, active);
+
+    for (auto c : name)
+    {
+        const uint64_t* advance = m_anyCharStates.data();
+        if (c < 128)
+            advance = &m_asciiStates[c * m_words];
+        else
+        {
+            auto u = Upper(c);
+            if (u < 128)
+                advance = &m_asciiStates[u * m_words];
+            else
+            {
+                auto it = m_otherStates.find(u);
+                if (it != m_otherStates.end())
+                    advance = it->second.data();
+            }
+        }
+
+        uint64_t carry = 0;
+        for (size_t w = 0; w < m_words; ++w)
+        {
+            uint64_t moved = active[w] & advance[w];
+            next[w]        = (moved << 1) | carry | (active[w] & m_starStates[w]);
+            carry          = moved >> 63;
+        }
+        SkipStars(next, m_starStates.data(), m_words);
+
+        uint64_t any = 0;
+        for (size_t w = 0; w < m_words; ++w)
+            any |= next[w];
+        if (any == 0)
+            return false;
+        std::swap(active, next);
+    }
+    for (size_t w = 0; w < m_words; ++w)
+    {
+        if (active[w] & m_acceptStates[w])
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,86 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * \ingroup Utils
+ * A set of wildcard patterns that is matched against a file name in one go,
+ * with the same results as calling PathMatchSpec() for every pattern.
+ *
+ * Each pattern may itself be a list separated by ';' like PathMatchSpec()
+ * accepts. '*' matches any number of characters, '?' exactly one, and the
+ * comparison ignores case.
+ *
+ * Patterns without wildcards and patterns like "*.ext" are kept in hash sets;
+ * all other patterns are combined into one automaton that is run over the
+ * name once, tracking the state of every pattern in a bit set.
+ */
+class CGlobSet
+{
+public:
+    CGlobSet() = default;
+    CGlobSet(const std::vector<std::wstring>& patterns);
+
+    bool Empty() const { return m_empty; }
+
+    /// returns true if \c name matches any of the patterns. \c name
+    /// must not contain the folder, see FileNamePart().
+    bool Matches(std::wstring_view name) const;
+
+    /// returns the part of \c path after the last folder separator
+    static std::wstring_view FileNamePart(std::wstring_view path);
+
+private:
+    void AddMask(std::wstring_view mask);
+    void AddToAutomaton(std::wstring_view mask);
+    void Compile();
+    bool RunAutomaton(std::wstring_view name) const;
+
+    struct NoCaseHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::wstring_view s) const;
+    };
+    struct NoCaseEqual
+    {
+        using is_transparent = void;
+        bool operator()(std::wstring_view lhs, std::wstring_view rhs) const;
+    };
+    using NoCaseSet = std::unordered_set<std::wstring, NoCaseHash, NoCaseEqual>;
+
+    bool      m_empty    = true;
+    bool      m_matchAll = false;
+    NoCaseSet m_names;      ///< patterns without wildcards
+    NoCaseSet m_extensions; ///< "ext" for the patterns "*.ext"
+
+    // The automaton has one state per pattern character plus one accepting
+    // state per pattern, stored as bits in m_words words of 64 bits.
+    std::vector<wchar_t>                               m_pattern;       ///< the upper case pattern characters, 0 for the accepting states
+    size_t                                             m_words = 0;
+    std::vector<uint64_t>                              m_startStates;
+    std::vector<uint64_t>                              m_acceptStates;
+    std::vector<uint64_t>                              m_starStates;
+    std::vector<uint64_t>                              m_anyCharStates; ///< states of a '?'
+    std::vector<uint64_t>                              m_asciiStates;   ///< states a character below 128 advances, '?' included
+    std::unordered_map<wchar_t, std::vector<uint64_t>> m_otherStates;   ///< the same for upper case characters above 127
+};
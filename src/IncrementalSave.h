@@ -0,0 +1,61 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2022 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * \ingroup Utils
+ * What a save back to the document's own file has to write.
+ *
+ * Scintilla tracks the span [unsavedStart, unsavedEnd) outside of which the
+ * text is still the text at the save point. If the file holds the text at the
+ * save point, only that span has to be written when the file keeps its length,
+ * otherwise everything from unsavedStart on is written and the file is cut
+ * after it.
+ *
+ * A matching file time alone doesn't show that the file holds the save point
+ * text: keeping the own text after the file was changed or deleted outside, or
+ * after opening the file under another path, updates the file time too. So
+ * the caller passes whether the file was loaded or fully saved to since.
+ */
+struct IncrementalSave
+{
+    bool          possible = false;
+    std::uint64_t offset   = 0;     ///< file offset to write the text from \c start at
+    std::size_t   start    = 0;     ///< first character of the text to write
+    std::size_t   end      = 0;     ///< end of the text to write
+    bool          truncate = false; ///< cut the file after the written text
+};
+
+inline IncrementalSave PlanIncrementalSave(bool savePointOnDisk, bool sameWriteTime, std::uint64_t fileSize, std::uint64_t bomLength,
+                                           std::size_t length, std::size_t unsavedStart, std::size_t unsavedEnd)
+{
+    IncrementalSave plan;
+    if (!savePointOnDisk || !sameWriteTime || unsavedStart > unsavedEnd || unsavedEnd > length)
+        return plan;
+    // the unchanged prefix and suffix must both still be in the file
+    if (fileSize < bomLength + unsavedStart + (length - unsavedEnd))
+        return plan;
+    const bool sameLength = fileSize == bomLength + length;
+    plan.possible         = true;
+    plan.offset           = bomLength + unsavedStart;
+    plan.start            = unsavedStart;
+    plan.end              = sameLength ? unsavedEnd : length;
+    plan.truncate         = !sameLength;
+    return plan;
+}
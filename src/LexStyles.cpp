@@ -77,6 +77,7 @@ LexerStyleData::LexerStyleData()
 
 CLexStyles::CLexStyles()
     : m_bLoaded(false)
+    , m_generation(0)
 {
 }
 
@@ -479,6 +480,7 @@ void CLexStyles::Load()
         m_filterSpec.push_back({name.c_str(), mask.c_str()});
 
     m_bLoaded = true;
+    ++m_generation;
 }
 
 const std::unordered_map<int, std::string>& CLexStyles::GetKeywordsForLang(const std::string& lang)
@@ -526,7 +528,10 @@ bool CLexStyles::AddUserFunctionForLang(const std::string& lang, const std::stri
         {
             auto [it, success] = lt->second.userKeyWords.insert(fnc);
             if (success)
+            {
                 lt->second.userKeyWordsUpdated = true;
+                ++m_generation;
+            }
             return success;
         }
     }
@@ -136,6 +136,8 @@ public:
     std::string GetLanguageForPath(const std::wstring& path);
     void        GenerateUserKeywords(LanguageData& ld) const;
     void        Reload();
+    // incremented whenever keywords or lexer properties may have changed
+    size_t      GetGeneration() const { return m_generation; }
 
 private:
     CLexStyles();
@@ -149,7 +151,8 @@ private:
                            LexerStyleData&                                            style) const;
 
 private:
-    bool m_bLoaded;
+    bool   m_bLoaded;
+    size_t m_generation;
 
     // Different languages may have the same file extension
     std::multimap<std::string, std::string> m_extLang;
@@ -0,0 +1,696 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include "LineSorter.h"
+#include "../ext/scintilla/src/CaseConvert.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace Scintilla::Internal;
+
+struct CLineSorter::SortLine
+{
+    uint64_t         keyStart; ///< the first bytes of the key, most comparisons are decided by it
+    std::string_view key;
+    std::string_view line;
+    size_t           keyTextStart; ///< where the text the key was built from is in the line
+    size_t           keyTextLength;
+    size_t           index;
+};
+
+namespace
+{
+// below this many lines per thread, starting threads costs more than it saves
+constexpr size_t minLinesPerThread = 16384;
+// the sorted runs are written and read in blocks of this size
+constexpr size_t runBufferSize = 1024 * 1024;
+
+uint64_t KeyStart(std::string_view key)
+{
+    uint64_t start = 0;
+    for (size_t i = 0; i < sizeof(start); ++i)
+        start = (start << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0);
+    return start;
+}
+
+std::string_view NextLine(std::string_view text, size_t& start)
+{
+    auto end = text.find_first_of("\r\n", start);
+    if (end == std::string_view::npos)
+        end = text.size();
+    auto line = text.substr(start, end - start);
+    start     = end + ((end + 1 < text.size() && text[end] == '\r' && text[end + 1] == '\n') ? 2 : 1);
+    return line;
+}
+
+// A run of digits becomes a '0' so it compares like a digit with other text, the
+// number of bytes needed for the count of significant digits, that count and then
+// the significant digits. Comparing bytewise then orders the runs by their value.
+void AppendNumber(std::string& key, std::string_view digits)
+{
+    auto firstSignificant = digits.find_first_not_of('0');
+    auto significant      = firstSignificant == std::string_view::npos ? digits.substr(digits.size() - 1) : digits.substr(firstSignificant);
+    char countBytes[sizeof(size_t)];
+    int  countLength = 0;
+    for (size_t count = significant.size(); count; count >>= 8)
+        countBytes[countLength++] = static_cast<char>(count & 0xFF);
+    key.push_back('0');
+    key.push_back(static_cast<char>(countLength));
+    while (countLength > 0)
+        key.push_back(countBytes[--countLength]);
+    key.append(significant);
+}
+
+void AppendKey(std::string& key, std::string_view line, bool digitsAsNumbers, ICaseConverter* folder)
+{
+    for (size_t i = 0; i < line.size();)
+    {
+        auto c = static_cast<unsigned char>(line[i]);
+        if (digitsAsNumbers && c >= '0' && c <= '9')
+        {
+            auto end = i;
+            while (end < line.size() && line[end] >= '0' && line[end] <= '9')
+                ++end;
+            AppendNumber(key, line.substr(i, end - i));
+            i = end;
+        }
+        else if (c < 0x80)
+        {
+            key.push_back(static_cast<char>((c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c));
+            ++i;
+        }
+        else
+        {
+            auto end = i;
+            while (end < line.size() && static_cast<unsigned char>(line[end]) >= 0x80)
+                ++end;
+            auto   keyLength = key.size();
+            size_t room      = (end - i) * maxExpansionCaseConversion;
+            key.resize(keyLength + room);
+            auto folded = folder->CaseConvertString(key.data() + keyLength, room, line.data() + i, end - i);
+            key.resize(keyLength + folded);
+            if (folded == 0)
+                key.append(line.substr(i, end - i));
+            i = end;
+        }
+    }
+}
+
+// Appends a parsed number or date in front of the key text: a 1 and the value
+// with its bytes ordered so they compare like the values, or a 0 if there's no
+// value so these lines come first.
+void AppendValue(std::string& key, bool valid, uint64_t orderedValue)
+{
+    key.push_back(valid ? 1 : 0);
+    if (!valid)
+        return;
+    for (int shift = 56; shift >= 0; shift -= 8)
+        key.push_back(static_cast<char>((orderedValue >> shift) & 0xFF));
+}
+
+uint64_t OrderedBits(double value)
+{
+    auto bits = std::bit_cast<uint64_t>(value + 0.0); // -0.0 becomes 0.0
+    return (bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL;
+}
+
+bool ParseNumber(std::string_view text, double& value)
+{
+    auto start = text.find_first_not_of(" \t");
+    if (start == std::string_view::npos)
+        return false;
+    text.remove_prefix(start);
+    if (text[0] == '+')
+        text.remove_prefix(1);
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error == std::errc::result_out_of_range)
+    {
+        // too large or too small for a double
+        auto number   = text.substr(0, static_cast<size_t>(end - text.data()));
+        auto exponent = number.find_first_of("eE");
+        bool tiny     = exponent == std::string_view::npos ? number.find_first_not_of("-0") == number.find('.') : number[exponent + 1] == '-';
+        value         = tiny ? 0.0 : HUGE_VAL;
+        if (number[0] == '-')
+            value = -value;
+        return true;
+    }
+    return error == std::errc() && !std::isnan(value);
+}
+
+int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= month <= 2;
+    const int64_t  era          = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra    = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear    = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra     = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+class DateScanner
+{
+public:
+    DateScanner(std::string_view text)
+        : m_text(text)
+    {
+    }
+
+    size_t Pos() const { return m_pos; }
+    void   SetPos(size_t pos) { m_pos = pos; }
+
+    void SkipSpaces()
+    {
+        while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t'))
+            ++m_pos;
+    }
+
+    bool Char(char c)
+    {
+        if (m_pos >= m_text.size() || m_text[m_pos] != c)
+            return false;
+        ++m_pos;
+        return true;
+    }
+
+    bool OneOf(std::string_view chars, char& c)
+    {
+        if (m_pos >= m_text.size() || chars.find(m_text[m_pos]) == std::string_view::npos)
+            return false;
+        c = m_text[m_pos++];
+        return true;
+    }
+
+    /// reads a number of minDigits to maxDigits digits, returns the number of digits or 0
+    size_t Number(int& value, size_t minDigits, size_t maxDigits)
+    {
+        size_t digits = 0;
+        value         = 0;
+        while (m_pos + digits < m_text.size() && digits < maxDigits && m_text[m_pos + digits] >= '0' && m_text[m_pos + digits] <= '9')
+            value = value * 10 + (m_text[m_pos + digits++] - '0');
+        if (digits < minDigits || (m_pos + digits < m_text.size() && m_text[m_pos + digits] >= '0' && m_text[m_pos + digits] <= '9'))
+            return 0;
+        m_pos += digits;
+        return digits;
+    }
+
+    std::string_view Word()
+    {
+        auto start = m_pos;
+        while (m_pos < m_text.size() && ((m_text[m_pos] | 0x20) >= 'a' && (m_text[m_pos] | 0x20) <= 'z'))
+            ++m_pos;
+        return m_text.substr(start, m_pos - start);
+    }
+
+private:
+    std::string_view m_text;
+    size_t           m_pos = 0;
+};
+
+int MonthFromName(std::string_view word)
+{
+    constexpr std::string_view months = "janfebmaraprmayjunjulaugsepoctnovdec";
+    if (word.size() < 3)
+        return 0;
+    char name[3];
+    for (size_t i = 0; i < 3; ++i)
+        name[i] = static_cast<char>(word[i] | 0x20);
+    auto found = months.find(std::string_view(name, 3));
+    return (found == std::string_view::npos || found % 3) ? 0 : static_cast<int>(found / 3 + 1);
+}
+
+// Parses "2021-03-14", "2021/03/14", "14/Mar/2021", "14 March 2021", "Sun, 14 Mar 2021",
+// "Mar 14, 2021" and "Mar 14" without a year like in syslog files, each with an optional
+// time like "15:09:26.535" after a space, a 'T' or a ':'. Dates with the day and month as
+// numbers in any other order are ambiguous and not parsed. Time zones are ignored.
+bool ParseDate(std::string_view text, int64_t& milliseconds)
+{
+    DateScanner scanner(text);
+    scanner.SkipSpaces();
+    int  year = 0, month = 0, day = 0;
+    auto word = scanner.Word();
+    if (!word.empty() && !MonthFromName(word))
+    {
+        // the day of the week
+        scanner.Char(',');
+        scanner.SkipSpaces();
+        word = scanner.Word();
+    }
+    if (!word.empty())
+    {
+        month = MonthFromName(word);
+        scanner.SkipSpaces();
+        if (!month || !scanner.Number(day, 1, 2))
+            return false;
+        scanner.Char(',');
+        auto beforeYear = scanner.Pos();
+        scanner.SkipSpaces();
+        if (!scanner.Number(year, 4, 4))
+            scanner.SetPos(beforeYear);
+    }
+    else
+    {
+        int  first  = 0;
+        auto digits = scanner.Number(first, 1, 4);
+        char separator;
+        if (digits == 4)
+        {
+            year = first;
+            if (!scanner.OneOf("-/.", separator) || !scanner.Number(month, 1, 2) || !scanner.Char(separator) || !scanner.Number(day, 1, 2))
+                return false;
+        }
+        else if (digits > 0 && digits <= 2)
+        {
+            day = first;
+            if (!scanner.OneOf("-/. ", separator))
+                return false;
+            scanner.SkipSpaces();
+            month = MonthFromName(scanner.Word());
+            if (!month || !scanner.OneOf("-/. ", separator))
+                return false;
+            scanner.SkipSpaces();
+            if (!scanner.Number(year, 4, 4))
+                return false;
+        }
+        else
+            return false;
+    }
+    if (month < 1 || month > 12 || day < 1 || day > 31)
+        return false;
+
+    int64_t timeOfDay  = 0;
+    auto    beforeTime = scanner.Pos();
+    char    separator;
+    scanner.OneOf("T:", separator);
+    scanner.SkipSpaces();
+    int hours = 0, minutes = 0, seconds = 0;
+    if (scanner.Number(hours, 1, 2) && scanner.Char(':') && scanner.Number(minutes, 2, 2) && hours < 24 && minutes < 60)
+    {
+        if (scanner.Char(':') && scanner.Number(seconds, 2, 2) && seconds <= 60)
+        {
+            int fraction = 0;
+            if (scanner.OneOf(".,", separator))
+            {
+                auto digits = scanner.Number(fraction, 1, 3);
+                while (digits && digits++ < 3)
+                    fraction *= 10;
+            }
+            timeOfDay = seconds * 1000LL + fraction;
+        }
+        timeOfDay += (hours * 60LL + minutes) * 60000;
+    }
+    else
+        scanner.SetPos(beforeTime);
+
+    milliseconds = DaysFromCivil(year, month, day) * 86400000 + timeOfDay;
+    return true;
+}
+
+std::string_view FieldText(std::string_view line, char delimiter, size_t field)
+{
+    size_t start = 0;
+    for (size_t current = 0;; ++current)
+    {
+        size_t end = 0;
+        if (start < line.size() && line[start] == '"')
+        {
+            // a quote inside a quoted field is written as two quotes
+            auto closing = start + 1;
+            while (closing < line.size() && (line[closing] != '"' || (closing + 1 < line.size() && line[closing + 1] == '"')))
+                closing += line[closing] == '"' ? 2 : 1;
+            if (current == field)
+                return line.substr(start + 1, (std::min)(closing, line.size()) - start - 1);
+            end = closing < line.size() ? line.find(delimiter, closing) : std::string_view::npos;
+        }
+        else
+        {
+            end = line.find(delimiter, start);
+            if (current == field)
+                return line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        }
+        if (end == std::string_view::npos)
+            return line.substr(line.size());
+        start = end + 1;
+    }
+}
+
+std::string_view ColumnText(std::string_view line, size_t firstColumn, size_t columnCount)
+{
+    auto skip = [line](size_t pos, size_t characters) {
+        for (; pos < line.size() && characters > 0; --characters)
+        {
+            ++pos;
+            while (pos < line.size() && (static_cast<unsigned char>(line[pos]) & 0xC0) == 0x80)
+                ++pos;
+        }
+        return pos;
+    };
+    auto start = skip(0, firstColumn);
+    auto end   = columnCount ? skip(start, columnCount) : line.size();
+    return line.substr(start, end - start);
+}
+
+// Runs f(chunk) for every chunk, on its own thread except for the last one
+template <typename F>
+void ForEachChunk(size_t chunks, F&& f)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(chunks);
+    for (size_t chunk = 0; chunk + 1 < chunks; ++chunk)
+        threads.emplace_back([&f, chunk]() { f(chunk); });
+    f(chunks - 1);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+// A sorted run is stored as one record per line: the sizes of the line and its
+// key, where the key text is in the line, then the line and the key.
+class RunReader
+{
+public:
+    RunReader(const std::filesystem::path& path)
+        : m_buffer(runBufferSize)
+    {
+        m_file.rdbuf()->pubsetbuf(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+        m_file.open(path, std::ios::binary);
+        m_failed = !m_file.is_open();
+    }
+
+    /// reads the next record of the run, returns false at its end or if reading failed
+    bool Next(std::string_view& line, std::string_view& key, size_t& keyTextStart, size_t& keyTextLength)
+    {
+        uint64_t header[4];
+        if (m_failed || !m_file.read(reinterpret_cast<char*>(header), sizeof(header)))
+        {
+            m_failed = m_failed || m_file.gcount() != 0;
+            return false;
+        }
+        m_line.resize(header[0]);
+        m_key.resize(header[1]);
+        if (!m_file.read(m_line.data(), static_cast<std::streamsize>(m_line.size())) || !m_file.read(m_key.data(), static_cast<std::streamsize>(m_key.size())))
+        {
+            m_failed = true;
+            return false;
+        }
+        line          = m_line;
+        key           = m_key;
+        keyTextStart  = header[2];
+        keyTextLength = header[3];
+        return true;
+    }
+
+    bool Failed() const { return m_failed; }
+
+private:
+    std::vector<char> m_buffer;
+    std::ifstream     m_file;
+    std::string       m_line;
+    std::string       m_key;
+    bool              m_failed = false;
+};
+
+class RunFiles
+{
+public:
+    ~RunFiles()
+    {
+        for (const auto& path : paths)
+        {
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+    }
+
+    std::vector<std::filesystem::path> paths;
+};
+} // namespace
+
+CLineSorter::CLineSorter(const Options& options)
+    : m_options(options)
+{
+    if (m_options.keySource == KeySource::Regex)
+        m_regex = std::regex(m_options.regex, std::regex_constants::ECMAScript);
+}
+
+std::vector<std::string_view> CLineSorter::SplitLines(std::string_view text)
+{
+    std::vector<std::string_view> lines;
+    for (size_t start = 0; start < text.size();)
+        lines.push_back(NextLine(text, start));
+    return lines;
+}
+
+std::string_view CLineSorter::KeyText(std::string_view line) const
+{
+    switch (m_options.keySource)
+    {
+        case KeySource::Field:
+            return FieldText(line, m_options.delimiter, m_options.field);
+        case KeySource::Column:
+            return ColumnText(line, m_options.firstColumn, m_options.columnCount);
+        case KeySource::Regex:
+        {
+            std::match_results<std::string_view::const_iterator> match;
+            auto                                                 group = m_options.regexGroup;
+            if (std::regex_search(line.begin(), line.end(), match, m_regex) && group < match.size() && match[group].matched)
+                return line.substr(static_cast<size_t>(match.position(group)), static_cast<size_t>(match.length(group)));
+            return line.substr(line.size());
+        }
+        default:
+            return line;
+    }
+}
+
+bool CLineSorter::Less(const SortLine& lhs, const SortLine& rhs) const
+{
+    int result = lhs.keyStart == rhs.keyStart ? lhs.key.compare(rhs.key) : (lhs.keyStart < rhs.keyStart ? -1 : 1);
+    if (result == 0 && !m_options.caseInsensitive)
+        result = lhs.line.substr(lhs.keyTextStart, lhs.keyTextLength).compare(rhs.line.substr(rhs.keyTextStart, rhs.keyTextLength));
+    // identical lines have to be next to each other to remove them
+    if (result == 0 && m_options.removeDuplicates)
+        result = lhs.line.compare(rhs.line);
+    if (result != 0)
+        return m_options.descending ? result > 0 : result < 0;
+    return lhs.index < rhs.index;
+}
+
+std::vector<CLineSorter::SortLine> CLineSorter::SortRun(const std::vector<std::string_view>& lines, std::vector<std::string>& keys) const
+{
+    const auto& options = m_options;
+    auto        less    = [this](const SortLine& lhs, const SortLine& rhs) { return Less(lhs, rhs); };
+
+    unsigned threadCount = m_threadCount ? m_threadCount : (std::max)(1u, std::thread::hardware_concurrency());
+    size_t   chunks      = std::clamp<size_t>(lines.size() / minLinesPerThread, 1, threadCount);
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t chunk = 0; chunk <= chunks; ++chunk)
+        bounds[chunk] = lines.size() * chunk / chunks;
+
+    // build the keys and sort every chunk on its own
+    auto* folder = ConverterFor(CaseConversion::fold); // sets up the tables before the threads use them
+    keys.assign(chunks, std::string());
+    std::vector<SortLine> sorted(lines.size());
+    ForEachChunk(chunks, [&](size_t chunk) {
+        auto&               key = keys[chunk];
+        std::vector<size_t> keyEnds;
+        keyEnds.reserve(bounds[chunk + 1] - bounds[chunk]);
+        for (auto i = bounds[chunk]; i < bounds[chunk + 1]; ++i)
+        {
+            auto keyText = KeyText(lines[i]);
+            if (options.keyType == KeyType::Number)
+            {
+                double value = 0;
+                bool   valid = ParseNumber(keyText, value);
+                AppendValue(key, valid, valid ? OrderedBits(value) : 0);
+            }
+            else if (options.keyType == KeyType::Date)
+            {
+                int64_t value = 0;
+                bool    valid = ParseDate(keyText, value);
+                AppendValue(key, valid, static_cast<uint64_t>(value) ^ 0x8000000000000000ULL);
+            }
+            if (!options.collator || !options.collator(keyText, key))
+                AppendKey(key, keyText, options.digitsAsNumbers, folder);
+            keyEnds.push_back(key.size());
+            sorted[i].keyTextStart  = static_cast<size_t>(keyText.data() - lines[i].data());
+            sorted[i].keyTextLength = keyText.size();
+        }
+        size_t keyStart = 0;
+        for (auto i = bounds[chunk]; i < bounds[chunk + 1]; ++i)
+        {
+            auto keyEnd        = keyEnds[i - bounds[chunk]];
+            sorted[i].key      = std::string_view(key).substr(keyStart, keyEnd - keyStart);
+            sorted[i].keyStart = KeyStart(sorted[i].key);
+            sorted[i].line     = lines[i];
+            sorted[i].index    = i;
+            keyStart           = keyEnd;
+        }
+        std::sort(sorted.begin() + bounds[chunk], sorted.begin() + bounds[chunk + 1], less);
+    });
+
+    // then merge pairs of neighbouring chunks until there's only one left
+    std::vector<SortLine> merged(sorted.size());
+    for (size_t width = 1; width < chunks; width *= 2)
+    {
+        std::vector<size_t> firsts;
+        for (size_t first = 0; first < chunks; first += 2 * width)
+            firsts.push_back(first);
+        ForEachChunk(firsts.size(), [&](size_t pair) {
+            auto begin  = sorted.begin() + bounds[firsts[pair]];
+            auto middle = sorted.begin() + bounds[(std::min)(firsts[pair] + width, chunks)];
+            auto end    = sorted.begin() + bounds[(std::min)(firsts[pair] + 2 * width, chunks)];
+            std::merge(begin, middle, middle, end, merged.begin() + (begin - sorted.begin()), less);
+        });
+        sorted.swap(merged);
+    }
+    return sorted;
+}
+
+std::vector<std::string_view> CLineSorter::Sort(const std::vector<std::string_view>& lines) const
+{
+    std::vector<std::string>      keys;
+    auto                          sorted = SortRun(lines, keys);
+    std::vector<std::string_view> result;
+    result.reserve(sorted.size());
+    for (const auto& line : sorted)
+    {
+        if (!m_options.removeDuplicates || result.empty() || result.back() != line.line)
+            result.push_back(line.line);
+    }
+    return result;
+}
+
+bool CLineSorter::SortText(std::string_view text, const LineSink& output) const
+{
+    // while a run is sorted every line has its view, two sort entries and a key
+    // that is about as long as the line
+    constexpr size_t lineOverhead = sizeof(std::string_view) + 2 * sizeof(SortLine);
+
+    RunFiles                      runs;
+    std::vector<std::string_view> lines;
+    size_t                        runMemory = 0;
+    auto                          writeRun  = [&]() {
+        std::error_code error;
+        auto            folder = m_options.tempFolder.empty() ? std::filesystem::temp_directory_path(error) : m_options.tempFolder;
+        if (error)
+            return false;
+        auto now  = std::chrono::steady_clock::now().time_since_epoch().count();
+        auto path = folder / ("linesort-" + std::to_string(now) + "-" + std::to_string(runs.paths.size()) + ".tmp");
+        runs.paths.push_back(path);
+
+        std::vector<std::string> keys;
+        auto                     sorted = SortRun(lines, keys);
+        std::ofstream            file(path, std::ios::binary | std::ios::trunc);
+        std::string              buffer;
+        buffer.reserve(runBufferSize);
+        for (size_t i = 0; i < sorted.size() && file; ++i)
+        {
+            const auto& line = sorted[i];
+            if (m_options.removeDuplicates && i > 0 && sorted[i - 1].line == line.line)
+                continue;
+            uint64_t header[4] = {line.line.size(), line.key.size(), line.keyTextStart, line.keyTextLength};
+            buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+            buffer.append(line.line);
+            buffer.append(line.key);
+            if (buffer.size() >= runBufferSize)
+            {
+                file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        }
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        file.close();
+        lines.clear();
+        runMemory = 0;
+        return !file.fail();
+    };
+
+    for (size_t start = 0; start < text.size();)
+    {
+        auto line = NextLine(text, start);
+        lines.push_back(line);
+        runMemory += lineOverhead + line.size();
+        if (m_options.memoryBudget && runMemory > m_options.memoryBudget && start < text.size() && !writeRun())
+            return false;
+    }
+    if (runs.paths.empty())
+    {
+        for (auto line : Sort(lines))
+            output(line);
+        return true;
+    }
+    if (!lines.empty() && !writeRun())
+        return false;
+    return MergeRuns(runs.paths, output);
+}
+
+bool CLineSorter::MergeRuns(const std::vector<std::filesystem::path>& runs, const LineSink& output) const
+{
+    std::vector<std::unique_ptr<RunReader>> readers;
+    std::vector<SortLine>                   current(runs.size());
+    std::vector<size_t>                     heap;
+    auto                                    next = [&](size_t run) {
+        auto& line = current[run];
+        if (!readers[run]->Next(line.line, line.key, line.keyTextStart, line.keyTextLength))
+            return false;
+        line.keyStart = KeyStart(line.key);
+        return true;
+    };
+    for (size_t run = 0; run < runs.size(); ++run)
+    {
+        readers.push_back(std::make_unique<RunReader>(runs[run]));
+        // every run holds lines that come after the ones in the runs before it,
+        // so that's the order for lines that compare equal
+        current[run].index = run;
+        if (next(run))
+            heap.push_back(run);
+        else if (readers[run]->Failed())
+            return false;
+    }
+
+    auto greater = [&](size_t lhs, size_t rhs) { return Less(current[rhs], current[lhs]); };
+    std::make_heap(heap.begin(), heap.end(), greater);
+    std::string lastLine;
+    bool        hasLastLine = false;
+    while (!heap.empty())
+    {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        auto run  = heap.back();
+        auto line = current[run].line;
+        if (!m_options.removeDuplicates)
+            output(line);
+        else if (!hasLastLine || lastLine != line)
+        {
+            output(line);
+            lastLine.assign(line);
+            hasLastLine = true;
+        }
+        if (next(run))
+            std::push_heap(heap.begin(), heap.end(), greater);
+        else if (readers[run]->Failed())
+            return false;
+        else
+            heap.pop_back();
+    }
+    return true;
+}
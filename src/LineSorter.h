@@ -0,0 +1,122 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * \ingroup Utils
+ * Sorts lines of UTF-8 text.
+ *
+ * The lines are compared by a key taken from each line: the whole line, a
+ * field between delimiters, the text in a range of columns or a capture group
+ * of a regular expression. Keys can be compared as text, as numbers or as
+ * dates and times.
+ *
+ * A collation key is built once for every line: the parsed number or date if
+ * there is one, then the case folded key text, with runs of digits encoded so
+ * they compare by their value if digitsAsNumbers is set. That orders text by
+ * code points, so a collator can build the text part instead to sort like the
+ * user's language does. The lines are then sorted by comparing the collation
+ * keys bytewise, in chunks on several threads that are merged afterwards for
+ * large inputs.
+ *
+ * Keys that only differ in case are ordered by their text unless
+ * caseInsensitive is set. Lines with equal keys keep their original order,
+ * except when duplicates are removed: then they are ordered by their text so
+ * every line that is identical to one kept before it can be dropped.
+ *
+ * SortText() keeps the memory it needs for the keys below memoryBudget by
+ * sorting the text in runs that are written to temporary files and merged
+ * at the end.
+ *
+ * The sorter doesn't use any Windows API so it can be tested anywhere.
+ */
+class CLineSorter
+{
+public:
+    enum class KeySource
+    {
+        Line,
+        Field,  ///< field number \c field, separated by \c delimiter. Fields may be quoted with '"'.
+        Column, ///< \c columnCount characters from character \c firstColumn on, the rest of the line for a count of 0
+        Regex,  ///< capture group \c regexGroup of the first match of \c regex, an empty key if it doesn't match
+    };
+    enum class KeyType
+    {
+        Text,
+        Number, ///< a decimal number, lines without one sort before the others
+        Date,   ///< a date with an optional time like "2021-03-14 15:09:26", "14/Mar/2021:15:09:26" or "Mar 14, 2021"
+    };
+
+    struct Options
+    {
+        bool        descending       = false;
+        bool        caseInsensitive  = false;
+        bool        digitsAsNumbers  = false; ///< "file9" sorts before "file10"
+        bool        removeDuplicates = false;
+        KeySource   keySource        = KeySource::Line;
+        char        delimiter        = ',';
+        size_t      field            = 0; ///< zero based
+        size_t      firstColumn      = 0;
+        size_t      columnCount      = 0;
+        std::string regex;                ///< ECMAScript syntax
+        size_t      regexGroup       = 0;
+        KeyType     keyType          = KeyType::Text;
+        size_t      memoryBudget     = 0; ///< bytes for the keys and entries of the lines, not the text, 0 to always sort in memory
+
+        std::filesystem::path tempFolder; ///< for the sorted runs, the system temp folder if empty
+
+        /// appends a key for the key text that compares bytewise in the collation order
+        /// wanted, honouring caseInsensitive and digitsAsNumbers. Called on several threads.
+        /// Returns false without appending anything to use the code point order instead.
+        std::function<bool(std::string_view text, std::string& key)> collator;
+    };
+    using LineSink = std::function<void(std::string_view line)>;
+
+    /// throws std::regex_error if the key is a regex capture group and \c options.regex is invalid
+    CLineSorter(const Options& options);
+
+    /// the number of threads to use for large inputs, 0 for one per core
+    void SetThreadCount(unsigned threads) { m_threadCount = threads; }
+
+    /// returns the lines in sorted order, the views point into the same text as \c lines
+    std::vector<std::string_view> Sort(const std::vector<std::string_view>& lines) const;
+
+    /// passes the lines of \c text to \c output in sorted order. Returns false
+    /// if a sorted run couldn't be written to or read back from its temp file.
+    bool SortText(std::string_view text, const LineSink& output) const;
+
+    /// splits \c text at CR, LF and CRLF. A line end at the end of the text doesn't start another line.
+    static std::vector<std::string_view> SplitLines(std::string_view text);
+
+private:
+    struct SortLine;
+
+    std::string_view      KeyText(std::string_view line) const;
+    std::vector<SortLine> SortRun(const std::vector<std::string_view>& lines, std::vector<std::string>& keys) const;
+    bool                  Less(const SortLine& lhs, const SortLine& rhs) const;
+    bool                  MergeRuns(const std::vector<std::filesystem::path>& runs, const LineSink& output) const;
+
+    Options    m_options;
+    std::regex m_regex;
+    unsigned   m_threadCount = 0;
+};
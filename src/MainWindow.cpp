@@ -38,6 +38,7 @@
 #include "DPIAware.h"
 #include "Monitor.h"
 #include "ResString.h"
+#include "FileNameIndex.h"
 #include "../ext/tinyexpr/tinyexpr.h"
 
 #include <memory>
@@ -896,6 +897,7 @@ LRESULT CALLBACK CMainWindow::WinMsgHandler(HWND hwnd, UINT uMsg, WPARAM wParam,
         {
             findReplaceFinish();
             SaveRecents();
+            CFileNameIndex::Instance().Stop();
             PostQuitMessage(0);
             return 0;
         }
@@ -1356,6 +1358,9 @@ LRESULT CMainWindow::HandleEditorEvents(const NMHDR& nmHdr, WPARAM wParam, LPARA
             break;
         case SCN_BP_MOUSEMSG:
             return HandleMouseMsg(scn);
+        case SCN_BP_MARKSCHANGED:
+            UpdateStatusBar(false);
+            break;
         case SCN_MODIFIED:
         {
             if (pScn->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))
@@ -1981,6 +1986,14 @@ void CMainWindow::EnsureNewLineAtEnd(const CDocument& doc) const
     }
 }
 
+void CMainWindow::RemoveDocument(DocID docID)
+{
+    auto document = m_docManager.GetDocumentFromID(docID).m_document;
+    m_editor.ForgetDocument(document);
+    m_scratchEditor.ForgetDocument(document);
+    m_docManager.RemoveDocument(docID);
+}
+
 bool CMainWindow::SaveCurrentTab(bool bSaveAs /* = false */)
 {
     auto docID = GetCurrentTabId();
@@ -2027,7 +2040,8 @@ bool CMainWindow::SaveDoc(DocID docID, bool bSaveAs)
 
         if (!ShowFileSaveDialog(*this, title, ext, extIndex, filePath))
             return false;
-        doc.m_path = filePath;
+        doc.m_path             = filePath;
+        doc.m_bSavePointOnDisk = false;
         if ((isActiveTab && m_fileTree.GetPath().empty()) || bSaveAs)
         {
             updateFileTree = true;
@@ -2281,7 +2295,7 @@ bool CMainWindow::CloseTab(int closingTabIndex, bool force /* = false */, bool q
     // SCI_SETDOCPOINTER is necessary so the reference count of the document
     // is decreased and the memory can be released.
     m_editor.Scintilla().SetDocPointer(nullptr);
-    m_docManager.RemoveDocument(closingTabId);
+    RemoveDocument(closingTabId);
 
     int tabCount     = GetItemCount();
     int nextTabIndex = (closingTabIndex < tabCount) ? closingTabIndex : tabCount - 1;
@@ -3459,7 +3473,7 @@ int CMainWindow::OpenFile(const std::wstring& file, unsigned int openFlags)
                 const auto& activeDoc = m_docManager.GetDocumentFromID(activeTabId);
                 if (!activeDoc.m_bIsDirty && !activeDoc.m_bNeedsSaving)
                 {
-                    m_docManager.RemoveDocument(activeTabId);
+                    RemoveDocument(activeTabId);
                 }
                 else
                     activeTabId = DocID();
@@ -3481,7 +3495,7 @@ int CMainWindow::OpenFile(const std::wstring& file, unsigned int openFlags)
                             --m_insertionIndex;
                         // Prefer to remove the document after the tab has gone as it supports it
                         // and deletion causes events that may expect it to be there.
-                        m_docManager.RemoveDocument(docID);
+                        RemoveDocument(docID);
                     }
                 }
             }
@@ -3569,9 +3583,10 @@ bool CMainWindow::OpenFileAs(const std::wstring& tempPath, const std::wstring& r
     // it'll currently have a temporary name.
     auto  docID        = m_docManager.GetIdForPath(tempPath);
     auto& doc          = m_docManager.GetModDocumentFromID(docID);
-    doc.m_path         = CPathUtils::GetLongPathname(realpath);
-    doc.m_bIsDirty     = bModified;
-    doc.m_bNeedsSaving = bModified;
+    doc.m_path             = CPathUtils::GetLongPathname(realpath);
+    doc.m_bIsDirty         = bModified;
+    doc.m_bNeedsSaving     = bModified;
+    doc.m_bSavePointOnDisk = false; // the text was loaded from the temp file
     m_docManager.UpdateFileTime(doc, true);
     std::wstring sFileName = CPathUtils::GetFileName(doc.m_path);
     const auto&  lang      = CLexStyles::Instance().GetLanguageForDocument(doc, m_scratchEditor);
@@ -4046,12 +4061,15 @@ bool CMainWindow::ReloadTab(int tab, int encoding, bool dueToOutsideChanges)
         // the file isn't dirty or it wasn't appropriate to save.
         else if (response == ResponseToOutsideModifiedFile::KeepOurChanges) // Save
         {
+            doc.m_bSavePointOnDisk = false;
             SaveDoc(docID);
         }
         else // Cancel or failed to ask
         {
-            // update the fileTime of the document to avoid this warning
+            // update the fileTime of the document to avoid this warning,
+            // but the file no longer holds the text at the save point
             m_docManager.UpdateFileTime(doc, false);
+            doc.m_bSavePointOnDisk = false;
             // the current content of the tab is possibly different
             // than the content on disk: mark the content as dirty
             // so the user knows he can save the changes.
@@ -4073,6 +4091,8 @@ bool CMainWindow::ReloadTab(int tab, int encoding, bool dueToOutsideChanges)
         editor->Scintilla().SetDocPointer(doc.m_document);
 
     // LoadFile increases the reference count, so decrease it here first
+    m_editor.ForgetDocument(doc.m_document);
+    m_scratchEditor.ForgetDocument(doc.m_document);
     editor->Scintilla().ReleaseDocument(doc.m_document);
     CDocument docReload = m_docManager.LoadFile(/**this,*/ doc.m_path, encoding, false);
     if (!docReload.m_document)
@@ -4142,7 +4162,8 @@ bool CMainWindow::HandleOutsideDeletedFile(int tab)
     }
 
     // keep the file: mark the file as modified
-    doc.m_bNeedsSaving = true;
+    doc.m_bNeedsSaving     = true;
+    doc.m_bSavePointOnDisk = false;
     // update the fileTime of the document to avoid this warning
     m_docManager.UpdateFileTime(doc, false);
     // the next to calls are only here to trigger SCN_SAVEPOINTLEFT/SCN_SAVEPOINTREACHED messages
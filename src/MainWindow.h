@@ -184,6 +184,7 @@ private:
     void                             UpdateTab(DocID docID);
     void                             CloseAllButThis(int idx = -1);
     void                             EnsureNewLineAtEnd(const CDocument& doc) const;
+    void                             RemoveDocument(DocID docID);
     void                             OpenNewTab();
     void                             PasteHistory();
     void                             About() const;
@@ -0,0 +1,249 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include "stdafx.h"
+#include "OccurrenceSearch.h"
+
+#include <algorithm>
+
+namespace
+{
+// small enough for every thread to get several chunks, large enough that
+// handing them out costs nothing next to searching them. Each thread reads
+// a chunk at a time, which blocks edits, so they are not too large either.
+constexpr size_t minChunkSize    = 256 * 1024;
+constexpr size_t maxChunkSize    = 4 * 1024 * 1024;
+constexpr size_t chunksPerThread = 8;
+} // namespace
+
+COccurrenceSearch::COccurrenceSearch()
+{
+    // the same defaults as Scintilla
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        if (ch == '\r' || ch == '\n')
+            m_classes[ch] = CharClass::NewLine;
+        else if (ch < 0x20 || ch == ' ')
+            m_classes[ch] = CharClass::Space;
+        else if (ch >= 0x80 || isalnum(ch) || ch == '_')
+            m_classes[ch] = CharClass::Word;
+        else
+            m_classes[ch] = CharClass::Punctuation;
+    }
+}
+
+COccurrenceSearch::~COccurrenceSearch()
+{
+    Stop();
+}
+
+void COccurrenceSearch::SetCharacterClasses(std::string_view wordChars, std::string_view whitespaceChars)
+{
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        if (ch != '\r' && ch != '\n')
+            m_classes[ch] = ch >= 0x80 ? CharClass::Word : CharClass::Punctuation;
+    }
+    for (unsigned char ch : wordChars)
+        m_classes[ch] = CharClass::Word;
+    for (unsigned char ch : whitespaceChars)
+        m_classes[ch] = CharClass::Space;
+}
+
+// Like Document::IsWordAt() in Scintilla: the class changes at both ends and
+// the first and last characters are word or punctuation characters.
+bool COccurrenceSearch::IsWordAt(std::string_view text, size_t start, size_t end) const
+{
+    auto first  = m_classes[static_cast<unsigned char>(text[start])];
+    auto last   = m_classes[static_cast<unsigned char>(text[end - 1])];
+    auto before = start > 0 ? m_classes[static_cast<unsigned char>(text[start - 1])] : CharClass::Space;
+    auto after  = end < text.size() ? m_classes[static_cast<unsigned char>(text[end])] : CharClass::Space;
+    return (first == CharClass::Word || first == CharClass::Punctuation) && (first != before) &&
+           (last == CharClass::Word || last == CharClass::Punctuation) && (last != after);
+}
+
+size_t COccurrenceSearch::NextMatch(std::string_view text, std::string_view needle, bool wholeWord, size_t start, size_t end) const
+{
+    // occurrences after end don't count, so the text after them isn't searched
+    auto searched = text.substr(0, (std::min)(end + needle.size() - 1, text.size()));
+    while (start < end)
+    {
+        auto found = searched.find(needle, start);
+        if (found == std::string_view::npos)
+            break;
+        if (!wholeWord || IsWordAt(text, found, found + needle.size()))
+            return found;
+        start = found + 1;
+    }
+    return std::string_view::npos;
+}
+
+void COccurrenceSearch::Find(std::string_view text, std::string_view needle, bool wholeWord, size_t start, size_t end, std::vector<size_t>& positions) const
+{
+    if (needle.empty())
+        return;
+    for (auto found = NextMatch(text, needle, wholeWord, start, end); found != std::string_view::npos;
+         found      = NextMatch(text, needle, wholeWord, found + needle.size(), end))
+        positions.push_back(found);
+}
+
+bool COccurrenceSearch::ReadRange(size_t start, size_t end, std::string& buffer, size_t& bufferStart) const
+{
+    bufferStart   = start > 0 ? start - 1 : 0;
+    auto rangeEnd = (std::min)(end + m_needle.size(), m_textLength);
+    buffer.resize(rangeEnd - bufferStart);
+    return m_readText(buffer.data(), bufferStart, buffer.size());
+}
+
+void COccurrenceSearch::Start(size_t textLength, ReadText readText, std::string needle, bool wholeWord, ResultsReady resultsReady, unsigned threadCount)
+{
+    Stop();
+    m_textLength   = textLength;
+    m_readText     = std::move(readText);
+    m_needle       = std::move(needle);
+    m_wholeWord    = wholeWord;
+    m_resultsReady = std::move(resultsReady);
+    if (threadCount == 0)
+        threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+
+    m_chunkSize  = std::clamp(m_textLength / (threadCount * chunksPerThread) + 1, minChunkSize, maxChunkSize);
+    auto chunks  = (m_textLength + m_chunkSize - 1) / m_chunkSize;
+    m_chunks.assign(chunks, {});
+    m_chunkDone  = std::vector<std::atomic_bool>(chunks);
+    m_nextChunk  = 0;
+    m_stop       = false;
+    {
+        std::lock_guard lock(m_resultsGuard);
+        m_chunksDelivered = 0;
+        m_lastEnd         = 0;
+        m_results.clear();
+        m_notified = false;
+    }
+    threadCount = static_cast<unsigned>((std::min)(static_cast<size_t>(threadCount), chunks));
+    for (unsigned i = 0; i < threadCount; ++i)
+        m_threads.emplace_back(&COccurrenceSearch::SearchThread, this);
+}
+
+void COccurrenceSearch::Stop()
+{
+    m_stop = true;
+    Wait();
+    m_readText = nullptr;
+}
+
+void COccurrenceSearch::Wait()
+{
+    for (auto& thread : m_threads)
+        thread.join();
+    m_threads.clear();
+}
+
+bool COccurrenceSearch::TakeResults(std::vector<size_t>& positions)
+{
+    bool finished = false;
+    {
+        std::lock_guard lock(m_resultsGuard);
+        positions.insert(positions.end(), m_results.begin(), m_results.end());
+        m_results.clear();
+        m_notified = false;
+        finished   = !m_stop && m_chunksDelivered == m_chunks.size();
+    }
+    if (finished && m_readText)
+    {
+        // the threads are done with the text, so it needn't be kept for them
+        Wait();
+        m_readText = nullptr;
+    }
+    return finished;
+}
+
+void COccurrenceSearch::SearchThread()
+{
+    std::string buffer;
+    for (auto chunk = m_nextChunk++; chunk < m_chunks.size() && !m_stop; chunk = m_nextChunk++)
+    {
+        auto   start       = chunk * m_chunkSize;
+        auto   end         = (std::min)(start + m_chunkSize, m_textLength);
+        size_t bufferStart = 0;
+        if (!ReadRange(start, end, buffer, bufferStart))
+        {
+            m_stop = true;
+            break;
+        }
+        auto& positions = m_chunks[chunk];
+        Find(buffer, m_needle, m_wholeWord, start - bufferStart, end - bufferStart, positions);
+        for (auto& position : positions)
+            position += bufferStart;
+        m_chunkDone[chunk] = true;
+        DeliverChunks();
+    }
+}
+
+// Moves the positions of the chunks that are done and follow the ones delivered
+// before to the results. Each chunk was searched from its own start, so if the
+// last occurrence of the chunk before reaches into it, it is searched again from
+// the end of that occurrence until it finds an occurrence the chunk search found
+// too; from there on both found the same occurrences.
+void COccurrenceSearch::DeliverChunks()
+{
+    bool        notify = false;
+    std::string buffer;
+    {
+        std::lock_guard lock(m_resultsGuard);
+        auto            delivered = m_results.size();
+        while (m_chunksDelivered < m_chunks.size() && m_chunkDone[m_chunksDelivered])
+        {
+            auto& positions = m_chunks[m_chunksDelivered];
+            auto  it        = positions.begin();
+            auto  chunkEnd  = (std::min)((m_chunksDelivered + 1) * m_chunkSize, m_textLength);
+            if (it != positions.end() && *it < m_lastEnd && m_lastEnd < chunkEnd)
+            {
+                size_t bufferStart = 0;
+                if (!ReadRange(m_lastEnd, chunkEnd, buffer, bufferStart))
+                {
+                    m_stop = true;
+                    break;
+                }
+                auto end   = chunkEnd - bufferStart;
+                auto found = NextMatch(buffer, m_needle, m_wholeWord, m_lastEnd - bufferStart, end);
+                for (; found != std::string_view::npos; found = NextMatch(buffer, m_needle, m_wholeWord, found + m_needle.size(), end))
+                {
+                    it = std::lower_bound(it, positions.end(), found + bufferStart);
+                    if (it != positions.end() && *it == found + bufferStart)
+                        break;
+                    m_results.push_back(found + bufferStart);
+                }
+                if (found == std::string_view::npos)
+                    it = positions.end();
+            }
+            else if (it != positions.end() && *it < m_lastEnd)
+            {
+                // the last occurrence delivered reaches past this chunk
+                it = positions.end();
+            }
+            m_results.insert(m_results.end(), it, positions.end());
+            if (!m_results.empty())
+                m_lastEnd = (std::max)(m_lastEnd, m_results.back() + m_needle.size());
+            std::vector<size_t>().swap(positions);
+            ++m_chunksDelivered;
+        }
+        bool finished = m_chunksDelivered == m_chunks.size();
+        notify        = (m_results.size() != delivered || finished) && !m_notified;
+        m_notified    = m_notified || notify;
+    }
+    if (notify && m_resultsReady)
+        m_resultsReady();
+}
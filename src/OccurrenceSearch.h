@@ -0,0 +1,108 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2021 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/**
+ * \ingroup Utils
+ * Finds all occurrences of a text in a snapshot of a document, with the same
+ * results as calling FindText() with SCFIND_MATCHCASE (and SCFIND_WHOLEWORD)
+ * repeatedly from the start of the document to its end.
+ *
+ * The text is split into chunks that are read and searched on several threads.
+ * The positions are handed out in document order as soon as a chunk and all the
+ * chunks before it are done, so the first occurrences can be shown while the
+ * rest of the document is still searched.
+ */
+class COccurrenceSearch
+{
+public:
+    using ResultsReady = std::function<void()>;
+    /// copies [position, position + length) of the text to \c buffer. Called on the
+    /// search threads; returns false if the text can't be read, which stops the search.
+    using ReadText     = std::function<bool(char* buffer, size_t position, size_t length)>;
+
+    COccurrenceSearch();
+    ~COccurrenceSearch();
+
+    /// sets the word and whitespace characters like SCI_SETWORDCHARS and
+    /// SCI_SETWHITESPACECHARS do. Line ends are a class of their own, other
+    /// characters below 0x80 are punctuation and characters above are word characters.
+    void SetCharacterClasses(std::string_view wordChars, std::string_view whitespaceChars);
+
+    /// appends the positions of the occurrences of \c needle in \c text that start
+    /// in [\c start, \c end) to \c positions. \c text may go on before \c start and
+    /// after \c end, the characters there decide if an occurrence is a whole word.
+    void Find(std::string_view text, std::string_view needle, bool wholeWord, size_t start, size_t end, std::vector<size_t>& positions) const;
+
+    /// stops the running search and starts searching the text of \c textLength that
+    /// \c readText reads. \c resultsReady is called on a search thread when TakeResults()
+    /// has new positions; it must not wait for the thread that calls Stop().
+    void Start(size_t textLength, ReadText readText, std::string needle, bool wholeWord, ResultsReady resultsReady, unsigned threadCount = 0);
+    /// stops the search and returns once all search threads have ended and \c readText
+    /// was released.
+    void Stop();
+    /// returns once the whole text has been searched.
+    void Wait();
+    /// appends the positions found since the last call to \c positions.
+    /// Returns true if the whole text has been searched and all positions were taken,
+    /// \c readText is released then.
+    bool TakeResults(std::vector<size_t>& positions);
+
+private:
+    enum class CharClass : unsigned char
+    {
+        Space,
+        NewLine,
+        Word,
+        Punctuation,
+    };
+
+    bool   IsWordAt(std::string_view text, size_t start, size_t end) const;
+    size_t NextMatch(std::string_view text, std::string_view needle, bool wholeWord, size_t start, size_t end) const;
+    /// reads the text the occurrences that start in [\c start, \c end) lie in, with a
+    /// character of context on either side, to \c buffer. Returns the position of the buffer.
+    bool   ReadRange(size_t start, size_t end, std::string& buffer, size_t& bufferStart) const;
+    void   SearchThread();
+    void   DeliverChunks();
+
+    CharClass                        m_classes[256];
+
+    size_t                           m_textLength = 0;
+    ReadText                         m_readText;
+    std::string                      m_needle;
+    bool                             m_wholeWord = false;
+    ResultsReady                     m_resultsReady;
+    size_t                           m_chunkSize = 0;
+    std::vector<std::vector<size_t>> m_chunks; ///< the positions found in each chunk
+    std::vector<std::atomic_bool>    m_chunkDone;
+    std::atomic_size_t               m_nextChunk = 0;
+    std::atomic_bool                 m_stop      = false;
+    std::vector<std::thread>         m_threads;
+
+    std::mutex                       m_resultsGuard; ///< protects the members below
+    size_t                           m_chunksDelivered = 0;
+    size_t                           m_lastEnd         = 0; ///< end of the last delivered occurrence
+    std::vector<size_t>              m_results;
+    bool                             m_notified = false; ///< resultsReady was called and TakeResults() wasn't yet
+};
@@ -223,6 +223,12 @@ void CPathWatcher::WorkerThread()
                             } while (nOffset);
                         }
                     }
+                    else
+                    {
+                        // the buffer overflowed: the changes are lost
+                        std::unique_lock locker(m_guard);
+                        m_changedPaths.emplace_back(PATH_CHANGES_LOST, pdi->m_dirName);
+                    }
                     SecureZeroMemory(pdi->m_buffer, sizeof(pdi->m_buffer));
                     SecureZeroMemory(&pdi->m_overlapped, sizeof(pdi->m_overlapped));
                     if (!ReadDirectoryChangesW(pdi->m_hDir,
@@ -24,6 +24,7 @@
 
 constexpr auto READ_DIR_CHANGE_BUFFER_SIZE = 4096;
 constexpr auto MAX_CHANGED_PATHS           = 4000;
+constexpr DWORD PATH_CHANGES_LOST          = 0; ///< action reported with a watched path when its notifications overflowed
 
 /**
  * \ingroup Utils
@@ -63,7 +64,9 @@ public:
     size_t GetNumberOfWatchedPaths() const { return watchedPaths.size(); }
 
     /**
-     * Returns all changed paths since the last call to GetChangedPaths
+     * Returns all changed paths since the last call to GetChangedPaths.
+     * An entry with the action PATH_CHANGES_LOST means that changes in that
+     * watched path were missed and anything in it may have changed.
      */
     std::vector<std::tuple<DWORD, std::wstring>> GetChangedPaths();
 
@@ -27,11 +27,11 @@
 #include "GDIHelpers.h"
 #include "DPIAware.h"
 #include "../ext/scintilla/include/ILexer.h"
+#include "../ext/scintilla/include/ILoader.h"
 #include "../ext/lexilla/lexlib/LexerModule.h"
 #include "Lexilla.h"
 
 #include <uxtheme.h>
-#include <chrono>
 
 constexpr Scintilla::AutomaticFold operator|(Scintilla::AutomaticFold a, Scintilla::AutomaticFold b) noexcept
 {
@@ -79,6 +79,9 @@ CScintillaWnd::CScintillaWnd(HINSTANCE hInst)
     : CWindow(hInst)
     , m_scrollTool(hInst)
     , m_selTextMarkerCount(0)
+    , m_markedSelStart(-1)
+    , m_occurrencesMarked(0)
+    , m_allOccurrencesMarked(false)
     , m_bCursorShown(true)
     , m_bScratch(false)
     , m_eraseBkgnd(true)
@@ -627,6 +630,9 @@ LRESULT CALLBACK CScintillaWnd::WinMsgHandler(HWND hwnd, UINT uMsg, WPARAM wPara
             }
         }
         break;
+        case WM_THREADRESULTREADY:
+            MarkFoundOccurrences();
+            return 0;
         case WM_TIMER:
             switch (wParam)
             {
@@ -981,39 +987,58 @@ void CScintillaWnd::SetupLexerForLang(const std::string& lang) const
     if (!lexerData.annotations.empty())
         m_scintilla.EOLAnnotationSetVisible(Scintilla::EOLAnnotationVisible::Boxed | Scintilla::EOLAnnotationVisible::AngleCircle);
 
-    if (lexerData.name == "bp_simple")
-    {
-        lexer = lmSimple.Create();
-        lexer->PrivateCall(100, *this);
-    }
-    if (lexerData.name == "bp_log")
-        lexer = lmLog.Create();
-    if (lexerData.name == "bp_snippets")
-        lexer = lmSnippets.Create();
-    if (lexer == nullptr && lexerData.name.empty())
-    {
-        switch (lexerData.id)
+    // A document keeps its lexer together with the properties and keyword lists
+    // set on it, so only create a new lexer when the language or the
+    // configuration changed since it was last set up for this document.
+    void*      docPointer = m_scintilla.DocPointer();
+    const auto generation = CLexStyles::Instance().GetGeneration();
+    auto       configIt   = m_lexerConfigs.find(docPointer);
+    bool       reuseLexer = configIt != m_lexerConfigs.end() &&
+                      configIt->second.lang == lang &&
+                      configIt->second.generation == generation &&
+                      !configIt->second.lexerName.empty() &&
+                      configIt->second.lexerName == m_scintilla.LexerLanguage();
+    if (!reuseLexer)
+    {
+        if (lexerData.name == "bp_simple")
         {
-            case 1100:
-                lexer = lmSimple.Create();
-                lexer->PrivateCall(100, *this);
-                break;
-            case 1101:
-                lexer = lmLog.Create();
-                break;
-            default:
-                break;
+            lexer = lmSimple.Create();
+            lexer->PrivateCall(100, *this);
+        }
+        if (lexerData.name == "bp_log")
+            lexer = lmLog.Create();
+        if (lexerData.name == "bp_snippets")
+            lexer = lmSnippets.Create();
+        if (lexer == nullptr && lexerData.name.empty())
+        {
+            switch (lexerData.id)
+            {
+                case 1100:
+                    lexer = lmSimple.Create();
+                    lexer->PrivateCall(100, *this);
+                    break;
+                case 1101:
+                    lexer = lmLog.Create();
+                    break;
+                default:
+                    break;
+            }
         }
-    }
 
-    if (lexer == nullptr)
-        lexer = CreateLexer(lexerData.name.c_str());
-    assert(lexer);
-    m_scintilla.SetILexer(lexer);
+        if (lexer == nullptr)
+            lexer = CreateLexer(lexerData.name.c_str());
+        assert(lexer);
+        m_scintilla.SetILexer(lexer);
 
-    for (const auto& [propName, propValue] : lexerData.properties)
-    {
-        m_scintilla.SetProperty(propName.c_str(), propValue.c_str());
+        for (const auto& [propName, propValue] : lexerData.properties)
+        {
+            m_scintilla.SetProperty(propName.c_str(), propValue.c_str());
+        }
+        for (const auto& [keyWordId, keyWord] : keywords)
+        {
+            m_scintilla.SetKeyWords(keyWordId - 1LL, keyWord.c_str());
+        }
+        m_lexerConfigs[docPointer] = {lang, m_scintilla.LexerLanguage(), generation};
     }
     for (const auto& [styleId, styleData] : lexerData.styles)
     {
@@ -1034,10 +1059,6 @@ void CScintillaWnd::SetupLexerForLang(const std::string& lang) const
         if (styleData.eolFilled)
             m_scintilla.StyleSetEOLFilled(styleId, true);
     }
-    for (const auto& [keyWordId, keyWord] : keywords)
-    {
-        m_scintilla.SetKeyWords(keyWordId - 1LL, keyWord.c_str());
-    }
     m_scintilla.SetLineEndTypesAllowed(static_cast<Scintilla::LineEndType>(m_scintilla.LineEndTypesSupported()));
     CCommandHandler::Instance().OnStylesSet();
 }
@@ -1371,13 +1392,11 @@ void CScintillaWnd::SelectionUpdated() const
 
 void CScintillaWnd::MarkSelectedWord(bool clear, bool edit)
 {
-    static std::string    lastSelText;
-    static Sci_PositionCR lastStopPosition = 0;
-    auto                  firstLine        = m_scintilla.FirstVisibleLine();
-    auto                  lastLine         = firstLine + m_scintilla.LinesOnScreen();
-    auto                  startStylePos    = m_scintilla.PositionFromLine(firstLine);
-    startStylePos                          = max(startStylePos, 0);
-    auto endStylePos                       = m_scintilla.PositionFromLine(lastLine) + m_scintilla.LineLength(lastLine);
+    auto firstLine     = m_scintilla.FirstVisibleLine();
+    auto lastLine      = firstLine + m_scintilla.LinesOnScreen();
+    auto startStylePos = m_scintilla.PositionFromLine(firstLine);
+    startStylePos      = max(startStylePos, 0);
+    auto endStylePos   = m_scintilla.PositionFromLine(lastLine) + m_scintilla.LineLength(lastLine);
     if (endStylePos < 0)
         endStylePos = m_scintilla.Length();
 
@@ -1393,9 +1412,7 @@ void CScintillaWnd::MarkSelectedWord(bool clear, bool edit)
     auto selTextLen = sSelText.size();
     if ((selTextLen == 0) || (clear))
     {
-        lastSelText.clear();
-        m_docScroll.Clear(DOCSCROLLTYPE_SELTEXT);
-        m_selTextMarkerCount = 0;
+        ClearMarkedOccurrences();
         SendMessage(*this, WM_NCPAINT, static_cast<WPARAM>(1), 0);
         return;
     }
@@ -1405,9 +1422,7 @@ void CScintillaWnd::MarkSelectedWord(bool clear, bool edit)
     auto selEndLine   = m_scintilla.LineFromPosition(origSelEnd);
     if (selStartLine != selEndLine)
     {
-        lastSelText.clear();
-        m_docScroll.Clear(DOCSCROLLTYPE_SELTEXT);
-        m_selTextMarkerCount = 0;
+        ClearMarkedOccurrences();
         SendMessage(*this, WM_NCPAINT, static_cast<WPARAM>(1), 0);
         return;
     }
@@ -1419,18 +1434,14 @@ void CScintillaWnd::MarkSelectedWord(bool clear, bool edit)
     auto origSelText = sSelText;
     if (origSelText.empty())
     {
-        lastSelText.clear();
-        m_docScroll.Clear(DOCSCROLLTYPE_SELTEXT);
-        m_selTextMarkerCount = 0;
+        ClearMarkedOccurrences();
         SendMessage(*this, WM_NCPAINT, static_cast<WPARAM>(1), 0);
         return;
     }
     CStringUtils::trim(sSelText);
     if (sSelText.empty())
     {
-        lastSelText.clear();
-        m_docScroll.Clear(DOCSCROLLTYPE_SELTEXT);
-        m_selTextMarkerCount = 0;
+        ClearMarkedOccurrences();
         SendMessage(*this, WM_NCPAINT, static_cast<WPARAM>(1), 0);
         return;
     }
@@ -1440,6 +1451,9 @@ void CScintillaWnd::MarkSelectedWord(bool clear, bool edit)
         m_selTextMarkerCount = g_searchMarkerCount;
         return;
     }
+    bool searchAgain = (m_markedText != origSelText) || edit;
+    if (searchAgain)
+        ClearMarkedOccurrences();
 
     auto          textBuffer = std::make_unique<char[]>(len + 1LL);
     Sci_TextRange textRange{};
@@ -1460,57 +1474,93 @@ void CScintillaWnd::MarkSelectedWord(bool clear, bool edit)
     auto lineCount = m_scintilla.LineCount();
     if ((selTextLen > 1) || (lineCount < 100000))
     {
-        auto selTextDifferent = lastSelText.compare(origSelText.c_str());
-        if (selTextDifferent || (lastStopPosition != 0) || edit)
+        if (searchAgain)
         {
-            auto start = std::chrono::steady_clock::now();
-            if (selTextDifferent)
-            {
-                m_docScroll.Clear(DOCSCROLLTYPE_SELTEXT);
-                m_selTextMarkerCount = 0;
-            }
-            Sci_TextToFind findText{};
-            findText.chrg.cpMin     = lastStopPosition;
-            findText.chrg.cpMax     = m_scintilla.Length();
-            findText.lpstrText      = origSelText.c_str();
-            lastStopPosition        = 0;
-            const auto selTextColor = CTheme::Instance().GetThemeColor(RGB(0, 255, 0), true);
-            auto       findOptions  = Scintilla::FindOption::MatchCase;
-            if (wholeWord)
-                findOptions |= Scintilla::FindOption::WholeWord;
-            while (m_scintilla.FindText(findOptions, &findText) >= 0)
+            m_markedText     = origSelText;
+            m_markedSelStart = selStartPos;
+
+            // search a snapshot of the document, so it can be edited while the
+            // search runs: an edit stops the search, see ReflectEvents()
+            std::shared_ptr<Scintilla::ITextSnapshot> snapshot(static_cast<Scintilla::ITextSnapshot*>(m_scintilla.TakeTextSnapshot()),
+                                                               [](Scintilla::ITextSnapshot* text) { if (text) text->Release(); });
+            if (!snapshot)
+                return;
+            HWND hWnd = *this;
+            m_occurrenceSearch.SetCharacterClasses(m_scintilla.WordChars(), m_scintilla.WhitespaceChars());
+            m_occurrenceSearch.Start(
+                static_cast<size_t>(snapshot->Length()),
+                [snapshot](char* buffer, size_t position, size_t length) {
+                    return snapshot->GetCharRange(buffer, static_cast<Sci_Position>(position), static_cast<Sci_Position>(length));
+                },
+                origSelText, wholeWord, [hWnd]() { PostMessage(hWnd, WM_THREADRESULTREADY, 0, 0); });
+            if (edit)
             {
-                if (edit)
+                // the selections can only be added once all occurrences are known
+                m_occurrenceSearch.Wait();
+                m_occurrenceSearch.TakeResults(m_occurrences);
+                for (auto pos : m_occurrences)
                 {
-                    if ((origSelStart != findText.chrgText.cpMin) || (origSelEnd != findText.chrgText.cpMax))
-                        m_scintilla.AddSelection(findText.chrgText.cpMax, findText.chrgText.cpMin);
-                }
-                auto line = m_scintilla.LineFromPosition(findText.chrgText.cpMin);
-                m_docScroll.AddLineColor(DOCSCROLLTYPE_SELTEXT, line, selTextColor);
-                ++m_selTextMarkerCount;
-                if (findText.chrg.cpMin >= findText.chrgText.cpMax)
-                    break;
-                findText.chrg.cpMin = findText.chrgText.cpMax;
-
-                if (!edit)
-                {
-                    // stop after 1.5 seconds - users don't want to wait for too long
-                    auto end = std::chrono::steady_clock::now();
-                    if (std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() > 1500)
-                    {
-                        lastStopPosition = findText.chrg.cpMin;
-                        break;
-                    }
+                    auto occurrenceStart = static_cast<sptr_t>(pos);
+                    if (occurrenceStart != origSelStart)
+                        m_scintilla.AddSelection(occurrenceStart + static_cast<sptr_t>(origSelText.size()), occurrenceStart);
                 }
-            }
-            if (edit)
                 m_scintilla.AddSelection(origSelEnd, origSelStart);
-            SendMessage(*this, WM_NCPAINT, static_cast<WPARAM>(1), 0);
+                MarkFoundOccurrences();
+            }
         }
-        lastSelText = origSelText.c_str();
     }
 }
 
+void CScintillaWnd::ClearMarkedOccurrences()
+{
+    m_occurrenceSearch.Stop();
+    // the occurrences outside the visible lines are marked too
+    m_scintilla.SetIndicatorCurrent(INDIC_SELECTION_MARK);
+    m_scintilla.IndicatorClearRange(0, m_scintilla.Length());
+    m_markedText.clear();
+    m_occurrences.clear();
+    m_occurrencesMarked    = 0;
+    m_allOccurrencesMarked = false;
+    m_docScroll.Clear(DOCSCROLLTYPE_SELTEXT);
+    m_selTextMarkerCount = 0;
+}
+
+void CScintillaWnd::MarkFoundOccurrences()
+{
+    bool finished = m_occurrenceSearch.TakeResults(m_occurrences);
+    if (m_markedText.empty() || (m_occurrencesMarked == m_occurrences.size()))
+        return;
+
+    // mark only so many occurrences at once, the messages for typing and
+    // scrolling are handled before the next ones are marked
+    constexpr size_t maxMarks     = 10000;
+    auto             end          = min(m_occurrences.size(), m_occurrencesMarked + maxMarks);
+    auto             textLength   = static_cast<sptr_t>(m_markedText.size());
+    const auto       selTextColor = CTheme::Instance().GetThemeColor(RGB(0, 255, 0), true);
+    m_scintilla.SetIndicatorCurrent(INDIC_SELECTION_MARK);
+    for (; m_occurrencesMarked < end; ++m_occurrencesMarked)
+    {
+        auto pos = static_cast<sptr_t>(m_occurrences[m_occurrencesMarked]);
+        // don't style the selected text itself
+        if (pos != m_markedSelStart)
+            m_scintilla.IndicatorFillRange(pos, textLength);
+        m_docScroll.AddLineColor(DOCSCROLLTYPE_SELTEXT, m_scintilla.LineFromPosition(pos), selTextColor);
+        ++m_selTextMarkerCount;
+    }
+    if (m_occurrencesMarked < m_occurrences.size())
+        PostMessage(*this, WM_THREADRESULTREADY, 0, 0);
+    else if (finished)
+        m_allOccurrencesMarked = true;
+    SendMessage(*this, WM_NCPAINT, static_cast<WPARAM>(1), 0);
+
+    // let the parent show the new count
+    SCNotification scn = {};
+    scn.nmhdr.code     = SCN_BP_MARKSCHANGED;
+    scn.nmhdr.hwndFrom = *this;
+    scn.nmhdr.idFrom   = ::GetDlgCtrlID(*this);
+    SendMessage(GetParent(*this), WM_NOTIFY, ::GetDlgCtrlID(*this), reinterpret_cast<LPARAM>(&scn));
+}
+
 void CScintillaWnd::MatchBraces(BraceMatch what)
 {
     static sptr_t lastIndicatorStart  = 0;
@@ -2451,6 +2501,17 @@ void CScintillaWnd::ReflectEvents(SCNotification* pScn)
                 UpdateLineNumberWidth();
             }
             break;
+        case SCN_MODIFIED:
+            // the occurrences are searched in a snapshot of the text, stop before the
+            // text changes so the snapshot needn't keep the text. The positions still
+            // to come would be wrong after the change: search again on the next update
+            if ((pScn->modificationType & (SC_MOD_BEFOREINSERT | SC_MOD_BEFOREDELETE)) &&
+                !m_markedText.empty() && !m_allOccurrencesMarked)
+            {
+                m_occurrenceSearch.Stop();
+                m_markedText.clear();
+            }
+            break;
         case SCN_SAVEPOINTREACHED:
             EnableChangeHistory();
             break;
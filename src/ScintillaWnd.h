@@ -24,6 +24,7 @@
 #include "../ext/scintilla/include/ScintillaTypes.h"
 #include "../ext/scintilla/include/ScintillaCall.h"
 #include "coolscroll.h"
+#include "OccurrenceSearch.h"
 #include <map>
 #include <vector>
 #include <unordered_map>
@@ -48,6 +49,7 @@ constexpr int SC_MARGE_SYMBOL = 2;
 constexpr int SC_MARGE_FOLDER = 4;
 constexpr int MARK_BOOKMARK       = 20;
 constexpr int SCN_BP_MOUSEMSG     = 4000;
+constexpr int SCN_BP_MARKSCHANGED = 4001;
 constexpr int DOCSCROLLTYPE_SELTEXT = 1;
 constexpr int DOCSCROLLTYPE_BOOKMARK = 2;
 constexpr int DOCSCROLLTYPE_SEARCHTEXT = 3;
@@ -193,6 +195,9 @@ public:
     sptr_t                    GetCurrentLineNumber() const;
     void                      VisibleLinesChanged() { m_docScroll.VisibleLinesChanged(); }
     void                      EnableChangeHistory() const;
+    /// forgets the lexer configuration of a document that is being released,
+    /// a new document may get the same pointer
+    void                      ForgetDocument(void* docPointer) { m_lexerConfigs.erase(docPointer); }
     static bool               IsXMLWhitespace(int ch) { return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n'; }
 
     LRESULT CALLBACK          HandleScrollbarCustomDraw(WPARAM wParam, NMCSBCUSTOMDRAW* pCustomDraw);
@@ -212,16 +217,34 @@ protected:
     std::vector<std::pair<sptr_t, sptr_t>> GetAttributesPos(sptr_t start, sptr_t end) const;
     bool                                   AutoBraces(WPARAM wParam) const;
 
+    void                                   ClearMarkedOccurrences();
+    void                                   MarkFoundOccurrences();
+
     void                                   BookmarkAdd(sptr_t lineNo);
     void                                   BookmarkDelete(sptr_t lineNo);
     bool                                   IsBookmarkPresent(sptr_t lineNo) const;
     void                                   BookmarkToggle(sptr_t lineNo);
 
 private:
+    // lexer configuration applied to a Scintilla document, so switching back
+    // to a document can keep its lexer instead of rebuilding keyword lists
+    struct LexerConfig
+    {
+        std::string lang;
+        std::string lexerName;
+        size_t      generation = 0;
+    };
+
     mutable Scintilla::ScintillaCall m_scintilla;
     CDocScroll                       m_docScroll;
     CScrollTool                      m_scrollTool;
     sptr_t                           m_selTextMarkerCount;
+    COccurrenceSearch                m_occurrenceSearch;
+    std::string                      m_markedText;           ///< the text the occurrences are marked for
+    sptr_t                           m_markedSelStart;       ///< the selection is not marked
+    std::vector<size_t>              m_occurrences;
+    size_t                           m_occurrencesMarked;    ///< the first ones of m_occurrences are marked
+    bool                             m_allOccurrencesMarked;
     bool                             m_bCursorShown;
     bool                             m_bScratch;
     bool                             m_eraseBkgnd;
@@ -236,4 +259,5 @@ private:
     AnimationVariable                m_animVarGrayBack;
     AnimationVariable                m_animVarGraySel;
     AnimationVariable                m_animVarGrayLineNr;
+    mutable std::unordered_map<void*, LexerConfig> m_lexerConfigs;
 };
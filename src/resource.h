@@ -136,6 +136,14 @@
 #define IDS_APP_TITLE                   231
 #define IDS_SELECTTAB_FILTERCUE         232
 #define IDS_OPENRECENT_FILTERCUE        233
+#define IDS_SORTKEY_LINE                234
+#define IDS_SORTKEY_FIELD               235
+#define IDS_SORTKEY_REGEX               236
+#define IDS_SORTKEY_COLUMNS             237
+#define IDS_SORTKEYTYPE_TEXT            238
+#define IDS_SORTKEYTYPE_NUMBER          239
+#define IDS_SORTKEYTYPE_DATE            240
+#define IDS_SORT_TEMPFILEERROR          241
 #define IDB_QUICKBAR                    270
 #define IDB_BITMAP1                     274
 #define IDC_BOWPAD                      300
@@ -198,6 +206,12 @@
 #define IDC_SNIPPETNAME                 356
 #define IDC_TABWIDTH                    357
 #define IDC_SORTDLG_ORDER_CHECK         358
+#define IDC_SORTDLG_KEY                 359
+#define IDC_SORTDLG_DELIMITER           360
+#define IDC_SORTDLG_FIELD               361
+#define IDC_SORTDLG_REGEX               362
+#define IDC_SORTDLG_GROUP               363
+#define IDC_SORTDLG_KEYTYPE             364
 #define cmdNothing                      30000
 #define cmdCommandPalette               30001
 #define cmdExit                         30002
@@ -0,0 +1,176 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2022 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include <string>
+#include <string_view>
+
+#include "EncodingDetect.h"
+
+#include "catch.hpp"
+
+namespace
+{
+struct Detected
+{
+    int  codepage;
+    bool hasBOM;
+    bool inconclusive;
+    int  skip;
+};
+
+Detected Detect(std::string_view text)
+{
+    Detected result{};
+    result.codepage = DetectCodepage(text.data(), text.size(), result.hasBOM, result.inconclusive, result.skip);
+    return result;
+}
+
+// Text with two and three byte UTF-8 sequences between ASCII runs
+std::string Utf8Text(size_t length)
+{
+    static constexpr std::string_view pieces[] = {"plain ascii text ", "gr\xc3\xbc\xc3\x9f ", "\xe6\x97\xa5\xe6\x9c\xac ", "x"};
+    std::string                       text;
+    for (size_t i = 0; text.size() < length; ++i)
+        text += pieces[i % std::size(pieces)];
+    // end at a character boundary
+    while (text.size() > length || (static_cast<unsigned char>(text.back()) & 0xC0) == 0x80 || static_cast<unsigned char>(text.back()) >= 0xC0)
+        text.pop_back();
+    return text;
+}
+} // namespace
+
+TEST_CASE("DetectCodepage")
+{
+    SECTION("ByteOrderMarks")
+    {
+        auto result = Detect("\xef\xbb\xbf" "abc");
+        REQUIRE(result.codepage == 65001);
+        REQUIRE(result.hasBOM);
+        REQUIRE(Detect(std::string_view("\xff\xfe" "a\0b\0", 6)).codepage == 1200);
+        REQUIRE(Detect(std::string_view("\xfe\xff" "\0a\0b", 6)).codepage == 1201);
+        REQUIRE(Detect(std::string_view("\xff\xfe\0\0" "a\0\0\0", 8)).codepage == 12000);
+        REQUIRE(Detect(std::string_view("\0\0\xfe\xff" "\0\0\0a", 8)).codepage == 12001);
+    }
+
+    SECTION("AsciiIsInconclusive")
+    {
+        const std::string ascii(1000, 'a');
+        auto              result = Detect(ascii);
+        REQUIRE(result.codepage == 0);
+        REQUIRE(result.inconclusive);
+        REQUIRE(!result.hasBOM);
+    }
+
+    SECTION("Utf8AtEveryLength")
+    {
+        // lengths around the 256 byte chunks and the 16 byte blocks of the validator
+        for (size_t length = 3; length < 700; ++length)
+        {
+            const std::string text = Utf8Text(length);
+            if (text.find('\xc3') == std::string::npos)
+                continue;
+            const auto result = Detect(text);
+            INFO("length " << text.size());
+            REQUIRE(result.codepage == 65001);
+            REQUIRE(!result.inconclusive);
+        }
+    }
+
+    SECTION("InvalidByteAnywhere")
+    {
+        const std::string text = Utf8Text(600);
+        for (size_t pos = 0; pos < text.size(); ++pos)
+        {
+            std::string invalid = text;
+            invalid[pos]        = '\xff';
+            INFO("position " << pos);
+            REQUIRE(Detect(invalid).codepage == 0);
+        }
+    }
+
+    SECTION("IncompleteSequenceAtTheEnd")
+    {
+        const std::string text   = std::string(300, 'a') + "\xc3\xbc" + "\xe6\x97";
+        const auto        result = Detect(text);
+        // undecided until the rest of the sequence is read, which needs one more byte
+        REQUIRE(result.codepage == 0);
+        REQUIRE(result.inconclusive);
+        REQUIRE(result.skip == 1);
+    }
+
+    SECTION("Binary")
+    {
+        std::string binary(4096, '\0');
+        binary[100] = 'E';
+        REQUIRE(Detect(binary).codepage == -1);
+    }
+
+    SECTION("Utf16WithoutBOM")
+    {
+        std::string utf16;
+        for (const char c : std::string(400, 'a'))
+        {
+            utf16.push_back(c);
+            utf16.push_back('\0');
+        }
+        REQUIRE(Detect(utf16).codepage == 1200);
+    }
+}
+
+TEST_CASE("CodepageFromCharset")
+{
+    SECTION("MimeEncodingNames")
+    {
+        // every name CompactEncDet returns that has a Windows codepage
+        static constexpr std::pair<std::string_view, int> names[] = {
+            {"ISO-8859-1", 28591}, {"ISO-8859-2", 28592}, {"ISO-8859-4", 28594}, {"ISO-8859-5", 28595},
+            {"ISO-8859-6", 28596}, {"ISO-8859-7", 28597}, {"ISO-8859-8", 28598}, {"ISO-8859-9", 28599},
+            {"EUC-JP", 51932}, {"Shift_JIS", 932}, {"ISO-2022-JP", 50220},
+            {"Big5", 950}, {"GB2312", 936}, {"EUC-CN", 936}, {"EUC-KR", 51949}, {"UTF-16LE", 1200},
+            {"EUC", 20000}, {"CNS", 20000}, {"BIG5-CP950", 950}, {"CP932", 932}, {"UTF-8", 65001},
+            {"US-ASCII", 20127}, {"KOI8-R", 20866}, {"windows-1251", 1251}, {"windows-1252", 1252},
+            {"KOI8-U", 21866}, {"windows-1250", 1250}, {"ISO-8859-15", 28605}, {"windows-1254", 1254},
+            {"windows-1257", 1257}, {"ISO-8859-11", 874}, {"windows-874", 874}, {"windows-1256", 1256},
+            {"windows-1255", 1255}, {"ISO-8859-8-I", 38598}, {"cp852", 852}, {"csn_369103", 28592},
+            {"windows-1253", 1253}, {"IBM866", 866}, {"ISO-8859-13", 28603}, {"ISO-2022-KR", 50225},
+            {"GBK", 936}, {"GB18030", 54936}, {"BIG5-HKSCS", 950}, {"ISO-2022-CN", 50227},
+            {"MACINTOSH", 10000}, {"UTF-7", 65000}, {"UTF-16BE", 1201}, {"UTF-32BE", 12001},
+            {"UTF-32LE", 12000}, {"HZ-GB-2312", 52936},
+        };
+        for (const auto& [name, codepage] : names)
+        {
+            INFO(name);
+            REQUIRE(CodepageFromCharset(name) == codepage);
+        }
+    }
+
+    SECTION("IgnoresCase")
+    {
+        REQUIRE(CodepageFromCharset("utf-8") == 65001);
+        REQUIRE(CodepageFromCharset("SHIFT_jis") == 932);
+        REQUIRE(CodepageFromCharset("CSISOLATIN1") == 28591);
+    }
+
+    SECTION("Unknown")
+    {
+        REQUIRE(CodepageFromCharset("") == 0);
+        REQUIRE(CodepageFromCharset("x-unknown") == 0);
+        REQUIRE(CodepageFromCharset("tscii") == 0);
+        // Windows has no Latin-6 codepage and Latin-4 decodes some of its letters wrongly
+        REQUIRE(CodepageFromCharset("ISO-8859-10") == 0);
+        REQUIRE(CodepageFromCharset("UTF-8 ") == 0);
+    }
+}
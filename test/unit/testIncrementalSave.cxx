@@ -0,0 +1,92 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2022 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include <cstddef>
+#include <cstdint>
+
+#include "IncrementalSave.h"
+
+#include "catch.hpp"
+
+namespace
+{
+constexpr std::size_t length = 100;
+} // namespace
+
+TEST_CASE("IncrementalSave")
+{
+    SECTION("SameLength")
+    {
+        // only the changed span is written over the file after the BOM
+        auto plan = PlanIncrementalSave(true, true, 3 + length, 3, length, 10, 20);
+        REQUIRE(plan.possible);
+        REQUIRE(plan.offset == 13);
+        REQUIRE(plan.start == 10);
+        REQUIRE(plan.end == 20);
+        REQUIRE(!plan.truncate);
+    }
+
+    SECTION("OtherLength")
+    {
+        // text was inserted: everything from the change on is written and the file is cut
+        auto plan = PlanIncrementalSave(true, true, length - 5, 0, length, 10, 20);
+        REQUIRE(plan.possible);
+        REQUIRE(plan.offset == 10);
+        REQUIRE(plan.start == 10);
+        REQUIRE(plan.end == length);
+        REQUIRE(plan.truncate);
+    }
+
+    SECTION("FileTooShort")
+    {
+        // the unchanged prefix and suffix aren't both in the file
+        REQUIRE(!PlanIncrementalSave(true, true, 50, 0, length, 10, 20).possible);
+    }
+
+    SECTION("ChangedOutside")
+    {
+        REQUIRE(!PlanIncrementalSave(true, false, length, 0, length, 10, 20).possible);
+    }
+
+    SECTION("ReloadConflict")
+    {
+        // The file was changed outside and the user kept their own text. The file time is
+        // updated so the change isn't reported again, but the file still holds the outside
+        // text: patching only the span changed since the save point would mix both versions.
+        bool savePointOnDisk = true;  // loaded from the file
+        bool sameWriteTime   = false; // changed outside
+        REQUIRE(!PlanIncrementalSave(savePointOnDisk, sameWriteTime, length, 0, length, 10, 20).possible);
+        savePointOnDisk = false; // kept the own text
+        sameWriteTime   = true;  // file time updated
+        REQUIRE(!PlanIncrementalSave(savePointOnDisk, sameWriteTime, length, 0, length, 10, 20).possible);
+        // a full save writes the save point to the file again
+        savePointOnDisk = true;
+        REQUIRE(PlanIncrementalSave(savePointOnDisk, sameWriteTime, length, 0, length, 10, 20).possible);
+    }
+
+    SECTION("DeletedOutside")
+    {
+        // the file was deleted outside, the user kept the tab and the file was created again
+        REQUIRE(!PlanIncrementalSave(false, true, length, 0, length, 10, 20).possible);
+    }
+
+    SECTION("Unchanged")
+    {
+        auto plan = PlanIncrementalSave(true, true, length, 0, length, length, length);
+        REQUIRE(plan.possible);
+        REQUIRE(plan.start == plan.end);
+    }
+}
@@ -0,0 +1,157 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2022 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ILexer.h"
+#include "Scintilla.h"
+
+#include "LexerModule.h"
+#include "TestDocument.h"
+
+#include "catch.hpp"
+
+extern Lexilla::LexerModule lmLog;
+
+namespace
+{
+constexpr int errorDefault = 12;
+constexpr int warnDefault  = 8;
+
+// A log lexer with a few tokens for each severity
+Scintilla::ILexer5* CreateLexer()
+{
+    Scintilla::ILexer5* lexer = lmLog.Create();
+    lexer->PropertySet("debugstrings", "debug trace");
+    lexer->PropertySet("infostrings", "info");
+    lexer->PropertySet("warnstrings", "warn warning");
+    lexer->PropertySet("errorstrings", "error fatal");
+    return lexer;
+}
+
+std::string Styles(TestDocument& doc)
+{
+    std::string styles;
+    for (Sci_Position pos = 0; pos < doc.Length(); ++pos)
+        styles.push_back(static_cast<char>('0' + doc.StyleAt(pos)));
+    return styles;
+}
+
+std::string StylesOf(std::string_view text)
+{
+    Scintilla::ILexer5* lexer = CreateLexer();
+    TestDocument        doc;
+    doc.Set(text);
+    lexer->Lex(0, doc.Length(), 0, &doc);
+    lexer->Release();
+    return Styles(doc);
+}
+
+// Lines with mixed severities, numbers, strings, brackets and line ends
+std::string GenerateLog(size_t lines)
+{
+    static constexpr const char* levels[] = {"DEBUG", "INFO", "Warning", "ERROR", "trace", "note"};
+    static constexpr const char* endings[] = {"\n", "\r\n", "\r"};
+    std::mt19937                 rng(1);
+    std::string                  log;
+    for (size_t line = 0; line < lines; ++line)
+    {
+        log += "2022-03-" + std::to_string(1 + rng() % 28) + " 12:" + std::to_string(rng() % 60) + " ";
+        log += levels[rng() % std::size(levels)];
+        log += " [worker " + std::to_string(rng() % 16) + "] request \"" + std::to_string(rng()) + "\" took ";
+        log += std::to_string(rng() % 1000) + ".5 ms (0x" + std::to_string(rng() % 10000) + ")";
+        if (rng() % 10 == 0)
+            log += " unterminated \"string";
+        log += endings[rng() % std::size(endings)];
+    }
+    return log;
+}
+} // namespace
+
+TEST_CASE("LexLog")
+{
+    SECTION("SeverityOfWholeWords")
+    {
+        REQUIRE(StylesOf("an error here\n") == std::string(14, '0' + errorDefault));
+        REQUIRE(StylesOf("no errors here\n") == std::string(15, '0'));
+        REQUIRE(StylesOf("Warning: warn\r\n") == std::string(15, '0' + warnDefault));
+        // the most severe token decides
+        REQUIRE(StylesOf("info then FATAL") == std::string(15, '0' + errorDefault));
+    }
+
+    SECTION("NumbersStringsAndBlocks")
+    {
+        // 0 default, 1 block, 2 string, 3 number
+        REQUIRE(StylesOf("x 42 \"s\" [b] 5\n") == "003302220111030");
+        // an unterminated string is not highlighted and ends with the line
+        REQUIRE(StylesOf("x \"s\n7\n") == "0000030");
+    }
+
+    SECTION("LinesAreIndependent")
+    {
+        // large enough to be split between threads where there is more than one core
+        const std::string log = GenerateLog(60000);
+        REQUIRE(log.size() > 0x300000);
+        TestDocument doc;
+        doc.Set(log);
+        Scintilla::ILexer5* lexer = CreateLexer();
+        lexer->Lex(0, doc.Length(), 0, &doc);
+        const std::string whole = Styles(doc);
+
+        // lexing line by line gives the same styles
+        TestDocument byLine;
+        byLine.Set(log);
+        for (Sci_Position line = 0; byLine.LineStart(line) < byLine.Length(); ++line)
+        {
+            const Sci_Position start = byLine.LineStart(line);
+            lexer->Lex(start, byLine.LineStart(line + 1) - start, 0, &byLine);
+        }
+        lexer->Release();
+        REQUIRE(Styles(byLine) == whole);
+    }
+}
+
+// Not run by default: unitTest "[.benchmark]"
+TEST_CASE("LexLogBenchmark", "[.benchmark]")
+{
+    const std::string log = GenerateLog(200000);
+    TestDocument      doc;
+    doc.Set(log);
+    Scintilla::ILexer5* lexer = CreateLexer();
+
+    auto start = std::chrono::steady_clock::now();
+    lexer->Lex(0, doc.Length(), 0, &doc);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "LexLog " << log.size() / 1000000 << " MB at once: " << static_cast<int>(elapsed.count() * 1000) << " ms\n";
+
+    // Scrolling and typing lex a screen of text at a time
+    constexpr Sci_Position screen = 0x4000;
+    start                         = std::chrono::steady_clock::now();
+    size_t calls                  = 0;
+    for (Sci_Position pos = 0; pos + screen < doc.Length(); pos += screen, ++calls)
+    {
+        const Sci_Position lineStart = doc.LineStart(doc.LineFromPosition(pos));
+        lexer->Lex(lineStart, screen, 0, &doc);
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "LexLog " << calls << " screens: " << static_cast<int>(elapsed.count() * 1000000 / calls) << " us per screen\n";
+    lexer->Release();
+}
@@ -0,0 +1,220 @@
+﻿// This file is part of BowPad.
+//
+// Copyright (C) 2022 - Stefan Kueng
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// See <http://www.gnu.org/licenses/> for a copy of the full license text
+//
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "LineSorter.h"
+
+#include "catch.hpp"
+
+namespace
+{
+using Lines = std::vector<std::string_view>;
+
+Lines Sorted(const CLineSorter::Options& options, const Lines& lines)
+{
+    return CLineSorter(options).Sort(lines);
+}
+
+Lines SortedText(const CLineSorter::Options& options, std::string_view text, std::vector<std::string>& storage)
+{
+    Lines lines;
+    storage.clear();
+    REQUIRE(CLineSorter(options).SortText(text, [&](std::string_view line) { storage.emplace_back(line); }));
+    lines.assign(storage.begin(), storage.end());
+    return lines;
+}
+
+// Lines of a few random words with numbers, many of them repeated
+std::string GenerateLines(size_t count)
+{
+    static constexpr std::string_view words[] = {"alpha", "Beta", "gamma", "delta", "\xc3\xa9t\xc3\xa9", "file", "Zeta", "\xce\xb1\xce\xb2"};
+    std::mt19937                      rng(1);
+    std::string                       text;
+    for (size_t line = 0; line < count; ++line)
+    {
+        const size_t wordCount = 1 + rng() % 4;
+        for (size_t word = 0; word < wordCount; ++word)
+        {
+            text += words[rng() % std::size(words)];
+            text += std::to_string(rng() % 1000);
+            text += ' ';
+        }
+        text += "\r\n";
+    }
+    return text;
+}
+} // namespace
+
+TEST_CASE("LineSorter")
+{
+    CLineSorter::Options options;
+
+    SECTION("SplitLines")
+    {
+        REQUIRE(CLineSorter::SplitLines("a\r\nb\rc\nd") == Lines{"a", "b", "c", "d"});
+        REQUIRE(CLineSorter::SplitLines("a\n\nb\n") == Lines{"a", "", "b"});
+        REQUIRE(CLineSorter::SplitLines("").empty());
+    }
+
+    SECTION("Case")
+    {
+        const Lines lines = {"b", "A", "B", "a"};
+        REQUIRE(Sorted(options, lines) == Lines{"A", "a", "B", "b"});
+        // lines that only differ in case keep their order
+        options.caseInsensitive = true;
+        REQUIRE(Sorted(options, lines) == Lines{"A", "a", "b", "B"});
+        options.descending = true;
+        REQUIRE(Sorted(options, lines) == Lines{"b", "B", "A", "a"});
+    }
+
+    SECTION("FoldsNonAscii")
+    {
+        REQUIRE(Sorted(options, {"\xc3\xa9z", "\xc3\x89" "a"}) == Lines{"\xc3\x89" "a", "\xc3\xa9z"});
+    }
+
+    SECTION("DigitsAsNumbers")
+    {
+        const Lines lines = {"file10", "file9", "file009", "file1"};
+        REQUIRE(Sorted(options, lines) == Lines{"file009", "file1", "file10", "file9"});
+        options.digitsAsNumbers = true;
+        // equal values are ordered by their text
+        REQUIRE(Sorted(options, lines) == Lines{"file1", "file009", "file9", "file10"});
+    }
+
+    SECTION("RemoveDuplicates")
+    {
+        options.removeDuplicates = true;
+        REQUIRE(Sorted(options, {"b", "a", "B", "b", "a"}) == Lines{"a", "B", "b"});
+        options.caseInsensitive = true;
+        REQUIRE(Sorted(options, {"b", "a", "B", "b", "a"}) == Lines{"a", "B", "b"});
+    }
+
+    SECTION("Field")
+    {
+        options.keySource = CLineSorter::KeySource::Field;
+        options.field     = 1;
+        REQUIRE(Sorted(options, {"1,c", "2,\"a,x\"", "3", "4,b,a"}) == Lines{"3", "2,\"a,x\"", "4,b,a", "1,c"});
+        options.delimiter = '\t';
+        options.field     = 0;
+        REQUIRE(Sorted(options, {"b\ta", "a\tb"}) == Lines{"a\tb", "b\ta"});
+    }
+
+    SECTION("Column")
+    {
+        // columns count characters, not bytes
+        options.keySource   = CLineSorter::KeySource::Column;
+        options.firstColumn = 1;
+        options.columnCount = 1;
+        REQUIRE(Sorted(options, {"\xc3\xa9" "cz", "xbz", "xa"}) == Lines{"xa", "xbz", "\xc3\xa9" "cz"});
+    }
+
+    SECTION("Regex")
+    {
+        options.keySource  = CLineSorter::KeySource::Regex;
+        options.regex      = "id=(\\d+)";
+        options.regexGroup = 1;
+        options.keyType    = CLineSorter::KeyType::Number;
+        REQUIRE(Sorted(options, {"x id=10", "y id=9", "none"}) == Lines{"none", "y id=9", "x id=10"});
+        options.regex = "(";
+        REQUIRE_THROWS_AS(CLineSorter(options), std::regex_error);
+    }
+
+    SECTION("Numbers")
+    {
+        options.keyType = CLineSorter::KeyType::Number;
+        REQUIRE(Sorted(options, {"10", "-2.5", "x", "1e400", "+3", "-0", "0"}) == Lines{"x", "-2.5", "-0", "0", "+3", "10", "1e400"});
+    }
+
+    SECTION("Dates")
+    {
+        options.keyType = CLineSorter::KeyType::Date;
+        REQUIRE(Sorted(options, {"2021-03-14 15:09:26", "14/Mar/2021:15:09:25", "Mar 13, 2021", "Sun, 14 Mar 2021 15:09", "03/14/2021"}) ==
+                Lines{"03/14/2021", "Mar 13, 2021", "Sun, 14 Mar 2021 15:09", "14/Mar/2021:15:09:25", "2021-03-14 15:09:26"});
+    }
+
+    SECTION("Collator")
+    {
+        // a collator that orders by the reversed text, or falls back for empty keys
+        options.collator = [](std::string_view text, std::string& key) {
+            if (text.empty())
+                return false;
+            key.append(text.rbegin(), text.rend());
+            return true;
+        };
+        REQUIRE(Sorted(options, {"ab", "ba", "", "ca"}) == Lines{"", "ba", "ca", "ab"});
+    }
+
+    SECTION("Threads")
+    {
+        const std::string text  = GenerateLines(100000);
+        const Lines       lines = CLineSorter::SplitLines(text);
+        options.digitsAsNumbers = true;
+        CLineSorter sorter(options);
+        sorter.SetThreadCount(1);
+        const Lines single = sorter.Sort(lines);
+        sorter.SetThreadCount(5);
+        REQUIRE(sorter.Sort(lines) == single);
+    }
+
+    SECTION("RunsInTempFiles")
+    {
+        const std::string        text = GenerateLines(20000);
+        std::vector<std::string> storage;
+        for (bool removeDuplicates : {false, true})
+        {
+            options.removeDuplicates = removeDuplicates;
+            options.memoryBudget     = 0;
+            const Lines inMemory     = Sorted(options, CLineSorter::SplitLines(text));
+            options.memoryBudget     = 64 * 1024;
+            REQUIRE(SortedText(options, text, storage) == inMemory);
+        }
+    }
+}
+
+// Not run by default: unitTest "[.benchmark]"
+TEST_CASE("LineSorterBenchmark", "[.benchmark]")
+{
+    const std::string text  = GenerateLines(1000000);
+    const Lines       lines = CLineSorter::SplitLines(text);
+    for (bool digitsAsNumbers : {false, true})
+    {
+        CLineSorter::Options options;
+        options.digitsAsNumbers = digitsAsNumbers;
+        for (unsigned threads : {1u, 0u})
+        {
+            CLineSorter sorter(options);
+            sorter.SetThreadCount(threads);
+            auto                          start   = std::chrono::steady_clock::now();
+            auto                          sorted  = sorter.Sort(lines);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "LineSorter " << lines.size() << " lines" << (digitsAsNumbers ? " digits as numbers" : "") << (threads ? " on one thread: " : ": ")
+                      << static_cast<int>(elapsed.count() * 1000) << " ms\n";
+        }
+    }
+    CLineSorter::Options options;
+    options.memoryBudget = text.size() / 4;
+    size_t lineCount     = 0;
+    auto   start         = std::chrono::steady_clock::now();
+    CLineSorter(options).SortText(text, [&lineCount](std::string_view) { ++lineCount; });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "LineSorter " << lineCount << " lines in runs in temp files: " << static_cast<int>(elapsed.count() * 1000) << " ms\n";
+}